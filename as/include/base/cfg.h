@@ -108,9 +108,12 @@ typedef struct as_config_s {
 	uint32_t		migrate_max_num_incoming;
 	uint32_t		n_migrate_threads;
 	char*			node_id_interface;
+	bool			partition_numa_homing; // home partitions on NUMA nodes, steer transactions
 	char*			pidfile;
 	int				proto_fd_idle_ms; // after this many milliseconds, connections are aborted unless transaction is in progress
 	uint32_t		n_proto_fd_max;
+	uint32_t		query_background_weight; // share of query workers for each background query
+	uint32_t		query_foreground_weight; // share of query workers for each long foreground query
 	uint32_t		query_max_done; // maximum number of finished queries kept for monitoring
 	uint32_t		n_query_threads_limit;
 	bool			run_as_daemon;
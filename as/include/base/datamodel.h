@@ -293,6 +293,10 @@ int as_bin_hll_read_tr(const as_bin *b, const struct as_msg_op_s *msg_op, as_bin
 int as_bin_hll_modify_exp(as_bin *b, msgpack_in_vec* mv, as_bin *rb, bool alloc_ns);
 int as_bin_hll_read_exp(const as_bin *b, msgpack_in_vec* mv, as_bin *rb, bool alloc_ns);
 const char* as_hll_op_name(uint32_t op_code, bool is_modify);
+uint32_t as_hll_sketch_sz(uint8_t n_index_bits);
+void as_hll_sketch_init(uint8_t* sketch, uint8_t n_index_bits);
+void as_hll_sketch_add(uint8_t* sketch, const uint8_t* buf, uint32_t buf_sz);
+void as_hll_sketch_union(uint8_t* to, const uint8_t* from);
 
 // geojson:
 typedef void *geo_region_t;
@@ -581,6 +585,10 @@ typedef struct as_index_tree_shared_s {
 	// Offsets into as_index_tree struct's variable-sized data.
 	uint32_t		sprigs_offset;
 	uint32_t		puddles_offset;
+
+	// Whether trees keep an expiration index for nsup.
+	bool			expire_index;
+	uint64_t*		expire_index_used_sz; // namespace total, for stats
 } as_index_tree_shared;
 
 
@@ -728,9 +736,11 @@ typedef struct as_namespace_s {
 	uint8_t*		si_startup_gc_bitmap; // optimize sindex startup GC
 	bool			si_startup_gc_needed; // may not need sindex startup GC
 	bool			sindexes_resumed_readable; // optimize startup populate and cool start
+	bool*			si_persisted_pids; // partitions re-attached from sindex-persist file
 	uint64_t		si_n_recs_checked; // used only by startup ticker
 
 	uint32_t		n_setless_sindexes;
+	uint32_t		n_derived_sindexes; // composite and expression sindexes
 	cf_shash*		sindex_defn_hash;
 	cf_shash*		sindex_iname_hash;
 	uint32_t		sindex_bin_bitmap[SINDEX_BIN_BITMAP_ARR_SZ];
@@ -774,6 +784,7 @@ typedef struct as_namespace_s {
 	bool			udf_sub_benchmarks_enabled;
 	bool			write_benchmarks_enabled;
 	bool			proxy_hist_enabled;
+	bool			evict_hist_online;
 	uint32_t		evict_hist_buckets;
 	uint32_t		evict_tenths_pct;
 	uint32_t		hwm_disk_pct;
@@ -796,6 +807,8 @@ typedef struct as_namespace_s {
 	bool			reject_xdr_writes;
 	uint32_t		cfg_replication_factor;
 	uint32_t		replication_factor; // indirect config - can become less than cfg_replication_factor
+	bool			set_index_bitmap; // set-indexes are compressed bitmaps of index handles
+	uint32_t		sindex_pi_scan_pct; // scan instead if range matches this much - 0 means never
 	uint64_t		sindex_stage_size;
 	bool			single_bin; // restrict the namespace to objects with exactly one bin
 	uint32_t		n_single_query_threads;
@@ -848,6 +861,7 @@ typedef struct as_namespace_s {
 	bool			storage_read_page_cache;
 	char*			storage_scheduler_mode; // relevant for devices only, not files
 	bool			storage_serialize_tomb_raider; // relevant only for enterprise edition
+	bool			storage_sindex_persist;
 	bool			storage_sindex_startup_device_scan;
 	uint32_t		storage_tomb_raider_sleep; // relevant only for enterprise edition
 	uint32_t		storage_write_block_size;
@@ -884,6 +898,7 @@ typedef struct as_namespace_s {
 	bool			hwm_breached;
 
 	uint64_t		non_expirable_objects;
+	uint64_t		n_live_non_expirable; // for nsup-expire-index only
 
 	uint64_t		n_expired_objects;
 	uint64_t		n_evicted_objects;
@@ -899,6 +914,8 @@ typedef struct as_namespace_s {
 	// Memory usage stats.
 
 	uint64_t		n_bytes_memory;
+	uint64_t		set_index_bitmap_sz; // for set-index-bitmap only
+	uint64_t		expire_index_sz; // for nsup-expire-index only
 
 	// Persistent storage stats.
 
@@ -1191,6 +1208,10 @@ typedef struct as_namespace_s {
 	uint64_t		n_si_query_ops_bg_error;
 	uint64_t		n_si_query_ops_bg_abort;
 
+	uint64_t		n_si_query_pi_planned; // si queries run as set-index or PI scans
+	uint64_t		n_si_query_covered; // si query records answered from the index
+	uint64_t		si_query_top_sz; // ordered si queries' buffered responses
+
 	// Geospatial query stats:
 	uint64_t		geo_region_query_count;		// number of region queries
 	uint64_t		geo_region_query_cells;		// number of cells used by region queries
@@ -1298,6 +1319,7 @@ typedef struct as_namespace_s {
 
 	// Histograms used for general eviction and expiration.
 	linear_hist*	evict_hist; // not just for info
+	uint64_t*		evict_online_counts; // for evict-hist-online only
 	linear_hist*	ttl_hist;
 	linear_hist*	set_ttl_hists[AS_SET_MAX_COUNT + 1];
 
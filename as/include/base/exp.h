@@ -46,6 +46,7 @@ typedef struct as_exp_s {
 	uint32_t cleanup_stack_ix;
 	uint8_t* buf_cleanup;
 	uint32_t max_var_count;
+	uint32_t rc; // 0 if private, else holders including the build cache
 	uint8_t mem[];
 } as_exp;
 
@@ -73,4 +74,5 @@ bool as_exp_eval(const as_exp* exp, const as_exp_ctx* ctx, as_bin* rb, cf_ll_buf
 as_exp_trilean as_exp_matches_metadata(const as_exp* predexp, const as_exp_ctx* ctx);
 bool as_exp_matches_record(const as_exp* predexp, const as_exp_ctx* ctx);
 bool as_exp_display(const as_exp* exp, cf_dyn_buf* db);
+bool as_exp_reads_only_bins(const as_exp* exp);
 void as_exp_destroy(as_exp* exp);
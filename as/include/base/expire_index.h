@@ -0,0 +1,52 @@
+/*
+ * expire_index.h
+ *
+ * Copyright (C) 2022 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdint.h>
+
+#include "base/index.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_expire_index_s;
+struct as_index_tree_s;
+struct as_namespace_s;
+
+
+//==========================================================
+// Public API.
+//
+
+struct as_expire_index_s* as_expire_index_create(uint64_t* used_sz);
+void as_expire_index_destroy(struct as_expire_index_s* ei);
+
+void as_expire_index_insert(struct as_index_tree_s* tree, uint64_t r_h, uint32_t void_time);
+void as_expire_index_remove(struct as_index_tree_s* tree, uint64_t r_h, uint32_t void_time);
+void as_expire_index_reduce(struct as_namespace_s* ns, struct as_index_tree_s* tree, uint32_t now, as_index_reduce_fn cb, void* udata);
@@ -31,6 +31,7 @@
 
 #include "arenax.h"
 #include "cf_mutex.h"
+#include "hardware.h"
 
 #include "base/datamodel.h"
 
@@ -295,6 +296,8 @@ typedef struct as_index_tree_s {
 	cf_mutex set_trees_lock;
 	struct as_set_index_tree_s* set_trees[1 + AS_SET_MAX_COUNT]; // 32M/cluster
 
+	struct as_expire_index_s* expire_index; // NULL unless configured
+
 	// Variable length data, dependent on configuration.
 	uint8_t data[];
 } as_index_tree;
@@ -369,6 +372,7 @@ void as_index_tree_gc(as_index_tree* tree);
 
 as_index_tree* as_index_tree_create(as_index_tree_shared* shared, uint8_t id, as_index_tree_done_fn cb, void* udata);
 as_index_tree* as_index_tree_resume(as_index_tree_shared* shared, as_treex* xmem_trees, uint32_t pid, as_index_tree_done_fn cb, void* udata);
+void as_index_tree_bind_numa(as_index_tree* tree, cf_topo_numa_node_index i_numa_node);
 void as_index_tree_block(as_index_tree* tree);
 void as_index_tree_reserve(as_index_tree* tree);
 void as_index_tree_release(as_namespace* ns, as_index_tree* tree);
@@ -382,6 +386,14 @@ bool as_index_reduce_from(as_index_tree* tree, const cf_digest* keyd, as_index_r
 bool as_index_reduce_live(as_index_tree* tree, as_index_reduce_fn cb, void* udata);
 bool as_index_reduce_from_live(as_index_tree* tree, const cf_digest* keyd, as_index_reduce_fn cb, void* udata);
 
+typedef bool (*as_index_sprig_fn) (uint32_t sprig_i, void* udata);
+
+bool as_index_reduce_sprigs_live(as_index_tree* tree, const cf_digest* keyd, as_index_sprig_fn sprig_cb, as_index_reduce_fn cb, void* udata);
+
+typedef void (*as_index_visit_fn) (as_index* r, cf_arenax_handle r_h, void* udata);
+
+void as_index_visit_quiesced(as_index_tree* tree, as_index_visit_fn cb, void* udata);
+
 int as_index_get_vlock(as_index_tree* tree, const cf_digest* keyd, as_index_ref* index_ref);
 int as_index_get_insert_vlock(as_index_tree* tree, const cf_digest* keyd, as_index_ref* index_ref);
 void as_index_delete(as_index_tree* tree, const cf_digest* keyd);
@@ -439,6 +451,10 @@ typedef struct as_index_ph_array_s {
 
 #define MAX_STACK_PHS (16 * 1024) // TODO - go bigger? Warn if we grow array?
 
+// Bounds both the stack used and the time the reduce lock is held - sprigs with
+// more elements are reduced in batches, resuming from the last digest.
+#define MAX_REDUCE_PHS 1024
+
 void as_index_grow_ph_array(as_index_ph_array* ph_a);
 
 
@@ -500,4 +516,19 @@ as_index_sprig_from_keyd(as_index_tree* tree, as_index_sprig* isprig,
 	isprig->puddle = tree_puddle_for_sprig(tree, sprig_i);
 }
 
+static inline void
+as_index_sprig_from_i(as_index_tree* tree, as_index_sprig* isprig,
+		uint32_t sprig_i)
+{
+	uint32_t lock_i = sprig_i >>
+			(tree->shared->locks_shift - tree->shared->sprigs_shift);
+
+	isprig->destructor = tree->shared->destructor;
+	isprig->destructor_udata = tree->shared->destructor_udata;
+	isprig->arena = tree->shared->arena;
+	isprig->pair = tree_locks(tree) + lock_i;
+	isprig->sprig = tree_sprigs(tree) + sprig_i;
+	isprig->puddle = tree_puddle_for_sprig(tree, sprig_i);
+}
+
 #define RESOLVE(__h) ((as_index*)cf_arenax_resolve(isprig->arena, __h))
@@ -62,6 +62,7 @@ typedef struct as_mon_jobstat_s {
 	uint32_t	n_pids_requested;
 	uint32_t	rps;
 	uint32_t	active_threads;
+	uint32_t	weight;
 	char		status[64];
 	float		progress_pct;
 	uint64_t	run_time;
@@ -84,6 +85,7 @@ typedef struct as_mon_cb_s {
 
 	// Per transaction
 	bool (*kill)						(uint64_t trid);
+	bool (*set_priority)				(uint64_t trid, uint32_t priority);
 } as_mon_cb;
 
 // Structure to register module with as mon interface.
@@ -51,3 +51,6 @@ bool as_nsup_handle_clock_skew(struct as_namespace_s* ns, uint64_t skew_ms);
 void as_nsup_eviction_reset_cmd(const char* ns_name, const char* ttl_str, cf_dyn_buf* db);
 
 bool as_cold_start_evict_if_needed(struct as_namespace_s* ns);
+
+void as_nsup_online_hist_add(struct as_namespace_s* ns, uint32_t void_time);
+void as_nsup_online_hist_remove(struct as_namespace_s* ns, uint32_t void_time);
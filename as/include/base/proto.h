@@ -228,7 +228,7 @@ typedef struct cl_msg_s {
 #define AS_MSG_INFO2_GENERATION_GT          (1 << 3) // apply write if new generation > old, good for restore
 #define AS_MSG_INFO2_DURABLE_DELETE         (1 << 4) // op resulting in record deletion leaves tombstone (enterprise only)
 #define AS_MSG_INFO2_CREATE_ONLY            (1 << 5) // write record only if it doesn't exist
-	// Bit 6 is unused.
+#define AS_MSG_INFO2_STORAGE_ORDER          (1 << 6) // primary index query may return records in storage order
 #define AS_MSG_INFO2_RESPOND_ALL_OPS        (1 << 7) // all bin ops (read, write, or modify) require a response, in request order
 
 // Bits in info3.
@@ -281,11 +281,14 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_TYPE_SAMPLE_MAX        13
 #define AS_MSG_FIELD_TYPE_LUT               14 // for XDR writes only
 #define AS_MSG_FIELD_TYPE_BVAL_ARRAY        15
+#define AS_MSG_FIELD_TYPE_SAMPLE_RATE       16 // parts per million
 
 // Secondary index.
 #define AS_MSG_FIELD_TYPE_INDEX_NAME        21 // was superfluous - but reserved for future use
 #define AS_MSG_FIELD_TYPE_INDEX_RANGE       22
 #define AS_MSG_FIELD_TYPE_INDEX_CONTEXT     23
+#define AS_MSG_FIELD_TYPE_INDEX_EXPRESSION  24
+#define AS_MSG_FIELD_TYPE_INDEX_ORDER       25
 #define AS_MSG_FIELD_TYPE_INDEX_TYPE        26
 
 // UDF.
@@ -299,6 +302,7 @@ typedef struct as_msg_field_s {
 #define AS_MSG_FIELD_TYPE_BATCH             41
 #define AS_MSG_FIELD_TYPE_BATCH_WITH_SET    42
 #define AS_MSG_FIELD_TYPE_PREDEXP           43
+#define AS_MSG_FIELD_TYPE_AGGR_EXP          44
 
 // Bits in as_transaction.msg_fields indicate which fields are present.
 #define AS_MSG_FIELD_BIT_NAMESPACE          (1 << 0)
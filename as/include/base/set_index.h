@@ -74,12 +74,54 @@ typedef struct uarena_s {
 // END uarena header.
 //--------------------------------------
 
+//--------------------------------------
+// Bitmap header.
+//
+
+// Roaring-style bitmap of primary index arena handles - the bits above the low
+// 16 select a container, which holds the low 16 bits either as a sorted array
+// (sparse) or as a 64K-bit bitmap (dense).
+
+#define SIB_LOW_N_BITS 16
+#define SIB_LOW_MASK ((1 << SIB_LOW_N_BITS) - 1) // 0xFFFF
+#define SIB_ARRAY_MAX 4096 // array this full is as big as a bitmap
+
+typedef struct sib_container_s {
+	uint32_t key; // handle bits above SIB_LOW_N_BITS
+	uint32_t n_vals;
+	uint32_t capacity; // of array - 0 means container is a bitmap
+	void* vals; // sorted uint16_t array, or uint64_t bitmap words
+} sib_container;
+
+typedef struct set_index_bitmap_s {
+	cf_mutex lock;
+	uint32_t n_containers;
+	uint32_t capacity;
+	sib_container* containers; // sorted by key
+	uint64_t sz; // bytes allocated for this bitmap
+	uint64_t* used_sz; // namespace total, for stats
+} set_index_bitmap;
+
+//
+// END bitmap header.
+//--------------------------------------
+
 // Minimum set sprigs - we're sharing the primary index tree's sprig locks.
 #define N_SET_SPRIGS NUM_LOCK_PAIRS
 
 typedef struct as_set_index_tree_s {
-	uarena ua;
-	uarena_handle roots[N_SET_SPRIGS];
+	bool is_bitmap;
+
+	union {
+		// Red-black sprigs, sharing the primary index tree's sprig locks.
+		struct {
+			uarena ua;
+			uarena_handle roots[N_SET_SPRIGS];
+		};
+
+		// Bitmap, with its own lock.
+		set_index_bitmap bm;
+	};
 } as_set_index_tree;
 
 typedef struct index_ele_s {
@@ -122,7 +164,7 @@ void as_set_index_init(void);
 // Set-index tree lifecycle.
 void as_set_index_create_all(struct as_namespace_s* ns, struct as_index_tree_s* tree);
 void as_set_index_destroy_all(struct as_index_tree_s* tree);
-void as_set_index_tree_create(struct as_index_tree_s* tree, uint16_t set_id);
+void as_set_index_tree_create(struct as_namespace_s* ns, struct as_index_tree_s* tree, uint16_t set_id);
 void as_set_index_tree_destroy(struct as_index_tree_s* tree, uint16_t set_id);
 void as_set_index_balance_lock(void);
 void as_set_index_balance_unlock(void);
@@ -132,6 +174,7 @@ void as_set_index_insert(struct as_namespace_s* ns, struct as_index_tree_s* tree
 void as_set_index_delete(struct as_namespace_s* ns, struct as_index_tree_s* tree, uint16_t set_id, uint64_t r_h);
 void as_set_index_delete_live(struct as_namespace_s* ns, struct as_index_tree_s* tree, struct as_index_s* r, uint64_t r_h);
 bool as_set_index_reduce(struct as_namespace_s* ns, struct as_index_tree_s* tree, uint16_t set_id, cf_digest* keyd, as_index_reduce_fn cb, void* udata);
+bool as_set_index_reduce_unordered(struct as_namespace_s* ns, struct as_index_tree_s* tree, uint16_t set_id, as_index_reduce_fn cb, void* udata);
 
 // Info & stats.
 void as_set_index_enable(struct as_namespace_s* ns, struct as_set_s* p_set, uint16_t set_id);
@@ -83,6 +83,10 @@ typedef struct as_stats_s {
 	// Batch-index proto compression stats.
 	as_proto_comp_stat batch_comp_stat; // relevant only for enterprise edition
 
+	// Filter expression build cache stats.
+	uint64_t		exp_cache_hits; // not in ticker
+	uint64_t		exp_cache_misses; // not in ticker
+
 	// Fabric stats.
 	uint64_t		fabric_bulk_s_rate;
 	uint64_t		fabric_bulk_r_rate;
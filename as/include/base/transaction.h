@@ -237,6 +237,7 @@ typedef struct as_transaction_s {
 #define FROM_FLAG_BATCH_SUB			0x0001
 #define FROM_FLAG_RESTART			0x0002 // only for detail logging
 #define FROM_FLAG_RESTART_STRICT	0x0004 // enterprise-only
+#define FROM_FLAG_NUMA_HOMED		0x0008 // steered to partition's NUMA node
 
 // 'flags' bits - set in transaction body after queuing:
 #define AS_TRANSACTION_FLAG_IS_DELETE				0x01
@@ -62,6 +62,8 @@ typedef struct as_truncate_s {
 	cf_mutex state_lock;
 	uint32_t n_threads_running;
 	uint32_t pid;
+	uint16_t set_id; // if not 0, this run only reduces this set's set-index
+	uint16_t restart_set_id;
 	uint64_t n_records_this_run;
 	uint64_t n_records;
 } as_truncate;
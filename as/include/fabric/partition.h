@@ -220,6 +220,7 @@ struct as_index_tree_s* as_partition_tree_reserve_query(struct as_namespace_s* n
 
 void as_partition_advance_tree_id(as_partition* p, const char* ns_name);
 void as_partition_tree_done(uint8_t id, void* udata);
+void as_partition_numa_home_tree(as_partition* p);
 
 void as_partition_getinfo_str(cf_dyn_buf* db);
 
@@ -277,6 +278,15 @@ as_partition_getid(const cf_digest* d)
 	return *(uint32_t*)d & AS_PARTITION_MASK;
 }
 
+// With partition-numa-homing, partitions are homed in contiguous blocks, one
+// block per NUMA node.
+static inline cf_topo_numa_node_index
+as_partition_numa_home(uint32_t pid)
+{
+	return (cf_topo_numa_node_index)
+			((pid * cf_topo_count_numa_nodes()) / AS_PARTITIONS);
+}
+
 static inline int
 find_self_in_replicas(const as_partition* p)
 {
@@ -51,4 +51,5 @@ uint32_t as_query_get_active_job_count(void);
 struct as_mon_jobstat_s* as_query_get_jobstat(uint64_t trid);
 struct as_mon_jobstat_s* as_query_get_jobstat_all(int* size);
 bool as_query_abort(uint64_t trid);
+bool as_query_set_priority(uint64_t trid, uint32_t priority);
 uint32_t as_query_abort_all(void);
@@ -0,0 +1,73 @@
+/*
+ * query_aggr.h
+ *
+ * Copyright (C) 2022 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+#pragma once
+
+//==========================================================
+// Includes.
+//
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "aerospike/as_val.h"
+
+
+//==========================================================
+// Forward declarations.
+//
+
+struct as_exp_ctx_s;
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// Native aggregation ops, as sent in AS_MSG_FIELD_TYPE_AGGR_EXP.
+typedef enum {
+	AS_QUERY_AGGR_OP_COUNT = 0,
+	AS_QUERY_AGGR_OP_SUM = 1,
+	AS_QUERY_AGGR_OP_MIN = 2,
+	AS_QUERY_AGGR_OP_MAX = 3,
+	AS_QUERY_AGGR_OP_AVG = 4,
+	AS_QUERY_AGGR_OP_DISTINCT = 5,
+
+	AS_QUERY_AGGR_OP_END
+} as_query_aggr_op;
+
+typedef struct as_query_aggr_s as_query_aggr;
+typedef struct as_query_aggr_acc_s as_query_aggr_acc;
+
+
+//==========================================================
+// Public API.
+//
+
+as_query_aggr* as_query_aggr_create(const uint8_t* buf, uint32_t buf_sz);
+void as_query_aggr_destroy(as_query_aggr* aggr);
+
+as_query_aggr_acc* as_query_aggr_acc_create(const as_query_aggr* aggr);
+void as_query_aggr_acc_destroy(as_query_aggr_acc* acc);
+bool as_query_aggr_acc_add(as_query_aggr_acc* acc, const struct as_exp_ctx_s* ctx);
+bool as_query_aggr_acc_merge(as_query_aggr_acc* to, const as_query_aggr_acc* from);
+as_val* as_query_aggr_acc_result(const as_query_aggr_acc* acc);
@@ -76,14 +76,37 @@ typedef struct as_query_range_s {
 	uint32_t str_len;
 	char str_stub[16];
 
+	// Whole string bounds (one allocation) - ordered sindexes match them
+	// lexicographically, and a prefix query has an empty end.
+	char* str_start;
+	char* str_end;
+	uint32_t str_end_len;
+	bool str_prefix;
+	bool str_ordered; // bvals are order-preserving, not hashed
+
 	uint16_t bin_id;
 	as_particle_type bin_type;
 	as_sindex_type itype;
 	bool isrange;
 	bool de_dup;
+	bool ordered; // top-K query - results in sindex key order
+	bool desc; // ... walking the sindex from high keys to low
 	char bin_name[AS_BIN_NAME_MAX_SZ];
 	uint8_t* ctx_buf;
 	uint32_t ctx_buf_sz;
+
+	// Expression sindex - no bin name, and the expression (not a bin) yields
+	// the value matched.
+	uint8_t* exp_buf;
+	uint32_t exp_buf_sz;
+
+	// Composite sindex - equality on leading bins, in key order.
+	uint32_t n_prefix;
+	struct as_query_range_s* prefix;
+
+	// Multi-range (IN-list) - sorted, disjoint entries on the same bin.
+	uint32_t n_multi;
+	struct as_query_range_s* multi;
 } as_query_range;
 
 typedef void (*as_query_slice_fn)(struct as_query_job_s* _job, struct as_partition_reservation_s* rsv, cf_buf_builder** bb_r);
@@ -119,16 +142,31 @@ typedef struct as_query_job_s {
 	char si_name[INAME_MAX_SZ];
 	char set_name[AS_SET_NAME_MAX_SIZE];
 	uint16_t set_id;
+	bool pi_plan; // si kept only to filter a primary index scan
+	bool pi_plan_resumable; // partition-tracked, and pi_plan_bval is valid
+	int64_t pi_plan_bval; // out of range - sent with PI-planned responses
+
+	// Intersection - sindexes for the range's prefix entries, narrowing si's:
+	uint32_t n_and_sis;
+	struct as_sindex_s* and_sis[MAX_COMPOSITE_BINS - 1];
+	bool and_recheck; // string hashes may collide
 
 	// Partition scope:
 	as_query_pid* pids;
+	uint16_t* pid_order; // if not NULL, order to visit partitions in
 
 	// Query threading model:
 	bool is_short;
+	bool is_background;
+	uint32_t weight; // 0 means the configured weight for the job's class
 
 	// Handle active phase:
-	uint32_t n_threads;
+	uint32_t n_threads; // query workers currently running the job
 	uint32_t pid;
+
+	// For scheduling - under the query manager lock:
+	uint32_t n_threads_wanted;
+	uint64_t pass; // weighted run time - the least served job goes next
 	uint64_t start_ms_clepoch;
 	volatile int abandoned;
 
@@ -161,7 +199,9 @@ typedef struct as_query_job_s {
 //
 
 void as_query_job_init(as_query_job* _job, const as_query_vtable* vtable, const struct as_transaction_s* tr, struct as_namespace_s* ns);
-void* as_query_job_run(void* pv_job);
+void as_query_job_run(as_query_job* _job, uint64_t stint_end_ns);
+void as_query_job_finish(as_query_job* _job);
+uint32_t as_query_job_weight(const as_query_job* _job);
 uint32_t as_query_job_throttle(as_query_job* _job);
 void as_query_job_destroy(as_query_job* _job);
 void as_query_job_info(as_query_job* _job, struct as_mon_jobstat_s* stat);
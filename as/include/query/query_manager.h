@@ -50,6 +50,8 @@ typedef struct as_query_manager_s {
 	cf_mutex lock;
 	cf_queue* active_jobs;
 	cf_queue* finished_jobs;
+	cf_queue* short_jobs; // waiting for a worker - run before long jobs
+	uint64_t pass; // pass of the last long job picked - new jobs start here
 } as_query_manager;
 
 
@@ -68,9 +70,11 @@ void as_query_manager_startup_init(void);
 int as_query_manager_start_job(struct as_query_job_s* _job);
 void as_query_manager_add_job_thread(struct as_query_job_s* _job);
 void as_query_manager_add_max_job_threads(struct as_query_job_s* _job);
+bool as_query_manager_should_yield(const struct as_query_job_s* _job, uint64_t stint_end_ns);
 void as_query_manager_finish_job(struct as_query_job_s* _job);
 void as_query_manager_abandon_job(struct as_query_job_s* _job, int reason);
 bool as_query_manager_abort_job(uint64_t trid);
+bool as_query_manager_set_job_weight(uint64_t trid, uint32_t weight);
 uint32_t as_query_manager_abort_all_jobs(void);
 void as_query_manager_limit_finished_jobs(void);
 struct as_mon_jobstat_s* as_query_manager_get_job_info(uint64_t trid);
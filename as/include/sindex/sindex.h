@@ -30,10 +30,12 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "citrusleaf/cf_hash_math.h"
 
 #include "arenax.h"
+#include "cf_mutex.h"
 #include "dynbuf.h"
 #include "shash.h"
 
@@ -45,6 +47,7 @@
 // Forward declarations.
 //
 
+struct as_exp_s;
 struct as_index_ref_s;
 struct as_namespace_s;
 struct as_storage_rd_s;
@@ -61,11 +64,28 @@ struct si_btree_s;
 #define MAX_STRING_KSIZE 2048 // TODO - increase?
 #define MAX_GEOJSON_KSIZE (1024 * 1024)
 
+// Composite sindexes - equality on leading bins, then range on the last bin.
+// The key is a hash of the leading bin values in the high bits, concatenated
+// with the last bin's value (clamped, or hashed if a string) in the low bits.
+#define MAX_COMPOSITE_BINS 4
+#define COMPOSITE_SUFFIX_BITS 44
+#define COMPOSITE_SUFFIX_MASK ((1UL << COMPOSITE_SUFFIX_BITS) - 1)
+
+// Ordered string sindexes - keys are a big-endian stub of the leading bytes,
+// then the length, which saturates to flag strings that overflow the stub.
+#define ORDERED_STUB_SZ 7
+#define ORDERED_OVERFLOW (ORDERED_STUB_SZ + 1)
+
+// Equi-depth histogram of bvals, sampled along with the cardinality stats.
+#define SI_HIST_N_BUCKETS 32
+#define SI_HIST_N_BOUNDS (SI_HIST_N_BUCKETS + 1)
+
 // Info command parsing buffer sizes.
 #define INDEXTYPE_MAX_SZ 10 // (default/list/mapkeys/mapvalues)
-#define INDEXDATA_MAX_SZ (AS_BIN_NAME_MAX_SZ + 11 + 1) // bin-name,key-type (string/numeric/geo2dsphere)
+#define INDEXDATA_MAX_SZ ((AS_BIN_NAME_MAX_SZ + 14 + 1) * MAX_COMPOSITE_BINS) // bin-name,key-type (string/string-ordered/numeric/geo2dsphere)[,...]
 #define CTX_B64_MAX_SZ 2048
-#define SINDEX_SMD_KEY_MAX_SZ (AS_ID_NAMESPACE_SZ + AS_SET_NAME_MAX_SIZE + AS_BIN_NAME_MAX_SZ + 2 + 2 + CTX_B64_MAX_SZ)
+#define EXP_B64_MAX_SZ 2048 // expression sindexes have no context - same space
+#define SINDEX_SMD_KEY_MAX_SZ (AS_ID_NAMESPACE_SZ + AS_SET_NAME_MAX_SIZE + AS_BIN_NAME_MAX_SZ + 2 + 2 + CTX_B64_MAX_SZ + 2 + (AS_BIN_NAME_MAX_SZ + 4) * (MAX_COMPOSITE_BINS - 1))
 
 typedef enum {
 	AS_SINDEX_OP_DELETE = 0,
@@ -81,6 +101,16 @@ typedef enum {
 	AS_SINDEX_N_ITYPES        = 4
 } as_sindex_type;
 
+typedef struct as_sindex_cbin_s {
+	char bin_name[AS_BIN_NAME_MAX_SZ];
+	uint16_t bin_id;
+	as_particle_type ktype;
+
+	char* ctx_b64;
+	uint8_t* ctx_buf;
+	uint32_t ctx_buf_sz;
+} as_sindex_cbin;
+
 typedef struct as_sindex_s {
 	struct as_namespace_s* ns;
 	char iname[INAME_MAX_SZ];
@@ -93,11 +123,24 @@ typedef struct as_sindex_s {
 
 	as_particle_type ktype;
 	as_sindex_type itype;
+	bool ordered; // string keys are order-preserving rather than hashed
 
 	char* ctx_b64;
 	uint8_t* ctx_buf;
 	uint32_t ctx_buf_sz;
 
+	// Composite only - leading (equality) bins, in key order. The bin above is
+	// the last (range) bin.
+	uint32_t n_cbins;
+	as_sindex_cbin* cbins;
+
+	// Expression only - keys come from evaluating this on the record's bins.
+	// There's no bin (or context) above.
+	char* exp_b64;
+	uint8_t* exp_buf;
+	uint32_t exp_buf_sz;
+	struct as_exp_s* exp;
+
 	uint32_t id;
 
 	bool readable; // false while building sindex
@@ -105,12 +148,28 @@ typedef struct as_sindex_s {
 
 	uint64_t keys_per_bval;
 	uint64_t keys_per_rec;
+
+	// Query planner stats - refreshed along with the above.
+	uint32_t n_hist_bounds; // 0 if not (yet) sampled
+	int64_t hist_bounds[SI_HIST_N_BOUNDS];
+	uint64_t hist_n_keys;
+	uint64_t hist_n_scan_objects; // records a set-index or PI scan would visit
 	uint64_t load_time;
 	uint32_t populate_pct;
 	uint64_t n_gc_cleaned;
 
+	// Expression only - write-path (and populate) cost.
+	uint64_t n_exp_evals;
+	uint64_t n_exp_eval_fails;
+	uint64_t exp_eval_ns;
+
 	uint32_t n_btrees;
 	struct si_btree_s** btrees;
+
+	// Bulk builds in progress - GC waits for them before freeing records.
+	cf_mutex bulk_lock;
+	cf_condition bulk_done;
+	uint32_t n_bulk_building;
 } as_sindex;
 
 typedef struct as_sindex_bin_s {
@@ -143,27 +202,35 @@ void as_sindex_release_arr(as_sindex* si_arr[], uint32_t si_arr_sz);
 // Populate sindexes.
 void as_sindex_put_all_rd(struct as_namespace_s* ns, struct as_storage_rd_s* rd, struct as_index_ref_s* r_ref);
 void as_sindex_put_rd(as_sindex* si, struct as_storage_rd_s* rd, struct as_index_ref_s* r_ref);
+bool as_sindex_sbin_from_rd(as_sindex* si, struct as_storage_rd_s* rd, as_sindex_bin* sbin);
 
 // Modify sindexes from writes/deletes.
 uint32_t as_sindex_arr_lookup_by_set_and_bin_lockfree(const struct as_namespace_s* ns, uint16_t set_id, uint16_t bin_id, as_sindex** si_arr);
 uint32_t as_sindex_sbins_from_bin(struct as_namespace_s* ns, uint16_t set_id, const as_bin* b, as_sindex_bin* start_sbin, as_sindex_op op);
-void as_sindex_update_by_sbin(as_sindex_bin* start_sbin, uint32_t n_sbins, cf_arenax_handle r_h);
+bool as_sindex_update_by_sbin(as_sindex_bin* start_sbin, uint32_t n_sbins, cf_arenax_handle r_h);
 void as_sindex_sbin_free_all(as_sindex_bin* sbin, uint32_t n_sbins);
+uint32_t as_sindex_derived_arr_lookup_lockfree(const struct as_namespace_s* ns, uint16_t set_id, as_sindex** si_arr);
+bool as_sindex_derived_sbin(as_sindex* si, as_record* r, const as_bin* bins, uint32_t n_bins, as_sindex_bin* sbin, as_sindex_op op);
 
 // Query.
-as_sindex* as_sindex_lookup_by_defn(const struct as_namespace_s* ns, uint16_t set_id, uint16_t bin_id, as_particle_type ktype, as_sindex_type itype, const uint8_t* ctx_buf, uint32_t ctx_buf_sz);
+as_sindex* as_sindex_lookup_by_defn(const struct as_namespace_s* ns, uint16_t set_id, uint16_t bin_id, as_particle_type ktype, as_sindex_type itype, bool ordered, const uint8_t* ctx_buf, uint32_t ctx_buf_sz);
+as_sindex* as_sindex_lookup_composite(const struct as_namespace_s* ns, uint16_t set_id, const uint16_t* bin_ids, const as_particle_type* ktypes, uint32_t n_bins, const uint8_t* ctx_buf, uint32_t ctx_buf_sz);
+as_sindex* as_sindex_lookup_exp(const struct as_namespace_s* ns, uint16_t set_id, const uint8_t* exp_buf, uint32_t exp_buf_sz, as_particle_type ktype, as_sindex_type itype, bool ordered);
 
 // GC.
 as_sindex* as_sindex_lookup_by_iname_lockfree(const struct as_namespace_s* ns, const char* iname);
 
 // Info & stats.
-as_particle_type as_sindex_ktype_from_string(const char* ktype_str);
+as_particle_type as_sindex_ktype_from_string(const char* ktype_str, bool* ordered);
 as_sindex_type as_sindex_itype_from_string(const char* itype_str);
 bool as_sindex_exists(const struct as_namespace_s* ns, const char* iname);
 bool as_sindex_stats_str(struct as_namespace_s* ns, char* iname, cf_dyn_buf* db);
 void as_sindex_list_str(const struct as_namespace_s* ns, bool b64, cf_dyn_buf* db);
-void as_sindex_build_smd_key(const char* ns_name, const char* set_name, const char* bin_name, const char* cdt_ctx, as_sindex_type itype, as_particle_type ktype, char* smd_key);
+void as_sindex_build_smd_key(const char* ns_name, const char* set_name, const char* bin_name, const char* cdt_ctx, as_sindex_type itype, as_particle_type ktype, bool ordered, char* smd_key);
+void as_sindex_build_composite_smd_key(const char* ns_name, const char* set_name, uint32_t n_bins, char* const* bin_names, char* const* cdt_ctxs, const as_particle_type* ktypes, char* smd_key);
+void as_sindex_build_exp_smd_key(const char* ns_name, const char* set_name, const char* exp_b64, as_sindex_type itype, as_particle_type ktype, bool ordered, char* smd_key);
 int32_t as_sindex_cdt_ctx_b64_decode(const char* ctx_b64, uint32_t ctx_b64_len, uint8_t** buf_r);
+struct as_exp_s* as_sindex_exp_b64_decode(const char* exp_b64, uint32_t exp_b64_len, uint8_t** buf_r, uint32_t* buf_sz_r);
 
 static inline uint32_t
 as_sindex_n_sindexes(const as_namespace* ns)
@@ -177,6 +244,108 @@ as_sindex_string_to_bval(const char* s, size_t len)
 	return (int64_t)cf_wyhash64((const void*)s, len);
 }
 
+// Lexicographic order of strings maps to (signed) order of keys - equal keys
+// are equal strings unless they flag overflow.
+static inline int64_t
+as_sindex_string_to_ordered_bval(const char* s, size_t len)
+{
+	uint64_t ubval = 0;
+	size_t stub_sz = len < ORDERED_STUB_SZ ? len : ORDERED_STUB_SZ;
+
+	for (size_t i = 0; i < stub_sz; i++) {
+		ubval |= (uint64_t)(uint8_t)s[i] << (56 - (8 * i));
+	}
+
+	ubval |= len < ORDERED_OVERFLOW ? len : ORDERED_OVERFLOW;
+
+	return (int64_t)(ubval ^ (1UL << 63));
+}
+
+// The last key a string starting with the prefix can have.
+static inline int64_t
+as_sindex_string_prefix_end_bval(const char* s, size_t len)
+{
+	uint64_t ubval = ORDERED_OVERFLOW;
+
+	for (size_t i = 0; i < ORDERED_STUB_SZ; i++) {
+		uint8_t c = i < len ? (uint8_t)s[i] : 0xFF;
+
+		ubval |= (uint64_t)c << (56 - (8 * i));
+	}
+
+	return (int64_t)(ubval ^ (1UL << 63));
+}
+
+static inline bool
+as_sindex_ordered_bval_overflows(int64_t bval)
+{
+	return (bval & 0xFF) == ORDERED_OVERFLOW;
+}
+
+static inline int64_t
+as_sindex_string_bval(const as_sindex* si, const char* s, size_t len)
+{
+	return si->ordered ?
+			as_sindex_string_to_ordered_bval(s, len) :
+			as_sindex_string_to_bval(s, len);
+}
+
+static inline bool
+as_sindex_is_composite(const as_sindex* si)
+{
+	return si->n_cbins != 0;
+}
+
+static inline bool
+as_sindex_is_exp(const as_sindex* si)
+{
+	return si->exp != NULL;
+}
+
+// Keys derived from (potentially) several bins - not in the set+bin-id hash.
+static inline bool
+as_sindex_is_derived(const as_sindex* si)
+{
+	return as_sindex_is_composite(si) || as_sindex_is_exp(si);
+}
+
+// Same values in the same order - derived keys are built deterministically.
+static inline bool
+as_sindex_sbin_values_match(const as_sindex_bin* sbin1,
+		const as_sindex_bin* sbin2)
+{
+	if (sbin1->n_values != sbin2->n_values || sbin1->val != sbin2->val) {
+		return false;
+	}
+
+	return sbin1->n_values == 1 || memcmp(sbin1->values + 1, sbin2->values + 1,
+			(sbin1->n_values - 1) * sizeof(int64_t)) == 0;
+}
+
+static inline uint64_t
+as_sindex_composite_prefix(const int64_t* bvals, uint32_t n_bvals)
+{
+	return cf_wyhash64((const void*)bvals, n_bvals * sizeof(int64_t));
+}
+
+// Order-preserving within a prefix for integers - values outside the suffix
+// range saturate, so queries must re-check the record.
+static inline int64_t
+as_sindex_composite_bval(uint64_t prefix, as_particle_type ktype, int64_t bval)
+{
+	uint64_t suffix;
+
+	if (ktype == AS_PARTICLE_TYPE_STRING) {
+		suffix = (uint64_t)bval >> (64 - COMPOSITE_SUFFIX_BITS);
+	}
+	else {
+		suffix = bval < 0 ? 0 : ((uint64_t)bval > COMPOSITE_SUFFIX_MASK ?
+				COMPOSITE_SUFFIX_MASK : (uint64_t)bval);
+	}
+
+	return (int64_t)((prefix & ~COMPOSITE_SUFFIX_MASK) | suffix);
+}
+
 static inline uint64_t
 as_sindex_used_bytes(const as_namespace* ns)
 {
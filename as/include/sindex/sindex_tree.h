@@ -46,7 +46,9 @@ struct as_partition_reservation_s;
 struct as_query_range_s;
 struct as_sindex_s;
 struct as_sindex_arena_s;
+struct as_sindex_bulk_s;
 struct si_btree_node_s;
+struct si_btree_side_s;
 
 
 //==========================================================
@@ -54,6 +56,7 @@ struct si_btree_node_s;
 //
 
 typedef bool (*as_sindex_reduce_fn)(struct as_index_ref_s* value, int64_t bval, void* udata);
+typedef void (*as_sindex_visit_fn)(int64_t bval, cf_arenax_handle r_h, void* udata);
 
 // In header for enterprise separation only - not public.
 
@@ -71,6 +74,7 @@ typedef struct si_btree_s {
 	si_arena_handle root_h;
 	uint64_t n_nodes;
 	uint64_t n_keys;
+	struct si_btree_side_s* side; // non-NULL while bulk building
 } si_btree;
 
 typedef struct si_btree_node_s {
@@ -110,12 +114,21 @@ uint64_t as_sindex_tree_n_keys(const struct as_sindex_s* si);
 uint64_t as_sindex_tree_mem_size(const struct as_sindex_s* si);
 
 void as_sindex_tree_gc(struct as_sindex_s* si);
+void as_sindex_tree_wait_for_bulk(struct as_sindex_s* si);
 
 bool as_sindex_tree_put(struct as_sindex_s* si, int64_t bval, cf_arenax_handle r_h);
 bool as_sindex_tree_delete(struct as_sindex_s* si, int64_t bval, cf_arenax_handle r_h);
 void as_sindex_tree_query(struct as_sindex_s* si, const struct as_query_range_s* range, struct as_partition_reservation_s* rsv, int64_t bval, cf_digest* keyd, as_sindex_reduce_fn cb, void* udata);
+uint64_t* as_sindex_tree_intersect(struct as_sindex_s* si, const struct as_query_range_s* range, uint32_t pid, uint64_t* r_hs, uint32_t* n_r_hs);
+void as_sindex_tree_query_filtered(struct as_sindex_s* si, const struct as_query_range_s* range, struct as_partition_reservation_s* rsv, int64_t bval, cf_digest* keyd, const uint64_t* r_hs, uint32_t n_r_hs, as_sindex_reduce_fn cb, void* udata);
+
+struct as_sindex_bulk_s* as_sindex_tree_bulk_start(struct as_sindex_s* si, uint32_t pid);
+void as_sindex_tree_bulk_add(struct as_sindex_bulk_s* bulk, int64_t bval, cf_arenax_handle r_h);
+void as_sindex_tree_bulk_finish(struct as_sindex_bulk_s* bulk);
 
 void as_sindex_tree_collect_cardinality(struct as_sindex_s* si);
+uint64_t as_sindex_tree_estimate_keys(const struct as_sindex_s* si, int64_t start, int64_t end);
+void as_sindex_tree_visit(struct as_sindex_s* si, uint32_t pid, as_sindex_visit_fn cb, void* udata);
 
 
 //==========================================================
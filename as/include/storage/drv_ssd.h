@@ -103,6 +103,7 @@ typedef struct ssd_wblock_state_s {
 	ssd_write_buf		*swb;		// pending writes for the wblock, also treated as a cache for reads
 	uint32_t			state;		// for now just a defrag flag
 	uint32_t			n_vac_dests; // number of wblocks into which this wblock defragged
+	uint32_t			n_swbs;		// swbs ever attached - lets read-ahead detect rewrites
 } ssd_wblock_state;
 
 
@@ -248,7 +249,7 @@ void apply_opt_meta(struct as_index_s *r, struct as_namespace_s *ns, const struc
 
 // Tomb raider.
 void ssd_cold_start_adjust_cenotaph(struct as_namespace_s *ns, const struct as_flat_record_s *flat, uint32_t block_void_time, struct as_index_s *r);
-void ssd_cold_start_transition_record(struct as_namespace_s *ns, const struct as_flat_record_s *flat, const as_flat_opt_meta* opt_meta, struct as_index_tree_s *tree, struct as_index_ref_s *r_ref, bool is_create);
+void ssd_cold_start_transition_record(struct as_namespace_s *ns, const struct as_flat_record_s *flat, const as_flat_opt_meta* opt_meta, struct as_index_tree_s *tree, struct as_index_ref_s *r_ref, bool is_create, uint32_t old_void_time);
 void ssd_cold_start_drop_cenotaphs(struct as_namespace_s *ns);
 
 // Record encryption.
@@ -130,6 +130,7 @@ typedef struct as_storage_rd_s {
 
 	// Only used by storage type AS_STORAGE_ENGINE_SSD:
 	uint8_t					*read_buf;
+	const struct as_storage_read_ahead_s *read_ahead; // may hold the record
 
 	// Flat storage format also used for pickled records sent via fabric:
 	bool					keep_pickle;
@@ -152,6 +153,16 @@ typedef struct storage_device_stats_s {
 	uint32_t shadow_write_q_sz;
 } storage_device_stats;
 
+// One large read covering several records - for storage-ordered scans. Add
+// records in storage order until one doesn't fit, then load.
+typedef struct as_storage_read_ahead_s {
+	uint32_t		n_records;
+	uint32_t		file_id;
+	uint64_t		start_offset;
+	uint64_t		end_offset;
+	uint8_t			*buf; // NULL if not loaded
+} as_storage_read_ahead;
+
 
 //==========================================================
 // Public API.
@@ -208,6 +219,10 @@ void as_storage_histogram_clear_all(struct as_namespace_s *ns); // clears all SS
 // Get record storage metadata.
 uint32_t as_storage_record_device_size(const struct as_namespace_s *ns, const struct as_index_s *r);
 
+// Storage-ordered reads.
+bool as_storage_read_ahead_add(struct as_namespace_s *ns, as_storage_read_ahead *ra, const struct as_index_s *r); // false if r doesn't fit - an empty ra always takes r
+void as_storage_read_ahead_load(struct as_namespace_s *ns, as_storage_read_ahead *ra);
+
 //------------------------------------------------
 // Generic functions that don't use "v-tables".
 //
@@ -220,6 +235,8 @@ void as_storage_record_get_set_name(as_storage_rd *rd);
 bool as_storage_rd_load_key(as_storage_rd *rd);
 bool as_storage_rd_load_pickle(as_storage_rd *rd);
 
+void as_storage_read_ahead_reset(as_storage_read_ahead *ra);
+
 //------------------------------------------------
 // AS_STORAGE_ENGINE_MEMORY functions.
 //
@@ -278,6 +295,9 @@ void as_storage_histogram_clear_ssd(struct as_namespace_s *ns);
 
 uint32_t as_storage_record_device_size_ssd(const struct as_index_s *r);
 
+bool as_storage_read_ahead_add_ssd(struct as_namespace_s *ns, as_storage_read_ahead *ra, const struct as_index_s *r);
+void as_storage_read_ahead_load_ssd(struct as_namespace_s *ns, as_storage_read_ahead *ra);
+
 //------------------------------------------------
 // AS_STORAGE_ENGINE_PMEM functions.
 //
@@ -165,6 +165,8 @@ cfg_set_defaults()
 	c->migrate_max_num_incoming = AS_MIGRATE_DEFAULT_MAX_NUM_INCOMING; // for receiver-side migration flow-control
 	c->n_migrate_threads = 1;
 	cf_os_use_group_perms(false);
+	c->query_background_weight = 1;
+	c->query_foreground_weight = 4;
 	c->query_max_done = 100;
 	c->n_query_threads_limit = 128;
 	c->run_as_daemon = true; // set false only to run in debugger & see console output
@@ -282,9 +284,12 @@ typedef enum {
 	CASE_SERVICE_NODE_ID,
 	CASE_SERVICE_NODE_ID_INTERFACE,
 	CASE_SERVICE_OS_GROUP_PERMS,
+	CASE_SERVICE_PARTITION_NUMA_HOMING,
 	CASE_SERVICE_PIDFILE,
 	CASE_SERVICE_PROTO_FD_IDLE_MS,
 	CASE_SERVICE_PROTO_FD_MAX,
+	CASE_SERVICE_QUERY_BACKGROUND_WEIGHT,
+	CASE_SERVICE_QUERY_FOREGROUND_WEIGHT,
 	CASE_SERVICE_QUERY_MAX_DONE,
 	CASE_SERVICE_QUERY_THREADS_LIMIT,
 	CASE_SERVICE_RUN_AS_DAEMON,
@@ -446,6 +451,7 @@ typedef enum {
 	CASE_NAMESPACE_ENABLE_BENCHMARKS_WRITE,
 	CASE_NAMESPACE_ENABLE_HIST_PROXY,
 	CASE_NAMESPACE_EVICT_HIST_BUCKETS,
+	CASE_NAMESPACE_EVICT_HIST_ONLINE,
 	CASE_NAMESPACE_EVICT_TENTHS_PCT,
 	CASE_NAMESPACE_HIGH_WATER_DISK_PCT,
 	CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT,
@@ -456,6 +462,7 @@ typedef enum {
 	CASE_NAMESPACE_MIGRATE_ORDER,
 	CASE_NAMESPACE_MIGRATE_RETRANSMIT_MS,
 	CASE_NAMESPACE_MIGRATE_SLEEP,
+	CASE_NAMESPACE_NSUP_EXPIRE_INDEX,
 	CASE_NAMESPACE_NSUP_HIST_PERIOD,
 	CASE_NAMESPACE_NSUP_PERIOD,
 	CASE_NAMESPACE_NSUP_THREADS,
@@ -466,6 +473,8 @@ typedef enum {
 	CASE_NAMESPACE_REJECT_NON_XDR_WRITES,
 	CASE_NAMESPACE_REJECT_XDR_WRITES,
 	CASE_NAMESPACE_REPLICATION_FACTOR,
+	CASE_NAMESPACE_SET_INDEX_BITMAP,
+	CASE_NAMESPACE_SINDEX_PI_SCAN_PCT,
 	CASE_NAMESPACE_SINDEX_STAGE_SIZE,
 	CASE_NAMESPACE_SINGLE_BIN,
 	CASE_NAMESPACE_SINGLE_QUERY_THREADS,
@@ -574,6 +583,7 @@ typedef enum {
 	CASE_NAMESPACE_STORAGE_DEVICE_READ_PAGE_CACHE,
 	CASE_NAMESPACE_STORAGE_DEVICE_SCHEDULER_MODE,
 	CASE_NAMESPACE_STORAGE_DEVICE_SERIALIZE_TOMB_RAIDER,
+	CASE_NAMESPACE_STORAGE_DEVICE_SINDEX_PERSIST,
 	CASE_NAMESPACE_STORAGE_DEVICE_SINDEX_STARTUP_DEVICE_SCAN,
 	CASE_NAMESPACE_STORAGE_DEVICE_TOMB_RAIDER_SLEEP,
 	CASE_NAMESPACE_STORAGE_DEVICE_WRITE_BLOCK_SIZE,
@@ -773,9 +783,12 @@ const cfg_opt SERVICE_OPTS[] = {
 		{ "node-id",						CASE_SERVICE_NODE_ID },
 		{ "node-id-interface",				CASE_SERVICE_NODE_ID_INTERFACE },
 		{ "os-group-perms",					CASE_SERVICE_OS_GROUP_PERMS },
+		{ "partition-numa-homing",			CASE_SERVICE_PARTITION_NUMA_HOMING },
 		{ "pidfile",						CASE_SERVICE_PIDFILE },
 		{ "proto-fd-idle-ms",				CASE_SERVICE_PROTO_FD_IDLE_MS },
 		{ "proto-fd-max",					CASE_SERVICE_PROTO_FD_MAX },
+		{ "query-background-weight",		CASE_SERVICE_QUERY_BACKGROUND_WEIGHT },
+		{ "query-foreground-weight",		CASE_SERVICE_QUERY_FOREGROUND_WEIGHT },
 		{ "query-max-done",					CASE_SERVICE_QUERY_MAX_DONE },
 		{ "query-threads-limit",			CASE_SERVICE_QUERY_THREADS_LIMIT },
 		{ "run-as-daemon",					CASE_SERVICE_RUN_AS_DAEMON },
@@ -959,6 +972,7 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "enable-benchmarks-write",		CASE_NAMESPACE_ENABLE_BENCHMARKS_WRITE },
 		{ "enable-hist-proxy",				CASE_NAMESPACE_ENABLE_HIST_PROXY },
 		{ "evict-hist-buckets",				CASE_NAMESPACE_EVICT_HIST_BUCKETS },
+		{ "evict-hist-online",				CASE_NAMESPACE_EVICT_HIST_ONLINE },
 		{ "evict-tenths-pct",				CASE_NAMESPACE_EVICT_TENTHS_PCT },
 		{ "high-water-disk-pct",			CASE_NAMESPACE_HIGH_WATER_DISK_PCT },
 		{ "high-water-memory-pct",			CASE_NAMESPACE_HIGH_WATER_MEMORY_PCT },
@@ -969,6 +983,7 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "migrate-order",					CASE_NAMESPACE_MIGRATE_ORDER },
 		{ "migrate-retransmit-ms",			CASE_NAMESPACE_MIGRATE_RETRANSMIT_MS },
 		{ "migrate-sleep",					CASE_NAMESPACE_MIGRATE_SLEEP },
+		{ "nsup-expire-index",				CASE_NAMESPACE_NSUP_EXPIRE_INDEX },
 		{ "nsup-hist-period",				CASE_NAMESPACE_NSUP_HIST_PERIOD },
 		{ "nsup-period",					CASE_NAMESPACE_NSUP_PERIOD },
 		{ "nsup-threads",					CASE_NAMESPACE_NSUP_THREADS },
@@ -979,6 +994,8 @@ const cfg_opt NAMESPACE_OPTS[] = {
 		{ "reject-non-xdr-writes",			CASE_NAMESPACE_REJECT_NON_XDR_WRITES },
 		{ "reject-xdr-writes",				CASE_NAMESPACE_REJECT_XDR_WRITES },
 		{ "replication-factor",				CASE_NAMESPACE_REPLICATION_FACTOR },
+		{ "set-index-bitmap",				CASE_NAMESPACE_SET_INDEX_BITMAP },
+		{ "sindex-pi-scan-pct",				CASE_NAMESPACE_SINDEX_PI_SCAN_PCT },
 		{ "sindex-stage-size",				CASE_NAMESPACE_SINDEX_STAGE_SIZE },
 		{ "single-bin",						CASE_NAMESPACE_SINGLE_BIN },
 		{ "single-query-threads",			CASE_NAMESPACE_SINGLE_QUERY_THREADS },
@@ -1100,6 +1117,7 @@ const cfg_opt NAMESPACE_STORAGE_DEVICE_OPTS[] = {
 		{ "read-page-cache",				CASE_NAMESPACE_STORAGE_DEVICE_READ_PAGE_CACHE },
 		{ "scheduler-mode",					CASE_NAMESPACE_STORAGE_DEVICE_SCHEDULER_MODE },
 		{ "serialize-tomb-raider",			CASE_NAMESPACE_STORAGE_DEVICE_SERIALIZE_TOMB_RAIDER },
+		{ "sindex-persist",					CASE_NAMESPACE_STORAGE_DEVICE_SINDEX_PERSIST },
 		{ "sindex-startup-device-scan",		CASE_NAMESPACE_STORAGE_DEVICE_SINDEX_STARTUP_DEVICE_SCAN },
 		{ "tomb-raider-sleep",				CASE_NAMESPACE_STORAGE_DEVICE_TOMB_RAIDER_SLEEP },
 		{ "write-block-size",				CASE_NAMESPACE_STORAGE_DEVICE_WRITE_BLOCK_SIZE },
@@ -2270,6 +2288,9 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_OS_GROUP_PERMS:
 				cf_os_use_group_perms(cfg_bool(&line));
 				break;
+			case CASE_SERVICE_PARTITION_NUMA_HOMING:
+				c->partition_numa_homing = cfg_bool(&line);
+				break;
 			case CASE_SERVICE_PIDFILE:
 				c->pidfile = cfg_strdup_no_checks(&line);
 				break;
@@ -2279,6 +2300,12 @@ as_config_init(const char* config_file)
 			case CASE_SERVICE_PROTO_FD_MAX:
 				c->n_proto_fd_max = cfg_u32(&line, MIN_PROTO_FD_MAX, MAX_PROTO_FD_MAX);
 				break;
+			case CASE_SERVICE_QUERY_BACKGROUND_WEIGHT:
+				c->query_background_weight = cfg_u32(&line, 1, 100);
+				break;
+			case CASE_SERVICE_QUERY_FOREGROUND_WEIGHT:
+				c->query_foreground_weight = cfg_u32(&line, 1, 100);
+				break;
 			case CASE_SERVICE_QUERY_MAX_DONE:
 				c->query_max_done = cfg_u32(&line, 0, 10000);
 				break;
@@ -2847,6 +2874,9 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_EVICT_HIST_BUCKETS:
 				ns->evict_hist_buckets = cfg_u32(&line, 100, 10000000);
 				break;
+			case CASE_NAMESPACE_EVICT_HIST_ONLINE:
+				ns->evict_hist_online = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_EVICT_TENTHS_PCT:
 				ns->evict_tenths_pct = cfg_u32_no_checks(&line);
 				break;
@@ -2878,6 +2908,9 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_MIGRATE_SLEEP:
 				ns->migrate_sleep = cfg_u32_no_checks(&line);
 				break;
+			case CASE_NAMESPACE_NSUP_EXPIRE_INDEX:
+				ns->tree_shared.expire_index = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_NSUP_HIST_PERIOD:
 				ns->nsup_hist_period = cfg_seconds_no_checks(&line);
 				break;
@@ -2924,6 +2957,12 @@ as_config_init(const char* config_file)
 			case CASE_NAMESPACE_REPLICATION_FACTOR:
 				ns->cfg_replication_factor = cfg_u32(&line, 1, AS_CLUSTER_SZ);
 				break;
+			case CASE_NAMESPACE_SET_INDEX_BITMAP:
+				ns->set_index_bitmap = cfg_bool(&line);
+				break;
+			case CASE_NAMESPACE_SINDEX_PI_SCAN_PCT:
+				ns->sindex_pi_scan_pct = cfg_u32(&line, 0, 100);
+				break;
 			case CASE_NAMESPACE_SINDEX_STAGE_SIZE:
 				ns->sindex_stage_size = cfg_u64_power_of_2(&line, SI_ARENA_MIN_STAGE_SIZE, SI_ARENA_MAX_STAGE_SIZE);
 				break;
@@ -3390,6 +3429,9 @@ as_config_init(const char* config_file)
 				cfg_enterprise_only(&line);
 				ns->storage_serialize_tomb_raider = cfg_bool(&line);
 				break;
+			case CASE_NAMESPACE_STORAGE_DEVICE_SINDEX_PERSIST:
+				ns->storage_sindex_persist = cfg_bool(&line);
+				break;
 			case CASE_NAMESPACE_STORAGE_DEVICE_SINDEX_STARTUP_DEVICE_SCAN:
 				ns->storage_sindex_startup_device_scan = cfg_bool(&line);
 				break;
@@ -3423,6 +3465,9 @@ as_config_init(const char* config_file)
 				if (ns->storage_sindex_startup_device_scan && ns->storage_data_in_memory) {
 					cf_crash_nostack(AS_CFG, "{%s} can't configure both 'sindex-startup-device-scan' and 'data-in-memory'", ns->name);
 				}
+				if (ns->storage_sindex_persist && ns->storage_data_in_memory) {
+					cf_crash_nostack(AS_CFG, "{%s} can't configure both 'sindex-persist' and 'data-in-memory'", ns->name);
+				}
 				if (ns->storage_commit_to_device && ns->storage_disable_odsync) {
 					cf_crash_nostack(AS_CFG, "{%s} can't configure both 'commit-to-device' and 'disable-odsync'", ns->name);
 				}
@@ -4001,6 +4046,16 @@ as_config_post_process(as_config* c, const char* config_file)
 				n_cpus * 5 : n_cpus;
 	}
 
+	if (c->partition_numa_homing) {
+		if (c->auto_pin != CF_TOPO_AUTO_PIN_CPU) {
+			cf_crash_nostack(AS_CFG, "'partition-numa-homing' requires 'auto-pin cpu'");
+		}
+
+		if (cf_topo_count_numa_nodes() < 2) {
+			cf_warning(AS_CFG, "'partition-numa-homing' has no effect with a single NUMA node");
+		}
+	}
+
 	// Setup performance metrics histograms.
 	cfg_create_all_histograms();
 
@@ -4268,6 +4323,7 @@ as_config_post_process(as_config* c, const char* config_file)
 		ns->tree_shared.sprigs_shift		= NUM_SPRIG_BITS - cf_msb(ns->tree_shared.n_sprigs);
 		ns->tree_shared.sprigs_offset		= sprigs_offset;
 		ns->tree_shared.puddles_offset		= puddles_offset;
+		ns->tree_shared.expire_index_used_sz	= &ns->expire_index_sz;
 
 		as_storage_cfg_init(ns);
 
@@ -243,9 +243,12 @@ cfg_get_service(cf_dyn_buf* db)
 	info_append_uint64_x(db, "node-id", g_config.self_node); // may be configured or auto-generated
 	info_append_string_safe(db, "node-id-interface", g_config.node_id_interface);
 	info_append_bool(db, "os-group-perms", cf_os_is_using_group_perms());
+	info_append_bool(db, "partition-numa-homing", g_config.partition_numa_homing);
 	info_append_string_safe(db, "pidfile", g_config.pidfile);
 	info_append_int(db, "proto-fd-idle-ms", g_config.proto_fd_idle_ms);
 	info_append_uint32(db, "proto-fd-max", g_config.n_proto_fd_max);
+	info_append_uint32(db, "query-background-weight", g_config.query_background_weight);
+	info_append_uint32(db, "query-foreground-weight", g_config.query_foreground_weight);
 	info_append_uint32(db, "query-max-done", g_config.query_max_done);
 	info_append_uint32(db, "query-threads-limit", g_config.n_query_threads_limit);
 	info_append_bool(db, "run-as-daemon", g_config.run_as_daemon);
@@ -391,6 +394,7 @@ cfg_get_namespace(char* context, cf_dyn_buf* db)
 	info_append_bool(db, "enable-benchmarks-write", ns->write_benchmarks_enabled);
 	info_append_bool(db, "enable-hist-proxy", ns->proxy_hist_enabled);
 	info_append_uint32(db, "evict-hist-buckets", ns->evict_hist_buckets);
+	info_append_bool(db, "evict-hist-online", ns->evict_hist_online);
 	info_append_uint32(db, "evict-tenths-pct", ns->evict_tenths_pct);
 	info_append_uint32(db, "high-water-disk-pct", ns->hwm_disk_pct);
 	info_append_uint32(db, "high-water-memory-pct", ns->hwm_memory_pct);
@@ -409,6 +413,7 @@ cfg_get_namespace(char* context, cf_dyn_buf* db)
 	info_append_uint32(db, "migrate-order", ns->migrate_order);
 	info_append_uint32(db, "migrate-retransmit-ms", ns->migrate_retransmit_ms);
 	info_append_uint32(db, "migrate-sleep", ns->migrate_sleep);
+	info_append_bool(db, "nsup-expire-index", ns->tree_shared.expire_index);
 	info_append_uint32(db, "nsup-hist-period", ns->nsup_hist_period);
 	info_append_uint32(db, "nsup-period", ns->nsup_period);
 	info_append_uint32(db, "nsup-threads", ns->n_nsup_threads);
@@ -419,6 +424,8 @@ cfg_get_namespace(char* context, cf_dyn_buf* db)
 	info_append_bool(db, "reject-non-xdr-writes", ns->reject_non_xdr_writes);
 	info_append_bool(db, "reject-xdr-writes", ns->reject_xdr_writes);
 	info_append_uint32(db, "replication-factor", ns->cfg_replication_factor);
+	info_append_bool(db, "set-index-bitmap", ns->set_index_bitmap);
+	info_append_uint32(db, "sindex-pi-scan-pct", ns->sindex_pi_scan_pct);
 	info_append_uint64(db, "sindex-stage-size", ns->sindex_stage_size);
 	info_append_bool(db, "single-bin", ns->single_bin);
 	info_append_uint32(db, "single-query-threads", ns->n_single_query_threads);
@@ -531,6 +538,7 @@ cfg_get_namespace(char* context, cf_dyn_buf* db)
 		info_append_bool(db, "storage-engine.read-page-cache", ns->storage_read_page_cache);
 		info_append_string_safe(db, "storage-engine.scheduler-mode", ns->storage_scheduler_mode);
 		info_append_bool(db, "storage-engine.serialize-tomb-raider", ns->storage_serialize_tomb_raider);
+		info_append_bool(db, "storage-engine.sindex-persist", ns->storage_sindex_persist);
 		info_append_bool(db, "storage-engine.sindex-startup-device-scan", ns->storage_sindex_startup_device_scan);
 		info_append_uint32(db, "storage-engine.tomb-raider-sleep", ns->storage_tomb_raider_sleep);
 		info_append_uint32(db, "storage-engine.write-block-size", ns->storage_write_block_size);
@@ -886,6 +894,24 @@ cfg_set_service(const char* cmd)
 		cf_info(AS_INFO, "Changing value of proto-fd-max from %u to %d ",
 				prev_val, val);
 	}
+	else if (as_info_parameter_get(cmd, "query-background-weight", v,
+			&v_len) == 0) {
+		if (cf_str_atoi(v, &val) != 0 || val < 1 || val > 100) {
+			return false;
+		}
+		cf_info(AS_INFO, "Changing value of query-background-weight from %u to %d ",
+				g_config.query_background_weight, val);
+		g_config.query_background_weight = (uint32_t)val;
+	}
+	else if (as_info_parameter_get(cmd, "query-foreground-weight", v,
+			&v_len) == 0) {
+		if (cf_str_atoi(v, &val) != 0 || val < 1 || val > 100) {
+			return false;
+		}
+		cf_info(AS_INFO, "Changing value of query-foreground-weight from %u to %d ",
+				g_config.query_foreground_weight, val);
+		g_config.query_foreground_weight = (uint32_t)val;
+	}
 	else if (as_info_parameter_get(cmd, "query-max-done", v, &v_len) == 0) {
 		if (cf_str_atoi(v, &val) != 0) {
 			return false;
@@ -1684,6 +1710,15 @@ cfg_set_namespace(const char* cmd)
 				ns->name, ns->cfg_replication_factor, val);
 		ns->cfg_replication_factor = (uint32_t)val;
 	}
+	else if (as_info_parameter_get(cmd, "sindex-pi-scan-pct", v,
+			&v_len) == 0) {
+		if (cf_str_atoi(v, &val) != 0 || val < 0 || val > 100) {
+			return false;
+		}
+		cf_info(AS_INFO, "Changing value of sindex-pi-scan-pct of ns %s from %u to %d ",
+				ns->name, ns->sindex_pi_scan_pct, val);
+		ns->sindex_pi_scan_pct = (uint32_t)val;
+	}
 	else if (as_info_parameter_get(cmd, "single-query-threads", v,
 			&v_len) == 0) {
 		if (cf_str_atoi(v, &val) != 0 || val < 1 || val > 128) {
@@ -33,12 +33,15 @@
 #include <regex.h>
 #include <stdint.h>
 
+#include "aerospike/as_atomic.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_b64.h"
 #include "citrusleaf/cf_byte_order.h"
 #include "citrusleaf/cf_clock.h"
+#include "citrusleaf/cf_hash_math.h"
 
 #include "bits.h"
+#include "cf_mutex.h"
 #include "dynbuf.h"
 #include "log.h"
 #include "msgpack_in.h"
@@ -48,6 +51,7 @@
 #include "base/proto.h"
 #include "base/particle.h"
 #include "base/particle_blob.h"
+#include "base/stats.h"
 #include "geospatial/geospatial.h"
 #include "storage/storage.h"
 
@@ -60,6 +64,26 @@
 
 #define EXP_MAX_SIZE (1 * 1024 * 1024) // 1 MiB
 
+// Clients send the same few filters over and over - keep them built. The cache
+// is a fixed set-associative table, so it's bounded and its locks are spread.
+#define EXP_CACHE_N_SETS 64
+#define EXP_CACHE_N_WAYS 8
+#define EXP_CACHE_MAX_WIRE_SZ (4 * 1024) // bigger filters are built every time
+
+typedef struct exp_cache_entry_s {
+	uint64_t hash;
+	uint8_t* wire;
+	uint32_t wire_sz;
+	bool hot; // hit since the last eviction sweep passed
+	as_exp* exp;
+} exp_cache_entry;
+
+typedef struct exp_cache_set_s {
+	cf_mutex lock;
+	uint32_t hand; // eviction sweep position
+	exp_cache_entry ways[EXP_CACHE_N_WAYS];
+} exp_cache_set;
+
 typedef enum {
 	GEO_CELL,
 	GEO_REGION,
@@ -459,6 +483,8 @@ struct op_table_entry_s {
 static const uint8_t* EMPTY_STRING = (uint8_t*)"";
 static const uint8_t call_eval_token[1] = "";
 
+static exp_cache_set g_exp_cache[EXP_CACHE_N_SETS];
+
 
 //==========================================================
 // Forward declarations.
@@ -509,6 +535,11 @@ static bool parse_op_call(op_call* op, build_args* args);
 static bool build_set_expected_particle_type(build_args* args);
 static as_exp* check_filter_exp(as_exp* exp);
 
+// Build cache.
+static as_exp* cache_get(const uint8_t* buf, uint32_t buf_sz, uint64_t hash);
+static as_exp* cache_put(as_exp* exp, const uint8_t* buf, uint32_t buf_sz, uint64_t hash);
+static bool cache_entry_matches(const exp_cache_entry* e, const uint8_t* buf, uint32_t buf_sz, uint64_t hash);
+
 // Runtime.
 static as_exp_trilean match_internal(const as_exp* predexp, const as_exp_ctx* ctx);
 static bool rt_eval(runtime* rt, rt_value* ret_val);
@@ -774,14 +805,36 @@ as_exp_filter_build(const as_msg_field* m, bool cpy_wire)
 	cf_debug(AS_EXP, "as_exp_filter_build - msg_field_sz %u msg-dump\n%*pH",
 			m->field_sz, as_msg_field_get_value_sz(m), m->data);
 
-	as_exp* exp = build_internal(m->data, as_msg_field_get_value_sz(m),
-			cpy_wire);
+	uint32_t buf_sz = as_msg_field_get_value_sz(m);
 
-	if (exp == NULL) {
+	if (buf_sz > EXP_CACHE_MAX_WIRE_SZ) {
+		as_exp* exp = build_internal(m->data, buf_sz, cpy_wire);
+
+		if (exp == NULL) {
+			return NULL;
+		}
+
+		return check_filter_exp(exp);
+	}
+
+	uint64_t hash = cf_wyhash64(m->data, buf_sz);
+	as_exp* exp = cache_get(m->data, buf_sz, hash);
+
+	if (exp != NULL) {
+		as_incr_uint64(&g_stats.exp_cache_hits);
+		return exp;
+	}
+
+	as_incr_uint64(&g_stats.exp_cache_misses);
+
+	// Cached expressions outlive the message - they must own their wire bytes.
+	exp = build_internal(m->data, buf_sz, true);
+
+	if (exp == NULL || (exp = check_filter_exp(exp)) == NULL) {
 		return NULL;
 	}
 
-	return check_filter_exp(exp);
+	return cache_put(exp, m->data, buf_sz, hash);
 }
 
 as_exp*
@@ -956,6 +1009,88 @@ as_exp_display(const as_exp* exp, cf_dyn_buf *db)
 	return true;
 }
 
+// True if the expression's value depends only on bin contents - any op that
+// reads the record's key or metadata, or isn't known to be pure, fails.
+bool
+as_exp_reads_only_bins(const as_exp* exp)
+{
+	const uint8_t* instr_ptr = exp->mem;
+	uint32_t n_ops = ((const op_base_mem*)instr_ptr)->instr_end_ix;
+
+	for (uint32_t i = 0; i < n_ops; i++) {
+		const op_base_mem* ob = (const op_base_mem*)instr_ptr;
+
+		switch (ob->code) {
+		case EXP_UNK:
+		case EXP_CMP_EQ:
+		case EXP_CMP_NE:
+		case EXP_CMP_GT:
+		case EXP_CMP_GE:
+		case EXP_CMP_LT:
+		case EXP_CMP_LE:
+		case EXP_CMP_REGEX:
+		case EXP_CMP_GEO:
+		case EXP_AND:
+		case EXP_OR:
+		case EXP_NOT:
+		case EXP_EXCLUSIVE:
+		case EXP_ADD:
+		case EXP_SUB:
+		case EXP_MUL:
+		case EXP_DIV:
+		case EXP_POW:
+		case EXP_LOG:
+		case EXP_MOD:
+		case EXP_ABS:
+		case EXP_FLOOR:
+		case EXP_CEIL:
+		case EXP_TO_INT:
+		case EXP_TO_FLOAT:
+		case EXP_INT_AND:
+		case EXP_INT_OR:
+		case EXP_INT_XOR:
+		case EXP_INT_NOT:
+		case EXP_INT_LSHIFT:
+		case EXP_INT_RSHIFT:
+		case EXP_INT_ARSHIFT:
+		case EXP_INT_COUNT:
+		case EXP_INT_LSCAN:
+		case EXP_INT_RSCAN:
+		case EXP_MIN:
+		case EXP_MAX:
+		case EXP_BIN:
+		case EXP_BIN_TYPE:
+		case EXP_COND:
+		case EXP_VAR:
+		case EXP_LET:
+		case EXP_QUOTE:
+		case EXP_CALL: // operates on its bin argument
+		case VOP_VALUE_NIL:
+		case VOP_VALUE_BOOL:
+		case VOP_VALUE_TRILEAN:
+		case VOP_VALUE_INT:
+		case VOP_VALUE_FLOAT:
+		case VOP_VALUE_STR:
+		case VOP_VALUE_BLOB:
+		case VOP_VALUE_GEO:
+		case VOP_VALUE_HLL:
+		case VOP_VALUE_MAP:
+		case VOP_VALUE_LIST:
+		case VOP_VALUE_MSGPACK:
+		case VOP_COND_CASE:
+			break;
+		default:
+			cf_warning(AS_EXP, "as_exp_reads_only_bins - op '%s' reads more than bins",
+					op_table[ob->code].name);
+			return false;
+		}
+
+		instr_ptr += op_table[ob->code].size;
+	}
+
+	return true;
+}
+
 void
 as_exp_destroy(as_exp* exp)
 {
@@ -963,6 +1098,11 @@ as_exp_destroy(as_exp* exp)
 		return;
 	}
 
+	// Cached expressions are shared - the last holder out destroys.
+	if (exp->rc != 0 && as_aaf_uint32(&exp->rc, -1) != 0) {
+		return;
+	}
+
 	for (uint32_t i = 0; i < exp->cleanup_stack_ix; i++) {
 		op_base_mem* ob = exp->cleanup_stack[i];
 
@@ -2792,6 +2932,120 @@ check_filter_exp(as_exp* exp)
 }
 
 
+//==========================================================
+// Local helpers - build cache.
+//
+
+// Returns a new reference to the matching cached expression, if any.
+static as_exp*
+cache_get(const uint8_t* buf, uint32_t buf_sz, uint64_t hash)
+{
+	exp_cache_set* set = &g_exp_cache[hash % EXP_CACHE_N_SETS];
+	as_exp* exp = NULL;
+
+	cf_mutex_lock(&set->lock);
+
+	for (uint32_t i = 0; i < EXP_CACHE_N_WAYS; i++) {
+		exp_cache_entry* e = &set->ways[i];
+
+		if (cache_entry_matches(e, buf, buf_sz, hash)) {
+			e->hot = true;
+			exp = e->exp;
+			as_incr_uint32(&exp->rc);
+			break;
+		}
+	}
+
+	cf_mutex_unlock(&set->lock);
+
+	return exp;
+}
+
+// Takes exp (not yet shared) and returns a reference to the cached copy - exp
+// itself, unless another thread cached an equal one first.
+static as_exp*
+cache_put(as_exp* exp, const uint8_t* buf, uint32_t buf_sz, uint64_t hash)
+{
+	exp_cache_set* set = &g_exp_cache[hash % EXP_CACHE_N_SETS];
+	exp_cache_entry* victim = NULL;
+
+	cf_mutex_lock(&set->lock);
+
+	for (uint32_t i = 0; i < EXP_CACHE_N_WAYS; i++) {
+		exp_cache_entry* e = &set->ways[i];
+
+		if (e->exp == NULL) {
+			if (victim == NULL) {
+				victim = e;
+			}
+
+			continue;
+		}
+
+		if (cache_entry_matches(e, buf, buf_sz, hash)) {
+			as_exp* cached = e->exp;
+
+			e->hot = true;
+			as_incr_uint32(&cached->rc);
+
+			cf_mutex_unlock(&set->lock);
+
+			as_exp_destroy(exp);
+
+			return cached;
+		}
+	}
+
+	as_exp* evicted = NULL;
+	uint8_t* evicted_wire = NULL;
+
+	if (victim == NULL) {
+		// Clock sweep - evict the first entry not hit since the hand passed.
+		while (true) {
+			exp_cache_entry* e = &set->ways[set->hand];
+
+			set->hand = (set->hand + 1) % EXP_CACHE_N_WAYS;
+
+			if (! e->hot) {
+				victim = e;
+				break;
+			}
+
+			e->hot = false;
+		}
+
+		evicted = victim->exp;
+		evicted_wire = victim->wire;
+	}
+
+	victim->hash = hash;
+	victim->wire = cf_malloc(buf_sz);
+	memcpy(victim->wire, buf, buf_sz);
+	victim->wire_sz = buf_sz;
+	victim->hot = false;
+	victim->exp = exp;
+
+	exp->rc = 2; // the cache's and the caller's
+
+	cf_mutex_unlock(&set->lock);
+
+	if (evicted != NULL) {
+		as_exp_destroy(evicted); // destroyed only if no one is using it
+		cf_free(evicted_wire);
+	}
+
+	return exp;
+}
+
+static bool
+cache_entry_matches(const exp_cache_entry* e, const uint8_t* buf,
+		uint32_t buf_sz, uint64_t hash)
+{
+	return e->exp != NULL && e->hash == hash && e->wire_sz == buf_sz &&
+			memcmp(e->wire, buf, buf_sz) == 0;
+}
+
+
 //==========================================================
 // Local helpers - runtime.
 //
@@ -0,0 +1,478 @@
+/*
+ * expire_index.c
+ *
+ * Copyright (C) 2022 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "base/expire_index.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "aerospike/as_atomic.h"
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_digest.h"
+
+#include "arenax.h"
+#include "cf_mutex.h"
+
+#include "base/datamodel.h"
+#include "base/index.h"
+
+//#include "warnings.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// A per-partition hierarchical timer wheel of arena handles. Level 0 slots
+// cover EI_SLOT_SEC each, level 1 slots cover a whole level 0 revolution, and
+// anything further out waits in a single 'far' bucket. A record has at most one
+// entry - it's moved when the record's void-time changes, and removed when the
+// record is deleted. Each bucket is an open-addressed hash keyed by handle, so
+// entries can be found given the handle and void-time.
+
+#define EI_N_SLOTS 256
+#define EI_SLOT_SEC 64 // level 0 spans ~4.5 hours, level 1 ~48 days
+
+#define EI_MIN_CAPACITY 8 // must be power of 2
+
+typedef struct ei_ele_s {
+	uint64_t r_h; // 0 (never a record handle) marks an empty cell
+	uint32_t void_time;
+} __attribute__ ((__packed__)) ei_ele;
+
+typedef struct ei_bucket_s {
+	uint32_t n_used;
+	uint32_t capacity; // power of 2, or 0 if nothing allocated
+	ei_ele* eles;
+} ei_bucket;
+
+// Plain array of entries collected for expiring.
+typedef struct ei_list_s {
+	uint32_t n_used;
+	uint32_t capacity;
+	ei_ele* eles;
+} ei_list;
+
+typedef struct as_expire_index_s {
+	cf_mutex lock;
+	uint32_t cur_slot; // absolute level 0 slot, i.e. void-time / EI_SLOT_SEC
+	ei_bucket l0[EI_N_SLOTS];
+	ei_bucket l1[EI_N_SLOTS];
+	ei_bucket far;
+	uint64_t* used_sz; // namespace total, for stats
+} as_expire_index;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static void advance(as_expire_index* ei, uint32_t now, ei_list* due);
+static void cascade(as_expire_index* ei, ei_bucket* b);
+static void insert_ele(as_expire_index* ei, const ei_ele* ele);
+static bool remove_ele(as_expire_index* ei, const ei_ele* ele);
+
+static void bucket_insert(as_expire_index* ei, ei_bucket* b, const ei_ele* ele);
+static bool bucket_remove(as_expire_index* ei, ei_bucket* b, const ei_ele* ele);
+static void bucket_resize(as_expire_index* ei, ei_bucket* b, uint32_t capacity);
+static void bucket_free(as_expire_index* ei, ei_bucket* b);
+
+static void list_append(ei_list* l, const ei_ele* ele);
+static void list_free(ei_list* l);
+
+static inline uint32_t
+ele_hash(uint64_t r_h, uint32_t capacity)
+{
+	return (uint32_t)((r_h * 0x9E3779B97F4A7C15UL) >> 32) & (capacity - 1);
+}
+
+
+//==========================================================
+// Public API.
+//
+
+as_expire_index*
+as_expire_index_create(uint64_t* used_sz)
+{
+	as_expire_index* ei = cf_malloc(sizeof(as_expire_index));
+
+	memset(ei, 0, sizeof(as_expire_index));
+
+	cf_mutex_init(&ei->lock);
+	ei->cur_slot = as_record_void_time_get() / EI_SLOT_SEC;
+	ei->used_sz = used_sz;
+
+	return ei;
+}
+
+void
+as_expire_index_destroy(as_expire_index* ei)
+{
+	if (ei == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < EI_N_SLOTS; i++) {
+		bucket_free(ei, &ei->l0[i]);
+		bucket_free(ei, &ei->l1[i]);
+	}
+
+	bucket_free(ei, &ei->far);
+
+	cf_mutex_destroy(&ei->lock);
+	cf_free(ei);
+}
+
+// Called under the record lock, after void-time is set.
+void
+as_expire_index_insert(as_index_tree* tree, uint64_t r_h, uint32_t void_time)
+{
+	as_expire_index* ei = tree->expire_index;
+	ei_ele ele = { .r_h = r_h, .void_time = void_time };
+
+	cf_mutex_lock(&ei->lock);
+	insert_ele(ei, &ele);
+	cf_mutex_unlock(&ei->lock);
+}
+
+// Called under the record lock, with the void-time the entry was inserted
+// with. Entries being expired are out of the wheel - not finding one is fine.
+void
+as_expire_index_remove(as_index_tree* tree, uint64_t r_h, uint32_t void_time)
+{
+	as_expire_index* ei = tree->expire_index;
+	ei_ele ele = { .r_h = r_h, .void_time = void_time };
+
+	cf_mutex_lock(&ei->lock);
+	remove_ele(ei, &ele);
+	cf_mutex_unlock(&ei->lock);
+}
+
+// Makes callbacks (with record locked) for records whose void-time is before
+// the current level 0 slot. Callback MUST call as_record_done() to unlock
+// record.
+void
+as_expire_index_reduce(as_namespace* ns, as_index_tree* tree, uint32_t now,
+		as_index_reduce_fn cb, void* udata)
+{
+	as_expire_index* ei = tree->expire_index;
+	ei_list due = { 0 };
+
+	cf_mutex_lock(&ei->lock);
+	advance(ei, now, &due);
+	cf_mutex_unlock(&ei->lock);
+
+	bool do_more = true;
+
+	for (uint32_t i = 0; i < due.n_used; i++) {
+		ei_ele* ele = &due.eles[i];
+		as_index* r = cf_arenax_resolve(tree->shared->arena, ele->r_h);
+
+		// Writes racing with collection may have left a stale entry here, and
+		// the element may since have been freed or reused - the lookup
+		// validates.
+		cf_digest keyd = r->keyd;
+		as_index_ref r_ref;
+
+		if (as_record_get_live(tree, &keyd, &r_ref, ns) != 0) {
+			continue;
+		}
+
+		// Any other void-time was inserted separately by its update.
+		if (r_ref.r_h != ele->r_h || r_ref.r->void_time != ele->void_time) {
+			as_record_done(&r_ref, ns);
+			continue;
+		}
+
+		if (! do_more) {
+			// Put it back - the record lock keeps this in step with writes.
+			cf_mutex_lock(&ei->lock);
+			insert_ele(ei, ele);
+			cf_mutex_unlock(&ei->lock);
+
+			as_record_done(&r_ref, ns);
+			continue;
+		}
+
+		do_more = cb(&r_ref, udata);
+	}
+
+	list_free(&due);
+}
+
+
+//==========================================================
+// Local helpers - timer wheel.
+//
+
+// Collects every level 0 slot before the one now is in, cascading the higher
+// levels down as level 0 wraps. Everything collected is due - the current
+// slot waits for the next reduce.
+static void
+advance(as_expire_index* ei, uint32_t now, ei_list* due)
+{
+	uint32_t target_slot = now / EI_SLOT_SEC;
+
+	while (ei->cur_slot < target_slot) {
+		ei_bucket* b = &ei->l0[ei->cur_slot % EI_N_SLOTS];
+
+		for (uint32_t i = 0; i < b->capacity; i++) {
+			if (b->eles[i].r_h != 0) {
+				list_append(due, &b->eles[i]);
+			}
+		}
+
+		bucket_free(ei, b);
+
+		ei->cur_slot++;
+
+		if (ei->cur_slot % EI_N_SLOTS == 0) {
+			uint32_t cur_l1_slot = ei->cur_slot / EI_N_SLOTS;
+
+			if (cur_l1_slot % EI_N_SLOTS == 0) {
+				cascade(ei, &ei->far);
+			}
+
+			cascade(ei, &ei->l1[cur_l1_slot % EI_N_SLOTS]);
+		}
+	}
+}
+
+static void
+cascade(as_expire_index* ei, ei_bucket* b)
+{
+	ei_bucket moving = *b;
+
+	memset(b, 0, sizeof(ei_bucket));
+
+	for (uint32_t i = 0; i < moving.capacity; i++) {
+		if (moving.eles[i].r_h != 0) {
+			insert_ele(ei, &moving.eles[i]);
+		}
+	}
+
+	bucket_free(ei, &moving);
+}
+
+static void
+insert_ele(as_expire_index* ei, const ei_ele* ele)
+{
+	uint32_t slot = ele->void_time / EI_SLOT_SEC;
+
+	// Already due - put in current slot, which the next reduce collects.
+	if (slot < ei->cur_slot) {
+		slot = ei->cur_slot;
+	}
+
+	if (slot < ei->cur_slot + EI_N_SLOTS) {
+		bucket_insert(ei, &ei->l0[slot % EI_N_SLOTS], ele);
+		return;
+	}
+
+	uint32_t l1_slot = slot / EI_N_SLOTS;
+
+	if (l1_slot < ei->cur_slot / EI_N_SLOTS + EI_N_SLOTS) {
+		bucket_insert(ei, &ei->l1[l1_slot % EI_N_SLOTS], ele);
+		return;
+	}
+
+	bucket_insert(ei, &ei->far, ele);
+}
+
+// An entry is in the level 0 slot insert_ele() would now pick, or it's still
+// waiting to cascade from level 1 or the far bucket.
+static bool
+remove_ele(as_expire_index* ei, const ei_ele* ele)
+{
+	uint32_t slot = ele->void_time / EI_SLOT_SEC;
+
+	if (slot < ei->cur_slot) {
+		slot = ei->cur_slot;
+	}
+
+	if (slot < ei->cur_slot + EI_N_SLOTS &&
+			bucket_remove(ei, &ei->l0[slot % EI_N_SLOTS], ele)) {
+		return true;
+	}
+
+	uint32_t l1_slot = slot / EI_N_SLOTS;
+	uint32_t cur_l1_slot = ei->cur_slot / EI_N_SLOTS;
+
+	// The current level 1 slot has already cascaded.
+	if (l1_slot > cur_l1_slot && l1_slot < cur_l1_slot + EI_N_SLOTS &&
+			bucket_remove(ei, &ei->l1[l1_slot % EI_N_SLOTS], ele)) {
+		return true;
+	}
+
+	return bucket_remove(ei, &ei->far, ele);
+}
+
+
+//==========================================================
+// Local helpers - buckets.
+//
+
+static void
+bucket_insert(as_expire_index* ei, ei_bucket* b, const ei_ele* ele)
+{
+	// Keep load factor at most 3/4.
+	if ((b->n_used + 1) * 4 > b->capacity * 3) {
+		bucket_resize(ei, b, b->capacity == 0 ?
+				EI_MIN_CAPACITY : b->capacity * 2);
+	}
+
+	uint32_t mask = b->capacity - 1;
+	uint32_t i = ele_hash(ele->r_h, b->capacity);
+
+	while (b->eles[i].r_h != 0) {
+		if (b->eles[i].r_h == ele->r_h) {
+			b->eles[i].void_time = ele->void_time;
+			return;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	b->eles[i] = *ele;
+	b->n_used++;
+}
+
+static bool
+bucket_remove(as_expire_index* ei, ei_bucket* b, const ei_ele* ele)
+{
+	if (b->n_used == 0) {
+		return false;
+	}
+
+	uint32_t mask = b->capacity - 1;
+	uint32_t i = ele_hash(ele->r_h, b->capacity);
+
+	while (b->eles[i].r_h != ele->r_h) {
+		if (b->eles[i].r_h == 0) {
+			return false;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	if (b->eles[i].void_time != ele->void_time) {
+		return false;
+	}
+
+	b->n_used--;
+
+	if (b->n_used == 0) {
+		bucket_free(ei, b);
+		return true;
+	}
+
+	// Backward-shift deletion - no tombstones, so probes stay short.
+	uint32_t j = i;
+
+	while (true) {
+		j = (j + 1) & mask;
+
+		if (b->eles[j].r_h == 0) {
+			break;
+		}
+
+		uint32_t home = ele_hash(b->eles[j].r_h, b->capacity);
+
+		// Move j into the hole at i unless its home lies cyclically in (i, j].
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			b->eles[i] = b->eles[j];
+			i = j;
+		}
+	}
+
+	b->eles[i].r_h = 0;
+
+	if (b->capacity > EI_MIN_CAPACITY && b->n_used * 8 < b->capacity) {
+		bucket_resize(ei, b, b->capacity / 2);
+	}
+
+	return true;
+}
+
+static void
+bucket_resize(as_expire_index* ei, ei_bucket* b, uint32_t capacity)
+{
+	ei_bucket old = *b;
+
+	b->n_used = 0;
+	b->capacity = capacity;
+	b->eles = cf_calloc(capacity, sizeof(ei_ele));
+
+	as_add_uint64(ei->used_sz, (int64_t)capacity * (int64_t)sizeof(ei_ele));
+
+	for (uint32_t i = 0; i < old.capacity; i++) {
+		if (old.eles[i].r_h != 0) {
+			bucket_insert(ei, b, &old.eles[i]);
+		}
+	}
+
+	bucket_free(ei, &old);
+}
+
+static void
+bucket_free(as_expire_index* ei, ei_bucket* b)
+{
+	if (b->eles != NULL) {
+		as_add_uint64(ei->used_sz,
+				-((int64_t)b->capacity * (int64_t)sizeof(ei_ele)));
+		cf_free(b->eles);
+	}
+
+	memset(b, 0, sizeof(ei_bucket));
+}
+
+
+//==========================================================
+// Local helpers - lists.
+//
+
+static void
+list_append(ei_list* l, const ei_ele* ele)
+{
+	if (l->n_used == l->capacity) {
+		l->capacity = l->capacity == 0 ? EI_MIN_CAPACITY : l->capacity * 2;
+		l->eles = cf_realloc(l->eles, l->capacity * sizeof(ei_ele));
+	}
+
+	l->eles[l->n_used++] = *ele;
+}
+
+static void
+list_free(ei_list* l)
+{
+	if (l->eles != NULL) {
+		cf_free(l->eles);
+	}
+
+	memset(l, 0, sizeof(ei_list));
+}
@@ -40,10 +40,12 @@
 #include "arenax.h"
 #include "cf_mutex.h"
 #include "cf_thread.h"
+#include "hardware.h"
 #include "log.h"
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/expire_index.h"
 #include "base/set_index.h"
 #include "base/stats.h"
 #include "sindex/gc.h"
@@ -76,8 +78,9 @@ static void* run_index_tree_gc(void* unused);
 static void as_index_tree_destroy(as_index_tree* tree);
 
 static bool as_index_sprig_reduce(as_index_sprig* isprig, const cf_digest* keyd, as_index_reduce_fn cb, void* udata);
-static void as_index_sprig_traverse(as_index_sprig* isprig, const cf_digest* keyd, cf_arenax_handle r_h, as_index_ph_array* ph_a);
+static bool as_index_sprig_traverse(as_index_sprig* isprig, const cf_digest* keyd, cf_arenax_handle r_h, as_index_ph_array* ph_a);
 static void as_index_sprig_traverse_purge(as_index_sprig* isprig, cf_arenax_handle r_h);
+static void as_index_sprig_traverse_visit(as_index_sprig* isprig, cf_arenax_handle r_h, as_index_visit_fn cb, void* udata);
 
 static int as_index_sprig_get_insert_vlock(as_index_sprig* isprig, uint8_t tree_id, const cf_digest* keyd, as_index_ref* index_ref);
 
@@ -87,19 +90,14 @@ static void as_index_sprig_delete_rebalance(as_index_sprig* isprig, as_index* ro
 static void as_index_rotate_left(as_index_ele* a, as_index_ele* b);
 static void as_index_rotate_right(as_index_ele* a, as_index_ele* b);
 
-static inline void
-as_index_sprig_from_i(as_index_tree* tree, as_index_sprig* isprig,
-		uint32_t sprig_i)
+static inline size_t
+tree_size(as_index_tree_shared* shared)
 {
-	uint32_t lock_i = sprig_i >>
-			(tree->shared->locks_shift - tree->shared->sprigs_shift);
-
-	isprig->destructor = tree->shared->destructor;
-	isprig->destructor_udata = tree->shared->destructor_udata;
-	isprig->arena = tree->shared->arena;
-	isprig->pair = tree_locks(tree) + lock_i;
-	isprig->sprig = tree_sprigs(tree) + sprig_i;
-	isprig->puddle = tree_puddle_for_sprig(tree, sprig_i);
+	size_t locks_size = sizeof(cf_mutex) * NUM_LOCK_PAIRS * 2;
+	size_t sprigs_size = sizeof(as_sprig) * shared->n_sprigs;
+
+	return sizeof(as_index_tree) + locks_size + sprigs_size +
+			tree_puddles_size(shared);
 }
 
 
@@ -136,14 +134,10 @@ as_index_tree*
 as_index_tree_create(as_index_tree_shared* shared, uint8_t id,
 		as_index_tree_done_fn cb, void* udata)
 {
-	size_t locks_size = sizeof(cf_mutex) * NUM_LOCK_PAIRS * 2;
 	size_t sprigs_size = sizeof(as_sprig) * shared->n_sprigs;
 	size_t puddles_size = tree_puddles_size(shared);
 
-	size_t tree_size = sizeof(as_index_tree) +
-			locks_size + sprigs_size + puddles_size;
-
-	as_index_tree* tree = cf_rc_alloc(tree_size);
+	as_index_tree* tree = cf_rc_alloc(tree_size(shared));
 
 	tree->id = id;
 	tree->done_cb = cb;
@@ -155,6 +149,9 @@ as_index_tree_create(as_index_tree_shared* shared, uint8_t id,
 	cf_mutex_init(&tree->set_trees_lock);
 	memset(tree->set_trees, 0, sizeof(tree->set_trees));
 
+	tree->expire_index = shared->expire_index ?
+			as_expire_index_create(shared->expire_index_used_sz) : NULL;
+
 	as_lock_pair* pair = tree_locks(tree);
 	as_lock_pair* pair_end = pair + NUM_LOCK_PAIRS;
 
@@ -171,6 +168,15 @@ as_index_tree_create(as_index_tree_shared* shared, uint8_t id,
 	return tree;
 }
 
+// Prefer the specified NUMA node for the tree's locks, sprigs and puddles. Only
+// whole pages are bound, so this is effective for trees with many sprigs.
+void
+as_index_tree_bind_numa(as_index_tree* tree,
+		cf_topo_numa_node_index i_numa_node)
+{
+	cf_topo_bind_memory(tree, tree_size(tree->shared), i_numa_node);
+}
+
 // On shutdown, lock all record locks.
 void
 as_index_tree_block(as_index_tree* tree)
@@ -209,6 +215,7 @@ as_index_tree_release(as_namespace* ns, as_index_tree* tree)
 	}
 
 	as_set_index_destroy_all(tree);
+	as_expire_index_destroy(tree->expire_index);
 
 	// TODO - call as_index_tree_destroy() directly if tree is empty?
 
@@ -275,6 +282,26 @@ as_index_reduce_from(as_index_tree* tree, const cf_digest* keyd,
 	return true;
 }
 
+// Visit every element without taking record or reduce locks. Only for trees
+// nothing else can touch - at startup before transactions are allowed, or at
+// shutdown once the tree is blocked.
+void
+as_index_visit_quiesced(as_index_tree* tree, as_index_visit_fn cb,
+		void* udata)
+{
+	if (tree == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < tree->shared->n_sprigs; i++) {
+		as_index_sprig isprig;
+		as_index_sprig_from_i(tree, &isprig, i);
+
+		as_index_sprig_traverse_visit(&isprig, isprig.sprig->root_h, cb,
+				udata);
+	}
+}
+
 
 //==========================================================
 // Public API - get/insert/delete an element in a tree.
@@ -341,6 +368,16 @@ as_index_delete(as_index_tree* tree, const cf_digest* keyd)
 	as_index_sprig isprig;
 	as_index_sprig_from_keyd(tree, &isprig, keyd);
 
+	if (tree->expire_index != NULL) {
+		as_index* r;
+		cf_arenax_handle r_h;
+
+		if (as_index_sprig_search_lockless(&isprig, keyd, &r, &r_h) == 0 &&
+				r->void_time != 0) {
+			as_expire_index_remove(tree, r_h, r->void_time);
+		}
+	}
+
 	if (as_index_sprig_delete(&isprig, keyd) == 0) {
 		as_decr_uint64(&tree->n_elements);
 	}
@@ -396,102 +433,123 @@ as_index_tree_destroy(as_index_tree* tree)
 //
 
 // Make a callback for a specified number of elements in the tree, from outside
-// the tree lock.
+// the tree lock. Elements are collected in bounded batches - the reduce lock is
+// dropped between batches, and traversal resumes from the last digest seen.
 static bool
 as_index_sprig_reduce(as_index_sprig* isprig, const cf_digest* keyd,
 		as_index_reduce_fn cb, void* udata)
 {
-	cf_mutex_lock(&isprig->pair->reduce_lock);
+	as_index_ph phs[MAX_REDUCE_PHS];
+	cf_digest resume_keyd;
+
+	while (true) {
+		cf_mutex_lock(&isprig->pair->reduce_lock);
+
+		// Common to encounter empty sprigs.
+		if (isprig->sprig->root_h == SENTINEL_H) {
+			cf_mutex_unlock(&isprig->pair->reduce_lock);
+			return true;
+		}
+
+		as_index_ph_array ph_a = {
+				.is_stack = true,
+				.capacity = MAX_REDUCE_PHS,
+				.phs = phs
+		};
+
+		// Traverse just fills array, then we make callbacks outside reduce lock.
+		bool done = as_index_sprig_traverse(isprig, keyd,
+				isprig->sprig->root_h, &ph_a);
 
-	// Common to encounter empty sprigs.
-	if (isprig->sprig->root_h == SENTINEL_H) {
 		cf_mutex_unlock(&isprig->pair->reduce_lock);
-		return true;
-	}
 
-	as_index_ph stack_phs[MAX_STACK_PHS];
-	as_index_ph_array ph_a = {
-			.is_stack = true,
-			.capacity = MAX_STACK_PHS,
-			.phs = stack_phs
-	};
+		if (ph_a.n_used == 0) {
+			return true;
+		}
 
-	// Traverse just fills array, then we make callbacks outside reduce lock.
-	as_index_sprig_traverse(isprig, keyd, isprig->sprig->root_h, &ph_a);
+		// Copy now - the element may be freed once released below.
+		resume_keyd = ph_a.phs[ph_a.n_used - 1].r->keyd;
 
-	cf_mutex_unlock(&isprig->pair->reduce_lock);
+		bool do_more = true;
 
-	bool do_more = true;
+		for (uint32_t i = 0; i < ph_a.n_used; i++) {
+			as_index_ph* ph = &ph_a.phs[i];
+			as_index_ref r_ref = {
+					.r = ph->r,
+					.r_h = ph->r_h,
+					.olock = &isprig->pair->lock
+			};
 
-	for (uint32_t i = 0; i < ph_a.n_used; i++) {
-		as_index_ph* ph = &ph_a.phs[i];
-		as_index_ref r_ref = {
-				.r = ph->r,
-				.r_h = ph->r_h,
-				.olock = &isprig->pair->lock
-		};
+			cf_mutex_lock(r_ref.olock);
 
-		cf_mutex_lock(r_ref.olock);
+			uint16_t rc = as_index_release(r_ref.r);
 
-		uint16_t rc = as_index_release(r_ref.r);
+			// Ignore this record if it's been deleted.
+			if (! as_index_is_valid_record(r_ref.r)) {
+				as_namespace* ns = isprig->destructor_udata;
 
-		// Ignore this record if it's been deleted.
-		if (! as_index_is_valid_record(r_ref.r)) {
-			as_namespace* ns = isprig->destructor_udata;
+				if (rc == 0) {
+					if (isprig->destructor != NULL) {
+						isprig->destructor(r_ref.r, ns);
+					}
 
-			if (rc == 0) {
-				if (isprig->destructor != NULL) {
-					isprig->destructor(r_ref.r, ns);
+					cf_arenax_free(isprig->arena, r_ref.r_h, NULL);
+				}
+				else if (r_ref.r->in_sindex == 1 && rc == 1) {
+					as_sindex_gc_record(ns, &r_ref);
 				}
 
-				cf_arenax_free(isprig->arena, r_ref.r_h, NULL);
-			}
-			else if (r_ref.r->in_sindex == 1 && rc == 1) {
-				as_sindex_gc_record(ns, &r_ref);
+				cf_mutex_unlock(r_ref.olock);
+				continue;
 			}
 
-			cf_mutex_unlock(r_ref.olock);
-			continue;
+			if (do_more) {
+				// Callback MUST call as_record_done() to unlock record.
+				do_more = cb(&r_ref, udata);
+			}
+			else {
+				cf_mutex_unlock(r_ref.olock);
+			}
 		}
 
-		if (do_more) {
-			// Callback MUST call as_record_done() to unlock record.
-			do_more = cb(&r_ref, udata);
+		if (! do_more) {
+			return false;
 		}
-		else {
-			cf_mutex_unlock(r_ref.olock);
+
+		if (done) {
+			return true;
 		}
-	}
 
-	if (! ph_a.is_stack) {
-		cf_free(ph_a.phs);
+		// Resume below the last digest collected - the sprig may have changed.
+		keyd = &resume_keyd;
 	}
-
-	return do_more;
 }
 
-static void
+// Returns false if the array filled before the traversal completed.
+static bool
 as_index_sprig_traverse(as_index_sprig* isprig, const cf_digest* keyd,
 		cf_arenax_handle r_h, as_index_ph_array* ph_a)
 {
 	if (r_h == SENTINEL_H) {
-		return;
+		return true;
 	}
 
 	as_index* r = RESOLVE(r_h);
 	int cmp = 0; // initialized to satisfy compiler
 
 	if (keyd == NULL || (cmp = cf_digest_compare(&r->keyd, keyd)) < 0) {
-		as_index_sprig_traverse(isprig, keyd, r->left_h, ph_a);
-	}
-
-	if (ph_a->n_used == ph_a->capacity) {
-		as_index_grow_ph_array(ph_a);
+		if (! as_index_sprig_traverse(isprig, keyd, r->left_h, ph_a)) {
+			return false;
+		}
 	}
 
 	// We do not collect the element with the boundary digest.
 
 	if (keyd == NULL || cmp < 0) {
+		if (ph_a->n_used == ph_a->capacity) {
+			return false;
+		}
+
 		as_index_reserve(r);
 
 		as_index_ph* ph = &ph_a->phs[ph_a->n_used++];
@@ -502,7 +560,7 @@ as_index_sprig_traverse(as_index_sprig* isprig, const cf_digest* keyd,
 		keyd = NULL;
 	}
 
-	as_index_sprig_traverse(isprig, keyd, r->right_h, ph_a);
+	return as_index_sprig_traverse(isprig, keyd, r->right_h, ph_a);
 }
 
 // Used also by set indexes, not a local helper.
@@ -550,6 +608,25 @@ as_index_sprig_traverse_purge(as_index_sprig* isprig, cf_arenax_handle r_h)
 	cf_arenax_free(isprig->arena, r_h, isprig->puddle);
 }
 
+static void
+as_index_sprig_traverse_visit(as_index_sprig* isprig, cf_arenax_handle r_h,
+		as_index_visit_fn cb, void* udata)
+{
+	if (r_h == SENTINEL_H) {
+		return;
+	}
+
+	as_index* r = RESOLVE(r_h);
+
+	as_index_sprig_traverse_visit(isprig, r->left_h, cb, udata);
+
+	if (as_index_is_valid_record(r)) {
+		cb(r, r_h, udata);
+	}
+
+	as_index_sprig_traverse_visit(isprig, r->right_h, cb, udata);
+}
+
 
 //==========================================================
 // Local helpers - get/insert/delete an element in a sprig.
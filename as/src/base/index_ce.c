@@ -31,11 +31,37 @@
 
 #include "citrusleaf/cf_digest.h"
 
+#include "arenax.h"
+#include "cf_mutex.h"
 #include "log.h"
 
 #include "base/datamodel.h"
 
 
+//==========================================================
+// Typedefs & constants.
+//
+
+// Live reduce collects digests along with handles, instead of reserving the
+// elements - the digest is used to validate the element once under its lock.
+typedef struct live_ph_s {
+	cf_digest keyd;
+	cf_arenax_handle r_h;
+} live_ph;
+
+typedef struct live_ph_array_s {
+	uint32_t n_used;
+	live_ph phs[MAX_REDUCE_PHS];
+} live_ph_array;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool live_sprig_traverse(as_index_sprig* isprig, const cf_digest* keyd, cf_arenax_handle r_h, live_ph_array* ph_a);
+
+
 //==========================================================
 // Public API.
 //
@@ -48,17 +74,54 @@ as_index_tree_resume(as_index_tree_shared* shared, as_treex* xmem_trees,
 	return NULL;
 }
 
+// Like as_index_reduce(), but doesn't reserve elements - meant for reducing
+// callbacks that don't need a stable reference outside the record lock.
 bool
 as_index_reduce_live(as_index_tree* tree, as_index_reduce_fn cb, void* udata)
 {
-	return as_index_reduce(tree, cb, udata);
+	return as_index_reduce_from_live(tree, NULL, cb, udata);
 }
 
 bool
 as_index_reduce_from_live(as_index_tree* tree, const cf_digest* keyd,
 		as_index_reduce_fn cb, void* udata)
 {
-	return as_index_reduce_from(tree, keyd, cb, udata);
+	return as_index_reduce_sprigs_live(tree, keyd, NULL, cb, udata);
+}
+
+// Like as_index_reduce_from_live(), but only reduces sprigs for which sprig_cb
+// (if not NULL) returns true - lets sampling skip most of the tree.
+bool
+as_index_reduce_sprigs_live(as_index_tree* tree, const cf_digest* keyd,
+		as_index_sprig_fn sprig_cb, as_index_reduce_fn cb, void* udata)
+{
+	if (tree == NULL) {
+		return true;
+	}
+
+	// Reduce sprigs from largest to smallest digests, as as_index_reduce_from()
+	// does.
+
+	uint32_t start_sprig_i = keyd == NULL ?
+			tree->shared->n_sprigs - 1 : as_index_sprig_i_from_keyd(tree, keyd);
+
+	for (int i = (int)start_sprig_i; i >= 0; i--) {
+		if (sprig_cb != NULL && ! sprig_cb((uint32_t)i, udata)) {
+			keyd = NULL;
+			continue;
+		}
+
+		as_index_sprig isprig;
+		as_index_sprig_from_i(tree, &isprig, (uint32_t)i);
+
+		if (! as_index_sprig_reduce_no_rc(&isprig, keyd, cb, udata)) {
+			return false;
+		}
+
+		keyd = NULL; // only need boundary digest for first sprig
+	}
+
+	return true;
 }
 
 
@@ -70,6 +133,102 @@ bool
 as_index_sprig_reduce_no_rc(as_index_sprig* isprig, const cf_digest* keyd,
 		as_index_reduce_fn cb, void* udata)
 {
-	cf_crash(AS_INDEX, "CE code called as_index_sprig_reduce_no_rc()");
-	return false;
+	live_ph_array ph_a;
+	cf_digest resume_keyd;
+
+	while (true) {
+		cf_mutex_lock(&isprig->pair->reduce_lock);
+
+		// Common to encounter empty sprigs.
+		if (isprig->sprig->root_h == SENTINEL_H) {
+			cf_mutex_unlock(&isprig->pair->reduce_lock);
+			return true;
+		}
+
+		ph_a.n_used = 0;
+
+		bool done = live_sprig_traverse(isprig, keyd, isprig->sprig->root_h,
+				&ph_a);
+
+		cf_mutex_unlock(&isprig->pair->reduce_lock);
+
+		if (ph_a.n_used == 0) {
+			return true;
+		}
+
+		for (uint32_t i = 0; i < ph_a.n_used; i++) {
+			live_ph* ph = &ph_a.phs[i];
+			as_index_ref r_ref = {
+					.r = RESOLVE(ph->r_h),
+					.r_h = ph->r_h,
+					.puddle = isprig->puddle,
+					.olock = &isprig->pair->lock
+			};
+
+			cf_mutex_lock(r_ref.olock);
+
+			// Without a reservation, the element may have been deleted, freed,
+			// and even reused since we collected it. Freeing leaves the digest
+			// but not the generation intact, so these checks suffice.
+			if (! as_index_is_valid_record(r_ref.r) ||
+					cf_digest_compare(&r_ref.r->keyd, &ph->keyd) != 0) {
+				cf_mutex_unlock(r_ref.olock);
+				continue;
+			}
+
+			// Callback MUST call as_record_done() to unlock record.
+			if (! cb(&r_ref, udata)) {
+				return false;
+			}
+		}
+
+		if (done) {
+			return true;
+		}
+
+		// Resume below the last digest collected - the sprig may have changed.
+		resume_keyd = ph_a.phs[ph_a.n_used - 1].keyd;
+		keyd = &resume_keyd;
+	}
+}
+
+
+//==========================================================
+// Local helpers.
+//
+
+// Returns false if the array filled before the traversal completed.
+static bool
+live_sprig_traverse(as_index_sprig* isprig, const cf_digest* keyd,
+		cf_arenax_handle r_h, live_ph_array* ph_a)
+{
+	if (r_h == SENTINEL_H) {
+		return true;
+	}
+
+	as_index* r = RESOLVE(r_h);
+	int cmp = 0; // initialized to satisfy compiler
+
+	if (keyd == NULL || (cmp = cf_digest_compare(&r->keyd, keyd)) < 0) {
+		if (! live_sprig_traverse(isprig, keyd, r->left_h, ph_a)) {
+			return false;
+		}
+	}
+
+	// We do not collect the element with the boundary digest.
+
+	if (keyd == NULL || cmp < 0) {
+		if (ph_a->n_used == MAX_REDUCE_PHS) {
+			return false;
+		}
+
+		live_ph* ph = &ph_a->phs[ph_a->n_used++];
+
+		ph->keyd = r->keyd;
+		ph->r_h = r_h;
+
+		keyd = NULL;
+	}
+
+	return live_sprig_traverse(isprig, keyd, r->right_h, ph_a);
 }
@@ -98,6 +98,7 @@ as_mon_register(const char *module)
 		cb->get_jobstat     = as_query_get_jobstat;
 		cb->get_jobstat_all = as_query_get_jobstat_all;
 		cb->kill            = as_query_abort;
+		cb->set_priority    = as_query_set_priority;
 
 		mod = QUERY_MOD;
 	}
@@ -159,6 +160,50 @@ as_mon_killjob(const char *module, uint64_t id, cf_dyn_buf *db)
 	return retval;
 }
 
+/*
+ * Calls the callback function to set the scheduling priority of a job.
+ *
+ * Returns
+ * 		AS_MON_OK - On success.
+ * 		AS_MON_ERR - on failure.
+ *
+ */
+int
+as_mon_set_priority(const char *module, uint64_t id, uint32_t priority,
+		cf_dyn_buf *db)
+{
+	int retval = AS_MON_ERR;
+	as_mon * mon_object = as_mon_get_module(module);
+
+	if (!mon_object) {
+		cf_warning(AS_MON, "Failed to find module %s", module);
+		cf_dyn_buf_append_string(db, "ERROR:");
+		cf_dyn_buf_append_int(db, AS_ERR_NOT_FOUND);
+		cf_dyn_buf_append_string(db, ":module \"");
+		cf_dyn_buf_append_string(db, module);
+		cf_dyn_buf_append_string(db, "\" not found");
+		return retval;
+	}
+
+	if (mon_object->cb.set_priority) {
+		retval = mon_object->cb.set_priority(id, priority) ?
+				AS_MON_OK : AS_MON_ERR;
+
+		if (retval == AS_MON_OK) {
+			cf_dyn_buf_append_string(db, "OK");
+		}
+		else {
+			cf_dyn_buf_append_string(db, "ERROR:");
+			cf_dyn_buf_append_int(db, AS_ERR_NOT_FOUND);
+			cf_dyn_buf_append_string(db, ":bad priority or job not active");
+		}
+	}
+	else {
+		cf_dyn_buf_append_string(db, "OK"); // for backward compatibility
+	}
+	return retval;
+}
+
 /*
  * Calls the callback function to populate the stat of a particular job.
  *
@@ -202,6 +247,11 @@ as_mon_populate_jobstat(as_mon_jobstat * job_stat, cf_dyn_buf *db)
 	cf_dyn_buf_append_string(db, ":active-threads=");
 	cf_dyn_buf_append_uint32(db, job_stat->active_threads);
 
+	if (job_stat->weight != 0) {
+		cf_dyn_buf_append_string(db, ":weight=");
+		cf_dyn_buf_append_uint32(db, job_stat->weight);
+	}
+
 	if (job_stat->status[0]) {
 		cf_dyn_buf_append_string(db, ":status=");
 		cf_dyn_buf_append_string(db, job_stat->status);
@@ -400,7 +450,7 @@ as_mon_info_cmd(const char *module, char *cmd, uint64_t trid, uint32_t value, cf
 		as_mon_killjob(module, trid, db);
 	}
 	else if (!strcmp(cmd, "set-priority")) {
-		cf_dyn_buf_append_string(db, "OK"); // for backward compatibility
+		as_mon_set_priority(module, trid, value, db);
 	}
 	else {
 		cf_dyn_buf_append_string(db, "ERROR:");
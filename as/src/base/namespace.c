@@ -113,6 +113,7 @@ as_namespace_create(char *name)
 	ns->read_consistency_level = AS_READ_CONSISTENCY_LEVEL_PROTO;
 	ns->cfg_replication_factor = 2;
 	ns->replication_factor = 0; // gets set on rebalance
+	ns->sindex_pi_scan_pct = 30; // scan if query range matches >= 30% of records
 	ns->sindex_stage_size = 1024L * 1024L * 1024L; // 1G
 	ns->n_single_query_threads = 4; // maximum number of threads a single query may run
 	ns->stop_writes_pct = 90; // stop writes when 90% of either memory or disk is used
@@ -47,6 +47,7 @@
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/expire_index.h"
 #include "base/index.h"
 #include "base/set_index.h"
 #include "base/smd.h"
@@ -121,6 +122,13 @@ typedef struct prep_evict_per_thread_info_s {
 #define EVAL_WRITE_STATE_FREQUENCY 1024
 #define COLD_START_HIST_MIN_BUCKETS 100000 // histogram memory is transient
 
+// Online eviction histogram - a ring of absolute void-time buckets, which must
+// span well beyond MAX_ALLOWED_TTL so future void-times never alias past ones.
+#define ONLINE_HIST_SHIFT 10 // 1024 second buckets
+#define ONLINE_HIST_WIDTH (1U << ONLINE_HIST_SHIFT)
+#define ONLINE_HIST_N_BUCKETS (1U << 19) // ~17 years
+#define ONLINE_HIST_SPREAD 16 // points per bucket when loading evict_hist
+
 
 //==========================================================
 // Forward declarations.
@@ -141,6 +149,7 @@ static bool evict_reduce_cb(as_index_ref* r_ref, void* udata);
 
 static bool eval_hwm_breached(as_namespace* ns);
 static uint32_t find_evict_void_time(as_namespace* ns, uint32_t now);
+static void prep_evict_from_online_hist(as_namespace* ns, uint32_t now, uint32_t ttl_range);
 static void* run_prep_evict(void* udata);
 static bool prep_evict_reduce_cb(as_index_ref* r_ref, void* udata);
 
@@ -184,6 +193,16 @@ as_nsup_init(void)
 {
 	as_smd_module_load(AS_SMD_MODULE_EVICT, nsup_smd_accept_cb,
 			nsup_smd_conflict_cb, NULL);
+
+	// Before storage init, so cold start records are counted.
+	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
+		as_namespace* ns = g_config.namespaces[ns_ix];
+
+		if (ns->evict_hist_online) {
+			ns->evict_online_counts = cf_calloc(ONLINE_HIST_N_BUCKETS,
+					sizeof(uint64_t));
+		}
+	}
 }
 
 void
@@ -278,6 +297,37 @@ as_cold_start_evict_if_needed(as_namespace* ns)
 	return result;
 }
 
+// Called when a record gets a void-time, or is added with one. Also keeps the
+// non-expirable count the expiration index can't see.
+void
+as_nsup_online_hist_add(as_namespace* ns, uint32_t void_time)
+{
+	if (void_time == 0) {
+		if (ns->tree_shared.expire_index) {
+			as_incr_uint64(&ns->n_live_non_expirable);
+		}
+	}
+	else if (ns->evict_online_counts != NULL) {
+		as_incr_uint64(&ns->evict_online_counts[
+				(void_time >> ONLINE_HIST_SHIFT) % ONLINE_HIST_N_BUCKETS]);
+	}
+}
+
+// Called when a record loses a void-time, or is removed with one.
+void
+as_nsup_online_hist_remove(as_namespace* ns, uint32_t void_time)
+{
+	if (void_time == 0) {
+		if (ns->tree_shared.expire_index) {
+			as_decr_uint64(&ns->n_live_non_expirable);
+		}
+	}
+	else if (ns->evict_online_counts != NULL) {
+		as_decr_uint64(&ns->evict_online_counts[
+				(void_time >> ONLINE_HIST_SHIFT) % ONLINE_HIST_N_BUCKETS]);
+	}
+}
+
 
 //==========================================================
 // Local helpers - SMD callbacks.
@@ -427,6 +477,12 @@ expire(as_namespace* ns)
 		cf_thread_join(tids[i]);
 	}
 
+	// The expiration index never visits non-expirable records - use the count
+	// kept as records transition.
+	if (ns->tree_shared.expire_index) {
+		overall.n_0_void_time = as_load_uint64(&ns->n_live_non_expirable);
+	}
+
 	update_stats(ns, overall.n_0_void_time, overall.n_expired, 0, start_ms);
 }
 
@@ -449,7 +505,15 @@ run_expire(void* udata)
 
 		per_thread.rsv = &rsv;
 
-		as_index_reduce_live(rsv.tree, expire_reduce_cb, (void*)&per_thread);
+		if (rsv.tree != NULL && rsv.tree->expire_index != NULL) {
+			as_expire_index_reduce(ns, rsv.tree, per_thread.now,
+					expire_reduce_cb, (void*)&per_thread);
+		}
+		else {
+			as_index_reduce_live(rsv.tree, expire_reduce_cb,
+					(void*)&per_thread);
+		}
+
 		as_partition_release(&rsv);
 	}
 
@@ -638,9 +702,11 @@ eval_hwm_breached(as_namespace* ns)
 	}
 
 	uint64_t set_index_sz = as_set_index_used_bytes(ns);
+	uint64_t expire_index_sz = as_load_uint64(&ns->expire_index_sz);
 	uint64_t sindex_sz = as_sindex_used_bytes(ns);
 	uint64_t dim_sz = as_load_uint64(&ns->n_bytes_memory);
-	uint64_t mem_sz = index_mem_sz + set_index_sz + sindex_sz + dim_sz;
+	uint64_t mem_sz = index_mem_sz + set_index_sz + expire_index_sz + sindex_sz +
+			dim_sz;
 	uint64_t mem_hwm = (ns->memory_size * ns->hwm_memory_pct) / 100;
 
 	uint64_t used_disk_sz = 0;
@@ -699,36 +765,44 @@ eval_hwm_breached(as_namespace* ns)
 static uint32_t
 find_evict_void_time(as_namespace* ns, uint32_t now)
 {
-	bool sets_not_evicting[AS_SET_MAX_COUNT + 1] = { false };
-	init_sets_not_evicting(ns, sets_not_evicting);
-
 	uint32_t ttl_range = get_ttl_range(ns, now);
 	uint32_t n_buckets = ns->evict_hist_buckets;
 	linear_hist_reset(ns->evict_hist, now, ttl_range, n_buckets);
 
-	uint32_t n_threads = as_load_uint32(&ns->n_nsup_threads);
-	cf_tid tids[n_threads];
+	// The online histogram doesn't distinguish sets - if any set is protected
+	// from eviction, fall back to scanning.
+	if (ns->evict_online_counts != NULL && ! sets_protected(ns)) {
+		prep_evict_from_online_hist(ns, now, ttl_range);
+	}
+	else {
+		bool sets_not_evicting[AS_SET_MAX_COUNT + 1] = { false };
+		init_sets_not_evicting(ns, sets_not_evicting);
 
-	prep_evict_per_thread_info per_threads[n_threads];
-	uint32_t pid = 0;
+		uint32_t n_threads = as_load_uint32(&ns->n_nsup_threads);
+		cf_tid tids[n_threads];
 
-	for (uint32_t i = 0; i < n_threads; i++) {
-		prep_evict_per_thread_info* per_thread = &per_threads[i];
+		prep_evict_per_thread_info per_threads[n_threads];
+		uint32_t pid = 0;
 
-		per_thread->ns = ns;
-		per_thread->p_pid = &pid;
-		per_thread->sets_not_evicting = (const bool*)sets_not_evicting;
-		per_thread->evict_hist = linear_hist_create("per-thread-hist",
-				LINEAR_HIST_SECONDS, now, ttl_range, n_buckets);
+		for (uint32_t i = 0; i < n_threads; i++) {
+			prep_evict_per_thread_info* per_thread = &per_threads[i];
 
-		tids[i] = cf_thread_create_joinable(run_prep_evict, (void*)per_thread);
-	}
+			per_thread->ns = ns;
+			per_thread->p_pid = &pid;
+			per_thread->sets_not_evicting = (const bool*)sets_not_evicting;
+			per_thread->evict_hist = linear_hist_create("per-thread-hist",
+					LINEAR_HIST_SECONDS, now, ttl_range, n_buckets);
 
-	for (uint32_t i = 0; i < n_threads; i++) {
-		cf_thread_join(tids[i]);
+			tids[i] = cf_thread_create_joinable(run_prep_evict,
+					(void*)per_thread);
+		}
 
-		linear_hist_merge(ns->evict_hist, per_threads[i].evict_hist);
-		linear_hist_destroy(per_threads[i].evict_hist);
+		for (uint32_t i = 0; i < n_threads; i++) {
+			cf_thread_join(tids[i]);
+
+			linear_hist_merge(ns->evict_hist, per_threads[i].evict_hist);
+			linear_hist_destroy(per_threads[i].evict_hist);
+		}
 	}
 
 	linear_hist_threshold threshold;
@@ -767,6 +841,50 @@ find_evict_void_time(as_namespace* ns, uint32_t now)
 	return evict_void_time;
 }
 
+// Loads evict_hist from the online counts - no scan needed. Each online bucket
+// is spread evenly over its span, since evict_hist buckets may be narrower.
+static void
+prep_evict_from_online_hist(as_namespace* ns, uint32_t now,
+		uint32_t ttl_range)
+{
+	uint32_t now_ix = now >> ONLINE_HIST_SHIFT;
+	uint32_t end_ix = (now + ttl_range) >> ONLINE_HIST_SHIFT;
+
+	// The rest of the ring can only hold past void-times not yet expired -
+	// these land in the first evict_hist bucket, as they would when scanning.
+	for (uint32_t ix = end_ix + 1; ix < now_ix + ONLINE_HIST_N_BUCKETS; ix++) {
+		uint64_t count = as_load_uint64(
+				&ns->evict_online_counts[ix % ONLINE_HIST_N_BUCKETS]);
+
+		if (count != 0) {
+			linear_hist_insert_data_points(ns->evict_hist, now, count);
+		}
+	}
+
+	for (uint32_t ix = now_ix; ix <= end_ix; ix++) {
+		uint64_t count = as_load_uint64(
+				&ns->evict_online_counts[ix % ONLINE_HIST_N_BUCKETS]);
+
+		if (count == 0) {
+			continue;
+		}
+
+		uint32_t start = ix << ONLINE_HIST_SHIFT;
+		uint64_t share = count / ONLINE_HIST_SPREAD;
+		uint64_t remainder = count % ONLINE_HIST_SPREAD;
+
+		for (uint32_t i = 0; i < ONLINE_HIST_SPREAD; i++) {
+			uint32_t point = start + (i * ONLINE_HIST_WIDTH / ONLINE_HIST_SPREAD);
+			uint64_t n = share + (i < remainder ? 1 : 0);
+
+			if (n != 0) {
+				linear_hist_insert_data_points(ns->evict_hist,
+						point < now ? now : point, n);
+			}
+		}
+	}
+}
+
 static void*
 run_prep_evict(void* udata)
 {
@@ -863,9 +981,11 @@ eval_stop_writes(as_namespace* ns)
 	uint64_t index_mem_sz = as_namespace_index_persisted(ns) ?
 			0 : (ns->n_tombstones + ns->n_objects) * sizeof(as_index);
 	uint64_t set_index_sz = as_set_index_used_bytes(ns);
+	uint64_t expire_index_sz = as_load_uint64(&ns->expire_index_sz);
 	uint64_t sindex_sz = as_sindex_used_bytes(ns);
 	uint64_t dim_sz = as_load_uint64(&ns->n_bytes_memory);
-	uint64_t mem_sz = index_mem_sz + set_index_sz + sindex_sz + dim_sz;
+	uint64_t mem_sz = index_mem_sz + set_index_sz + expire_index_sz + sindex_sz +
+			dim_sz;
 
 	static const char* reasons[] = {
 			NULL,									// 0x0
@@ -496,6 +496,36 @@ as_hll_op_name(uint32_t op_code, bool is_modify)
 	return name;
 }
 
+// Plain HLL sketches (no minhash bits), as used by native aggregation. The
+// sketch memory is the HLL particle image, so clients can union and count it.
+
+uint32_t
+as_hll_sketch_sz(uint8_t n_index_bits)
+{
+	cf_assert(validate_n_index_bits(n_index_bits), AS_PARTICLE,
+			"bad n-index-bits %u", n_index_bits);
+
+	return hmh_required_sz(n_index_bits, 0);
+}
+
+void
+as_hll_sketch_init(uint8_t* sketch, uint8_t n_index_bits)
+{
+	hmh_init((hll_t*)sketch, n_index_bits, 0);
+}
+
+void
+as_hll_sketch_add(uint8_t* sketch, const uint8_t* buf, uint32_t buf_sz)
+{
+	hmh_add((hll_t*)sketch, buf_sz, buf);
+}
+
+void
+as_hll_sketch_union(uint8_t* to, const uint8_t* from)
+{
+	hmh_union((hll_t*)to, (const hll_t*)from);
+}
+
 
 //==========================================================
 // Local helpers - cleanup.
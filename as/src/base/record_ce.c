@@ -33,7 +33,9 @@
 #include "log.h"
 
 #include "base/datamodel.h"
+#include "base/expire_index.h"
 #include "base/index.h"
+#include "base/nsup.h"
 #include "base/set_index.h"
 #include "storage/storage.h"
 #include "transaction/rw_utils.h"
@@ -104,6 +106,12 @@ as_record_drop_stats(as_record* r, as_namespace* ns)
 {
 	as_namespace_release_set_id(ns, as_index_get_set_id(r));
 
+	// A record created but never committed (e.g. its write failed) was never
+	// added - see as_record_transition_stats().
+	if (r->generation != 0) {
+		as_nsup_online_hist_remove(ns, r->void_time);
+	}
+
 	as_decr_uint64(&ns->n_objects);
 }
 
@@ -111,6 +119,13 @@ void
 as_record_transition_stats(as_record* r, as_namespace* ns,
 		const index_metadata* old)
 {
+	if (r->void_time != old->void_time || old->generation == 0) {
+		if (old->generation != 0) {
+			as_nsup_online_hist_remove(ns, old->void_time);
+		}
+
+		as_nsup_online_hist_add(ns, r->void_time);
+	}
 }
 
 void
@@ -128,6 +143,18 @@ as_record_transition_set_index(as_index_tree* tree, as_index_ref* r_ref,
 	else if (inserted) {
 		as_set_index_insert(ns, tree, as_index_get_set_id(r), r_ref->r_h);
 	}
+
+	// Expiration index entries are found by void-time - move the record's
+	// entry. Deleted records' entries are removed by as_index_delete().
+	if (tree->expire_index != NULL && r->void_time != old->void_time) {
+		if (! inserted && old->void_time != 0) {
+			as_expire_index_remove(tree, r_ref->r_h, old->void_time);
+		}
+
+		if (! is_delete && r->void_time != 0) {
+			as_expire_index_insert(tree, r_ref->r_h, r->void_time);
+		}
+	}
 }
 
 
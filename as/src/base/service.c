@@ -102,6 +102,14 @@ static cf_sockets g_sockets;
 static cf_mutex g_thread_locks[MAX_SERVICE_THREADS];
 static thread_ctx* g_thread_ctxs[MAX_SERVICE_THREADS];
 
+// For partition-numa-homing - CPU indexes grouped by NUMA node.
+static cf_topo_cpu_index g_numa_cpus[CPU_SETSIZE];
+static uint16_t g_numa_cpus_start[CPU_SETSIZE];
+static uint16_t g_n_numa_cpus[CPU_SETSIZE];
+
+static __thread cf_topo_numa_node_index g_thread_numa_node =
+		CF_TOPO_INVALID_INDEX;
+
 static cf_mutex g_reaper_lock = CF_MUTEX_INIT;
 static uint32_t g_n_slots;
 static as_file_handle** g_file_handles;
@@ -114,6 +122,7 @@ static cf_queue g_free_slots;
 
 // Setup.
 static void create_service_thread(uint32_t sid);
+static void init_numa_cpus(void);
 static void add_localhost(cf_serv_cfg* serv_cfg, cf_sock_owner owner);
 
 // Accept client connections.
@@ -125,6 +134,7 @@ static uint32_t select_sid(void);
 static uint32_t select_sid_pinned(cf_topo_cpu_index i_cpu);
 static uint32_t select_sid_adq(cf_topo_napi_id id);
 static uint32_t select_sid_specified(const cf_digest* d, uint32_t max_threads, bool use_pid);
+static uint32_t select_sid_numa(cf_topo_numa_node_index i_numa_node, const cf_digest* d);
 static void schedule_redistribution(void);
 
 // Demarshal requests.
@@ -171,6 +181,10 @@ as_service_init(void)
 		cf_mutex_init(&g_thread_locks[i]);
 	}
 
+	if (g_config.partition_numa_homing) {
+		init_numa_cpus();
+	}
+
 	for (uint32_t i = 0; i < g_config.n_service_threads; i++) {
 		create_service_thread(i);
 	}
@@ -314,6 +328,46 @@ as_service_enqueue_internal_raw(as_transaction* tr, const cf_digest* d,
 	}
 }
 
+// Returns true if the transaction was re-queued to a service thread on the
+// home NUMA node of its partition.
+bool
+as_service_steer_to_numa_home(as_transaction* tr)
+{
+	if (! g_config.partition_numa_homing ||
+			g_thread_numa_node == CF_TOPO_INVALID_INDEX ||
+			(tr->from_flags & FROM_FLAG_NUMA_HOMED) != 0) {
+		return false;
+	}
+
+	cf_topo_numa_node_index i_numa_node =
+			as_partition_numa_home(as_partition_getid(&tr->keyd));
+
+	if (i_numa_node == g_thread_numa_node) {
+		return false;
+	}
+
+	// Steer only once - service threads may be reconfigured meanwhile.
+	tr->from_flags |= FROM_FLAG_NUMA_HOMED;
+
+	while (true) {
+		uint32_t sid = select_sid_numa(i_numa_node, &tr->keyd);
+
+		cf_mutex_lock(&g_thread_locks[sid]);
+
+		thread_ctx* ctx = g_thread_ctxs[sid];
+
+		if (ctx != NULL) {
+			cf_epoll_queue_push(&ctx->trans_q, tr);
+			cf_mutex_unlock(&g_thread_locks[sid]);
+			break;
+		}
+
+		cf_mutex_unlock(&g_thread_locks[sid]);
+	}
+
+	return true;
+}
+
 
 //==========================================================
 // Local helpers - setup.
@@ -345,6 +399,29 @@ create_service_thread(uint32_t sid)
 	cf_mutex_unlock(&g_thread_locks[sid]);
 }
 
+static void
+init_numa_cpus(void)
+{
+	uint16_t n_cpus = cf_topo_count_cpus();
+	uint16_t n_numa_nodes = cf_topo_count_numa_nodes();
+	uint16_t n_placed = 0;
+
+	for (cf_topo_numa_node_index n = 0; n < n_numa_nodes; n++) {
+		g_numa_cpus_start[n] = n_placed;
+
+		for (cf_topo_cpu_index i_cpu = 0; i_cpu < n_cpus; i_cpu++) {
+			if (cf_topo_cpu_numa_node(i_cpu) == n) {
+				g_numa_cpus[n_placed++] = i_cpu;
+			}
+		}
+
+		g_n_numa_cpus[n] = (uint16_t)(n_placed - g_numa_cpus_start[n]);
+
+		cf_assert(g_n_numa_cpus[n] != 0, AS_SERVICE,
+				"no CPUs on NUMA node %hu", n);
+	}
+}
+
 static void
 add_localhost(cf_serv_cfg* serv_cfg, cf_sock_owner owner)
 {
@@ -576,6 +653,25 @@ select_sid_specified(const cf_digest* d, uint32_t max_threads, bool use_pid)
 	return rr++ % max_threads;
 }
 
+// Like select_sid_pinned(), but restricted to CPUs on the specified NUMA node.
+// Uses the digest so a record's transactions share a service thread.
+static uint32_t
+select_sid_numa(cf_topo_numa_node_index i_numa_node, const cf_digest* d)
+{
+	uint32_t n_service_threads = as_load_uint32(&g_config.n_service_threads);
+	uint16_t n_cpus = cf_topo_count_cpus();
+	uint32_t threads_per_cpu = n_service_threads / n_cpus;
+
+	uint32_t rand = *(uint32_t*)&d->digest[DIGEST_RAND_BASE_BYTE];
+	uint16_t n_node_cpus = g_n_numa_cpus[i_numa_node];
+
+	cf_topo_cpu_index i_cpu =
+			g_numa_cpus[g_numa_cpus_start[i_numa_node] + (rand % n_node_cpus)];
+	uint32_t thread_ix = (rand / n_node_cpus) % threads_per_cpu;
+
+	return (thread_ix * n_cpus) + i_cpu;
+}
+
 static void
 schedule_redistribution(void)
 {
@@ -609,6 +705,10 @@ run_service(void* udata)
 
 	if (as_config_is_cpu_pinned()) {
 		cf_topo_pin_to_cpu(ctx->i_cpu);
+
+		if (g_config.partition_numa_homing) {
+			g_thread_numa_node = cf_topo_cpu_numa_node(ctx->i_cpu);
+		}
 	}
 
 	cf_poll poll = ctx->poll;
@@ -29,6 +29,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "aerospike/as_atomic.h"
 #include "citrusleaf/alloc.h"
@@ -76,6 +78,9 @@ typedef struct populate_cb_info_s {
 
 #define N_POPULATE_THREADS 4
 
+// Each ordered bitmap batch scans the whole bitmap, so batches are big.
+#define MAX_ORDERED_PHS MAX_STACK_PHS
+
 //--------------------------------------
 // uarena constants.
 //
@@ -84,6 +89,23 @@ typedef struct populate_cb_info_s {
 #define STAGE_CAPACITY (1 << ELE_ID_N_BITS) // 256
 #define STAGE_SIZE (STAGE_CAPACITY * ELE_SIZE) // 4K
 
+//--------------------------------------
+// Bitmap constants.
+//
+
+#define SIB_BITMAP_WORDS ((1 << SIB_LOW_N_BITS) / 64) // 1024
+#define SIB_BITMAP_SIZE (SIB_BITMAP_WORDS * sizeof(uint64_t)) // 8K
+#define SIB_MIN_CAPACITY 4
+#define SIB_MIN_CONTAINERS 4
+
+typedef struct sib_iter_s {
+	const set_index_bitmap* bm;
+	uint32_t ix; // container index
+	uint32_t v_ix; // array containers
+	uint32_t w_ix; // bitmap containers
+	uint64_t word; // bitmap containers
+} sib_iter;
+
 
 //==========================================================
 // Globals.
@@ -106,7 +128,7 @@ static void* run_populate_q(void* udata);
 static void* run_populate(void* udata);
 static bool populate_reduce_cb(as_index_ref* r_ref, void* udata);
 
-static inline as_set_index_tree* stree_create(void);
+static inline as_set_index_tree* stree_create(as_namespace* ns);
 static inline void stree_destroy(as_set_index_tree* stree);
 static inline as_set_index_tree* stree_reserve(as_index_tree* tree, uint16_t set_id);
 static inline void stree_release(as_set_index_tree* stree);
@@ -125,6 +147,15 @@ static void delete_rebalance(ssprig_info* ssi, index_ele* root_parent, stack_ele
 static void rotate_left(stack_ele* a, stack_ele* b);
 static void rotate_right(stack_ele* a, stack_ele* b);
 
+static bool bitmap_insert(as_set_index_tree* stree, uint64_t r_h);
+static void bitmap_delete(as_set_index_tree* stree, uint64_t r_h);
+static bool bitmap_reduce(as_index_tree* tree, as_set_index_tree* stree, const cf_digest* keyd, as_index_reduce_fn cb, void* udata);
+static bool bitmap_reduce_unordered(as_index_tree* tree, as_set_index_tree* stree, as_index_reduce_fn cb, void* udata);
+static bool bitmap_reduce_phs(as_index_tree* tree, as_index_ph_array* ph_a, as_index_reduce_fn cb, void* udata);
+static int ph_digest_cmp_desc(const void* pa, const void* pb);
+static void ph_heap_sift_up(as_index_ph* phs, uint32_t i);
+static void ph_heap_sift_down(as_index_ph* phs, uint32_t n, uint32_t i);
+
 //--------------------------------------
 // uarena API.
 //
@@ -135,6 +166,24 @@ static void uarena_add_stage(uarena* ua);
 static uarena_handle uarena_alloc(uarena* ua);
 static void uarena_free(uarena* ua, uarena_handle h);
 
+//--------------------------------------
+// Bitmap API.
+//
+
+static void sib_init(set_index_bitmap* bm, uint64_t* used_sz);
+static void sib_destroy(set_index_bitmap* bm);
+static bool sib_add(set_index_bitmap* bm, uint64_t h);
+static void sib_remove(set_index_bitmap* bm, uint64_t h);
+static bool sib_collect(const set_index_bitmap* bm, cf_arenax* arena, uint64_t start_h, as_index_ph_array* ph_a);
+static bool sib_collect_top(const set_index_bitmap* bm, cf_arenax* arena, const cf_digest* keyd, as_index_ph_array* ph_a);
+static void sib_iter_init(sib_iter* it, const set_index_bitmap* bm, uint64_t start_h);
+static void sib_iter_enter(sib_iter* it, uint32_t start_low);
+static bool sib_iter_next(sib_iter* it, uint64_t* r_h);
+static bool sib_find(const set_index_bitmap* bm, uint32_t key, uint32_t* ix);
+static bool sib_array_find(const uint16_t* vals, uint32_t n_vals, uint16_t val, uint32_t* ix);
+static void sib_to_bitmap(set_index_bitmap* bm, sib_container* c);
+static void sib_to_array(set_index_bitmap* bm, sib_container* c);
+
 
 //==========================================================
 // Inlines & macros.
@@ -152,6 +201,17 @@ uarena_set_handle(uarena_handle* h, uint32_t stage_id, uint32_t ele_id)
 	*h = (stage_id << ELE_ID_N_BITS) | ele_id;
 }
 
+//--------------------------------------
+// Bitmap API.
+//
+
+static inline void
+sib_account(set_index_bitmap* bm, int64_t delta)
+{
+	bm->sz += (uint64_t)delta;
+	as_add_uint64(bm->used_sz, delta);
+}
+
 
 //==========================================================
 // Public API - startup.
@@ -178,7 +238,7 @@ as_set_index_create_all(as_namespace* ns, as_index_tree* tree)
 
 	for (uint16_t set_id = 1; set_id <= n_sets; set_id++) {
 		if (is_set_indexed(ns, set_id)) {
-			tree->set_trees[set_id] = stree_create();
+			tree->set_trees[set_id] = stree_create(ns);
 		}
 	}
 }
@@ -202,9 +262,10 @@ as_set_index_destroy_all(as_index_tree* tree)
 }
 
 void
-as_set_index_tree_create(as_index_tree* tree, uint16_t set_id)
+as_set_index_tree_create(as_namespace* ns, as_index_tree* tree,
+		uint16_t set_id)
 {
-	tree->set_trees[set_id] = stree_create();
+	tree->set_trees[set_id] = stree_create(ns);
 }
 
 void
@@ -251,6 +312,15 @@ as_set_index_insert(as_namespace* ns, as_index_tree* tree, uint16_t set_id,
 		return;
 	}
 
+	if (stree->is_bitmap) {
+		if (! bitmap_insert(stree, r_h)) {
+			cf_warning(AS_INDEX, "insert found existing element - unexpected");
+		}
+
+		stree_release(stree);
+		return;
+	}
+
 	as_index* r = cf_arenax_resolve(tree->shared->arena, r_h);
 	ssprig_info ssi;
 
@@ -277,6 +347,12 @@ as_set_index_delete(as_namespace* ns, as_index_tree* tree, uint16_t set_id,
 		return;
 	}
 
+	if (stree->is_bitmap) {
+		bitmap_delete(stree, r_h);
+		stree_release(stree);
+		return;
+	}
+
 	as_index* r = cf_arenax_resolve(tree->shared->arena, r_h);
 	ssprig_info ssi;
 
@@ -309,6 +385,13 @@ as_set_index_reduce(as_namespace* ns, as_index_tree* tree, uint16_t set_id,
 		return false;
 	}
 
+	if (stree->is_bitmap) {
+		bitmap_reduce(tree, stree, keyd, cb, udata);
+		stree_release(stree);
+
+		return true;
+	}
+
 	uint32_t start_sprig_i;
 	uint32_t keyd_stub;
 
@@ -347,6 +430,34 @@ as_set_index_reduce(as_namespace* ns, as_index_tree* tree, uint16_t set_id,
 	return true;
 }
 
+// Like as_set_index_reduce(), but for callers that don't need digest order or
+// resumption - bitmaps are then reduced in handle order, in bounded batches.
+bool
+as_set_index_reduce_unordered(as_namespace* ns, as_index_tree* tree,
+		uint16_t set_id, as_index_reduce_fn cb, void* udata)
+{
+	if (! is_set_populated(ns, set_id)) {
+		return false;
+	}
+
+	as_set_index_tree* stree = stree_reserve(tree, set_id);
+
+	if (stree == NULL) {
+		return false;
+	}
+
+	bool is_bitmap = stree->is_bitmap;
+
+	if (is_bitmap) {
+		bitmap_reduce_unordered(tree, stree, cb, udata);
+	}
+
+	stree_release(stree);
+
+	return is_bitmap ||
+			as_set_index_reduce(ns, tree, set_id, NULL, cb, udata);
+}
+
 
 //==========================================================
 // Public API - info & stats.
@@ -421,6 +532,10 @@ as_set_index_disable(as_namespace* ns, as_set* p_set, uint16_t set_id)
 uint64_t
 as_set_index_used_bytes(const as_namespace* ns)
 {
+	if (ns->set_index_bitmap) {
+		return as_load_uint64(&ns->set_index_bitmap_sz);
+	}
+
 	uint64_t n_objects = 0;
 	uint32_t n_sets = cf_vmapx_count(ns->p_sets_vmap);
 
@@ -593,10 +708,15 @@ populate_reduce_cb(as_index_ref* r_ref, void* udata)
 		return true;
 	}
 
-	ssprig_info ssi;
+	if (cbi->stree->is_bitmap) {
+		bitmap_insert(cbi->stree, r_ref->r_h);
+	}
+	else {
+		ssprig_info ssi;
 
-	ssi_from_keyd(cbi->tree, cbi->stree, &r_ref->r->keyd, &ssi);
-	ssprig_insert(&ssi, r_ref->r_h);
+		ssi_from_keyd(cbi->tree, cbi->stree, &r_ref->r->keyd, &ssi);
+		ssprig_insert(&ssi, r_ref->r_h);
+	}
 
 	as_record_done(r_ref, cbi->ns);
 
@@ -609,12 +729,19 @@ populate_reduce_cb(as_index_ref* r_ref, void* udata)
 //
 
 static inline as_set_index_tree*
-stree_create(void)
+stree_create(as_namespace* ns)
 {
 	as_set_index_tree* stree = cf_rc_alloc(sizeof(as_set_index_tree));
 
 	memset(stree, 0, sizeof(as_set_index_tree));
-	uarena_init(&stree->ua);
+
+	if (ns->set_index_bitmap) {
+		stree->is_bitmap = true;
+		sib_init(&stree->bm, &ns->set_index_bitmap_sz);
+	}
+	else {
+		uarena_init(&stree->ua);
+	}
 
 	return stree;
 }
@@ -622,7 +749,13 @@ stree_create(void)
 static inline void
 stree_destroy(as_set_index_tree* stree)
 {
-	uarena_destroy(&stree->ua);
+	if (stree->is_bitmap) {
+		sib_destroy(&stree->bm);
+	}
+	else {
+		uarena_destroy(&stree->ua);
+	}
+
 	cf_rc_free(stree);
 }
 
@@ -1364,6 +1497,219 @@ rotate_right(stack_ele* a, stack_ele* b)
 }
 
 
+//==========================================================
+// Local helpers - bitmap set-index trees.
+//
+
+static bool
+bitmap_insert(as_set_index_tree* stree, uint64_t r_h)
+{
+	cf_mutex_lock(&stree->bm.lock);
+
+	bool added = sib_add(&stree->bm, r_h);
+
+	cf_mutex_unlock(&stree->bm.lock);
+
+	return added;
+}
+
+static void
+bitmap_delete(as_set_index_tree* stree, uint64_t r_h)
+{
+	cf_mutex_lock(&stree->bm.lock);
+	sib_remove(&stree->bm, r_h);
+	cf_mutex_unlock(&stree->bm.lock);
+}
+
+// Handles carry no digest order, so an ordered (resumable) reduce selects the
+// next batch of greatest digests per pass over the bitmap, and resumes below
+// the last digest seen - use as_set_index_reduce_unordered() where possible.
+static bool
+bitmap_reduce(as_index_tree* tree, as_set_index_tree* stree,
+		const cf_digest* keyd, as_index_reduce_fn cb, void* udata)
+{
+	as_index_ph phs[MAX_ORDERED_PHS];
+	cf_digest resume_keyd;
+
+	while (true) {
+		as_index_ph_array ph_a = {
+				.is_stack = true,
+				.capacity = MAX_ORDERED_PHS,
+				.phs = phs
+		};
+
+		cf_mutex_lock(&stree->bm.lock);
+
+		bool done = sib_collect_top(&stree->bm, tree->shared->arena, keyd,
+				&ph_a);
+
+		cf_mutex_unlock(&stree->bm.lock);
+
+		if (ph_a.n_used == 0) {
+			return true;
+		}
+
+		// Same order as the red-black sprigs - descending digest.
+		qsort(ph_a.phs, ph_a.n_used, sizeof(as_index_ph), ph_digest_cmp_desc);
+
+		// Copy now - the element may be freed once released below.
+		resume_keyd = ph_a.phs[ph_a.n_used - 1].r->keyd;
+		keyd = &resume_keyd;
+
+		if (! bitmap_reduce_phs(tree, &ph_a, cb, udata)) {
+			return false;
+		}
+
+		if (done) {
+			return true;
+		}
+	}
+}
+
+static bool
+bitmap_reduce_unordered(as_index_tree* tree, as_set_index_tree* stree,
+		as_index_reduce_fn cb, void* udata)
+{
+	as_index_ph phs[MAX_REDUCE_PHS];
+	uint64_t start_h = 0;
+	bool more_in_set = true;
+
+	while (more_in_set) {
+		as_index_ph_array ph_a = {
+				.is_stack = true,
+				.capacity = MAX_REDUCE_PHS,
+				.phs = phs
+		};
+
+		cf_mutex_lock(&stree->bm.lock);
+
+		more_in_set = ! sib_collect(&stree->bm, tree->shared->arena, start_h,
+				&ph_a);
+
+		cf_mutex_unlock(&stree->bm.lock);
+
+		if (ph_a.n_used == 0) {
+			break;
+		}
+
+		start_h = ph_a.phs[ph_a.n_used - 1].r_h + 1;
+
+		if (! bitmap_reduce_phs(tree, &ph_a, cb, udata)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Releases all collected elements - same deleted-record handling as sprigs.
+static bool
+bitmap_reduce_phs(as_index_tree* tree, as_index_ph_array* ph_a,
+		as_index_reduce_fn cb, void* udata)
+{
+	as_namespace* ns = tree->shared->destructor_udata;
+	bool do_more = true;
+
+	for (uint32_t i = 0; i < ph_a->n_used; i++) {
+		as_index_ph* ph = &ph_a->phs[i];
+		as_index_ref r_ref = {
+				.r = ph->r,
+				.r_h = ph->r_h,
+				.olock = as_index_olock_from_keyd(tree, &ph->r->keyd)
+		};
+
+		cf_mutex_lock(r_ref.olock);
+
+		uint16_t rc = as_index_release(r_ref.r);
+
+		// Ignore this record if it's been deleted.
+		if (! as_index_is_valid_record(r_ref.r)) {
+			if (rc == 0) {
+				if (tree->shared->destructor != NULL) {
+					tree->shared->destructor(r_ref.r, ns);
+				}
+
+				cf_arenax_free(tree->shared->arena, r_ref.r_h, NULL);
+			}
+			else if (r_ref.r->in_sindex == 1 && rc == 1) {
+				as_sindex_gc_record(ns, &r_ref);
+			}
+
+			cf_mutex_unlock(r_ref.olock);
+			continue;
+		}
+
+		if (do_more) {
+			// Callback MUST call as_record_done() to unlock record.
+			do_more = cb(&r_ref, udata);
+		}
+		else {
+			cf_mutex_unlock(r_ref.olock);
+		}
+	}
+
+	return do_more;
+}
+
+static int
+ph_digest_cmp_desc(const void* pa, const void* pb)
+{
+	const as_index_ph* a = (const as_index_ph*)pa;
+	const as_index_ph* b = (const as_index_ph*)pb;
+
+	return cf_digest_compare(&b->r->keyd, &a->r->keyd);
+}
+
+// Min-heap by digest - the root is the least digest.
+static void
+ph_heap_sift_up(as_index_ph* phs, uint32_t i)
+{
+	while (i != 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (cf_digest_compare(&phs[parent].r->keyd, &phs[i].r->keyd) <= 0) {
+			break;
+		}
+
+		as_index_ph tmp = phs[parent];
+
+		phs[parent] = phs[i];
+		phs[i] = tmp;
+		i = parent;
+	}
+}
+
+static void
+ph_heap_sift_down(as_index_ph* phs, uint32_t n, uint32_t i)
+{
+	while (true) {
+		uint32_t least = i;
+		uint32_t left = 2 * i + 1;
+		uint32_t right = left + 1;
+
+		if (left < n && cf_digest_compare(&phs[left].r->keyd,
+				&phs[least].r->keyd) < 0) {
+			least = left;
+		}
+
+		if (right < n && cf_digest_compare(&phs[right].r->keyd,
+				&phs[least].r->keyd) < 0) {
+			least = right;
+		}
+
+		if (least == i) {
+			break;
+		}
+
+		as_index_ph tmp = phs[least];
+
+		phs[least] = phs[i];
+		phs[i] = tmp;
+		i = least;
+	}
+}
+
+
 //==========================================================
 // uarena API.
 //
@@ -1442,3 +1788,422 @@ uarena_free(uarena* ua, uarena_handle h)
 
 	cf_mutex_unlock(&ua->lock);
 }
+
+
+//==========================================================
+// Bitmap API.
+//
+
+static void
+sib_init(set_index_bitmap* bm, uint64_t* used_sz)
+{
+	cf_mutex_init(&bm->lock);
+
+	bm->used_sz = used_sz;
+	bm->capacity = SIB_MIN_CONTAINERS;
+	bm->containers = cf_malloc(SIB_MIN_CONTAINERS * sizeof(sib_container));
+
+	sib_account(bm, (int64_t)(SIB_MIN_CONTAINERS * sizeof(sib_container)));
+}
+
+static void
+sib_destroy(set_index_bitmap* bm)
+{
+	for (uint32_t i = 0; i < bm->n_containers; i++) {
+		cf_free(bm->containers[i].vals);
+	}
+
+	cf_free(bm->containers);
+
+	as_add_uint64(bm->used_sz, -(int64_t)bm->sz);
+	cf_mutex_destroy(&bm->lock);
+}
+
+// Returns false if the handle was already present.
+static bool
+sib_add(set_index_bitmap* bm, uint64_t h)
+{
+	uint32_t key = (uint32_t)(h >> SIB_LOW_N_BITS);
+	uint16_t low = (uint16_t)(h & SIB_LOW_MASK);
+	uint32_t ix;
+
+	if (! sib_find(bm, key, &ix)) {
+		if (bm->n_containers == bm->capacity) {
+			bm->containers = cf_realloc(bm->containers,
+					bm->capacity * 2 * sizeof(sib_container));
+
+			sib_account(bm, (int64_t)(bm->capacity * sizeof(sib_container)));
+			bm->capacity *= 2;
+		}
+
+		memmove(&bm->containers[ix + 1], &bm->containers[ix],
+				(bm->n_containers - ix) * sizeof(sib_container));
+		bm->n_containers++;
+
+		bm->containers[ix] = (sib_container){
+				.key = key,
+				.capacity = SIB_MIN_CAPACITY,
+				.vals = cf_malloc(SIB_MIN_CAPACITY * sizeof(uint16_t))
+		};
+
+		sib_account(bm, (int64_t)(SIB_MIN_CAPACITY * sizeof(uint16_t)));
+	}
+
+	sib_container* c = &bm->containers[ix];
+
+	if (c->capacity != 0) {
+		uint16_t* vals = (uint16_t*)c->vals;
+		uint32_t v_ix;
+
+		if (sib_array_find(vals, c->n_vals, low, &v_ix)) {
+			return false;
+		}
+
+		if (c->n_vals < SIB_ARRAY_MAX) {
+			if (c->n_vals == c->capacity) {
+				vals = cf_realloc(vals, c->capacity * 2 * sizeof(uint16_t));
+				c->vals = vals;
+
+				sib_account(bm, (int64_t)(c->capacity * sizeof(uint16_t)));
+				c->capacity *= 2;
+			}
+
+			memmove(&vals[v_ix + 1], &vals[v_ix],
+					(c->n_vals - v_ix) * sizeof(uint16_t));
+
+			vals[v_ix] = low;
+			c->n_vals++;
+
+			return true;
+		}
+
+		// Array is full - switch to bitmap and set the bit below.
+		sib_to_bitmap(bm, c);
+	}
+
+	uint64_t* words = (uint64_t*)c->vals;
+	uint64_t bit = 1UL << (low & 63);
+
+	if ((words[low >> 6] & bit) != 0) {
+		return false;
+	}
+
+	words[low >> 6] |= bit;
+	c->n_vals++;
+
+	return true;
+}
+
+// Tolerates absent handles - deletes may race with population.
+static void
+sib_remove(set_index_bitmap* bm, uint64_t h)
+{
+	uint32_t key = (uint32_t)(h >> SIB_LOW_N_BITS);
+	uint16_t low = (uint16_t)(h & SIB_LOW_MASK);
+	uint32_t ix;
+
+	if (! sib_find(bm, key, &ix)) {
+		return;
+	}
+
+	sib_container* c = &bm->containers[ix];
+
+	if (c->capacity == 0) {
+		uint64_t* words = (uint64_t*)c->vals;
+		uint64_t bit = 1UL << (low & 63);
+
+		if ((words[low >> 6] & bit) == 0) {
+			return;
+		}
+
+		words[low >> 6] &= ~bit;
+		c->n_vals--;
+
+		// Hysteresis - don't flip back and forth around SIB_ARRAY_MAX.
+		if (c->n_vals == SIB_ARRAY_MAX / 2) {
+			sib_to_array(bm, c);
+		}
+
+		return;
+	}
+
+	uint16_t* vals = (uint16_t*)c->vals;
+	uint32_t v_ix;
+
+	if (! sib_array_find(vals, c->n_vals, low, &v_ix)) {
+		return;
+	}
+
+	c->n_vals--;
+
+	if (c->n_vals == 0) {
+		cf_free(vals);
+		sib_account(bm, -(int64_t)(c->capacity * sizeof(uint16_t)));
+
+		bm->n_containers--;
+		memmove(&bm->containers[ix], &bm->containers[ix + 1],
+				(bm->n_containers - ix) * sizeof(sib_container));
+
+		return;
+	}
+
+	memmove(&vals[v_ix], &vals[v_ix + 1],
+			(c->n_vals - v_ix) * sizeof(uint16_t));
+
+	if (c->capacity > SIB_MIN_CAPACITY && c->n_vals <= c->capacity / 4) {
+		c->vals = cf_realloc(vals, c->capacity / 2 * sizeof(uint16_t));
+
+		sib_account(bm, -(int64_t)(c->capacity / 2 * sizeof(uint16_t)));
+		c->capacity /= 2;
+	}
+}
+
+// Collects (and reserves) elements in handle order, from start_h onwards.
+// Returns false if ph_a filled up before all elements were collected.
+static bool
+sib_collect(const set_index_bitmap* bm, cf_arenax* arena, uint64_t start_h,
+		as_index_ph_array* ph_a)
+{
+	sib_iter it;
+	uint64_t r_h;
+
+	sib_iter_init(&it, bm, start_h);
+
+	while (sib_iter_next(&it, &r_h)) {
+		if (ph_a->n_used == ph_a->capacity) {
+			return false;
+		}
+
+		as_index* r = cf_arenax_resolve(arena, r_h);
+
+		as_index_reserve(r);
+
+		as_index_ph* ph = &ph_a->phs[ph_a->n_used++];
+
+		ph->r = r;
+		ph->r_h = r_h;
+	}
+
+	return true;
+}
+
+// Collects (and reserves) the elements with the greatest digests less than keyd
+// (or the greatest overall if keyd is NULL), up to ph_a's capacity, unordered.
+// Returns false if ph_a filled up, i.e. elements with lesser digests may remain.
+static bool
+sib_collect_top(const set_index_bitmap* bm, cf_arenax* arena,
+		const cf_digest* keyd, as_index_ph_array* ph_a)
+{
+	sib_iter it;
+	uint64_t r_h;
+
+	sib_iter_init(&it, bm, 0);
+
+	while (sib_iter_next(&it, &r_h)) {
+		as_index* r = cf_arenax_resolve(arena, r_h);
+
+		// We do not collect the element with the boundary digest.
+		if (keyd != NULL && cf_digest_compare(&r->keyd, keyd) >= 0) {
+			continue;
+		}
+
+		if (ph_a->n_used < ph_a->capacity) {
+			as_index_ph* ph = &ph_a->phs[ph_a->n_used];
+
+			ph->r = r;
+			ph->r_h = r_h;
+
+			ph_heap_sift_up(ph_a->phs, ph_a->n_used++);
+			continue;
+		}
+
+		// Full - replace the least digest if this one is greater.
+		if (cf_digest_compare(&r->keyd, &ph_a->phs[0].r->keyd) > 0) {
+			ph_a->phs[0].r = r;
+			ph_a->phs[0].r_h = r_h;
+
+			ph_heap_sift_down(ph_a->phs, ph_a->n_used, 0);
+		}
+	}
+
+	// Reserve only the winners.
+	for (uint32_t i = 0; i < ph_a->n_used; i++) {
+		as_index_reserve(ph_a->phs[i].r);
+	}
+
+	return ph_a->n_used < ph_a->capacity;
+}
+
+static void
+sib_iter_init(sib_iter* it, const set_index_bitmap* bm, uint64_t start_h)
+{
+	uint32_t start_key = (uint32_t)(start_h >> SIB_LOW_N_BITS);
+
+	it->bm = bm;
+
+	bool found = sib_find(bm, start_key, &it->ix);
+
+	sib_iter_enter(it, found ? (uint32_t)(start_h & SIB_LOW_MASK) : 0);
+}
+
+// Positions the iterator at start_low in the current container, if any.
+static void
+sib_iter_enter(sib_iter* it, uint32_t start_low)
+{
+	if (it->ix == it->bm->n_containers) {
+		return;
+	}
+
+	const sib_container* c = &it->bm->containers[it->ix];
+
+	it->v_ix = 0;
+	it->w_ix = start_low >> 6;
+	it->word = 0;
+
+	if (c->capacity != 0) {
+		sib_array_find((const uint16_t*)c->vals, c->n_vals,
+				(uint16_t)start_low, &it->v_ix);
+	}
+	else {
+		it->word = ((const uint64_t*)c->vals)[it->w_ix] &
+				(~0UL << (start_low & 63));
+	}
+}
+
+// Yields elements in handle order - false when there are no more.
+static bool
+sib_iter_next(sib_iter* it, uint64_t* r_h)
+{
+	const set_index_bitmap* bm = it->bm;
+
+	for (; it->ix < bm->n_containers; it->ix++, sib_iter_enter(it, 0)) {
+		const sib_container* c = &bm->containers[it->ix];
+		uint64_t high = (uint64_t)c->key << SIB_LOW_N_BITS;
+
+		if (c->capacity != 0) {
+			if (it->v_ix < c->n_vals) {
+				*r_h = high | ((const uint16_t*)c->vals)[it->v_ix++];
+				return true;
+			}
+
+			continue;
+		}
+
+		while (it->word == 0 && ++it->w_ix < SIB_BITMAP_WORDS) {
+			it->word = ((const uint64_t*)c->vals)[it->w_ix];
+		}
+
+		if (it->word != 0) {
+			*r_h = high | ((uint64_t)it->w_ix << 6) |
+					(uint64_t)__builtin_ctzll(it->word);
+			it->word &= it->word - 1;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Binary search - if not found, ix is the insertion point.
+static bool
+sib_find(const set_index_bitmap* bm, uint32_t key, uint32_t* ix)
+{
+	uint32_t lo = 0;
+	uint32_t hi = bm->n_containers;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+		uint32_t mid_key = bm->containers[mid].key;
+
+		if (mid_key == key) {
+			*ix = mid;
+			return true;
+		}
+
+		if (mid_key < key) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	*ix = lo;
+
+	return false;
+}
+
+// Binary search - if not found, ix is the insertion point.
+static bool
+sib_array_find(const uint16_t* vals, uint32_t n_vals, uint16_t val,
+		uint32_t* ix)
+{
+	uint32_t lo = 0;
+	uint32_t hi = n_vals;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (vals[mid] == val) {
+			*ix = mid;
+			return true;
+		}
+
+		if (vals[mid] < val) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	*ix = lo;
+
+	return false;
+}
+
+static void
+sib_to_bitmap(set_index_bitmap* bm, sib_container* c)
+{
+	uint16_t* vals = (uint16_t*)c->vals;
+	uint64_t* words = cf_calloc(SIB_BITMAP_WORDS, sizeof(uint64_t));
+
+	for (uint32_t i = 0; i < c->n_vals; i++) {
+		words[vals[i] >> 6] |= 1UL << (vals[i] & 63);
+	}
+
+	sib_account(bm, (int64_t)SIB_BITMAP_SIZE -
+			(int64_t)(c->capacity * sizeof(uint16_t)));
+
+	cf_free(vals);
+
+	c->vals = words;
+	c->capacity = 0;
+}
+
+static void
+sib_to_array(set_index_bitmap* bm, sib_container* c)
+{
+	uint64_t* words = (uint64_t*)c->vals;
+	uint32_t capacity = c->n_vals * 2; // leave room to grow
+	uint16_t* vals = cf_malloc(capacity * sizeof(uint16_t));
+	uint32_t n_vals = 0;
+
+	for (uint32_t w_ix = 0; w_ix < SIB_BITMAP_WORDS; w_ix++) {
+		uint64_t word = words[w_ix];
+
+		while (word != 0) {
+			vals[n_vals++] = (uint16_t)((w_ix << 6) |
+					(uint32_t)__builtin_ctzll(word));
+			word &= word - 1;
+		}
+	}
+
+	sib_account(bm, (int64_t)(capacity * sizeof(uint16_t)) -
+			(int64_t)SIB_BITMAP_SIZE);
+
+	cf_free(words);
+
+	c->vals = vals;
+	c->capacity = capacity;
+}
@@ -67,6 +67,7 @@
 #include "base/cfg.h"
 #include "base/cfg_info.h"
 #include "base/datamodel.h"
+#include "base/exp.h"
 #include "base/features.h"
 #include "base/health.h"
 #include "base/index.h"
@@ -285,6 +286,8 @@ static void add_index_device_stats(as_namespace* ns, cf_dyn_buf* db);
 static int32_t oldest_nvme_age(const char* path);
 static void add_data_device_stats(as_namespace* ns, cf_dyn_buf* db);
 static void find_sindex_key(const cf_vector* items, void* udata);
+static bool sindex_composite_smd_key(const char* index_name, const char* ns_name, const char* set_name, char* bin_name, char* type_str, char* ctx_str, as_sindex_type itype, char* smd_key, cf_dyn_buf* db);
+static bool sindex_exp_smd_key(const char* index_name, const char* ns_name, const char* set_name, const char* exp_b64, uint32_t exp_b64_len, const char* type_str, as_sindex_type itype, char* smd_key, cf_dyn_buf* db);
 static void smd_show_cb(const cf_vector* items, void* udata);
 
 
@@ -3047,6 +3050,9 @@ cmd_sindex_create(char* name, char* params, cf_dyn_buf* db)
 	// sindex-create:ns=usermap;set=demo;indexname=um_age;indextype=list;indexdata=age,numeric
 	// sindex-create:ns=usermap;set=demo;indexname=um_state;indexdata=state,string
 	// sindex-create:ns=usermap;set=demo;indexname=um_highscore;context=<base64-cdt-ctx>;indexdata=scores,numeric
+	// sindex-create:ns=usermap;set=demo;indexname=um_tenant_ts;indexdata=tenant,string,ts,numeric
+	// sindex-create:ns=usermap;set=demo;indexname=um_tenant_ts;context=,<base64-cdt-ctx>;indexdata=tenant,string,ts,numeric
+	// sindex-create:ns=usermap;set=demo;indexname=um_total;exp=<base64-exp>;indexdata=numeric
 
 	char index_name_str[INAME_MAX_SZ];
 	int index_name_len = sizeof(index_name_str);
@@ -3110,7 +3116,10 @@ cmd_sindex_create(char* name, char* params, cf_dyn_buf* db)
 
 	rv = as_info_parameter_get(params, "context", ctx_b64, &ctx_b64_len);
 
-	if (rv == 0) {
+	if (rv == 0 && strchr(ctx_b64, ',') != NULL) {
+		p_cdt_ctx = ctx_b64; // composite - validated per bin below
+	}
+	else if (rv == 0) {
 		uint8_t* buf;
 		int32_t buf_sz = as_sindex_cdt_ctx_b64_decode(ctx_b64, ctx_b64_len,
 				&buf);
@@ -3198,49 +3207,87 @@ cmd_sindex_create(char* name, char* params, cf_dyn_buf* db)
 		return 0;
 	}
 
-	char* bin_name = indexdata_str;
-	char* type_str = strchr(indexdata_str, ',');
+	char exp_b64[EXP_B64_MAX_SZ];
+	int exp_b64_len = sizeof(exp_b64);
+	char smd_key[SINDEX_SMD_KEY_MAX_SZ];
+
+	rv = as_info_parameter_get(params, "exp", exp_b64, &exp_b64_len);
 
-	if (type_str == NULL) {
-		cf_warning(AS_INFO, "sindex-create %s: 'indexdata' missing bin type",
+	if (rv == -2) {
+		cf_warning(AS_INFO, "sindex-create %s: 'exp' too long",
 				index_name_str);
-		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' missing bin type");
+		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'exp' too long");
 		return 0;
 	}
 
-	*type_str++ = '\0';
+	if (rv == 0) {
+		if (p_cdt_ctx != NULL) {
+			cf_warning(AS_INFO, "sindex-create %s: 'context' not allowed with 'exp'",
+					index_name_str);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'context' not allowed with 'exp'");
+			return 0;
+		}
 
-	if (bin_name[0] == '\0') {
-		cf_warning(AS_INFO, "sindex-create %s: 'indexdata' missing bin name",
-				index_name_str);
-		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' missing bin name");
-		return 0;
+		if (! sindex_exp_smd_key(index_name_str, ns_str, p_set_str, exp_b64,
+				(uint32_t)exp_b64_len, indexdata_str, itype, smd_key, db)) {
+			return 0;
+		}
 	}
+	else {
+		char* bin_name = indexdata_str;
+		char* type_str = strchr(indexdata_str, ',');
 
-	if (strlen(bin_name) >= AS_BIN_NAME_MAX_SZ) {
-		cf_warning(AS_INFO, "sindex-create %s: 'indexdata' bin name too long",
-				index_name_str);
-		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' bin name too long");
-		return 0;
-	}
+		if (type_str == NULL) {
+			cf_warning(AS_INFO, "sindex-create %s: 'indexdata' missing bin type",
+					index_name_str);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' missing bin type");
+			return 0;
+		}
 
-	as_particle_type ktype = as_sindex_ktype_from_string(type_str);
+		*type_str++ = '\0';
 
-	if (ktype == AS_PARTICLE_TYPE_BAD) {
-		cf_warning(AS_INFO, "sindex-create %s: bad 'indexdata' bin type '%s'",
-				index_name_str, type_str);
-		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "bad 'indexdata' bin type - must be one of 'numeric', 'string', 'geo2dsphere'");
-		return 0;
+		if (bin_name[0] == '\0') {
+			cf_warning(AS_INFO, "sindex-create %s: 'indexdata' missing bin name",
+					index_name_str);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' missing bin name");
+			return 0;
+		}
+
+		if (strlen(bin_name) >= AS_BIN_NAME_MAX_SZ) {
+			cf_warning(AS_INFO, "sindex-create %s: 'indexdata' bin name too long",
+					index_name_str);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' bin name too long");
+			return 0;
+		}
+
+		if (strchr(type_str, ',') != NULL ||
+				(p_cdt_ctx != NULL && strchr(p_cdt_ctx, ',') != NULL)) {
+			if (! sindex_composite_smd_key(index_name_str, ns_str, p_set_str,
+					bin_name, type_str, p_cdt_ctx == NULL ? NULL : ctx_b64,
+					itype, smd_key, db)) {
+				return 0;
+			}
+		}
+		else {
+			bool ordered;
+			as_particle_type ktype = as_sindex_ktype_from_string(type_str,
+					&ordered);
+
+			if (ktype == AS_PARTICLE_TYPE_BAD) {
+				cf_warning(AS_INFO, "sindex-create %s: bad 'indexdata' bin type '%s'",
+						index_name_str, type_str);
+				INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "bad 'indexdata' bin type - must be one of 'numeric', 'string', 'string-ordered', 'geo2dsphere'");
+				return 0;
+			}
+
+			as_sindex_build_smd_key(ns_str, p_set_str, bin_name, p_cdt_ctx,
+					itype, ktype, ordered, smd_key);
+		}
 	}
 
 	cf_info(AS_INFO, "sindex-create: request received for %s:%s via info",
 			ns_str, index_name_str);
 
-	char smd_key[SINDEX_SMD_KEY_MAX_SZ];
-
-	as_sindex_build_smd_key(ns_str, p_set_str, bin_name, p_cdt_ctx, itype,
-			ktype, smd_key);
-
 	find_sindex_key_udata fsk = {
 			.ns_name = ns_str,
 			.index_name = index_name_str,
@@ -3777,6 +3824,14 @@ dyn_statistics(char* name, cf_dyn_buf* db)
 	info_append_format(db, "batch_index_proto_uncompressed_pct", "%.3f", g_stats.batch_comp_stat.uncomp_pct);
 	info_append_format(db, "batch_index_proto_compression_ratio", "%.3f", batch_ratio);
 
+	uint64_t exp_hits = as_load_uint64(&g_stats.exp_cache_hits);
+	uint64_t exp_lookups = exp_hits + as_load_uint64(&g_stats.exp_cache_misses);
+	double exp_hit_ratio = exp_lookups != 0 ? (double)exp_hits / exp_lookups : 0.0;
+
+	info_append_uint64(db, "exp_cache_hits", exp_hits);
+	info_append_uint64(db, "exp_cache_misses", exp_lookups - exp_hits);
+	info_append_format(db, "exp_cache_hit_ratio", "%.3f", exp_hit_ratio);
+
 	char paxos_principal[16 + 1];
 	sprintf(paxos_principal, "%lX", as_exchange_principal());
 	info_append_string(db, "paxos_principal", paxos_principal);
@@ -4263,13 +4318,15 @@ info_get_namespace_info(as_namespace* ns, cf_dyn_buf* db)
 	uint64_t data_memory = as_load_uint64(&ns->n_bytes_memory);
 	uint64_t index_memory = as_namespace_index_persisted(ns) ? 0 : index_used;
 	uint64_t set_index_memory = as_set_index_used_bytes(ns);
+	uint64_t expire_index_memory = as_load_uint64(&ns->expire_index_sz);
 	uint64_t sindex_memory = as_sindex_used_bytes(ns);
-	uint64_t used_memory = data_memory + index_memory + set_index_memory + sindex_memory;
+	uint64_t used_memory = data_memory + index_memory + set_index_memory + expire_index_memory + sindex_memory;
 
 	info_append_uint64(db, "memory_used_bytes", used_memory);
 	info_append_uint64(db, "memory_used_data_bytes", data_memory);
 	info_append_uint64(db, "memory_used_index_bytes", index_memory);
 	info_append_uint64(db, "memory_used_set_index_bytes", set_index_memory);
+	info_append_uint64(db, "memory_used_expire_index_bytes", expire_index_memory);
 	info_append_uint64(db, "memory_used_sindex_bytes", sindex_memory);
 
 	uint64_t free_pct = ns->memory_size > used_memory ?
@@ -4681,6 +4738,10 @@ info_get_namespace_info(as_namespace* ns, cf_dyn_buf* db)
 	info_append_uint64(db, "si_query_ops_bg_error", ns->n_si_query_ops_bg_error);
 	info_append_uint64(db, "si_query_ops_bg_abort", ns->n_si_query_ops_bg_abort);
 
+	info_append_uint64(db, "si_query_pi_planned", ns->n_si_query_pi_planned);
+	info_append_uint64(db, "si_query_covered", ns->n_si_query_covered);
+	info_append_uint64(db, "si_query_top_bytes", ns->si_query_top_sz);
+
 	// Geospatial query stats:
 	info_append_uint64(db, "geo_region_query_reqs", ns->geo_region_query_count);
 	info_append_uint64(db, "geo_region_query_cells", ns->geo_region_query_cells);
@@ -4942,6 +5003,184 @@ add_data_device_stats(as_namespace* ns, cf_dyn_buf* db)
 	}
 }
 
+// indexdata=bin-name,keytype,bin-name,keytype[,...] - the last bin gets the
+// range, the others equality. context=[<base64-cdt-ctx>],[<base64-cdt-ctx>]...
+// is optional, but if present must have one (possibly empty) entry per bin.
+static bool
+sindex_composite_smd_key(const char* index_name, const char* ns_name,
+		const char* set_name, char* bin_name, char* type_str, char* ctx_str,
+		as_sindex_type itype, char* smd_key, cf_dyn_buf* db)
+{
+	if (itype != AS_SINDEX_ITYPE_DEFAULT) {
+		cf_warning(AS_INFO, "sindex-create %s: composite 'indextype' must be 'default'",
+				index_name);
+		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "composite 'indextype' must be 'default'");
+		return false;
+	}
+
+	char* bin_names[MAX_COMPOSITE_BINS];
+	char* cdt_ctxs[MAX_COMPOSITE_BINS] = { NULL };
+	as_particle_type ktypes[MAX_COMPOSITE_BINS];
+	uint32_t n_bins = 0;
+
+	// On entry bin_name is terminated and type_str is the rest.
+	char* read = type_str;
+
+	while (true) {
+		if (n_bins == MAX_COMPOSITE_BINS) {
+			cf_warning(AS_INFO, "sindex-create %s: 'indexdata' more than %u bins",
+					index_name, MAX_COMPOSITE_BINS);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' too many bins");
+			return false;
+		}
+
+		char* next = strchr(read, ',');
+
+		if (next != NULL) {
+			*next++ = '\0';
+		}
+
+		if (bin_name[0] == '\0' || strlen(bin_name) >= AS_BIN_NAME_MAX_SZ ||
+				strchr(bin_name, ':') != NULL) {
+			cf_warning(AS_INFO, "sindex-create %s: 'indexdata' bad bin name '%s'",
+					index_name, bin_name);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' bad bin name");
+			return false;
+		}
+
+		as_particle_type ktype = as_sindex_ktype_from_string(read, NULL);
+
+		if (ktype != AS_PARTICLE_TYPE_INTEGER &&
+				ktype != AS_PARTICLE_TYPE_STRING) {
+			cf_warning(AS_INFO, "sindex-create %s: bad 'indexdata' composite bin type '%s'",
+					index_name, read);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "bad 'indexdata' composite bin type - must be one of 'numeric', 'string'");
+			return false;
+		}
+
+		bin_names[n_bins] = bin_name;
+		ktypes[n_bins] = ktype;
+		n_bins++;
+
+		if (next == NULL) {
+			break;
+		}
+
+		bin_name = next;
+		read = strchr(next, ',');
+
+		if (read == NULL) {
+			cf_warning(AS_INFO, "sindex-create %s: 'indexdata' missing bin type",
+					index_name);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'indexdata' missing bin type");
+			return false;
+		}
+
+		*read++ = '\0';
+	}
+
+	if (n_bins < 2) {
+		cf_warning(AS_INFO, "sindex-create %s: 'context' list needs composite 'indexdata'",
+				index_name);
+		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'context' list needs composite 'indexdata'");
+		return false;
+	}
+
+	if (ctx_str != NULL) {
+		uint32_t n_ctxs = 0;
+
+		read = ctx_str;
+
+		while (read != NULL) {
+			char* next = strchr(read, ',');
+
+			if (next != NULL) {
+				*next++ = '\0';
+			}
+
+			if (n_ctxs == n_bins) {
+				break; // too many - caught below
+			}
+
+			if (*read != '\0') {
+				uint8_t* buf;
+				int32_t buf_sz = as_sindex_cdt_ctx_b64_decode(read,
+						(uint32_t)strlen(read), &buf);
+
+				if (buf_sz < 0) {
+					cf_warning(AS_INFO, "sindex-create %s: 'context' %u invalid",
+							index_name, n_ctxs);
+					INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'context' invalid");
+					return false;
+				}
+
+				cf_free(buf);
+				cdt_ctxs[n_ctxs] = read;
+			}
+
+			n_ctxs++;
+			read = next;
+		}
+
+		if (n_ctxs != n_bins || read != NULL) {
+			cf_warning(AS_INFO, "sindex-create %s: 'context' needs one entry per bin",
+					index_name);
+			INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'context' needs one entry per bin");
+			return false;
+		}
+	}
+
+	as_sindex_build_composite_smd_key(ns_name, set_name, n_bins, bin_names,
+			cdt_ctxs, ktypes, smd_key);
+
+	return true;
+}
+
+// exp=<base64-exp> replaces the bin - indexdata=keytype is the type the
+// expression must yield for a record to be indexed.
+static bool
+sindex_exp_smd_key(const char* index_name, const char* ns_name,
+		const char* set_name, const char* exp_b64, uint32_t exp_b64_len,
+		const char* type_str, as_sindex_type itype, char* smd_key,
+		cf_dyn_buf* db)
+{
+	if (exp_b64_len == 0) {
+		cf_warning(AS_INFO, "sindex-create %s: zero-length 'exp'", index_name);
+		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "zero-length 'exp'");
+		return false;
+	}
+
+	uint8_t* buf;
+	uint32_t buf_sz;
+	as_exp* exp = as_sindex_exp_b64_decode(exp_b64, exp_b64_len, &buf,
+			&buf_sz);
+
+	if (exp == NULL) {
+		cf_warning(AS_INFO, "sindex-create %s: 'exp' invalid expression or reads more than bins",
+				index_name);
+		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "'exp' invalid expression or reads more than bins");
+		return false;
+	}
+
+	as_exp_destroy(exp);
+	cf_free(buf);
+
+	bool ordered;
+	as_particle_type ktype = as_sindex_ktype_from_string(type_str, &ordered);
+
+	if (ktype == AS_PARTICLE_TYPE_BAD) {
+		cf_warning(AS_INFO, "sindex-create %s: bad 'indexdata' type '%s'",
+				index_name, type_str);
+		INFO_FAIL_RESPONSE(db, AS_ERR_PARAMETER, "bad 'indexdata' type - must be one of 'numeric', 'string', 'string-ordered', 'geo2dsphere'");
+		return false;
+	}
+
+	as_sindex_build_exp_smd_key(ns_name, set_name, exp_b64, itype, ktype,
+			ordered, smd_key);
+
+	return true;
+}
+
 static void
 find_sindex_key(const cf_vector* items, void* udata)
 {
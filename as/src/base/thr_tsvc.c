@@ -41,6 +41,7 @@
 #include "base/datamodel.h"
 #include "base/proto.h"
 #include "base/security.h"
+#include "base/service.h"
 #include "base/stats.h"
 #include "base/transaction.h"
 #include "base/transaction_policy.h"
@@ -223,6 +224,13 @@ as_tsvc_process_transaction(as_transaction *tr)
 	// else - batch sub-transactions & all internal transactions have no digest
 	// in the message - digest is already in tr.
 
+	// With partition-numa-homing, move client transactions to a service thread
+	// on the partition's home NUMA node.
+	if (tr->origin == FROM_CLIENT && as_service_steer_to_numa_home(tr)) {
+		free_msgp = false; // msgp now owned by the re-queued transaction
+		goto Cleanup;
+	}
+
 	// Process the transaction.
 
 	bool is_write = (m->info2 & AS_MSG_INFO2_WRITE) != 0;
@@ -475,28 +475,32 @@ log_line_memory_usage(as_namespace* ns, uint64_t index_used_sz)
 {
 	uint64_t index_mem = as_namespace_index_persisted(ns) ? 0 : index_used_sz;
 	uint64_t set_index_mem = as_set_index_used_bytes(ns);
+	uint64_t expire_index_mem = as_load_uint64(&ns->expire_index_sz);
 	uint64_t sindex_mem = as_sindex_used_bytes(ns);
 	uint64_t data_mem = as_load_uint64(&ns->n_bytes_memory);
-	uint64_t total_mem = index_mem + set_index_mem + sindex_mem + data_mem;
+	uint64_t total_mem = index_mem + set_index_mem + expire_index_mem + sindex_mem +
+			data_mem;
 
 	double mem_used_pct = (double)(total_mem * 100) / (double)ns->memory_size;
 
 	if (ns->storage_data_in_memory) {
-		cf_info(AS_INFO, "{%s} memory-usage: total-bytes %lu index-bytes %lu set-index-bytes %lu sindex-bytes %lu data-bytes %lu used-pct %.2lf",
+		cf_info(AS_INFO, "{%s} memory-usage: total-bytes %lu index-bytes %lu set-index-bytes %lu expire-index-bytes %lu sindex-bytes %lu data-bytes %lu used-pct %.2lf",
 				ns->name,
 				total_mem,
 				index_mem,
 				set_index_mem,
+				expire_index_mem,
 				sindex_mem,
 				data_mem,
 				mem_used_pct);
 	}
 	else {
-		cf_info(AS_INFO, "{%s} memory-usage: total-bytes %lu index-bytes %lu set-index-bytes %lu sindex-bytes %lu used-pct %.2lf",
+		cf_info(AS_INFO, "{%s} memory-usage: total-bytes %lu index-bytes %lu set-index-bytes %lu expire-index-bytes %lu sindex-bytes %lu used-pct %.2lf",
 				ns->name,
 				total_mem,
 				index_mem,
 				set_index_mem,
+				expire_index_mem,
 				sindex_mem,
 				mem_used_pct);
 	}
@@ -309,6 +309,8 @@ truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut)
 				lut - now);
 	}
 
+	uint16_t set_id = 0; // whole namespace unless set-index can be used
+
 	if (set_name != NULL) {
 		as_set* p_set = as_namespace_get_set_by_name(ns, set_name);
 
@@ -318,6 +320,10 @@ truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut)
 			return;
 		}
 
+		if (p_set->index_enabled) {
+			set_id = as_namespace_get_set_id(ns, set_name);
+		}
+
 		if (lut <= p_set->truncate_lut) {
 			cf_info(AS_TRUNCATE, "{%s|%s} truncate lut %lu <= vmap lut %lu",
 					ns->name, set_name, lut, p_set->truncate_lut);
@@ -345,16 +351,24 @@ truncate_action_do(as_namespace* ns, const char* set_name, uint64_t lut)
 
 	cf_mutex_lock(&ns->truncate.state_lock);
 
+	// A restart must cover whatever the interrupted run didn't finish.
 	switch (ns->truncate.state) {
 	case TRUNCATE_IDLE:
+		ns->truncate.set_id = set_id;
 		truncate_all(ns);
 		break;
 	case TRUNCATE_RUNNING:
 		cf_info(AS_TRUNCATE, "{%s} flagging truncate to restart", ns->name);
 		ns->truncate.state = TRUNCATE_RESTART;
+		ns->truncate.restart_set_id =
+				ns->truncate.set_id == set_id ? set_id : 0;
 		break;
 	case TRUNCATE_RESTART:
 		cf_info(AS_TRUNCATE, "{%s} truncate already will restart", ns->name);
+
+		if (ns->truncate.restart_set_id != set_id) {
+			ns->truncate.restart_set_id = 0;
+		}
 		break;
 	default:
 		cf_crash(AS_TRUNCATE, "bad truncate state %d", ns->truncate.state);
@@ -398,9 +412,9 @@ truncate_all(as_namespace* ns)
 
 	uint32_t n_threads = as_load_uint32(&ns->n_truncate_threads);
 
-	cf_info(AS_TRUNCATE, "{%s} %s truncate on %u threads", ns->name,
+	cf_info(AS_TRUNCATE, "{%s} %s truncate on %u threads%s", ns->name,
 			ns->truncate.state == TRUNCATE_IDLE ? "starting" : "restarting",
-			n_threads);
+			n_threads, ns->truncate.set_id != 0 ? " using set-index" : "");
 
 	ns->truncate.state = TRUNCATE_RUNNING;
 	as_store_uint32(&ns->truncate.n_threads_running, n_threads);
@@ -425,7 +439,14 @@ run_truncate(void* arg)
 
 		truncate_reduce_cb_info cb_info = { .ns = ns, .tree = rsv.tree };
 
-		as_index_reduce(rsv.tree, truncate_reduce_cb, (void*)&cb_info);
+		// Falls back to whole tree if set-index is not (yet) usable.
+		if (ns->truncate.set_id == 0 ||
+				! as_set_index_reduce_unordered(ns, rsv.tree,
+						ns->truncate.set_id, truncate_reduce_cb,
+						(void*)&cb_info)) {
+			as_index_reduce(rsv.tree, truncate_reduce_cb, (void*)&cb_info);
+		}
+
 		as_partition_release(&rsv);
 
 		as_add_uint64(&ns->truncate.n_records_this_run, cb_info.n_deleted);
@@ -453,6 +474,7 @@ truncate_finish(as_namespace* ns)
 			ns->truncate.state = TRUNCATE_IDLE;
 			break;
 		case TRUNCATE_RESTART:
+			ns->truncate.set_id = ns->truncate.restart_set_id;
 			truncate_all(ns);
 			break;
 		case TRUNCATE_IDLE:
@@ -125,7 +125,7 @@ as_partition_create_set_index(as_namespace* ns, uint32_t pid, uint16_t set_id)
 	cf_mutex_lock(&p->lock);
 
 	if (p->tree != NULL) {
-		as_set_index_tree_create(p->tree, set_id);
+		as_set_index_tree_create(ns, p->tree, set_id);
 	}
 
 	cf_mutex_unlock(&p->lock);
@@ -564,6 +564,15 @@ as_partition_tree_done(uint8_t id, void* udata)
 	cf_mutex_unlock(&p->lock);
 }
 
+// Prefer the partition's home NUMA node for its (new) tree, if so configured.
+void
+as_partition_numa_home_tree(as_partition* p)
+{
+	if (g_config.partition_numa_homing) {
+		as_index_tree_bind_numa(p->tree, as_partition_numa_home(p->id));
+	}
+}
+
 void
 as_partition_getinfo_str(cf_dyn_buf* db)
 {
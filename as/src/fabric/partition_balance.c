@@ -648,6 +648,8 @@ create_trees(as_namespace* ns, as_partition* p)
 	p->tree = as_index_tree_create(&ns->tree_shared, p->tree_id,
 			as_partition_tree_done, (void*)p);
 
+	as_partition_numa_home_tree(p);
+
 	as_set_index_create_all(ns, p->tree);
 }
 
@@ -28,6 +28,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -45,6 +46,7 @@
 #include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_ll.h"
+#include "citrusleaf/cf_random.h"
 
 #include "arenax.h"
 #include "cf_mutex.h"
@@ -72,6 +74,7 @@
 #include "base/udf_record.h"
 #include "fabric/partition.h"
 #include "geospatial/geospatial.h"
+#include "query/query_aggr.h"
 #include "query/query_job.h"
 #include "query/query_manager.h"
 #include "sindex/sindex.h"
@@ -92,6 +95,7 @@ typedef enum {
 	QUERY_TYPE_AGGR		= 1,
 	QUERY_TYPE_UDF_BG	= 2,
 	QUERY_TYPE_OPS_BG	= 3,
+	QUERY_TYPE_EXP_AGGR	= 4,
 
 	QUERY_TYPE_UNKNOWN	= -1
 } query_type;
@@ -103,6 +107,14 @@ typedef enum {
 
 #define MAX_ACTIVE_TRANSACTIONS 200
 
+#define MAX_TOP_K (100U * 1000U) // ordered queries hold this many responses
+#define MAX_TOP_SZ (64UL * 1024 * 1024) // ... and this many response bytes
+
+#define STORAGE_ORDER_GROUP_SZ (64U * 1024U) // records sorted at a time
+
+#define SAMPLE_RATE_MAX 1000000 // sample rate is in parts per million
+#define SAMPLE_SPRIG_FACTOR 4 // traverse this many times the sample in sprigs
+
 #define DEFAULT_TTL_NS 1000000000 // 1 second
 
 
@@ -118,6 +130,7 @@ static int basic_query_job_start(as_transaction* tr, as_namespace* ns);
 static int aggr_query_job_start(as_transaction* tr, as_namespace* ns);
 static int udf_bg_query_job_start(as_transaction* tr, as_namespace* ns);
 static int ops_bg_query_job_start(as_transaction* tr, as_namespace* ns);
+static int exp_aggr_query_job_start(as_transaction* tr, as_namespace* ns);
 
 //----------------------------------------------------------
 // Non-class-specific utilities.
@@ -133,19 +146,34 @@ static bool get_query_rps(const as_transaction* tr, uint32_t* rps);
 static bool get_query_socket_timeout(const as_transaction* tr, int32_t* timeout);
 
 static bool get_query_sample_max(const as_transaction* tr, uint64_t* sample_max);
+static bool get_query_sample_rate(const as_transaction* tr, uint32_t* sample_rate);
 static bool get_query_filter_exp(const as_transaction* tr, as_exp** exp);
 
+static bool range_bin_from_msg(const uint8_t** p_data, uint32_t* p_len, as_query_range* range);
+static bool ranges_from_msg(const uint8_t* data, uint32_t len, uint32_t n_ranges, as_query_range* range);
+static uint32_t entry_from_msg(const uint8_t* data, as_query_range* entry, uint32_t len);
+static int entry_cmp(const void* pa, const void* pb);
 static bool range_from_msg_integer(const uint8_t* data, as_query_range* range, uint32_t len);
 static bool range_from_msg_string(const uint8_t* data, as_query_range* range, uint32_t len);
 static bool range_from_msg_geojson(as_namespace* ns, const uint8_t* data, as_query_range* range, uint32_t len);
 static void sort_geo_range(as_query_geo_range* geo);
 
 static bool find_sindex(as_query_job* _job);
+static bool find_and_sindexes(as_query_job* _job);
+static as_sindex* lookup_sindex(const as_query_job* _job, as_query_range* range, as_sindex_type itype, const uint8_t* ctx_buf, uint32_t ctx_buf_sz);
+static void set_ordered_bvals(as_query_range* range);
+static void plan_query(as_query_job* _job);
+static bool pi_plan_bval(const as_query_range* range, int64_t* bval);
+static bool sindexes_readable(const as_query_job* _job);
+static void query_sindex(as_query_job* _job, as_partition_reservation* rsv, int64_t bval, cf_digest* keyd, as_sindex_reduce_fn cb, void* udata);
 static bool validate_background_query_rps(const as_namespace* ns, uint32_t* rps);
 
+static void set_response_proto(uint8_t* buf, size_t size);
 static size_t send_blocking_response_chunk(as_file_handle* fd_h, uint8_t* buf, size_t size, int32_t timeout, bool compress, as_proto_comp_stat* comp_stat);
 
 static bool record_matches_query(as_query_job* _job, as_storage_rd* rd);
+static bool record_matches_prefix(const as_query_job* _job, as_storage_rd* rd);
+static bool record_matches_and(const as_query_job* _job, as_storage_rd* rd);
 static bool record_matches_query_cdt(as_query_job* _job, const as_bin* b);
 static bool match_mapkeys_foreach(msgpack_in* key, msgpack_in* val, void* udata);
 static bool match_mapvalues_foreach(msgpack_in* key, msgpack_in* val, void* udata);
@@ -153,6 +181,8 @@ static bool match_listeles_foreach(msgpack_in* element, void* udata);
 static bool match_integer_element(const as_query_job* _job, msgpack_in* element);
 static bool match_string_element(const as_query_job* _job, msgpack_in* element);
 static bool match_geojson_element(const as_query_job* _job, msgpack_in* element);
+static bool range_has_integer(const as_query_range* range, int64_t i);
+static bool range_has_string(const as_query_range* range, const char* str, uint32_t len);
 
 
 //==========================================================
@@ -166,6 +196,34 @@ record_changed_since_start(const as_query_job* _job, const as_record *r)
 			_job->start_ms_clepoch;
 }
 
+// An ordered string key within the range means the record matches, unless it
+// overflows the stub and ties a bound - then only the record can tell.
+static inline bool
+ordered_key_matches(const as_query_job* _job, const as_record* r, int64_t bval)
+{
+	const as_query_range* range = _job->range;
+
+	if (! range->str_ordered || _job->pi_plan || _job->and_recheck ||
+			record_changed_since_start(_job, r)) {
+		return false;
+	}
+
+	if (! as_sindex_ordered_bval_overflows(bval)) {
+		return true;
+	}
+
+	// Multi-range entries are equalities - overflowing keys tie them.
+	return range->n_multi == 0 && bval != range->u.r.start &&
+			bval != range->u.r.end;
+}
+
+// Whether a partition was resumed from a PI-planned response.
+static inline bool
+resumed_pi_plan(const as_query_job* _job, const as_query_pid* qp)
+{
+	return _job->pi_plan_resumable && qp->bval == _job->pi_plan_bval;
+}
+
 static inline bool
 strings_match(const as_query_range* range, const char* str, size_t len)
 {
@@ -175,6 +233,54 @@ strings_match(const as_query_range* range, const char* str, size_t len)
 					len : sizeof(range->str_stub)) == 0;
 }
 
+// Lexicographic, by unsigned bytes - as ordered sindex keys compare.
+static inline int
+strings_cmp(const char* str_1, uint32_t len_1, const char* str_2,
+		uint32_t len_2)
+{
+	int cmp = memcmp(str_1, str_2, len_1 < len_2 ? len_1 : len_2);
+
+	if (cmp != 0) {
+		return cmp;
+	}
+
+	return len_1 == len_2 ? 0 : (len_1 < len_2 ? -1 : 1);
+}
+
+static inline bool
+string_in_range(const as_query_range* range, const char* str, uint32_t len)
+{
+	if (range->str_prefix) {
+		return len >= range->str_len &&
+				memcmp(str, range->str_start, range->str_len) == 0;
+	}
+
+	return strings_cmp(str, len, range->str_start, range->str_len) >= 0 &&
+			strings_cmp(str, len, range->str_end, range->str_end_len) <= 0;
+}
+
+// String ranges and prefixes - not multi-ranges, which are equalities.
+static inline bool
+needs_ordered(const as_query_range* range)
+{
+	return range->bin_type == AS_PARTICLE_TYPE_STRING && range->isrange &&
+			range->n_multi == 0;
+}
+
+static inline as_sindex*
+lookup_by_defn(const as_query_job* _job, const as_query_range* range,
+		as_sindex_type itype, bool ordered, const uint8_t* ctx_buf,
+		uint32_t ctx_buf_sz)
+{
+	if (range->exp_buf != NULL) {
+		return as_sindex_lookup_exp(_job->ns, _job->set_id, range->exp_buf,
+				range->exp_buf_sz, range->bin_type, itype, ordered);
+	}
+
+	return as_sindex_lookup_by_defn(_job->ns, _job->set_id, range->bin_id,
+			range->bin_type, itype, ordered, ctx_buf, ctx_buf_sz);
+}
+
 static inline const char*
 query_type_str(query_type type)
 {
@@ -187,6 +293,8 @@ query_type_str(query_type type)
 		return "background-udf";
 	case QUERY_TYPE_OPS_BG:
 		return "background-ops";
+	case QUERY_TYPE_EXP_AGGR:
+		return "exp-aggregation";
 	default:
 		return "?";
 	}
@@ -232,6 +340,8 @@ as_query(as_transaction* tr, as_namespace* ns)
 		return udf_bg_query_job_start(tr, ns);
 	case QUERY_TYPE_OPS_BG:
 		return ops_bg_query_job_start(tr, ns);
+	case QUERY_TYPE_EXP_AGGR:
+		return exp_aggr_query_job_start(tr, ns);
 	default:
 		return AS_ERR_PARAMETER;
 	}
@@ -267,6 +377,17 @@ as_query_abort(uint64_t trid)
 	return as_query_manager_abort_job(trid);
 }
 
+// Priority is a stride weight, 1 to 100 - 0 restores the job class default.
+bool
+as_query_set_priority(uint64_t trid, uint32_t priority)
+{
+	if (priority > 100) {
+		return false;
+	}
+
+	return as_query_manager_set_job_weight(trid, priority);
+}
+
 uint32_t
 as_query_abort_all(void)
 {
@@ -282,8 +403,14 @@ static query_type
 get_query_type(const as_transaction* tr)
 {
 	if (! as_transaction_is_udf(tr)) {
-		return (tr->msgp->msg.info2 & AS_MSG_INFO2_WRITE) != 0 ?
-				QUERY_TYPE_OPS_BG : QUERY_TYPE_BASIC;
+		if ((tr->msgp->msg.info2 & AS_MSG_INFO2_WRITE) != 0) {
+			return QUERY_TYPE_OPS_BG;
+		}
+
+		const as_msg_field* aggr_f = as_msg_field_get(&tr->msgp->msg,
+				AS_MSG_FIELD_TYPE_AGGR_EXP);
+
+		return aggr_f != NULL ? QUERY_TYPE_EXP_AGGR : QUERY_TYPE_BASIC;
 	}
 	// else - UDF query.
 
@@ -486,64 +613,44 @@ get_query_range(const as_transaction* tr, as_namespace* ns,
 	uint8_t n_ranges = *data++;
 	len--;
 
-	if (n_ranges != 1) {
-		cf_warning(AS_QUERY, "%u ranges - only 1 supported", n_ranges);
-		return false;
-	}
-
-	if (len == 0) {
-		cf_warning(AS_QUERY, "cannot parse bin name");
-		return false;
-	}
-
-	uint8_t bin_name_len = *data++;
-	len--;
-
-	if (bin_name_len == 0 || bin_name_len >= AS_BIN_NAME_MAX_SZ) {
-		cf_warning(AS_QUERY, "invalid bin name length %u", bin_name_len);
-		return false;
-	}
-
-	if (len < bin_name_len) {
-		cf_warning(AS_QUERY, "cannot parse bin name");
+	if (n_ranges == 0) {
+		cf_warning(AS_QUERY, "no ranges");
 		return false;
 	}
 
 	as_query_range* range = cf_calloc(1, sizeof(as_query_range));
 	*range_r = range; // link it to the job so that as_job_destroy will clean it
 
-	memcpy(range->bin_name, data, bin_name_len); // null-terminated via calloc
-
-	data += bin_name_len;
-	len -= bin_name_len;
-
-	if (len == 0) {
-		cf_warning(AS_QUERY, "cannot parse particle type");
-		return false;
+	if (n_ranges > 1) {
+		if (! ranges_from_msg(data, len, n_ranges, range)) {
+			return false;
+		}
 	}
+	else {
+		if (! range_bin_from_msg(&data, &len, range)) {
+			return false;
+		}
 
-	range->bin_type = *data++;
-	len--;
-
-	bool success;
+		bool success;
 
-	switch (range->bin_type) {
-	case AS_PARTICLE_TYPE_INTEGER:
-		success = range_from_msg_integer(data, range, len);
-		break;
-	case AS_PARTICLE_TYPE_STRING:
-		success = range_from_msg_string(data, range, len);
-		break;
-	case AS_PARTICLE_TYPE_GEOJSON:
-		success = range_from_msg_geojson(ns, data, range, len);
-		break;
-	default:
-		cf_warning(AS_QUERY, "invalid particle type %u", range->bin_type);
-		success = false;
-	}
+		switch (range->bin_type) {
+		case AS_PARTICLE_TYPE_INTEGER:
+			success = range_from_msg_integer(data, range, len);
+			break;
+		case AS_PARTICLE_TYPE_STRING:
+			success = range_from_msg_string(data, range, len);
+			break;
+		case AS_PARTICLE_TYPE_GEOJSON:
+			success = range_from_msg_geojson(ns, data, range, len);
+			break;
+		default:
+			cf_warning(AS_QUERY, "invalid particle type %u", range->bin_type);
+			success = false;
+		}
 
-	if (! success) {
-		return false;
+		if (! success) {
+			return false;
+		}
 	}
 
 	f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_INDEX_TYPE);
@@ -555,8 +662,37 @@ get_query_range(const as_transaction* tr, as_namespace* ns,
 
 	range->itype = f == NULL ? AS_SINDEX_ITYPE_DEFAULT : *f->data;
 
+	if (range->n_prefix != 0 && (range->itype != AS_SINDEX_ITYPE_DEFAULT ||
+			range->bin_type == AS_PARTICLE_TYPE_GEOJSON)) {
+		cf_warning(AS_QUERY, "multi-bin query must be default itype and not geo");
+		return false;
+	}
+
 	range->de_dup = range->isrange && range->itype != AS_SINDEX_ITYPE_DEFAULT;
 
+	f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_INDEX_ORDER);
+
+	if (f != NULL) {
+		if (as_msg_field_get_value_sz(f) != sizeof(uint8_t) || *f->data > 1) {
+			cf_warning(AS_QUERY, "cannot parse index order");
+			return false;
+		}
+
+		if (get_query_type(tr) != QUERY_TYPE_BASIC) {
+			cf_warning(AS_QUERY, "ordered query must be basic");
+			return false;
+		}
+
+		if (range->itype != AS_SINDEX_ITYPE_DEFAULT || range->n_multi != 0 ||
+				range->bin_type == AS_PARTICLE_TYPE_GEOJSON) {
+			cf_warning(AS_QUERY, "ordered query must be single range, default itype and not geo");
+			return false;
+		}
+
+		range->ordered = true;
+		range->desc = *f->data == 1;
+	}
+
 	f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_INDEX_CONTEXT);
 
 	if (f != NULL) {
@@ -606,6 +742,41 @@ get_query_range(const as_transaction* tr, as_namespace* ns,
 		}
 	}
 
+	f = as_msg_field_get(&tr->msgp->msg, AS_MSG_FIELD_TYPE_INDEX_EXPRESSION);
+
+	if (f != NULL) {
+		range->exp_buf_sz = as_msg_field_get_value_sz(f);
+
+		if (range->exp_buf_sz == 0) {
+			cf_warning(AS_QUERY, "cannot parse index expression");
+			return false;
+		}
+
+		if (range->bin_name[0] != '\0' || range->n_prefix != 0 ||
+				range->ctx_buf != NULL) {
+			cf_warning(AS_QUERY, "index expression with bin name or context");
+			return false;
+		}
+
+		// Only compared with sindex expressions - never evaluated.
+		range->exp_buf = cf_malloc(range->exp_buf_sz);
+		memcpy(range->exp_buf, f->data, range->exp_buf_sz);
+
+		return true;
+	}
+
+	if (range->bin_name[0] == '\0') {
+		cf_warning(AS_QUERY, "missing bin name");
+		return false;
+	}
+
+	for (uint32_t i = 0; i < range->n_prefix; i++) {
+		if (range->prefix[i].bin_name[0] == '\0') {
+			cf_warning(AS_QUERY, "missing bin name");
+			return false;
+		}
+	}
+
 	return true;
 }
 
@@ -678,6 +849,35 @@ get_query_sample_max(const as_transaction* tr, uint64_t* sample_max)
 	return true;
 }
 
+static bool
+get_query_sample_rate(const as_transaction* tr, uint32_t* sample_rate)
+{
+	const as_msg_field* f = as_msg_field_get(&tr->msgp->msg,
+			AS_MSG_FIELD_TYPE_SAMPLE_RATE);
+
+	if (f == NULL) {
+		return true;
+	}
+
+	if (as_msg_field_get_value_sz(f) != sizeof(uint32_t)) {
+		cf_warning(AS_QUERY, "sample-rate field size not %zu",
+				sizeof(uint32_t));
+		return false;
+	}
+
+	uint32_t rate = cf_swap_from_be32(*(uint32_t*)f->data);
+
+	if (rate == 0 || rate > SAMPLE_RATE_MAX) {
+		cf_warning(AS_QUERY, "sample-rate %u not 1 to %u", rate,
+				SAMPLE_RATE_MAX);
+		return false;
+	}
+
+	*sample_rate = rate;
+
+	return true;
+}
+
 static bool
 get_query_filter_exp(const as_transaction* tr, as_exp** exp)
 {
@@ -694,106 +894,368 @@ get_query_filter_exp(const as_transaction* tr, as_exp** exp)
 }
 
 static bool
-range_from_msg_integer(const uint8_t* data, as_query_range* range, uint32_t len)
+range_bin_from_msg(const uint8_t** p_data, uint32_t* p_len,
+		as_query_range* range)
 {
-	if (len < (sizeof(uint32_t) * 2) + (sizeof(uint64_t) * 2)) {
-		cf_warning(AS_QUERY, "cannot parse integer range");
+	const uint8_t* data = *p_data;
+	uint32_t len = *p_len;
+
+	if (len == 0) {
+		cf_warning(AS_QUERY, "cannot parse bin name");
 		return false;
 	}
 
-	uint32_t startl = cf_swap_from_be32(*((uint32_t*)data));
+	uint8_t bin_name_len = *data++;
+	len--;
 
-	if (startl != 8) {
-		cf_warning(AS_QUERY, "can only handle 8 byte integers %u", startl);
+	// Zero length is ok here - it's an expression sindex query if there's an
+	// index expression, checked later.
+	if (bin_name_len >= AS_BIN_NAME_MAX_SZ) {
+		cf_warning(AS_QUERY, "invalid bin name length %u", bin_name_len);
 		return false;
 	}
 
-	data += sizeof(uint32_t);
-
-	int64_t start = (int64_t)cf_swap_from_be64(*((uint64_t*)data));
-
-	data += sizeof(uint64_t);
-
-	uint32_t endl = cf_swap_from_be32(*((uint32_t*)data));
-
-	if (endl != 8) {
-		cf_warning(AS_QUERY, "can only handle 8 byte integers %u", endl);
+	if (len < bin_name_len) {
+		cf_warning(AS_QUERY, "cannot parse bin name");
 		return false;
 	}
 
-	data += sizeof(uint32_t);
+	memcpy(range->bin_name, data, bin_name_len); // null-terminated via calloc
 
-	int64_t end = (int64_t)cf_swap_from_be64(*((uint64_t*)data));
+	data += bin_name_len;
+	len -= bin_name_len;
 
-	if (start > end) {
-		cf_warning(AS_QUERY, "invalid range - %ld ... %ld", start, end);
+	if (len == 0) {
+		cf_warning(AS_QUERY, "cannot parse particle type");
 		return false;
 	}
 
-	range->u.r.start = start;
-	range->u.r.end = end;
-
-	range->isrange = start != end;
+	range->bin_type = *data++;
+	len--;
 
-	cf_debug(AS_QUERY, "query range - %ld ... %ld", start, end);
+	*p_data = data;
+	*p_len = len;
 
 	return true;
 }
 
+// Multiple ranges on different bins must all match - they query a composite
+// sindex if there's one and all but the last are equalities, else intersect
+// single-bin sindexes. If all on the same bin, they are a list of values and
+// ranges to match any of (an IN-list).
 static bool
-range_from_msg_string(const uint8_t* data, as_query_range* range, uint32_t len)
+ranges_from_msg(const uint8_t* data, uint32_t len, uint32_t n_ranges,
+		as_query_range* range)
 {
-	if (len < sizeof(uint32_t)) {
-		cf_warning(AS_QUERY, "cannot parse string range");
-		return false;
+	as_query_range* entries = cf_calloc(n_ranges, sizeof(as_query_range));
+	bool same_bin = true;
+
+	// Until it's split up, the range owns the entries - for cleanup.
+	range->multi = entries;
+
+	for (uint32_t i = 0; i < n_ranges; i++) {
+		uint32_t sz = entry_from_msg(data, &entries[i], len);
+
+		if (sz == 0) {
+			return false;
+		}
+
+		range->n_multi = i + 1;
+
+		data += sz;
+		len -= sz;
+
+		if (strcmp(entries[i].bin_name, entries[0].bin_name) != 0) {
+			same_bin = false;
+		}
 	}
 
-	uint32_t startl = cf_swap_from_be32(*((uint32_t*)data));
+	if (! same_bin) {
+		if (n_ranges > MAX_COMPOSITE_BINS) {
+			cf_warning(AS_QUERY, "%u ranges on different bins - only up to %u supported",
+					n_ranges, MAX_COMPOSITE_BINS);
+			return false;
+		}
 
-	if (startl >= MAX_STRING_KSIZE) {
-		cf_warning(AS_QUERY, "query string too long - %u", startl);
-		return false;
+		*range = entries[n_ranges - 1];
+		range->n_prefix = n_ranges - 1;
+		range->prefix = entries;
+
+		return true;
 	}
 
-	data += sizeof(uint32_t);
-	len -= (uint32_t)sizeof(uint32_t);
+	for (uint32_t i = 0; i < n_ranges; i++) {
+		if (entries[i].bin_type != entries[0].bin_type) {
+			cf_warning(AS_QUERY, "mixed particle types in multi-range on bin %s",
+					entries[0].bin_name);
+			return false;
+		}
 
-	if (len < startl) {
-		cf_warning(AS_QUERY, "cannot parse string range");
-		return false;
+		// Overlapping string ranges would visit records more than once.
+		if (entries[i].bin_type == AS_PARTICLE_TYPE_STRING &&
+				entries[i].isrange) {
+			cf_warning(AS_QUERY, "string ranges and prefixes not allowed in multi-range on bin %s",
+					entries[0].bin_name);
+			return false;
+		}
 	}
 
-	const char* startp = (const char*)data;
+	// Sorted so a partition's sindex tree is traversed once, in bval order.
+	qsort(entries, n_ranges, sizeof(as_query_range), entry_cmp);
 
-	// Currently, clients also send an 'end' string which is identical to the
-	// 'start' string. Ignore that here for performance, since it's redundant.
+	uint32_t n_multi = 1;
 
-	range->u.r.start = as_sindex_string_to_bval(startp, startl);
-	range->u.r.end = range->u.r.start;
+	for (uint32_t i = 1; i < n_ranges; i++) {
+		as_query_range* last = &entries[n_multi - 1];
+		const as_query_range* entry = &entries[i];
 
-	range->str_len = startl;
-	memcpy(range->str_stub, startp, startl < sizeof(range->str_stub) ?
-			startl : sizeof(range->str_stub));
+		// Merge overlapping or adjacent integer ranges. (Strings must stay
+		// separate, to check for hash collisions.)
+		if (entry->bin_type == AS_PARTICLE_TYPE_INTEGER &&
+				(last->u.r.end == INT64_MAX ||
+						entry->u.r.start <= last->u.r.end + 1)) {
+			if (entry->u.r.end > last->u.r.end) {
+				last->u.r.end = entry->u.r.end;
+			}
+
+			last->isrange = true;
+			continue;
+		}
+
+		entries[n_multi++] = *entry;
+	}
+
+	strcpy(range->bin_name, entries[0].bin_name);
+	range->bin_type = entries[0].bin_type;
+
+	// The lone range spans all the entries.
+	range->u.r.start = entries[0].u.r.start;
+	range->u.r.end = entries[0].u.r.end;
+
+	for (uint32_t i = 1; i < n_multi; i++) {
+		if (entries[i].u.r.end > range->u.r.end) {
+			range->u.r.end = entries[i].u.r.end;
+		}
+	}
 
-	range->isrange = false;
+	range->isrange = true; // a record may match more than one entry
+	range->n_multi = n_multi;
+	range->multi = entries;
 
-	cf_debug(AS_QUERY, "query on string %.*s", startl, startp);
+	cf_debug(AS_QUERY, "query multi-range on bin %s - %u entries",
+			range->bin_name, n_multi);
 
 	return true;
 }
 
-static bool
-range_from_msg_geojson(as_namespace* ns, const uint8_t* data,
-		as_query_range* range, uint32_t len)
+// Returns the number of bytes parsed, or 0 on error.
+static uint32_t
+entry_from_msg(const uint8_t* data, as_query_range* entry, uint32_t len)
 {
-	if (len < sizeof(uint32_t)) {
-		cf_warning(AS_QUERY, "cannot parse geojson range");
-		return false;
+	const uint8_t* start = data;
+
+	if (! range_bin_from_msg(&data, &len, entry)) {
+		return 0;
 	}
 
-	uint32_t startl = cf_swap_from_be32(*((uint32_t*)data));
+	uint32_t sz;
 
-	if (startl == 0 || startl >= MAX_GEOJSON_KSIZE) {
+	switch (entry->bin_type) {
+	case AS_PARTICLE_TYPE_INTEGER:
+		if (! range_from_msg_integer(data, entry, len)) {
+			return 0;
+		}
+
+		sz = (sizeof(uint32_t) + sizeof(uint64_t)) * 2;
+		break;
+	case AS_PARTICLE_TYPE_STRING:
+		if (! range_from_msg_string(data, entry, len)) {
+			return 0;
+		}
+
+		sz = ((uint32_t)sizeof(uint32_t) * 2) + entry->str_len +
+				entry->str_end_len;
+		break;
+	default:
+		cf_warning(AS_QUERY, "invalid multi-range particle type %u",
+				entry->bin_type);
+		return 0;
+	}
+
+	return (uint32_t)(data - start) + sz;
+}
+
+static int
+entry_cmp(const void* pa, const void* pb)
+{
+	const as_query_range* a = (const as_query_range*)pa;
+	const as_query_range* b = (const as_query_range*)pb;
+
+	if (a->u.r.start != b->u.r.start) {
+		return a->u.r.start > b->u.r.start ? 1 : -1;
+	}
+
+	if (a->u.r.end != b->u.r.end) {
+		return a->u.r.end > b->u.r.end ? 1 : -1;
+	}
+
+	return 0;
+}
+
+static bool
+range_from_msg_integer(const uint8_t* data, as_query_range* range, uint32_t len)
+{
+	if (len < (sizeof(uint32_t) * 2) + (sizeof(uint64_t) * 2)) {
+		cf_warning(AS_QUERY, "cannot parse integer range");
+		return false;
+	}
+
+	uint32_t startl = cf_swap_from_be32(*((uint32_t*)data));
+
+	if (startl != 8) {
+		cf_warning(AS_QUERY, "can only handle 8 byte integers %u", startl);
+		return false;
+	}
+
+	data += sizeof(uint32_t);
+
+	int64_t start = (int64_t)cf_swap_from_be64(*((uint64_t*)data));
+
+	data += sizeof(uint64_t);
+
+	uint32_t endl = cf_swap_from_be32(*((uint32_t*)data));
+
+	if (endl != 8) {
+		cf_warning(AS_QUERY, "can only handle 8 byte integers %u", endl);
+		return false;
+	}
+
+	data += sizeof(uint32_t);
+
+	int64_t end = (int64_t)cf_swap_from_be64(*((uint64_t*)data));
+
+	if (start > end) {
+		cf_warning(AS_QUERY, "invalid range - %ld ... %ld", start, end);
+		return false;
+	}
+
+	range->u.r.start = start;
+	range->u.r.end = end;
+
+	range->isrange = start != end;
+
+	cf_debug(AS_QUERY, "query range - %ld ... %ld", start, end);
+
+	return true;
+}
+
+static bool
+range_from_msg_string(const uint8_t* data, as_query_range* range, uint32_t len)
+{
+	if (len < sizeof(uint32_t)) {
+		cf_warning(AS_QUERY, "cannot parse string range");
+		return false;
+	}
+
+	uint32_t startl = cf_swap_from_be32(*((uint32_t*)data));
+
+	if (startl >= MAX_STRING_KSIZE) {
+		cf_warning(AS_QUERY, "query string too long - %u", startl);
+		return false;
+	}
+
+	data += sizeof(uint32_t);
+	len -= (uint32_t)sizeof(uint32_t);
+
+	if (len < startl + sizeof(uint32_t)) {
+		cf_warning(AS_QUERY, "cannot parse string range");
+		return false;
+	}
+
+	const char* startp = (const char*)data;
+
+	data += startl;
+	len -= startl;
+
+	uint32_t endl = cf_swap_from_be32(*((uint32_t*)data));
+
+	if (endl >= MAX_STRING_KSIZE) {
+		cf_warning(AS_QUERY, "query end string too long - %u", endl);
+		return false;
+	}
+
+	data += sizeof(uint32_t);
+	len -= (uint32_t)sizeof(uint32_t);
+
+	if (len < endl) {
+		cf_warning(AS_QUERY, "cannot parse string range");
+		return false;
+	}
+
+	const char* endp = (const char*)data;
+
+	// Clients send an 'end' string identical to the 'start' string for
+	// equality. A different 'end' makes an (inclusive) lexicographic range,
+	// and an empty 'end' a prefix query - these need an ordered sindex.
+	bool equality = endl == startl && memcmp(startp, endp, startl) == 0;
+
+	range->str_prefix = ! equality && endl == 0;
+
+	if (! equality && ! range->str_prefix &&
+			strings_cmp(startp, startl, endp, endl) > 0) {
+		cf_warning(AS_QUERY, "invalid string range - %.*s ... %.*s", startl,
+				startp, endl, endp);
+		return false;
+	}
+
+	range->u.r.start = as_sindex_string_to_bval(startp, startl);
+	range->u.r.end = range->u.r.start;
+
+	range->str_len = startl;
+	memcpy(range->str_stub, startp, startl < sizeof(range->str_stub) ?
+			startl : sizeof(range->str_stub));
+
+	range->str_start = cf_malloc(startl + (equality ? 0 : endl) + 1);
+	memcpy(range->str_start, startp, startl);
+
+	if (equality) {
+		range->str_end = range->str_start;
+		range->str_end_len = startl;
+	}
+	else {
+		range->str_end = range->str_start + startl;
+		range->str_end_len = endl;
+		memcpy(range->str_end, endp, endl);
+	}
+
+	range->isrange = ! equality;
+
+	if (range->str_prefix) {
+		cf_debug(AS_QUERY, "query on string prefix %.*s", startl, startp);
+	}
+	else if (range->isrange) {
+		cf_debug(AS_QUERY, "query on strings %.*s ... %.*s", startl, startp,
+				endl, endp);
+	}
+	else {
+		cf_debug(AS_QUERY, "query on string %.*s", startl, startp);
+	}
+
+	return true;
+}
+
+static bool
+range_from_msg_geojson(as_namespace* ns, const uint8_t* data,
+		as_query_range* range, uint32_t len)
+{
+	if (len < sizeof(uint32_t)) {
+		cf_warning(AS_QUERY, "cannot parse geojson range");
+		return false;
+	}
+
+	uint32_t startl = cf_swap_from_be32(*((uint32_t*)data));
+
+	if (startl == 0 || startl >= MAX_GEOJSON_KSIZE) {
 		cf_warning(AS_QUERY, "invalid query key size - %u", startl);
 		return false;
 	}
@@ -908,13 +1370,51 @@ find_sindex(as_query_job* _job)
 		return true;
 	}
 
-	if (! as_bin_get_id(_job->ns, range->bin_name, &range->bin_id)) {
+	if (range->exp_buf == NULL &&
+			! as_bin_get_id(_job->ns, range->bin_name, &range->bin_id)) {
 		cf_warning(AS_QUERY, "bin %s not found", range->bin_name);
 		return false;
 	}
 
-	_job->si = as_sindex_lookup_by_defn(_job->ns, _job->set_id, range->bin_id,
-			range->bin_type, range->itype, range->ctx_buf, range->ctx_buf_sz);
+	if (range->n_prefix != 0) {
+		uint16_t bin_ids[MAX_COMPOSITE_BINS];
+		as_particle_type ktypes[MAX_COMPOSITE_BINS];
+		bool all_equality = true;
+
+		for (uint32_t i = 0; i < range->n_prefix; i++) {
+			as_query_range* prefix = &range->prefix[i];
+
+			if (! as_bin_get_id(_job->ns, prefix->bin_name, &prefix->bin_id)) {
+				cf_warning(AS_QUERY, "bin %s not found", prefix->bin_name);
+				return false;
+			}
+
+			bin_ids[i] = prefix->bin_id;
+			ktypes[i] = prefix->bin_type;
+
+			if (prefix->isrange) {
+				all_equality = false;
+			}
+		}
+
+		bin_ids[range->n_prefix] = range->bin_id;
+		ktypes[range->n_prefix] = range->bin_type;
+
+		// Composite keys hash a string range bin.
+		if (all_equality && ! needs_ordered(range)) {
+			_job->si = as_sindex_lookup_composite(_job->ns, _job->set_id,
+					bin_ids, ktypes, range->n_prefix + 1, range->ctx_buf,
+					range->ctx_buf_sz);
+		}
+
+		if (_job->si == NULL && ! find_and_sindexes(_job)) {
+			return false;
+		}
+	}
+	else {
+		_job->si = lookup_sindex(_job, range, range->itype, range->ctx_buf,
+				range->ctx_buf_sz);
+	}
 
 	if (_job->si == NULL) {
 		return false;
@@ -924,115 +1424,398 @@ find_sindex(as_query_job* _job)
 		strcpy(_job->si_name, _job->si->iname);
 	}
 
+	if (_job->n_and_sis == 0) {
+		plan_query(_job);
+	}
+
 	return true;
 }
 
+// No composite sindex - the last range's sindex drives the query, so results
+// (and resumption) are in its order, and the others narrow it per partition.
 static bool
-validate_background_query_rps(const as_namespace* ns, uint32_t* rps)
+find_and_sindexes(as_query_job* _job)
 {
-	uint32_t max_rps = as_load_uint32(&ns->background_query_max_rps);
+	as_query_range* range = _job->range;
+	as_sindex* si = lookup_sindex(_job, range, range->itype, range->ctx_buf,
+			range->ctx_buf_sz);
 
-	if (*rps > max_rps) {
-		cf_warning(AS_QUERY, "query rps %u exceeds 'background-query-max-rps' %u",
-				*rps, max_rps);
+	if (si == NULL) {
 		return false;
 	}
 
-	if (*rps == 0) {
-		*rps = max_rps;
+	for (uint32_t i = 0; i < range->n_prefix; i++) {
+		as_query_range* prefix = &range->prefix[i];
+		as_sindex* and_si = lookup_sindex(_job, prefix,
+				AS_SINDEX_ITYPE_DEFAULT, NULL, 0);
+
+		if (and_si == NULL) {
+			cf_warning(AS_QUERY, "no sindex on bin %s to intersect",
+					prefix->bin_name);
+			as_sindex_release(si);
+			return false;
+		}
+
+		_job->and_sis[_job->n_and_sis++] = and_si;
+
+		if (prefix->bin_type == AS_PARTICLE_TYPE_STRING) {
+			_job->and_recheck = true;
+		}
 	}
 
+	_job->si = si;
+
 	return true;
 }
 
-static size_t
-send_blocking_response_chunk(as_file_handle* fd_h, uint8_t* buf, size_t size,
-		int32_t timeout, bool compress, as_proto_comp_stat* comp_stat)
+// String equality prefers a hashed sindex, whose keys never tie - string
+// ranges and prefixes need an ordered one.
+static as_sindex*
+lookup_sindex(const as_query_job* _job, as_query_range* range,
+		as_sindex_type itype, const uint8_t* ctx_buf, uint32_t ctx_buf_sz)
 {
-	cf_socket* sock = &fd_h->sock;
-	as_proto* proto = (as_proto*)buf;
-
-	proto->version = PROTO_VERSION;
-	proto->type = PROTO_TYPE_AS_MSG;
-	proto->sz = size - sizeof(as_proto);
-	as_proto_swap(proto);
-
-	const uint8_t* msgp = (const uint8_t*)buf;
+	as_sindex* si = NULL;
 
-	if (compress) {
-		msgp = as_proto_compress(msgp, &size, comp_stat);
+	if (! needs_ordered(range)) {
+		si = lookup_by_defn(_job, range, itype, false, ctx_buf, ctx_buf_sz);
 	}
 
-	if (cf_socket_send_all(sock, msgp, size, MSG_NOSIGNAL, timeout) < 0) {
-		cf_warning(AS_QUERY, "error sending to %s - fd %d sz %lu %s",
-				fd_h->client, CSFD(sock), size, cf_strerror(errno));
-		return 0;
+	if (si == NULL && range->bin_type == AS_PARTICLE_TYPE_STRING) {
+		si = lookup_by_defn(_job, range, itype, true, ctx_buf, ctx_buf_sz);
+
+		if (si != NULL) {
+			set_ordered_bvals(range);
+		}
 	}
 
-	return sizeof(as_proto) + size;
+	return si;
 }
 
-static bool
-record_matches_query(as_query_job* _job, as_storage_rd* rd)
+static void
+set_ordered_bvals(as_query_range* range)
 {
-	if (! record_changed_since_start(_job, rd->r) &&
-			_job->si->ktype != AS_PARTICLE_TYPE_GEOJSON && // geo needs to check bounds anyway
-			_job->si->ktype != AS_PARTICLE_TYPE_STRING) { // strings need to check for hash collisions
-		return true;
-	}
+	range->str_ordered = true;
 
-	as_bin stack_bins[RECORD_MAX_BINS]; // never single-bin
+	if (range->n_multi != 0) {
+		for (uint32_t i = 0; i < range->n_multi; i++) {
+			set_ordered_bvals(&range->multi[i]);
+		}
 
-	if (as_storage_rd_load_bins(rd, stack_bins) < 0) {
-		return false; // for now - not separating error from false positive
+		// Re-sort in (ordered) bval order - entries are all equalities.
+		qsort(range->multi, range->n_multi, sizeof(as_query_range), entry_cmp);
+
+		range->u.r.start = range->multi[0].u.r.start;
+		range->u.r.end = range->multi[range->n_multi - 1].u.r.end;
+
+		return;
 	}
 
-	const as_query_range* range = _job->range;
-	const as_sindex* si = _job->si;
+	range->u.r.start = as_sindex_string_to_ordered_bval(range->str_start,
+			range->str_len);
+	range->u.r.end = range->str_prefix ?
+			as_sindex_string_prefix_end_bval(range->str_start,
+					range->str_len) :
+			as_sindex_string_to_ordered_bval(range->str_end,
+					range->str_end_len);
+}
 
-	const as_bin* b = as_bin_get_by_id_live(rd, si->bin_id);
+// A range matching a big enough fraction of the records is cheaper to serve
+// with a (set-index or) primary index scan, filtering each record against the
+// range, than with a random access per sindex entry.
+static void
+plan_query(as_query_job* _job)
+{
+	as_namespace* ns = _job->ns;
+	const as_sindex* si = _job->si;
+	const as_query_range* range = _job->range;
+	uint32_t threshold_pct = ns->sindex_pi_scan_pct;
 
-	if (b == NULL) {
-		return false;
+	// An ordered query relies on walking the sindex in key order.
+	if (range->bin_type == AS_PARTICLE_TYPE_GEOJSON || range->ordered ||
+			as_sindex_is_composite(si)) {
+		return;
 	}
 
-	as_particle_type type = as_bin_get_particle_type(b);
-	as_bin ctx_bin = { 0 };
-
-	if (range->ctx_buf != NULL) {
-		if (type != AS_PARTICLE_TYPE_LIST && type != AS_PARTICLE_TYPE_MAP) {
-			return false;
+	// A partition-tracked query may be resumed, and must carry on in the plan
+	// it started with - stats may change between pages. PI-planned responses
+	// carry a bval no sindex key in the range has, so the resume bvals say
+	// which plan that was. (A partition resumed in the other plan, e.g. after
+	// migrating from another node, is rescanned.)
+	if (_job->pids != NULL) {
+		if (! pi_plan_bval(range, &_job->pi_plan_bval)) {
+			return; // range spans every bval - keep the sindex plan
 		}
 
-		if (! as_bin_cdt_get_by_context(b, si->ctx_buf, si->ctx_buf_sz,
-				&ctx_bin, false)) {
-			return false;
-		}
+		_job->pi_plan_resumable = true;
 
-		type = as_bin_get_particle_type(&ctx_bin);
+		for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+			const as_query_pid* qp = &_job->pids[pid];
 
-		if (type == AS_PARTICLE_TYPE_GEOJSON &&
-				! as_bin_cdt_context_geojson_parse(&ctx_bin)) {
-			return false;
+			if (qp->has_resume) {
+				if (resumed_pi_plan(_job, qp)) {
+					_job->pi_plan = true;
+					as_incr_uint64(&ns->n_si_query_pi_planned);
+				}
+
+				return;
+			}
 		}
+	}
 
-		b = &ctx_bin;
+	if (threshold_pct == 0) {
+		return;
 	}
 
-	bool ret = false;
+	uint64_t n_scan_objects = si->hist_n_scan_objects;
 
-	switch (type) {
-		case AS_PARTICLE_TYPE_INTEGER:
-			if (type != si->ktype || si->itype != AS_SINDEX_ITYPE_DEFAULT) {
-				break;
-			}
+	if (n_scan_objects == 0) {
+		return;
+	}
 
-			int64_t i = as_bin_particle_integer_value(b);
+	uint64_t n_keys = 0;
 
-			// Start and end are same for point query.
-			ret = range->u.r.start <= i && i <= range->u.r.end;
-			break;
-		case AS_PARTICLE_TYPE_STRING:
+	if (range->n_multi != 0) {
+		for (uint32_t i = 0; i < range->n_multi; i++) {
+			const as_query_range* entry = &range->multi[i];
+			uint64_t n = as_sindex_tree_estimate_keys(si, entry->u.r.start,
+					entry->u.r.end);
+
+			if (n == UINT64_MAX) {
+				return;
+			}
+
+			n_keys += n;
+		}
+	}
+	else {
+		n_keys = as_sindex_tree_estimate_keys(si, range->u.r.start,
+				range->u.r.end);
+
+		if (n_keys == UINT64_MAX) {
+			return;
+		}
+	}
+
+	uint64_t n_recs = si->keys_per_rec <= 1 ?
+			n_keys : n_keys / si->keys_per_rec;
+
+	if (n_recs * 100 < n_scan_objects * threshold_pct) {
+		return;
+	}
+
+	cf_debug(AS_QUERY, "sindex %s range matches ~%lu of %lu records - scanning",
+			si->iname, n_recs, n_scan_objects);
+
+	_job->pi_plan = true;
+	as_incr_uint64(&ns->n_si_query_pi_planned);
+}
+
+// A bval just outside the range - no sindex key a query matches can have it.
+// False if the range spans every bval.
+static bool
+pi_plan_bval(const as_query_range* range, int64_t* bval)
+{
+	if (range->u.r.start != INT64_MIN) {
+		*bval = range->u.r.start - 1;
+		return true;
+	}
+
+	if (range->u.r.end != INT64_MAX) {
+		*bval = range->u.r.end + 1;
+		return true;
+	}
+
+	return false;
+}
+
+static bool
+sindexes_readable(const as_query_job* _job)
+{
+	if (_job->si != NULL && ! _job->si->readable) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < _job->n_and_sis; i++) {
+		if (! _job->and_sis[i]->readable) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Intersecting gathers the other sindexes' matching records first, so the
+// driving sindex only reads records matching all the ranges.
+static void
+query_sindex(as_query_job* _job, as_partition_reservation* rsv, int64_t bval,
+		cf_digest* keyd, as_sindex_reduce_fn cb, void* udata)
+{
+	if (_job->n_and_sis == 0) {
+		as_sindex_tree_query(_job->si, _job->range, rsv, bval, keyd, cb,
+				udata);
+		return;
+	}
+
+	uint64_t* r_hs = NULL;
+	uint32_t n_r_hs = 0;
+
+	for (uint32_t i = 0; i < _job->n_and_sis; i++) {
+		r_hs = as_sindex_tree_intersect(_job->and_sis[i],
+				&_job->range->prefix[i], rsv->p->id, r_hs, &n_r_hs);
+
+		if (n_r_hs == 0) {
+			break;
+		}
+	}
+
+	if (n_r_hs != 0) {
+		as_sindex_tree_query_filtered(_job->si, _job->range, rsv, bval, keyd,
+				r_hs, n_r_hs, cb, udata);
+	}
+
+	if (r_hs != NULL) {
+		cf_free(r_hs);
+	}
+}
+
+static bool
+validate_background_query_rps(const as_namespace* ns, uint32_t* rps)
+{
+	uint32_t max_rps = as_load_uint32(&ns->background_query_max_rps);
+
+	if (*rps > max_rps) {
+		cf_warning(AS_QUERY, "query rps %u exceeds 'background-query-max-rps' %u",
+				*rps, max_rps);
+		return false;
+	}
+
+	if (*rps == 0) {
+		*rps = max_rps;
+	}
+
+	return true;
+}
+
+static void
+set_response_proto(uint8_t* buf, size_t size)
+{
+	as_proto* proto = (as_proto*)buf;
+
+	proto->version = PROTO_VERSION;
+	proto->type = PROTO_TYPE_AS_MSG;
+	proto->sz = size - sizeof(as_proto);
+	as_proto_swap(proto);
+}
+
+static size_t
+send_blocking_response_chunk(as_file_handle* fd_h, uint8_t* buf, size_t size,
+		int32_t timeout, bool compress, as_proto_comp_stat* comp_stat)
+{
+	cf_socket* sock = &fd_h->sock;
+
+	set_response_proto(buf, size);
+
+	const uint8_t* msgp = (const uint8_t*)buf;
+
+	if (compress) {
+		msgp = as_proto_compress(msgp, &size, comp_stat);
+	}
+
+	if (cf_socket_send_all(sock, msgp, size, MSG_NOSIGNAL, timeout) < 0) {
+		cf_warning(AS_QUERY, "error sending to %s - fd %d sz %lu %s",
+				fd_h->client, CSFD(sock), size, cf_strerror(errno));
+		return 0;
+	}
+
+	return sizeof(as_proto) + size;
+}
+
+static bool
+record_matches_query(as_query_job* _job, as_storage_rd* rd)
+{
+	if (! _job->pi_plan && // scanned records were never matched by sindex
+			! record_changed_since_start(_job, rd->r) &&
+			_job->si->ktype != AS_PARTICLE_TYPE_GEOJSON && // geo needs to check bounds anyway
+			_job->si->ktype != AS_PARTICLE_TYPE_STRING && // strings need to check for hash collisions
+			! as_sindex_is_composite(_job->si) && // composite keys are lossy
+			! _job->and_recheck) {
+		return true;
+	}
+
+	as_bin stack_bins[RECORD_MAX_BINS]; // never single-bin
+
+	if (as_storage_rd_load_bins(rd, stack_bins) < 0) {
+		return false; // for now - not separating error from false positive
+	}
+
+	const as_query_range* range = _job->range;
+	const as_sindex* si = _job->si;
+
+	if (as_sindex_is_composite(si) && ! record_matches_prefix(_job, rd)) {
+		return false;
+	}
+
+	if (_job->n_and_sis != 0 && ! record_matches_and(_job, rd)) {
+		return false;
+	}
+
+	as_bin exp_bin = { 0 };
+	const as_bin* b;
+
+	if (as_sindex_is_exp(si)) {
+		as_exp_ctx ctx = { .ns = _job->ns, .r = rd->r, .rd = rd };
+
+		if (! as_exp_eval(si->exp, &ctx, &exp_bin, NULL, false)) {
+			return false;
+		}
+
+		if (! as_bin_is_live(&exp_bin)) {
+			as_bin_particle_destroy(&exp_bin);
+			return false;
+		}
+
+		b = &exp_bin;
+	}
+	else if ((b = as_bin_get_by_id_live(rd, si->bin_id)) == NULL) {
+		return false;
+	}
+
+	as_particle_type type = as_bin_get_particle_type(b);
+	as_bin ctx_bin = { 0 };
+
+	if (range->ctx_buf != NULL) {
+		if (type != AS_PARTICLE_TYPE_LIST && type != AS_PARTICLE_TYPE_MAP) {
+			return false;
+		}
+
+		if (! as_bin_cdt_get_by_context(b, si->ctx_buf, si->ctx_buf_sz,
+				&ctx_bin, false)) {
+			return false;
+		}
+
+		type = as_bin_get_particle_type(&ctx_bin);
+
+		if (type == AS_PARTICLE_TYPE_GEOJSON &&
+				! as_bin_cdt_context_geojson_parse(&ctx_bin)) {
+			return false;
+		}
+
+		b = &ctx_bin;
+	}
+
+	bool ret = false;
+
+	switch (type) {
+		case AS_PARTICLE_TYPE_INTEGER:
+			if (type != si->ktype || si->itype != AS_SINDEX_ITYPE_DEFAULT) {
+				break;
+			}
+
+			int64_t i = as_bin_particle_integer_value(b);
+
+			ret = range_has_integer(range, i);
+			break;
+		case AS_PARTICLE_TYPE_STRING:
 			if (type != si->ktype || si->itype != AS_SINDEX_ITYPE_DEFAULT) {
 				break;
 			}
@@ -1040,7 +1823,7 @@ record_matches_query(as_query_job* _job, as_storage_rd* rd)
 			char* str;
 			uint32_t len = as_bin_particle_string_ptr(b, &str);
 
-			ret = strings_match(range, str, len);
+			ret = range_has_string(range, str, len);
 			break;
 		case AS_PARTICLE_TYPE_GEOJSON:
 			if (type != si->ktype || si->itype != AS_SINDEX_ITYPE_DEFAULT) {
@@ -1076,9 +1859,101 @@ record_matches_query(as_query_job* _job, as_storage_rd* rd)
 		as_bin_particle_destroy(&ctx_bin);
 	}
 
+	if (as_sindex_is_exp(si)) {
+		as_bin_particle_destroy(&exp_bin);
+	}
+
 	return ret;
 }
 
+static bool
+record_matches_prefix(const as_query_job* _job, as_storage_rd* rd)
+{
+	const as_sindex* si = _job->si;
+
+	for (uint32_t i = 0; i < si->n_cbins; i++) {
+		const as_sindex_cbin* cbin = &si->cbins[i];
+		const as_query_range* prefix = &_job->range->prefix[i];
+		const as_bin* b = as_bin_get_by_id_live(rd, cbin->bin_id);
+
+		if (b == NULL) {
+			return false;
+		}
+
+		as_particle_type type = as_bin_get_particle_type(b);
+		as_bin ctx_bin = { 0 };
+
+		if (cbin->ctx_buf != NULL) {
+			if (type != AS_PARTICLE_TYPE_LIST && type != AS_PARTICLE_TYPE_MAP) {
+				return false;
+			}
+
+			if (! as_bin_cdt_get_by_context(b, cbin->ctx_buf,
+					cbin->ctx_buf_sz, &ctx_bin, false)) {
+				return false;
+			}
+
+			type = as_bin_get_particle_type(&ctx_bin);
+			b = &ctx_bin;
+		}
+
+		bool match = false;
+
+		if (type == cbin->ktype) {
+			if (type == AS_PARTICLE_TYPE_INTEGER) {
+				match = as_bin_particle_integer_value(b) == prefix->u.r.start;
+			}
+			else {
+				char* str;
+				uint32_t len = as_bin_particle_string_ptr(b, &str);
+
+				match = strings_match(prefix, str, len);
+			}
+		}
+
+		if (cbin->ctx_buf != NULL) {
+			as_bin_particle_destroy(&ctx_bin);
+		}
+
+		if (! match) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool
+record_matches_and(const as_query_job* _job, as_storage_rd* rd)
+{
+	for (uint32_t i = 0; i < _job->n_and_sis; i++) {
+		const as_query_range* prefix = &_job->range->prefix[i];
+		const as_bin* b = as_bin_get_by_id_live(rd, prefix->bin_id);
+
+		if (b == NULL || as_bin_get_particle_type(b) != prefix->bin_type) {
+			return false;
+		}
+
+		bool match;
+
+		if (prefix->bin_type == AS_PARTICLE_TYPE_INTEGER) {
+			match = range_has_integer(prefix, as_bin_particle_integer_value(b));
+		}
+		else {
+			char* str;
+			uint32_t len = as_bin_particle_string_ptr(b, &str);
+
+			match = range_has_string(prefix, str, len);
+		}
+
+		if (! match) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static bool
 record_matches_query_cdt(as_query_job* _job, const as_bin* b)
 {
@@ -1182,8 +2057,7 @@ match_integer_element(const as_query_job* _job, msgpack_in* element)
 		return false;
 	}
 
-	// Start and end are same for point query.
-	return range->u.r.start <= i && i <= range->u.r.end;
+	return range_has_integer(range, i);
 }
 
 static bool
@@ -1206,7 +2080,7 @@ match_string_element(const as_query_job* _job, msgpack_in* element)
 	str++;
 	str_sz--;
 
-	return strings_match(range, (const char*)str, str_sz);
+	return range_has_string(range, (const char*)str, str_sz);
 }
 
 static bool
@@ -1222,33 +2096,108 @@ match_geojson_element(const as_query_job* _job, msgpack_in* element)
 			range->u.geo.region, _job->ns->geo2dsphere_within_strict);
 }
 
+static bool
+range_has_integer(const as_query_range* range, int64_t i)
+{
+	if (range->n_multi == 0) {
+		// Start and end are same for point query.
+		return range->u.r.start <= i && i <= range->u.r.end;
+	}
 
-//==============================================================================
-// conn_query_job derived class implementation - not final class.
-//
+	// Find the last entry starting at or below i - entries are disjoint.
+	const as_query_range* multi = range->multi;
+	uint32_t lo = 0;
+	uint32_t hi = range->n_multi;
 
-//----------------------------------------------------------
-// conn_query_job typedefs and forward declarations.
-//
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
 
-typedef struct conn_query_job_s {
-	// Base object must be first:
-	as_query_job _base;
+		if (multi[mid].u.r.start <= i) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
 
-	// Derived class data:
-	cf_mutex fd_lock;
-	as_file_handle* fd_h;
-	int32_t fd_timeout;
+	return lo != 0 && i <= multi[lo - 1].u.r.end;
+}
 
-	bool compress_response;
-	uint64_t net_io_bytes;
-	uint64_t net_io_ns;
+static bool
+range_has_string(const as_query_range* range, const char* str, uint32_t len)
+{
+	if (range->n_multi == 0) {
+		return range->str_ordered ?
+				string_in_range(range, str, len) :
+				strings_match(range, str, len);
+	}
+
+	int64_t bval = range->str_ordered ?
+			as_sindex_string_to_ordered_bval(str, len) :
+			as_sindex_string_to_bval(str, len);
+
+	// Find the first entry with this bval - there may be several.
+	const as_query_range* multi = range->multi;
+	uint32_t lo = 0;
+	uint32_t hi = range->n_multi;
+
+	while (lo < hi) {
+		uint32_t mid = (lo + hi) / 2;
+
+		if (multi[mid].u.r.start < bval) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	for (uint32_t i = lo; i < range->n_multi && multi[i].u.r.start == bval;
+			i++) {
+		if (range->str_ordered ?
+				string_in_range(&multi[i], str, len) :
+				strings_match(&multi[i], str, len)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+//==============================================================================
+// conn_query_job derived class implementation - not final class.
+//
+
+//----------------------------------------------------------
+// conn_query_job typedefs and forward declarations.
+//
+
+typedef struct conn_query_job_s {
+	// Base object must be first:
+	as_query_job _base;
+
+	// Derived class data:
+	cf_mutex fd_lock;
+	as_file_handle* fd_h;
+	int32_t fd_timeout;
+
+	bool compress_response;
+	uint64_t net_io_bytes;
+	uint64_t net_io_ns;
+
+	// Streamed chunk the socket hasn't taken yet - goes before anything else:
+	cf_buf_builder* pend_bb;
+	size_t pend_off;
+	cf_buf_builder* spare_bb; // drained chunk, recycled for the next one
 } conn_query_job;
 
 static void conn_query_job_init(conn_query_job* job, const as_transaction* tr);
 static void conn_query_job_destroy(conn_query_job* job);
 static void conn_query_job_finish(conn_query_job* job);
 static bool conn_query_job_send_response(conn_query_job* job, uint8_t* buf, size_t size);
+static bool conn_query_job_stream_response(conn_query_job* job, cf_buf_builder** bb_r);
+static bool conn_query_job_drain_response(conn_query_job* job);
 static void conn_query_job_release_fd(conn_query_job* job, bool force_close);
 static void conn_query_job_info(conn_query_job* job, as_mon_jobstat* stat);
 
@@ -1282,6 +2231,17 @@ conn_query_job_finish(conn_query_job* job)
 {
 	as_query_job* _job = (as_query_job*)job;
 
+	if (job->fd_h && job->pend_bb != NULL) {
+		uint64_t before_ns = cf_getns();
+
+		if (conn_query_job_drain_response(job)) {
+			job->net_io_ns += cf_getns() - before_ns;
+		}
+	}
+
+	cf_buf_builder_free(job->pend_bb); // only left if drain failed
+	cf_buf_builder_free(job->spare_bb);
+
 	if (job->fd_h) {
 		if (_job->is_short) {
 			conn_query_job_release_fd(job, false);
@@ -1324,6 +2284,12 @@ conn_query_job_send_response(conn_query_job* job, uint8_t* buf, size_t size)
 		before_ns = cf_getns();
 	}
 
+	// A streamed chunk may still be draining - it must go out first.
+	if (job->pend_bb != NULL && ! conn_query_job_drain_response(job)) {
+		cf_mutex_unlock(&job->fd_lock);
+		return false;
+	}
+
 	size_t size_sent = send_blocking_response_chunk(job->fd_h, buf, size,
 			job->fd_timeout, job->compress_response,
 			&_job->ns->query_comp_stat);
@@ -1348,6 +2314,101 @@ conn_query_job_send_response(conn_query_job* job, uint8_t* buf, size_t size)
 	return true;
 }
 
+// Sends as much of the chunk as the socket takes now. The rest drains while
+// the caller builds the next chunk, in which case the caller's buf-builder is
+// swapped for a recycled one, or NULL.
+static bool
+conn_query_job_stream_response(conn_query_job* job, cf_buf_builder** bb_r)
+{
+	cf_buf_builder* bb = *bb_r;
+
+	if (job->compress_response) {
+		// Compressed chunk isn't in bb - can't leave it draining.
+		return conn_query_job_send_response(job, bb->buf, bb->used_sz);
+	}
+
+	cf_mutex_lock(&job->fd_lock);
+
+	if (! job->fd_h) {
+		cf_mutex_unlock(&job->fd_lock);
+		// Job already abandoned.
+		return false;
+	}
+
+	uint64_t before_ns = cf_getns();
+
+	// By now the previous chunk has had a chunk's build time to drain.
+	if (job->pend_bb != NULL && ! conn_query_job_drain_response(job)) {
+		cf_mutex_unlock(&job->fd_lock);
+		return false;
+	}
+
+	cf_socket* sock = &job->fd_h->sock;
+	size_t size = bb->used_sz;
+
+	set_response_proto(bb->buf, size);
+
+	int32_t sent = cf_socket_try_send_all(sock, bb->buf, size, MSG_NOSIGNAL);
+
+	if (sent < 0) {
+		cf_warning(AS_QUERY, "error sending to %s - fd %d sz %lu %s",
+				job->fd_h->client, CSFD(sock), size, cf_strerror(errno));
+		conn_query_job_release_fd(job, true);
+		cf_mutex_unlock(&job->fd_lock);
+		as_query_manager_abandon_job((as_query_job*)job,
+				AS_QUERY_RESPONSE_ERROR);
+		return false;
+	}
+
+	if ((size_t)sent < size) {
+		job->pend_bb = bb;
+		job->pend_off = (size_t)sent;
+
+		*bb_r = job->spare_bb;
+		job->spare_bb = NULL;
+	}
+
+	job->net_io_ns += cf_getns() - before_ns;
+	job->net_io_bytes += size;
+
+	cf_mutex_unlock(&job->fd_lock);
+	return true;
+}
+
+// Call with fd_lock held (or when no other thread can send). On failure, the
+// fd is released and the job abandoned.
+static bool
+conn_query_job_drain_response(conn_query_job* job)
+{
+	cf_socket* sock = &job->fd_h->sock;
+	cf_buf_builder* bb = job->pend_bb;
+	size_t size = bb->used_sz - job->pend_off;
+
+	// Same buf and size as the partial send left off - TLS requires it.
+	if (cf_socket_send_all(sock, bb->buf + job->pend_off, size, MSG_NOSIGNAL,
+			job->fd_timeout) < 0) {
+		int reason = errno == ETIMEDOUT ?
+				AS_QUERY_RESPONSE_TIMEOUT : AS_QUERY_RESPONSE_ERROR;
+
+		cf_warning(AS_QUERY, "error sending to %s - fd %d sz %lu %s",
+				job->fd_h->client, CSFD(sock), size, cf_strerror(errno));
+		conn_query_job_release_fd(job, true);
+		as_query_manager_abandon_job((as_query_job*)job, reason);
+		return false;
+	}
+
+	job->pend_bb = NULL;
+
+	if (job->spare_bb == NULL) {
+		job->spare_bb = bb;
+	}
+	else {
+		cf_buf_builder_free(bb);
+	}
+
+	return true;
+}
+
 static void
 conn_query_job_release_fd(conn_query_job* job, bool force_close)
 {
@@ -1387,6 +2448,12 @@ typedef struct basic_query_job_s {
 	uint64_t sample_count;
 	as_exp* filter_exp;
 	cf_vector* bin_ids;
+	bool covered; // projection is the indexed value - may skip storage
+	struct query_top_s* top; // ordered queries only
+	bool storage_order; // scan partitions in device order, not digest order
+	uint32_t sample_rate; // parts per million - 0 if not a sampling scan
+	double sample_sprig_p; // chance a sprig is traversed
+	double sample_rec_p; // chance a record in a traversed sprig is sampled
 } basic_query_job;
 
 static void basic_query_job_slice(as_query_job* _job, as_partition_reservation* rsv, cf_buf_builder** bb_r);
@@ -1404,13 +2471,70 @@ static const as_query_vtable basic_query_job_vtable = {
 typedef struct basic_query_slice_s {
 	basic_query_job* job;
 	cf_buf_builder** bb_r;
+	uint64_t n_top; // responses this partition added to the top-K
+	const as_storage_read_ahead* ra; // storage-ordered scans only
+	uint64_t sprig_skip; // sampling scans only - sprigs before the next pick
+	uint64_t rec_skip; // sampling scans only - records before the next pick
 } basic_query_slice;
 
+// An ordered query keeps the best sample-max responses from all partitions,
+// and sends them in order when the job finishes.
+typedef struct top_entry_s {
+	int64_t bval;
+	uint8_t* buf;
+	uint32_t buf_sz;
+} top_entry;
+
+typedef struct query_top_s {
+	cf_mutex lock;
+	bool desc;
+	bool unsigned_bvals; // composite bvals
+	uint32_t n_max;
+	uint32_t n_entries;
+	uint32_t capacity;
+	top_entry* entries; // heap - worst entry at the root
+	uint64_t sz; // entries array and responses
+	uint64_t* used_sz; // namespace total, for stats
+	bool too_big; // responses would exceed MAX_TOP_SZ
+} query_top;
+
+// A storage-ordered scan sorts a partition's records by device position, a
+// group at a time, and reads each run of nearby records with one large read.
+typedef struct storage_order_ele_s {
+	uint64_t pos; // file_id and rblock_id
+	cf_arenax_handle r_h;
+} storage_order_ele;
+
+typedef struct storage_order_collect_info_s {
+	as_namespace* ns;
+	storage_order_ele* eles;
+	uint32_t n_eles;
+	cf_digest last;
+} storage_order_collect_info;
+
 static void basic_query_job_init(basic_query_job* job);
 static bool basic_query_get_bin_ids(const as_transaction* tr, as_namespace* ns, cf_vector** bin_ids);
+static bool basic_query_is_covered(const basic_query_job* job);
 static bool basic_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata);
 static bool basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata);
 static bool basic_query_filter_meta(const basic_query_job* job, const as_record* r, as_exp** exp);
+static void basic_query_scan_storage_order(basic_query_job* job, as_partition_reservation* rsv, basic_query_slice* slice);
+static bool storage_order_collect_cb(as_index_ref* r_ref, void* udata);
+static int storage_order_ele_cmp(const void* pa, const void* pb);
+static bool storage_order_reduce(basic_query_job* job, as_partition_reservation* rsv, basic_query_slice* slice, const storage_order_ele* eles, uint32_t n_eles);
+static int basic_query_init_sample(basic_query_job* job);
+static void basic_query_scan_sample(basic_query_job* job, as_partition_reservation* rsv, const cf_digest* keyd, basic_query_slice* slice);
+static bool sample_sprig_cb(uint32_t sprig_i, void* udata);
+static bool sample_reduce_cb(as_index_ref* r_ref, void* udata);
+static uint64_t sample_skip(double p);
+static int basic_query_init_top(basic_query_job* job);
+static void basic_query_send_top(basic_query_job* job);
+static bool top_rejects(query_top* top, int64_t bval);
+static bool top_offer(query_top* top, int64_t bval, const uint8_t* buf, uint32_t buf_sz, bool* too_big);
+static bool top_fits(query_top* top, int64_t delta);
+static int32_t top_cmp(const query_top* top, int64_t bval_1, int64_t bval_2);
+static void top_sift_down(query_top* top, uint32_t i);
+static int top_entry_cmp(const void* pa, const void* pb, void* udata);
 
 //----------------------------------------------------------
 // basic_query_job public API.
@@ -1451,7 +2575,7 @@ basic_query_job_start(as_transaction* tr, as_namespace* ns)
 		return AS_ERR_SINDEX_NOT_FOUND;
 	}
 
-	if (_job->si != NULL && ! _job->si->readable) {
+	if (! sindexes_readable(_job)) {
 		as_query_job_destroy(_job);
 		return AS_ERR_SINDEX_NOT_READABLE;
 	}
@@ -1480,6 +2604,7 @@ basic_query_job_start(as_transaction* tr, as_namespace* ns)
 	basic_query_job_init(job);
 
 	if (! get_query_sample_max(tr, &job->sample_max) ||
+			! get_query_sample_rate(tr, &job->sample_rate) ||
 			! basic_query_get_bin_ids(tr, ns, &job->bin_ids) ||
 			! get_query_filter_exp(tr, &job->filter_exp)) {
 		cf_warning(AS_QUERY, "basic query job failed msg field processing");
@@ -1489,8 +2614,32 @@ basic_query_job_start(as_transaction* tr, as_namespace* ns)
 	}
 
 	job->no_bin_data = (m->info1 & AS_MSG_INFO1_GET_NO_BINS) != 0;
+	job->covered = basic_query_is_covered(job);
 
-	int result = as_security_check_rps(tr->from.proto_fd_h, _job->rps,
+	// Clients resume partitions after the last digest they got, so only scans
+	// that finish whole partitions (no sample-max) may scramble digest order.
+	// A retry after an interrupted partition still carries a resume digest -
+	// it's meaningless here, so the partition is rescanned from the start,
+	// duplicating records rather than losing them.
+	job->storage_order = (m->info2 & AS_MSG_INFO2_STORAGE_ORDER) != 0 &&
+			job->sample_max == 0 && job->sample_rate == 0 &&
+			! job->no_bin_data &&
+			ns->storage_type == AS_STORAGE_ENGINE_SSD &&
+			! ns->storage_data_in_memory;
+
+	int result = basic_query_init_top(job);
+
+	if (result == AS_OK) {
+		result = basic_query_init_sample(job);
+	}
+
+	if (result != AS_OK) {
+		conn_query_job_destroy(conn_job);
+		as_query_job_destroy(_job);
+		return result;
+	}
+
+	result = as_security_check_rps(tr->from.proto_fd_h, _job->rps,
 			PERM_QUERY, false, &_job->rps_udata);
 
 	if (result != AS_OK) {
@@ -1510,10 +2659,11 @@ basic_query_job_start(as_transaction* tr, as_namespace* ns)
 		}
 	}
 	else {
-		cf_debug(AS_QUERY, "starting basic query job %lu {%s:%s:%s} n-pids-requested %hu rps %u sample-max %lu%s socket-timeout %d from %s",
+		cf_debug(AS_QUERY, "starting basic query job %lu {%s:%s:%s} n-pids-requested %hu rps %u sample-max %lu sample-rate %u%s socket-timeout %d from %s",
 				_job->trid, ns->name, _job->set_name,
 				_job->si != NULL ? _job->si_name : "<pi-query>",
 				_job->n_pids_requested, _job->rps, job->sample_max,
+				job->sample_rate,
 				job->no_bin_data ? " metadata-only" : "", conn_job->fd_timeout,
 				_job->client);
 	}
@@ -1546,16 +2696,13 @@ basic_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 		cf_buf_builder_reserve(bb_r, (int)sizeof(as_proto), NULL);
 	}
 	else if (rsv == NULL) { // this thread finished all its partitions
-		if (_job->is_short) {
+		if (_job->is_short && job->top == NULL) {
 			as_msg_fin_bufbuilder(bb_r, _job->abandoned);
 			// Won't send fin later in finish().
 		}
 
-		cf_buf_builder* bb = *bb_r;
-
-		if (bb->used_sz > sizeof(as_proto)) {
-			conn_query_job_send_response((conn_query_job*)job, bb->buf,
-					bb->used_sz);
+		if ((*bb_r)->used_sz > sizeof(as_proto)) {
+			conn_query_job_stream_response((conn_query_job*)job, bb_r);
 		}
 
 		return;
@@ -1586,7 +2733,7 @@ basic_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 		return;
 	}
 
-	basic_query_slice slice = { job, bb_r };
+	basic_query_slice slice = { .job = job, .bb_r = bb_r };
 
 	if (job->sample_max == 0 || job->sample_count < job->sample_max) {
 		int64_t bval = 0;
@@ -1595,16 +2742,25 @@ basic_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 		if (_job->pids != NULL) {
 			as_query_pid* qp = &_job->pids[rsv->p->id];
 
-			if (qp->has_resume) {
+			// Resuming in the other plan would lose records - rescan instead.
+			if (qp->has_resume && (_job->si == NULL ||
+					resumed_pi_plan(_job, qp) == _job->pi_plan)) {
 				bval = qp->bval;
 				keyd = &qp->keyd;
 			}
 		}
 
-		if (_job->si != NULL) {
-			as_sindex_tree_query(_job->si, _job->range, rsv, bval, keyd,
+		if (_job->si != NULL && ! _job->pi_plan) {
+			query_sindex(_job, rsv, bval, keyd,
 					basic_query_job_reduce_cb, (void*)&slice);
 		}
+		else if (job->sample_rate != 0) {
+			basic_query_scan_sample(job, rsv, keyd, &slice);
+		}
+		else if (job->storage_order) {
+			// Ignores any resume digest - see basic_query_job_start().
+			basic_query_scan_storage_order(job, rsv, &slice);
+		}
 		else {
 			if (! as_set_index_reduce(_job->ns, tree, _job->set_id, keyd,
 					basic_pi_query_job_reduce_cb, (void*)&slice)) {
@@ -1627,6 +2783,12 @@ basic_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 static void
 basic_query_job_finish(as_query_job* _job)
 {
+	basic_query_job* job = (basic_query_job*)_job;
+
+	if (job->top != NULL) {
+		basic_query_send_top(job);
+	}
+
 	conn_query_job_finish((conn_query_job*)_job);
 
 	as_namespace* ns = _job->ns;
@@ -1707,6 +2869,23 @@ basic_query_job_destroy(as_query_job* _job)
 	}
 
 	as_exp_destroy(job->filter_exp);
+
+	query_top* top = job->top;
+
+	if (top != NULL) {
+		for (uint32_t i = 0; i < top->n_entries; i++) {
+			cf_free(top->entries[i].buf);
+		}
+
+		if (top->entries != NULL) {
+			cf_free(top->entries);
+		}
+
+		as_add_uint64(top->used_sz, -(int64_t)top->sz);
+
+		cf_mutex_destroy(&top->lock);
+		cf_free(top);
+	}
 }
 
 static void
@@ -1793,10 +2972,40 @@ basic_query_get_bin_ids(const as_transaction* tr, as_namespace* ns,
 	return true;
 }
 
+static bool
+basic_query_is_covered(const basic_query_job* job)
+{
+	const as_query_job* _job = (const as_query_job*)job;
+	const as_sindex* si = _job->si;
+
+	// Only plain integer sindexes hold the whole value in their keys.
+	if (si == NULL || _job->pi_plan || _job->n_and_sis != 0 ||
+			_job->ns->single_bin || job->no_bin_data ||
+			si->ktype != AS_PARTICLE_TYPE_INTEGER ||
+			si->itype != AS_SINDEX_ITYPE_DEFAULT || si->ctx_buf != NULL ||
+			as_sindex_is_derived(si)) {
+		return false;
+	}
+
+	if (job->bin_ids == NULL || cf_vector_size(job->bin_ids) != 1) {
+		return false;
+	}
+
+	uint16_t bin_id;
+
+	cf_vector_get(job->bin_ids, 0, &bin_id);
+
+	return bin_id == si->bin_id;
+}
+
 static bool
 basic_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata)
 {
-	return basic_query_job_reduce_cb(r_ref, 0, udata);
+	basic_query_slice* slice = (basic_query_slice*)udata;
+
+	// A PI-planned query sends an out-of-range bval, to be resumed in plan.
+	return basic_query_job_reduce_cb(r_ref,
+			((as_query_job*)slice->job)->pi_plan_bval, udata);
 }
 
 static bool
@@ -1812,6 +3021,12 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 		return false;
 	}
 
+	// Keys only get worse from here - done with this partition.
+	if (job->top != NULL && top_rejects(job->top, bval)) {
+		as_record_done(r_ref, ns);
+		return false;
+	}
+
 	as_index* r = r_ref->r;
 
 	if (excluded_set(r, _job->set_id)) {
@@ -1836,6 +3051,22 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 
 	as_storage_record_open(ns, r, &rd);
 
+	rd.read_ahead = slice->ra;
+
+	// Answer from the index alone if the sindex key is the projected bin's
+	// value - but not if the key must be read, or the record may have changed
+	// since its sindex entry was made.
+	bool covered = job->covered && filter_exp == NULL && r->key_stored == 0 &&
+			! record_changed_since_start(_job, r);
+	as_bin covered_bin = { 0 };
+
+	if (covered) {
+		covered_bin.id = _job->si->bin_id;
+		as_bin_set_int(&covered_bin, bval);
+		rd.bins = &covered_bin;
+		rd.n_bins = 1;
+	}
+
 	if (filter_exp != NULL && read_and_filter_bins(&rd, filter_exp) != 0) {
 		as_storage_record_close(&rd);
 		as_record_done(r_ref, ns);
@@ -1848,7 +3079,8 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 		return true;
 	}
 
-	if (_job->si != NULL && ! record_matches_query(_job, &rd)) {
+	if (_job->si != NULL && ! covered && ! ordered_key_matches(_job, r, bval) &&
+			! record_matches_query(_job, &rd)) {
 		as_storage_record_close(&rd);
 		as_record_done(r_ref, ns);
 		return true;
@@ -1856,7 +3088,8 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 
 	bool last_sample = false;
 
-	if (job->sample_max != 0) { // sample-max checks post-filters
+	// sample-max checks post-filters - for ordered queries it's the top-K size.
+	if (job->sample_max != 0 && job->top == NULL) {
 		uint64_t count = as_aaf_uint64(&job->sample_count, 1);
 
 		if (count > job->sample_max) {
@@ -1871,6 +3104,7 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 	}
 
 	bool send_bval = _job->si != NULL && _job->pids != NULL;
+	size_t top_off = (*slice->bb_r)->used_sz;
 
 	if (job->no_bin_data) {
 		as_msg_make_response_bufbuilder(slice->bb_r, &rd, true, NULL, send_bval,
@@ -1879,7 +3113,10 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 	else {
 		as_bin stack_bins[ns->single_bin ? 1 : RECORD_MAX_BINS];
 
-		if (as_storage_rd_load_bins(&rd, stack_bins) < 0) {
+		if (covered) {
+			as_incr_uint64(&ns->n_si_query_covered);
+		}
+		else if (as_storage_rd_load_bins(&rd, stack_bins) < 0) {
 			cf_warning(AS_QUERY, "job %lu - record unreadable", _job->trid);
 			as_storage_record_close(&rd);
 			as_record_done(r_ref, ns);
@@ -1903,17 +3140,40 @@ basic_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 		throttle_sleep(_job);
 	}
 
-	cf_buf_builder* bb = *slice->bb_r;
+	if (job->top != NULL) {
+		// Take the response back out of the buffer - finish() sends it, if it
+		// makes the top-K.
+		cf_buf_builder* bb = *slice->bb_r;
+		bool too_big = false;
+		bool added = top_offer(job->top, bval, bb->buf + top_off,
+				(uint32_t)(bb->used_sz - top_off), &too_big);
+
+		bb->used_sz = top_off;
+
+		if (too_big) {
+			as_query_manager_abandon_job(_job, AS_ERR_RECORD_TOO_BIG);
+			return false;
+		}
+
+		// Later keys in this partition can't beat the ones it added.
+		return added && ++slice->n_top < job->sample_max;
+	}
 
 	// If we exceed the proto size limit, send accumulated data back to client
 	// and reset the buf-builder to start a new proto.
-	if (bb->used_sz > QUERY_CHUNK_LIMIT) {
-		if (! conn_query_job_send_response((conn_query_job*)job, bb->buf,
-				bb->used_sz)) {
+	if ((*slice->bb_r)->used_sz > QUERY_CHUNK_LIMIT) {
+		if (! conn_query_job_stream_response((conn_query_job*)job,
+				slice->bb_r)) {
 			return true;
 		}
 
-		cf_buf_builder_reset(bb);
+		if (*slice->bb_r == NULL) { // previous chunk still draining
+			*slice->bb_r = cf_buf_builder_create(INIT_BUF_BUILDER_SIZE);
+		}
+		else {
+			cf_buf_builder_reset(*slice->bb_r);
+		}
+
 		cf_buf_builder_reserve(slice->bb_r, (int)sizeof(as_proto), NULL);
 	}
 
@@ -1944,93 +3204,1036 @@ basic_query_filter_meta(const basic_query_job* job, const as_record* r,
 	return tv == AS_EXP_TRUE;
 }
 
+static void
+basic_query_scan_storage_order(basic_query_job* job,
+		as_partition_reservation* rsv, basic_query_slice* slice)
+{
+	as_query_job* _job = (as_query_job*)job;
+	as_namespace* ns = _job->ns;
 
-//==============================================================================
-// aggr_query_job derived class implementation.
-//
+	storage_order_ele* eles =
+			cf_malloc(STORAGE_ORDER_GROUP_SZ * sizeof(storage_order_ele));
+	storage_order_collect_info ci = { .ns = ns, .eles = eles };
 
-//----------------------------------------------------------
-// aggr_query_job typedefs and forward declarations.
-//
+	cf_digest resume;
+	cf_digest* keyd = NULL;
 
-typedef struct aggr_query_job_s {
-	// Base object must be first:
-	conn_query_job _base;
+	while (true) {
+		ci.n_eles = 0;
 
-	// Derived class data:
-	as_aggr_call aggr_call;
-} aggr_query_job;
+		if (! as_set_index_reduce(ns, rsv->tree, _job->set_id, keyd,
+				storage_order_collect_cb, (void*)&ci)) {
+			as_index_reduce_from_live(rsv->tree, keyd,
+					storage_order_collect_cb, (void*)&ci);
+		}
 
-static void aggr_query_job_slice(as_query_job* _job, as_partition_reservation* rsv, cf_buf_builder** bb_r);
-static void aggr_query_job_finish(as_query_job* _job);
-static void aggr_query_job_destroy(as_query_job* _job);
-static void aggr_query_job_info(as_query_job* _job, as_mon_jobstat* stat);
+		qsort(eles, ci.n_eles, sizeof(storage_order_ele),
+				storage_order_ele_cmp);
 
-static const as_query_vtable aggr_query_job_vtable = {
-	aggr_query_job_slice,
-	aggr_query_job_finish,
-	aggr_query_job_destroy,
-	aggr_query_job_info
-};
+		if (! storage_order_reduce(job, rsv, slice, eles, ci.n_eles)) {
+			break; // callback stopped query
+		}
 
-typedef struct aggr_query_slice_s {
-	aggr_query_job* job;
-	cf_ll* ll;
-	cf_buf_builder** bb_r;
-} aggr_query_slice;
+		if (ci.n_eles != STORAGE_ORDER_GROUP_SZ) {
+			break; // done with this partition
+		}
 
-static void aggr_query_job_init(aggr_query_job* job);
-static bool aggr_query_init(as_aggr_call* call, const as_transaction* tr);
-static bool aggr_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata);
-static bool aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata);
-static bool aggr_query_add_digest(const as_namespace* ns, cf_ll* ll, as_index* r, cf_arenax_handle r_h);
-static as_stream_status aggr_query_ostream_write(void* udata, as_val* val);
-static bool aggr_query_pre_check(void* udata, udf_record* urecord);
-static void aggr_query_add_val_response(aggr_query_slice* slice, const as_val* val, bool success);
+		resume = ci.last;
+		keyd = &resume;
+	}
 
-static const as_aggr_hooks pi_query_aggr_hooks = {
-	.ostream_write = aggr_query_ostream_write,
-	.pre_check     = NULL
-};
+	cf_free(eles);
+}
+
+static bool
+storage_order_collect_cb(as_index_ref* r_ref, void* udata)
+{
+	storage_order_collect_info* ci = (storage_order_collect_info*)udata;
+	as_index* r = r_ref->r;
+
+	as_index_reserve(r);
+
+	ci->eles[ci->n_eles++] = (storage_order_ele){
+			.pos = ((uint64_t)r->file_id << 40) | r->rblock_id,
+			.r_h = r_ref->r_h
+	};
+
+	ci->last = r->keyd;
+
+	as_record_done(r_ref, ci->ns);
+
+	return ci->n_eles != STORAGE_ORDER_GROUP_SZ;
+}
+
+static int
+storage_order_ele_cmp(const void* pa, const void* pb)
+{
+	uint64_t a = ((const storage_order_ele*)pa)->pos;
+	uint64_t b = ((const storage_order_ele*)pb)->pos;
+
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+// Records may have moved since they were collected - read-ahead buffers are
+// only a hint, checked when each record is read.
+static bool
+storage_order_reduce(basic_query_job* job, as_partition_reservation* rsv,
+		basic_query_slice* slice, const storage_order_ele* eles,
+		uint32_t n_eles)
+{
+	as_namespace* ns = ((as_query_job*)job)->ns;
+	as_storage_read_ahead ra = { 0 };
+	bool do_more = true;
+	uint32_t i = 0;
+
+	slice->ra = &ra;
+
+	while (i < n_eles) {
+		uint32_t start_i = i;
+
+		while (i < n_eles && as_storage_read_ahead_add(ns, &ra,
+				cf_arenax_resolve(ns->arena, eles[i].r_h))) {
+			i++;
+		}
+
+		if (do_more) {
+			as_storage_read_ahead_load(ns, &ra);
+		}
+
+		for (uint32_t j = start_i; j < i; j++) {
+			as_index* r = cf_arenax_resolve(ns->arena, eles[j].r_h);
+			as_index_ref r_ref = {
+					.r = r,
+					.r_h = eles[j].r_h,
+					.olock = as_index_olock_from_keyd(rsv->tree, &r->keyd)
+			};
+
+			cf_mutex_lock(r_ref.olock);
+
+			as_index_release(r);
+
+			if (! as_index_is_valid_record(r)) {
+				as_record_done(&r_ref, ns);
+				continue;
+			}
+
+			if (do_more) {
+				// Callback MUST call as_record_done() to unlock record.
+				do_more = basic_pi_query_job_reduce_cb(&r_ref, (void*)slice);
+			}
+			else {
+				cf_mutex_unlock(r_ref.olock);
+			}
+		}
+
+		as_storage_read_ahead_reset(&ra);
+	}
+
+	slice->ra = NULL;
+
+	return do_more;
+}
+
+// A sampling scan picks sprigs at random, then records at random within them.
+// This is cluster sampling - each record's marginal chance of being sampled is
+// the rate, but records in unpicked sprigs are all skipped together, so picks
+// are not independent. Digests are hashes, so a sprig holds a random subset of
+// the partition. Only picked sprigs are traversed, so cost follows the sample
+// size and not the set size.
+static int
+basic_query_init_sample(basic_query_job* job)
+{
+	if (job->sample_rate == 0) {
+		return AS_OK;
+	}
+
+	as_query_job* _job = (as_query_job*)job;
+
+	if (_job->si != NULL) {
+		cf_warning(AS_QUERY, "sample-rate only for primary index queries");
+		return AS_ERR_PARAMETER;
+	}
+
+	double rate = (double)job->sample_rate / SAMPLE_RATE_MAX;
+
+	job->sample_sprig_p = rate * SAMPLE_SPRIG_FACTOR;
+
+	if (job->sample_sprig_p > 1.0) {
+		job->sample_sprig_p = 1.0;
+	}
+
+	job->sample_rec_p = rate / job->sample_sprig_p;
+
+	// Visit partitions in random order, so stopping at sample-max doesn't
+	// favor low partition IDs.
+	uint16_t* order = cf_malloc(sizeof(uint16_t) * AS_PARTITIONS);
+
+	for (uint32_t i = 0; i < AS_PARTITIONS; i++) {
+		order[i] = (uint16_t)i;
+	}
+
+	for (uint32_t i = AS_PARTITIONS - 1; i != 0; i--) {
+		uint32_t j = (uint32_t)(cf_get_rand64() % (i + 1));
+		uint16_t t = order[i];
+
+		order[i] = order[j];
+		order[j] = t;
+	}
+
+	_job->pid_order = order;
+
+	return AS_OK;
+}
+
+static void
+basic_query_scan_sample(basic_query_job* job, as_partition_reservation* rsv,
+		const cf_digest* keyd, basic_query_slice* slice)
+{
+	slice->sprig_skip = sample_skip(job->sample_sprig_p);
+	slice->rec_skip = sample_skip(job->sample_rec_p);
+
+	as_index_reduce_sprigs_live(rsv->tree, keyd, sample_sprig_cb,
+			sample_reduce_cb, (void*)slice);
+}
+
+static bool
+sample_sprig_cb(uint32_t sprig_i, void* udata)
+{
+	(void)sprig_i;
+
+	basic_query_slice* slice = (basic_query_slice*)udata;
+
+	if (slice->sprig_skip != 0) {
+		slice->sprig_skip--;
+		return false;
+	}
+
+	slice->sprig_skip = sample_skip(slice->job->sample_sprig_p);
+
+	return true;
+}
+
+static bool
+sample_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	basic_query_slice* slice = (basic_query_slice*)udata;
+	as_query_job* _job = (as_query_job*)slice->job;
+
+	if (slice->rec_skip != 0) {
+		slice->rec_skip--;
+		as_record_done(r_ref, _job->ns);
+		return true;
+	}
+
+	slice->rec_skip = sample_skip(slice->job->sample_rec_p);
+
+	return basic_pi_query_job_reduce_cb(r_ref, udata);
+}
+
+// Number of items to pass over before the next one sampled - geometric, so
+// each item is sampled independently with probability p, at one random draw
+// per sampled item.
+static uint64_t
+sample_skip(double p)
+{
+	if (p >= 1.0) {
+		return 0;
+	}
+
+	// Uniform in (0, 1] - 53 random bits.
+	double u = (double)((cf_get_rand64() >> 11) + 1) / (double)(1UL << 53);
+
+	return (uint64_t)(log(u) / log1p(-p));
+}
+
+static int
+basic_query_init_top(basic_query_job* job)
+{
+	as_query_job* _job = (as_query_job*)job;
+	const as_query_range* range = _job->range;
+
+	if (range == NULL || ! range->ordered) {
+		return AS_OK;
+	}
+
+	if (_job->n_and_sis != 0) {
+		cf_warning(AS_QUERY, "ordered query needs a composite sindex");
+		return AS_ERR_PARAMETER;
+	}
+
+	if (job->sample_max == 0 || job->sample_max > MAX_TOP_K) {
+		cf_warning(AS_QUERY, "ordered query sample-max %lu not 1 to %u",
+				job->sample_max, MAX_TOP_K);
+		return AS_ERR_PARAMETER;
+	}
+
+	// Resuming would need each partition's place in the global order.
+	if (_job->pids != NULL) {
+		for (uint32_t pid = 0; pid < AS_PARTITIONS; pid++) {
+			if (_job->pids[pid].has_resume) {
+				cf_warning(AS_QUERY, "ordered query can't resume");
+				return AS_ERR_PARAMETER;
+			}
+		}
+	}
+
+	// Flash sindexes don't hold records while walking the tree.
+	if (_job->ns->xmem_type == CF_XMEM_TYPE_FLASH) {
+		cf_warning(AS_QUERY, "ordered query not supported with flash sindex");
+		return AS_ERR_UNSUPPORTED_FEATURE;
+	}
+
+	query_top* top = cf_calloc(1, sizeof(query_top));
+
+	cf_mutex_init(&top->lock);
+	top->desc = range->desc;
+	top->unsigned_bvals = as_sindex_is_composite(_job->si);
+	top->n_max = (uint32_t)job->sample_max;
+	top->used_sz = &_job->ns->si_query_top_sz;
+
+	job->top = top;
+
+	return AS_OK;
+}
+
+static void
+basic_query_send_top(basic_query_job* job)
+{
+	as_query_job* _job = (as_query_job*)job;
+	query_top* top = job->top;
+
+	// All partitions are done - no need to lock.
+	qsort_r(top->entries, top->n_entries, sizeof(top_entry), top_entry_cmp,
+			top);
+
+	cf_buf_builder* bb = cf_buf_builder_create(INIT_BUF_BUILDER_SIZE);
+
+	cf_buf_builder_reserve(&bb, (int)sizeof(as_proto), NULL);
+
+	for (uint32_t i = 0; i < top->n_entries && _job->abandoned == 0; i++) {
+		top_entry* e = &top->entries[i];
+		uint8_t* buf;
+
+		cf_buf_builder_reserve(&bb, (int)e->buf_sz, &buf);
+		memcpy(buf, e->buf, e->buf_sz);
+
+		if (bb->used_sz > QUERY_CHUNK_LIMIT) {
+			if (! conn_query_job_send_response((conn_query_job*)job, bb->buf,
+					bb->used_sz)) {
+				break;
+			}
+
+			cf_buf_builder_reset(bb);
+			cf_buf_builder_reserve(&bb, (int)sizeof(as_proto), NULL);
+		}
+	}
+
+	if (_job->is_short) {
+		as_msg_fin_bufbuilder(&bb, _job->abandoned);
+		// Won't send fin later in finish().
+	}
+
+	if (bb->used_sz > sizeof(as_proto)) {
+		conn_query_job_send_response((conn_query_job*)job, bb->buf,
+				bb->used_sz);
+	}
+
+	cf_buf_builder_free(bb);
+}
+
+// Whether a full top-K already beats bval - ties are kept on a first come
+// basis, so bval must be strictly worse to be rejected.
+static bool
+top_rejects(query_top* top, int64_t bval)
+{
+	cf_mutex_lock(&top->lock);
+
+	bool rejects = top->n_entries == top->n_max &&
+			top_cmp(top, bval, top->entries[0].bval) > 0;
+
+	cf_mutex_unlock(&top->lock);
+
+	return rejects;
+}
+
+// Sets too_big (and doesn't add) if the responses would exceed MAX_TOP_SZ.
+static bool
+top_offer(query_top* top, int64_t bval, const uint8_t* buf, uint32_t buf_sz,
+		bool* too_big)
+{
+	cf_mutex_lock(&top->lock);
+
+	if (top->n_entries == top->n_max) {
+		top_entry* root = &top->entries[0];
+
+		if (top_cmp(top, bval, root->bval) >= 0) {
+			cf_mutex_unlock(&top->lock);
+			return false;
+		}
+
+		if (! top_fits(top, (int64_t)buf_sz - (int64_t)root->buf_sz)) {
+			*too_big = true;
+			cf_mutex_unlock(&top->lock);
+			return false;
+		}
+
+		cf_free(root->buf);
+
+		root->bval = bval;
+		root->buf = cf_malloc(buf_sz);
+		root->buf_sz = buf_sz;
+		memcpy(root->buf, buf, buf_sz);
+
+		top_sift_down(top, 0);
+
+		cf_mutex_unlock(&top->lock);
+		return true;
+	}
+
+	uint32_t capacity = top->capacity;
+
+	if (top->n_entries == capacity) {
+		capacity = capacity == 0 ? 64 : capacity * 2;
+
+		if (capacity > top->n_max) {
+			capacity = top->n_max;
+		}
+	}
+
+	if (! top_fits(top, (int64_t)buf_sz +
+			(int64_t)((capacity - top->capacity) * sizeof(top_entry)))) {
+		*too_big = true;
+		cf_mutex_unlock(&top->lock);
+		return false;
+	}
+
+	if (capacity != top->capacity) {
+		top->capacity = capacity;
+		top->entries = cf_realloc(top->entries,
+				top->capacity * sizeof(top_entry));
+	}
+
+	uint32_t i = top->n_entries++;
+
+	// Sift up - worse entries move toward the root.
+	while (i != 0) {
+		uint32_t parent = (i - 1) / 2;
+
+		if (top_cmp(top, bval, top->entries[parent].bval) <= 0) {
+			break;
+		}
+
+		top->entries[i] = top->entries[parent];
+		i = parent;
+	}
+
+	top_entry* e = &top->entries[i];
+
+	e->bval = bval;
+	e->buf = cf_malloc(buf_sz);
+	e->buf_sz = buf_sz;
+	memcpy(e->buf, buf, buf_sz);
+
+	cf_mutex_unlock(&top->lock);
+
+	return true;
+}
+
+// Call under the top lock - accounts delta if the total stays in bounds.
+static bool
+top_fits(query_top* top, int64_t delta)
+{
+	uint64_t sz = top->sz + (uint64_t)delta;
+
+	if (sz > MAX_TOP_SZ) {
+		if (! top->too_big) {
+			top->too_big = true;
+			cf_warning(AS_QUERY, "ordered query responses exceed %lu bytes",
+					MAX_TOP_SZ);
+		}
+
+		return false;
+	}
+
+	top->sz = sz;
+	as_add_uint64(top->used_sz, delta);
+
+	return true;
+}
+
+// Negative if bval_1 comes first in the results.
+static int32_t
+top_cmp(const query_top* top, int64_t bval_1, int64_t bval_2)
+{
+	int32_t cmp = top->unsigned_bvals ?
+			((uint64_t)bval_1 > (uint64_t)bval_2) -
+					((uint64_t)bval_1 < (uint64_t)bval_2) :
+			(bval_1 > bval_2) - (bval_1 < bval_2);
+
+	return top->desc ? -cmp : cmp;
+}
+
+static void
+top_sift_down(query_top* top, uint32_t i)
+{
+	top_entry e = top->entries[i];
+
+	while (true) {
+		uint32_t worst = i * 2 + 1;
+
+		if (worst >= top->n_entries) {
+			break;
+		}
+
+		if (worst + 1 < top->n_entries && top_cmp(top,
+				top->entries[worst + 1].bval, top->entries[worst].bval) > 0) {
+			worst++;
+		}
+
+		if (top_cmp(top, top->entries[worst].bval, e.bval) <= 0) {
+			break;
+		}
+
+		top->entries[i] = top->entries[worst];
+		i = worst;
+	}
+
+	top->entries[i] = e;
+}
+
+static int
+top_entry_cmp(const void* pa, const void* pb, void* udata)
+{
+	return top_cmp((const query_top*)udata, ((const top_entry*)pa)->bval,
+			((const top_entry*)pb)->bval);
+}
+
+
+//==============================================================================
+// aggr_query_job derived class implementation.
+//
+
+//----------------------------------------------------------
+// aggr_query_job typedefs and forward declarations.
+//
+
+typedef struct aggr_query_job_s {
+	// Base object must be first:
+	conn_query_job _base;
+
+	// Derived class data:
+	as_aggr_call aggr_call;
+} aggr_query_job;
+
+static void aggr_query_job_slice(as_query_job* _job, as_partition_reservation* rsv, cf_buf_builder** bb_r);
+static void aggr_query_job_finish(as_query_job* _job);
+static void aggr_query_job_destroy(as_query_job* _job);
+static void aggr_query_job_info(as_query_job* _job, as_mon_jobstat* stat);
+
+static const as_query_vtable aggr_query_job_vtable = {
+	aggr_query_job_slice,
+	aggr_query_job_finish,
+	aggr_query_job_destroy,
+	aggr_query_job_info
+};
+
+typedef struct aggr_query_slice_s {
+	aggr_query_job* job;
+	cf_ll* ll;
+	cf_buf_builder** bb_r;
+} aggr_query_slice;
+
+static void aggr_query_job_init(aggr_query_job* job);
+static bool aggr_query_init(as_aggr_call* call, const as_transaction* tr);
+static bool aggr_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata);
+static bool aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata);
+static bool aggr_query_add_digest(const as_namespace* ns, cf_ll* ll, as_index* r, cf_arenax_handle r_h);
+static as_stream_status aggr_query_ostream_write(void* udata, as_val* val);
+static bool aggr_query_pre_check(void* udata, udf_record* urecord);
+static void aggr_query_add_val_response(aggr_query_slice* slice, const as_val* val, bool success);
+
+static const as_aggr_hooks pi_query_aggr_hooks = {
+	.ostream_write = aggr_query_ostream_write,
+	.pre_check     = NULL
+};
+
+static const as_aggr_hooks si_query_aggr_hooks = {
+	.ostream_write = aggr_query_ostream_write,
+	.pre_check     = aggr_query_pre_check
+};
+
+//----------------------------------------------------------
+// aggr_query_job public API.
+//
+
+static int
+aggr_query_job_start(as_transaction* tr, as_namespace* ns)
+{
+	// Temporary security vulnerability protection.
+	if (g_config.udf_execution_disabled) {
+		cf_warning(AS_QUERY, "aggregation query job forbidden");
+		return AS_ERR_FORBIDDEN;
+	}
+
+	if (as_transaction_is_short_query(tr)) {
+		cf_warning(AS_QUERY, "aggregation queries can't be 'short' queries");
+		return AS_ERR_PARAMETER;
+	}
+
+	if (as_transaction_has_predexp(tr)) {
+		cf_warning(AS_QUERY, "aggregation queries do not support predexp filters");
+		return AS_ERR_UNSUPPORTED_FEATURE;
+	}
+
+	aggr_query_job* job = cf_calloc(1, sizeof(aggr_query_job));
+	conn_query_job* conn_job = (conn_query_job*)job;
+	as_query_job* _job = (as_query_job*)job;
+
+	as_query_job_init(_job, &aggr_query_job_vtable, tr, ns);
+
+	if (! get_query_set(tr, ns, _job->set_name, &_job->set_id) ||
+			! get_query_range(tr, ns, &_job->range) ||
+			! get_query_rps(tr, &_job->rps)) {
+		cf_warning(AS_QUERY, "aggregation query job failed msg field processing");
+		as_query_job_destroy(_job);
+		return AS_ERR_PARAMETER;
+	}
+
+	if (_job->set_id == INVALID_SET_ID && _job->set_name[0] != '\0') {
+		as_query_job_destroy(_job);
+		return AS_ERR_NOT_FOUND;
+	}
+
+	if (! find_sindex(_job)) {
+		as_query_job_destroy(_job);
+		return AS_ERR_SINDEX_NOT_FOUND;
+	}
+
+	if (! sindexes_readable(_job)) {
+		as_query_job_destroy(_job);
+		return AS_ERR_SINDEX_NOT_READABLE;
+	}
+
+	// Take ownership of socket from transaction.
+	conn_query_job_init(conn_job, tr);
+
+	if (! get_query_socket_timeout(tr, &conn_job->fd_timeout)) {
+		cf_warning(AS_QUERY, "aggregation query job failed msg field processing");
+		conn_query_job_destroy(conn_job);
+		as_query_job_destroy(_job);
+		return AS_ERR_PARAMETER;
+	}
+
+	aggr_query_job_init(job);
+
+	int result = as_security_check_rps(tr->from.proto_fd_h, _job->rps,
+			PERM_UDF_QUERY, false, &_job->rps_udata);
+
+	if (result != AS_OK) {
+		cf_warning(AS_QUERY, "aggregation query job failed quota %d", result);
+		conn_query_job_destroy(conn_job);
+		as_query_job_destroy(_job);
+		return result;
+	}
+
+	if (! aggr_query_init(&job->aggr_call, tr)) {
+		cf_warning(AS_QUERY, "aggregation query job failed call init");
+		conn_query_job_destroy(conn_job);
+		as_query_job_destroy(_job);
+		return AS_ERR_PARAMETER;
+	}
+
+	cf_debug(AS_QUERY, "starting aggregation query job %lu {%s:%s:%s} rps %u socket-timeout %d from %s",
+			_job->trid, ns->name, _job->set_name,
+			_job->si != NULL ? _job->si_name : "<pi-query>",
+			_job->rps, conn_job->fd_timeout, _job->client);
+
+	if ((result = as_query_manager_start_job(_job)) != AS_OK) {
+		cf_warning(AS_QUERY, "aggregation query job %lu failed to start (%d)",
+				_job->trid, result);
+		conn_query_job_destroy((conn_query_job*)job);
+		as_query_job_destroy(_job);
+		return result;
+	}
+
+	return AS_OK;
+}
+
+//----------------------------------------------------------
+// aggr_query_job mandatory query_job interface.
+//
+
+static void
+aggr_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
+		cf_buf_builder** bb_r)
+{
+	if (rsv == NULL) { // this thread finished all its partitions
+		return;
+	}
+
+	aggr_query_job* job = (aggr_query_job*)_job;
+	cf_ll ll;
+
+	cf_ll_init(&ll, as_aggr_keys_destroy_cb, false);
+
+	cf_buf_builder* bb = *bb_r;
+
+	if (bb == NULL) {
+		bb = cf_buf_builder_create(INIT_BUF_BUILDER_SIZE);
+	}
+	else {
+		cf_buf_builder_reset(bb);
+	}
+
+	cf_buf_builder_reserve(&bb, (int)sizeof(as_proto), NULL);
+
+	aggr_query_slice slice = { job, &ll, &bb };
+
+	if (_job->si != NULL && ! _job->pi_plan) {
+		query_sindex(_job, rsv, 0, NULL,
+				aggr_query_job_reduce_cb, (void*)&slice);
+	}
+	else {
+		if (! as_set_index_reduce_unordered(_job->ns, rsv->tree, _job->set_id,
+				aggr_pi_query_job_reduce_cb, (void*)&slice)) {
+			as_index_reduce_live(rsv->tree, aggr_pi_query_job_reduce_cb,
+					(void*)&slice);
+		}
+	}
+
+	if (cf_ll_size(&ll) != 0) {
+		as_result result;
+		as_result_init(&result);
+
+		int ret = as_aggr_process(_job->ns, rsv, &job->aggr_call, &ll,
+				(void*)&slice, &result);
+
+		if (ret != 0) {
+			char* rs = as_module_err_string(ret);
+
+			if (result.value) {
+				as_string* lua_s = as_string_fromval(result.value);
+				char* lua_err = (char*)as_string_tostring(lua_s);
+
+				if (lua_err) {
+					size_t l_rs_len = strlen(rs);
+
+					rs = cf_realloc(rs, l_rs_len + strlen(lua_err) + 4);
+					sprintf(&rs[l_rs_len], " : %s", lua_err);
+				}
+			}
+
+			const as_val* v = (as_val*)as_string_new(rs, false);
+
+			aggr_query_add_val_response(&slice, v, false);
+			as_val_destroy(v);
+			cf_free(rs);
+			as_query_manager_abandon_job(_job, AS_ERR_UNKNOWN);
+		}
+
+		as_result_destroy(&result);
+	}
+
+	as_aggr_release_udata udata = { .ns = _job->ns, .tree = rsv->tree };
+
+	cf_ll_reduce(&ll, true, as_aggr_keys_release_cb, &udata);
+
+	if (bb->used_sz > sizeof(as_proto)) {
+		conn_query_job_send_response((conn_query_job*)job, bb->buf, bb->used_sz);
+	}
+
+	*bb_r = bb;
+}
+
+static void
+aggr_query_job_finish(as_query_job* _job)
+{
+	aggr_query_job* job = (aggr_query_job*)_job;
+
+	conn_query_job_finish((conn_query_job*)job);
+
+	if (job->aggr_call.def.arglist) {
+		as_list_destroy(job->aggr_call.def.arglist);
+		job->aggr_call.def.arglist = NULL;
+	}
+
+	as_namespace* ns = _job->ns;
+
+	switch (_job->abandoned) {
+	case 0:
+		as_incr_uint64(_job->si == NULL ?
+				&ns->n_pi_query_aggr_complete : &ns->n_si_query_aggr_complete);
+		break;
+	case AS_ERR_QUERY_ABORT:
+		as_incr_uint64(_job->si == NULL ?
+				&ns->n_pi_query_aggr_abort : &ns->n_si_query_aggr_abort);
+		break;
+	case AS_ERR_UNKNOWN:
+	case AS_QUERY_RESPONSE_ERROR:
+	case AS_QUERY_RESPONSE_TIMEOUT:
+	default:
+		as_incr_uint64(_job->si == NULL ?
+				&ns->n_pi_query_aggr_error : &ns->n_si_query_aggr_error);
+		break;
+	}
+
+	cf_debug(AS_QUERY, "finished aggregation query job %lu (%d)", _job->trid,
+			_job->abandoned);
+}
+
+static void
+aggr_query_job_destroy(as_query_job* _job)
+{
+	aggr_query_job* job = (aggr_query_job*)_job;
+
+	if (job->aggr_call.def.arglist) {
+		as_list_destroy(job->aggr_call.def.arglist);
+	}
+}
+
+static void
+aggr_query_job_info(as_query_job* _job, as_mon_jobstat* stat)
+{
+	strcpy(stat->job_type, query_type_str(QUERY_TYPE_AGGR));
+	conn_query_job_info((conn_query_job*)_job, stat);
+}
+
+//----------------------------------------------------------
+// aggr_query_job utilities.
+//
+
+static void
+aggr_query_job_init(aggr_query_job* job)
+{
+	(void)job;
+}
+
+static bool
+aggr_query_init(as_aggr_call* call, const as_transaction* tr)
+{
+	if (! udf_def_init_from_msg(&call->def, tr)) {
+		return false;
+	}
+
+	call->aggr_hooks = as_transaction_has_where_clause(tr) ?
+			&si_query_aggr_hooks : &pi_query_aggr_hooks;
+
+	return true;
+}
+
+static bool
+aggr_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata)
+{
+	return aggr_query_job_reduce_cb(r_ref, 0, udata);
+}
+
+static bool
+aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
+{
+	(void)bval;
+
+	aggr_query_slice* slice = (aggr_query_slice*)udata;
+	aggr_query_job* job = slice->job;
+	as_query_job* _job = (as_query_job*)job;
+	as_namespace* ns = _job->ns;
+
+	if (_job->abandoned != 0) {
+		as_record_done(r_ref, ns);
+		return false;
+	}
+
+	as_index* r = r_ref->r;
+
+	if ((_job->si == NULL || _job->pi_plan) &&
+			excluded_set(r, _job->set_id)) {
+		as_record_done(r_ref, ns);
+		return true;
+	}
+
+	if (as_record_is_doomed(r, ns)) {
+		as_record_done(r_ref, ns);
+		return true;
+	}
+
+	if (! aggr_query_add_digest(ns, slice->ll, r, r_ref->r_h)) {
+		as_record_done(r_ref, ns);
+		as_query_manager_abandon_job(_job, AS_ERR_UNKNOWN);
+		return false;
+	}
+
+	as_record_done(r_ref, ns);
+	as_incr_uint64(&_job->n_succeeded);
+
+	throttle_sleep(_job);
+
+	return true;
+}
+
+static bool
+aggr_query_add_digest(const as_namespace* ns, cf_ll* ll, as_index* r,
+		cf_arenax_handle r_h)
+{
+	as_aggr_keys_ll_element* tail_e = (as_aggr_keys_ll_element*)ll->tail;
+	as_aggr_keys_arr* keys_arr;
+
+	if (tail_e != NULL) {
+		keys_arr = tail_e->keys_arr;
+
+		if (keys_arr->num == AS_AGGR_KEYS_PER_ARR) {
+			tail_e = NULL;
+		}
+	}
+
+	if (tail_e == NULL) {
+		keys_arr = cf_malloc(sizeof(as_aggr_keys_arr));
+		keys_arr->num = 0;
+
+		tail_e = cf_malloc(sizeof(as_aggr_keys_ll_element));
+		tail_e->keys_arr = keys_arr;
+
+		cf_ll_append(ll, (cf_ll_element*)tail_e);
+	}
+
+	// TODO - proper EE split.
+	if (ns->xmem_type == CF_XMEM_TYPE_FLASH) {
+		keys_arr->u.digests[keys_arr->num] = r->keyd;
+	}
+	else {
+		as_index_reserve(r);
+
+		keys_arr->u.handles[keys_arr->num] = (uint64_t)r_h;
+	}
+
+	keys_arr->num++;
+
+	return true;
+}
+
+static as_stream_status
+aggr_query_ostream_write(void* udata, as_val* val)
+{
+	aggr_query_slice* slice = (aggr_query_slice*)udata;
+
+	if (val != NULL) {
+		aggr_query_add_val_response(slice, val, true);
+		as_val_destroy(val);
+	}
+
+	return AS_STREAM_OK;
+}
+
+static bool
+aggr_query_pre_check(void* udata, udf_record* urecord)
+{
+	if (udf_record_load(urecord) != 0) {
+		return false;
+	}
+
+	aggr_query_slice* slice = (aggr_query_slice*)udata;
+	as_query_job* _job = (as_query_job*)slice->job;
+
+	if (! record_matches_query(_job, urecord->rd)) {
+		return false;
+	}
+
+	return true;
+}
+
+static void
+aggr_query_add_val_response(aggr_query_slice* slice, const as_val* val,
+		bool success)
+{
+	uint32_t size = as_particle_asval_client_value_size(val);
+
+	as_msg_make_val_response_bufbuilder(val, slice->bb_r, size, success);
+
+	cf_buf_builder* bb = *slice->bb_r;
+	conn_query_job* conn_job = (conn_query_job*)slice->job;
+
+	// If we exceed the proto size limit, send accumulated data back to client
+	// and reset the buf-builder to start a new proto.
+	if (bb->used_sz > QUERY_CHUNK_LIMIT) {
+		if (! conn_query_job_send_response(conn_job, bb->buf, bb->used_sz)) {
+			return;
+		}
+
+		cf_buf_builder_reset(bb);
+		cf_buf_builder_reserve(slice->bb_r, (int)sizeof(as_proto), NULL);
+	}
+}
+
+
+//==============================================================================
+// exp_aggr_query_job derived class implementation.
+//
+
+//----------------------------------------------------------
+// exp_aggr_query_job typedefs and forward declarations.
+//
+
+// Aggregates natively, without Lua - each partition accumulates on its own,
+// then merges into the node's accumulator, which finish() sends as one value.
+
+typedef struct exp_aggr_query_job_s {
+	// Base object must be first:
+	conn_query_job _base;
+
+	// Derived class data:
+	as_query_aggr* aggr;
+	as_exp* filter_exp;
 
-static const as_aggr_hooks si_query_aggr_hooks = {
-	.ostream_write = aggr_query_ostream_write,
-	.pre_check     = aggr_query_pre_check
+	cf_mutex acc_lock;
+	as_query_aggr_acc* acc; // merged from all partitions
+	bool too_many_groups;
+} exp_aggr_query_job;
+
+static void exp_aggr_query_job_slice(as_query_job* _job, as_partition_reservation* rsv, cf_buf_builder** bb_r);
+static void exp_aggr_query_job_finish(as_query_job* _job);
+static void exp_aggr_query_job_destroy(as_query_job* _job);
+static void exp_aggr_query_job_info(as_query_job* _job, as_mon_jobstat* stat);
+
+static const as_query_vtable exp_aggr_query_job_vtable = {
+	exp_aggr_query_job_slice,
+	exp_aggr_query_job_finish,
+	exp_aggr_query_job_destroy,
+	exp_aggr_query_job_info
 };
 
+typedef struct exp_aggr_query_slice_s {
+	exp_aggr_query_job* job;
+	as_query_aggr_acc* acc;
+} exp_aggr_query_slice;
+
+static bool exp_aggr_query_init(exp_aggr_query_job* job, const as_transaction* tr);
+static bool exp_aggr_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata);
+static bool exp_aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata);
+static void exp_aggr_query_fail_groups(exp_aggr_query_job* job);
+static void exp_aggr_query_send_val(exp_aggr_query_job* job, const as_val* val, bool success);
+
 //----------------------------------------------------------
-// aggr_query_job public API.
+// exp_aggr_query_job public API.
 //
 
 static int
-aggr_query_job_start(as_transaction* tr, as_namespace* ns)
+exp_aggr_query_job_start(as_transaction* tr, as_namespace* ns)
 {
-	// Temporary security vulnerability protection.
-	if (g_config.udf_execution_disabled) {
-		cf_warning(AS_QUERY, "aggregation query job forbidden");
-		return AS_ERR_FORBIDDEN;
-	}
-
 	if (as_transaction_is_short_query(tr)) {
-		cf_warning(AS_QUERY, "aggregation queries can't be 'short' queries");
+		cf_warning(AS_QUERY, "exp aggregation queries can't be 'short' queries");
 		return AS_ERR_PARAMETER;
 	}
 
-	if (as_transaction_has_predexp(tr)) {
-		cf_warning(AS_QUERY, "aggregation queries do not support predexp filters");
-		return AS_ERR_UNSUPPORTED_FEATURE;
-	}
-
-	aggr_query_job* job = cf_calloc(1, sizeof(aggr_query_job));
+	exp_aggr_query_job* job = cf_calloc(1, sizeof(exp_aggr_query_job));
 	conn_query_job* conn_job = (conn_query_job*)job;
 	as_query_job* _job = (as_query_job*)job;
 
-	as_query_job_init(_job, &aggr_query_job_vtable, tr, ns);
+	cf_mutex_init(&job->acc_lock);
+
+	as_query_job_init(_job, &exp_aggr_query_job_vtable, tr, ns);
 
 	if (! get_query_set(tr, ns, _job->set_name, &_job->set_id) ||
 			! get_query_range(tr, ns, &_job->range) ||
 			! get_query_rps(tr, &_job->rps)) {
-		cf_warning(AS_QUERY, "aggregation query job failed msg field processing");
+		cf_warning(AS_QUERY, "exp aggregation query job failed msg field processing");
 		as_query_job_destroy(_job);
 		return AS_ERR_PARAMETER;
 	}
@@ -2045,7 +4248,7 @@ aggr_query_job_start(as_transaction* tr, as_namespace* ns)
 		return AS_ERR_SINDEX_NOT_FOUND;
 	}
 
-	if (_job->si != NULL && ! _job->si->readable) {
+	if (! sindexes_readable(_job)) {
 		as_query_job_destroy(_job);
 		return AS_ERR_SINDEX_NOT_READABLE;
 	}
@@ -2053,41 +4256,35 @@ aggr_query_job_start(as_transaction* tr, as_namespace* ns)
 	// Take ownership of socket from transaction.
 	conn_query_job_init(conn_job, tr);
 
-	if (! get_query_socket_timeout(tr, &conn_job->fd_timeout)) {
-		cf_warning(AS_QUERY, "aggregation query job failed msg field processing");
+	if (! get_query_socket_timeout(tr, &conn_job->fd_timeout) ||
+			! get_query_filter_exp(tr, &job->filter_exp) ||
+			! exp_aggr_query_init(job, tr)) {
+		cf_warning(AS_QUERY, "exp aggregation query job failed msg field processing");
 		conn_query_job_destroy(conn_job);
 		as_query_job_destroy(_job);
 		return AS_ERR_PARAMETER;
 	}
 
-	aggr_query_job_init(job);
-
 	int result = as_security_check_rps(tr->from.proto_fd_h, _job->rps,
-			PERM_UDF_QUERY, false, &_job->rps_udata);
+			PERM_QUERY, false, &_job->rps_udata);
 
 	if (result != AS_OK) {
-		cf_warning(AS_QUERY, "aggregation query job failed quota %d", result);
+		cf_warning(AS_QUERY, "exp aggregation query job failed quota %d",
+				result);
 		conn_query_job_destroy(conn_job);
 		as_query_job_destroy(_job);
 		return result;
 	}
 
-	if (! aggr_query_init(&job->aggr_call, tr)) {
-		cf_warning(AS_QUERY, "aggregation query job failed call init");
-		conn_query_job_destroy(conn_job);
-		as_query_job_destroy(_job);
-		return AS_ERR_PARAMETER;
-	}
-
-	cf_debug(AS_QUERY, "starting aggregation query job %lu {%s:%s:%s} rps %u socket-timeout %d from %s",
+	cf_debug(AS_QUERY, "starting exp aggregation query job %lu {%s:%s:%s} rps %u socket-timeout %d from %s",
 			_job->trid, ns->name, _job->set_name,
 			_job->si != NULL ? _job->si_name : "<pi-query>",
 			_job->rps, conn_job->fd_timeout, _job->client);
 
 	if ((result = as_query_manager_start_job(_job)) != AS_OK) {
-		cf_warning(AS_QUERY, "aggregation query job %lu failed to start (%d)",
+		cf_warning(AS_QUERY, "exp aggregation query job %lu failed to start (%d)",
 				_job->trid, result);
-		conn_query_job_destroy((conn_query_job*)job);
+		conn_query_job_destroy(conn_job);
 		as_query_job_destroy(_job);
 		return result;
 	}
@@ -2096,102 +4293,73 @@ aggr_query_job_start(as_transaction* tr, as_namespace* ns)
 }
 
 //----------------------------------------------------------
-// aggr_query_job mandatory query_job interface.
+// exp_aggr_query_job mandatory query_job interface.
 //
 
 static void
-aggr_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
+exp_aggr_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 		cf_buf_builder** bb_r)
 {
+	(void)bb_r; // nothing is sent until finish()
+
 	if (rsv == NULL) { // this thread finished all its partitions
 		return;
 	}
 
-	aggr_query_job* job = (aggr_query_job*)_job;
-	cf_ll ll;
-
-	cf_ll_init(&ll, as_aggr_keys_destroy_cb, false);
-
-	cf_buf_builder* bb = *bb_r;
-
-	if (bb == NULL) {
-		bb = cf_buf_builder_create(INIT_BUF_BUILDER_SIZE);
-	}
-	else {
-		cf_buf_builder_reset(bb);
-	}
-
-	cf_buf_builder_reserve(&bb, (int)sizeof(as_proto), NULL);
-
-	aggr_query_slice slice = { job, &ll, &bb };
+	exp_aggr_query_job* job = (exp_aggr_query_job*)_job;
+	exp_aggr_query_slice slice = {
+			.job = job,
+			.acc = as_query_aggr_acc_create(job->aggr)
+	};
 
-	if (_job->si != NULL) {
-		as_sindex_tree_query(_job->si, _job->range, rsv, 0, NULL,
-				aggr_query_job_reduce_cb, (void*)&slice);
+	if (_job->si != NULL && ! _job->pi_plan) {
+		query_sindex(_job, rsv, 0, NULL, exp_aggr_query_job_reduce_cb,
+				(void*)&slice);
 	}
 	else {
-		if (! as_set_index_reduce(_job->ns, rsv->tree, _job->set_id, NULL,
-				aggr_pi_query_job_reduce_cb, (void*)&slice)) {
-			as_index_reduce_live(rsv->tree, aggr_pi_query_job_reduce_cb,
+		if (! as_set_index_reduce_unordered(_job->ns, rsv->tree, _job->set_id,
+				exp_aggr_pi_query_job_reduce_cb, (void*)&slice)) {
+			as_index_reduce_live(rsv->tree, exp_aggr_pi_query_job_reduce_cb,
 					(void*)&slice);
 		}
 	}
 
-	if (cf_ll_size(&ll) != 0) {
-		as_result result;
-		as_result_init(&result);
-
-		int ret = as_aggr_process(_job->ns, rsv, &job->aggr_call, &ll,
-				(void*)&slice, &result);
-
-		if (ret != 0) {
-			char* rs = as_module_err_string(ret);
-
-			if (result.value) {
-				as_string* lua_s = as_string_fromval(result.value);
-				char* lua_err = (char*)as_string_tostring(lua_s);
-
-				if (lua_err) {
-					size_t l_rs_len = strlen(rs);
+	if (_job->abandoned == 0) {
+		cf_mutex_lock(&job->acc_lock);
 
-					rs = cf_realloc(rs, l_rs_len + strlen(lua_err) + 4);
-					sprintf(&rs[l_rs_len], " : %s", lua_err);
-				}
-			}
+		bool merged = as_query_aggr_acc_merge(job->acc, slice.acc);
 
-			const as_val* v = (as_val*)as_string_new(rs, false);
+		cf_mutex_unlock(&job->acc_lock);
 
-			aggr_query_add_val_response(&slice, v, false);
-			as_val_destroy(v);
-			cf_free(rs);
-			as_query_manager_abandon_job(_job, AS_ERR_UNKNOWN);
+		if (! merged) {
+			exp_aggr_query_fail_groups(job);
 		}
-
-		as_result_destroy(&result);
-	}
-
-	as_aggr_release_udata udata = { .ns = _job->ns, .tree = rsv->tree };
-
-	cf_ll_reduce(&ll, true, as_aggr_keys_release_cb, &udata);
-
-	if (bb->used_sz > sizeof(as_proto)) {
-		conn_query_job_send_response((conn_query_job*)job, bb->buf, bb->used_sz);
 	}
 
-	*bb_r = bb;
+	as_query_aggr_acc_destroy(slice.acc);
 }
 
 static void
-aggr_query_job_finish(as_query_job* _job)
+exp_aggr_query_job_finish(as_query_job* _job)
 {
-	aggr_query_job* job = (aggr_query_job*)_job;
+	exp_aggr_query_job* job = (exp_aggr_query_job*)_job;
 
-	conn_query_job_finish((conn_query_job*)job);
+	// All partitions are done - no need to lock.
+	if (job->too_many_groups) {
+		const as_val* v = (as_val*)as_string_new(
+				(char*)"aggregation exceeded max-groups", false);
 
-	if (job->aggr_call.def.arglist) {
-		as_list_destroy(job->aggr_call.def.arglist);
-		job->aggr_call.def.arglist = NULL;
+		exp_aggr_query_send_val(job, v, false);
+		as_val_destroy(v);
 	}
+	else if (_job->abandoned == 0) {
+		as_val* v = as_query_aggr_acc_result(job->acc);
+
+		exp_aggr_query_send_val(job, v, true);
+		as_val_destroy(v);
+	}
+
+	conn_query_job_finish((conn_query_job*)job);
 
 	as_namespace* ns = _job->ns;
 
@@ -2213,63 +4381,67 @@ aggr_query_job_finish(as_query_job* _job)
 		break;
 	}
 
-	cf_debug(AS_QUERY, "finished aggregation query job %lu (%d)", _job->trid,
-			_job->abandoned);
+	cf_debug(AS_QUERY, "finished exp aggregation query job %lu (%d)",
+			_job->trid, _job->abandoned);
 }
 
 static void
-aggr_query_job_destroy(as_query_job* _job)
+exp_aggr_query_job_destroy(as_query_job* _job)
 {
-	aggr_query_job* job = (aggr_query_job*)_job;
+	exp_aggr_query_job* job = (exp_aggr_query_job*)_job;
 
-	if (job->aggr_call.def.arglist) {
-		as_list_destroy(job->aggr_call.def.arglist);
+	if (job->acc != NULL) {
+		as_query_aggr_acc_destroy(job->acc);
+	}
+
+	if (job->aggr != NULL) {
+		as_query_aggr_destroy(job->aggr);
 	}
+
+	as_exp_destroy(job->filter_exp);
+	cf_mutex_destroy(&job->acc_lock);
 }
 
 static void
-aggr_query_job_info(as_query_job* _job, as_mon_jobstat* stat)
+exp_aggr_query_job_info(as_query_job* _job, as_mon_jobstat* stat)
 {
-	strcpy(stat->job_type, query_type_str(QUERY_TYPE_AGGR));
+	strcpy(stat->job_type, query_type_str(QUERY_TYPE_EXP_AGGR));
 	conn_query_job_info((conn_query_job*)_job, stat);
 }
 
 //----------------------------------------------------------
-// aggr_query_job utilities.
+// exp_aggr_query_job utilities.
 //
 
-static void
-aggr_query_job_init(aggr_query_job* job)
-{
-	(void)job;
-}
-
 static bool
-aggr_query_init(as_aggr_call* call, const as_transaction* tr)
+exp_aggr_query_init(exp_aggr_query_job* job, const as_transaction* tr)
 {
-	if (! udf_def_init_from_msg(&call->def, tr)) {
+	const as_msg_field* f = as_msg_field_get(&tr->msgp->msg,
+			AS_MSG_FIELD_TYPE_AGGR_EXP);
+
+	if ((job->aggr = as_query_aggr_create(f->data,
+			as_msg_field_get_value_sz(f))) == NULL) {
 		return false;
 	}
 
-	call->aggr_hooks = as_transaction_has_where_clause(tr) ?
-			&si_query_aggr_hooks : &pi_query_aggr_hooks;
+	job->acc = as_query_aggr_acc_create(job->aggr);
 
 	return true;
 }
 
 static bool
-aggr_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata)
+exp_aggr_pi_query_job_reduce_cb(as_index_ref* r_ref, void* udata)
 {
-	return aggr_query_job_reduce_cb(r_ref, 0, udata);
+	return exp_aggr_query_job_reduce_cb(r_ref, 0, udata);
 }
 
 static bool
-aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
+exp_aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 {
 	(void)bval;
 
-	aggr_query_slice* slice = (aggr_query_slice*)udata;
-	aggr_query_job* job = slice->job;
+	exp_aggr_query_slice* slice = (exp_aggr_query_slice*)udata;
+	exp_aggr_query_job* job = slice->job;
 	as_query_job* _job = (as_query_job*)job;
 	as_namespace* ns = _job->ns;
 
@@ -2280,121 +4452,88 @@ aggr_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 
 	as_index* r = r_ref->r;
 
-	if (_job->si == NULL && excluded_set(r, _job->set_id)) {
+	if (excluded_set(r, _job->set_id) || as_record_is_doomed(r, ns)) {
 		as_record_done(r_ref, ns);
 		return true;
 	}
 
-	if (as_record_is_doomed(r, ns)) {
-		as_record_done(r_ref, ns);
-		return true;
-	}
+	as_exp_ctx ctx = { .ns = ns, .r = r };
+	as_exp_trilean tv = job->filter_exp == NULL ?
+			AS_EXP_TRUE : as_exp_matches_metadata(job->filter_exp, &ctx);
 
-	if (! aggr_query_add_digest(ns, slice->ll, r, r_ref->r_h)) {
+	if (tv == AS_EXP_FALSE) {
 		as_record_done(r_ref, ns);
-		as_query_manager_abandon_job(_job, AS_ERR_UNKNOWN);
-		return false;
+		as_incr_uint64(&_job->n_filtered_meta);
+		return true;
 	}
 
-	as_record_done(r_ref, ns);
-	as_incr_uint64(&_job->n_succeeded);
-
-	throttle_sleep(_job);
-
-	return true;
-}
+	as_storage_rd rd;
 
-static bool
-aggr_query_add_digest(const as_namespace* ns, cf_ll* ll, as_index* r,
-		cf_arenax_handle r_h)
-{
-	as_aggr_keys_ll_element* tail_e = (as_aggr_keys_ll_element*)ll->tail;
-	as_aggr_keys_arr* keys_arr;
+	as_storage_record_open(ns, r, &rd);
 
-	if (tail_e != NULL) {
-		keys_arr = tail_e->keys_arr;
+	as_bin stack_bins[ns->single_bin ? 1 : RECORD_MAX_BINS];
 
-		if (keys_arr->num == AS_AGGR_KEYS_PER_ARR) {
-			tail_e = NULL;
-		}
+	if (as_storage_rd_load_bins(&rd, stack_bins) < 0) {
+		cf_warning(AS_QUERY, "job %lu - record unreadable", _job->trid);
+		as_storage_record_close(&rd);
+		as_record_done(r_ref, ns);
+		as_incr_uint64(&_job->n_failed);
+		return true;
 	}
 
-	if (tail_e == NULL) {
-		keys_arr = cf_malloc(sizeof(as_aggr_keys_arr));
-		keys_arr->num = 0;
-
-		tail_e = cf_malloc(sizeof(as_aggr_keys_ll_element));
-		tail_e->keys_arr = keys_arr;
-
-		cf_ll_append(ll, (cf_ll_element*)tail_e);
-	}
+	ctx.rd = &rd;
 
-	// TODO - proper EE split.
-	if (ns->xmem_type == CF_XMEM_TYPE_FLASH) {
-		keys_arr->u.digests[keys_arr->num] = r->keyd;
+	if (tv == AS_EXP_UNK && ! as_exp_matches_record(job->filter_exp, &ctx)) {
+		as_storage_record_close(&rd);
+		as_record_done(r_ref, ns);
+		as_incr_uint64(&_job->n_filtered_bins);
+		throttle_sleep(_job);
+		return true;
 	}
-	else {
-		as_index_reserve(r);
 
-		keys_arr->u.handles[keys_arr->num] = (uint64_t)r_h;
+	if (_job->si != NULL && ! record_matches_query(_job, &rd)) {
+		as_storage_record_close(&rd);
+		as_record_done(r_ref, ns);
+		return true;
 	}
 
-	keys_arr->num++;
-
-	return true;
-}
-
-static as_stream_status
-aggr_query_ostream_write(void* udata, as_val* val)
-{
-	aggr_query_slice* slice = (aggr_query_slice*)udata;
-
-	if (val != NULL) {
-		aggr_query_add_val_response(slice, val, true);
-		as_val_destroy(val);
-	}
+	bool added = as_query_aggr_acc_add(slice->acc, &ctx);
 
-	return AS_STREAM_OK;
-}
+	as_storage_record_close(&rd);
+	as_record_done(r_ref, ns);
 
-static bool
-aggr_query_pre_check(void* udata, udf_record* urecord)
-{
-	if (udf_record_load(urecord) != 0) {
+	if (! added) {
+		exp_aggr_query_fail_groups(job);
 		return false;
 	}
 
-	aggr_query_slice* slice = (aggr_query_slice*)udata;
-	as_query_job* _job = (as_query_job*)slice->job;
+	as_incr_uint64(&_job->n_succeeded);
 
-	if (! record_matches_query(_job, urecord->rd)) {
-		return false;
-	}
+	throttle_sleep(_job);
 
 	return true;
 }
 
 static void
-aggr_query_add_val_response(aggr_query_slice* slice, const as_val* val,
-		bool success)
+exp_aggr_query_fail_groups(exp_aggr_query_job* job)
 {
-	uint32_t size = as_particle_asval_client_value_size(val);
+	job->too_many_groups = true;
+	as_query_manager_abandon_job((as_query_job*)job, AS_ERR_UNKNOWN);
+}
 
-	as_msg_make_val_response_bufbuilder(val, slice->bb_r, size, success);
+static void
+exp_aggr_query_send_val(exp_aggr_query_job* job, const as_val* val,
+		bool success)
+{
+	cf_buf_builder* bb = cf_buf_builder_create(INIT_BUF_BUILDER_SIZE);
 
-	cf_buf_builder* bb = *slice->bb_r;
-	conn_query_job* conn_job = (conn_query_job*)slice->job;
+	cf_buf_builder_reserve(&bb, (int)sizeof(as_proto), NULL);
 
-	// If we exceed the proto size limit, send accumulated data back to client
-	// and reset the buf-builder to start a new proto.
-	if (bb->used_sz > QUERY_CHUNK_LIMIT) {
-		if (! conn_query_job_send_response(conn_job, bb->buf, bb->used_sz)) {
-			return;
-		}
+	uint32_t size = as_particle_asval_client_value_size(val);
 
-		cf_buf_builder_reset(bb);
-		cf_buf_builder_reserve(slice->bb_r, (int)sizeof(as_proto), NULL);
-	}
+	as_msg_make_val_response_bufbuilder(val, &bb, size, success);
+	conn_query_job_send_response((conn_query_job*)job, bb->buf, bb->used_sz);
+	cf_buf_builder_free(bb);
 }
 
 
@@ -2456,6 +4595,8 @@ udf_bg_query_job_start(as_transaction* tr, as_namespace* ns)
 
 	as_query_job_init(_job, &udf_bg_query_job_vtable, tr, ns);
 
+	_job->is_background = true;
+
 	if (! get_query_set(tr, ns, _job->set_name, &_job->set_id) ||
 			! get_query_range(tr, ns, &_job->range) ||
 			! get_query_rps(tr, &_job->rps)) {
@@ -2480,7 +4621,7 @@ udf_bg_query_job_start(as_transaction* tr, as_namespace* ns)
 		return AS_ERR_SINDEX_NOT_FOUND;
 	}
 
-	if (_job->si != NULL && ! _job->si->readable) {
+	if (! sindexes_readable(_job)) {
 		as_query_job_destroy(_job);
 		return AS_ERR_SINDEX_NOT_READABLE;
 	}
@@ -2561,12 +4702,12 @@ udf_bg_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 {
 	(void)bb_r;
 
-	if (_job->si != NULL) {
-		as_sindex_tree_query(_job->si, _job->range, rsv, 0, NULL,
+	if (_job->si != NULL && ! _job->pi_plan) {
+		query_sindex(_job, rsv, 0, NULL,
 				udf_bg_query_job_reduce_cb, (void*)_job);
 	}
 	else {
-		if (! as_set_index_reduce(_job->ns, rsv->tree, _job->set_id, NULL,
+		if (! as_set_index_reduce_unordered(_job->ns, rsv->tree, _job->set_id,
 				udf_bg_pi_query_job_reduce_cb, (void*)_job)) {
 			as_index_reduce_live(rsv->tree, udf_bg_pi_query_job_reduce_cb,
 					(void*)_job);
@@ -2665,7 +4806,8 @@ udf_bg_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 
 	as_index* r = r_ref->r;
 
-	if (_job->si == NULL && excluded_set(r, _job->set_id)) {
+	if ((_job->si == NULL || _job->pi_plan) &&
+			excluded_set(r, _job->set_id)) {
 		as_record_done(r_ref, ns);
 		return true;
 	}
@@ -2792,6 +4934,8 @@ ops_bg_query_job_start(as_transaction* tr, as_namespace* ns)
 
 	as_query_job_init(_job, &ops_bg_query_job_vtable, tr, ns);
 
+	_job->is_background = true;
+
 	if (! get_query_set(tr, ns, _job->set_name, &_job->set_id) ||
 			! get_query_range(tr, ns, &_job->range) ||
 			! get_query_rps(tr, &_job->rps)) {
@@ -2816,7 +4960,7 @@ ops_bg_query_job_start(as_transaction* tr, as_namespace* ns)
 		return AS_ERR_SINDEX_NOT_FOUND;
 	}
 
-	if (_job->si != NULL && ! _job->si->readable) {
+	if (! sindexes_readable(_job)) {
 		as_query_job_destroy(_job);
 		return AS_ERR_SINDEX_NOT_READABLE;
 	}
@@ -2902,12 +5046,12 @@ ops_bg_query_job_slice(as_query_job* _job, as_partition_reservation* rsv,
 {
 	(void)bb_r;
 
-	if (_job->si != NULL) {
-		as_sindex_tree_query(_job->si, _job->range, rsv, 0, NULL,
+	if (_job->si != NULL && ! _job->pi_plan) {
+		query_sindex(_job, rsv, 0, NULL,
 				ops_bg_query_job_reduce_cb, (void*)_job);
 	}
 	else {
-		if (! as_set_index_reduce(_job->ns, rsv->tree, _job->set_id, NULL,
+		if (! as_set_index_reduce_unordered(_job->ns, rsv->tree, _job->set_id,
 				ops_bg_pi_query_job_reduce_cb, (void*)_job)) {
 			as_index_reduce_live(rsv->tree, ops_bg_pi_query_job_reduce_cb,
 					(void*)_job);
@@ -3062,7 +5206,8 @@ ops_bg_query_job_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
 
 	as_index* r = r_ref->r;
 
-	if (_job->si == NULL && excluded_set(r, _job->set_id)) {
+	if ((_job->si == NULL || _job->pi_plan) &&
+			excluded_set(r, _job->set_id)) {
 		as_record_done(r_ref, ns);
 		return true;
 	}
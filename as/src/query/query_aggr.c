@@ -0,0 +1,825 @@
+/*
+ * query_aggr.c
+ *
+ * Copyright (C) 2022 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "query/query_aggr.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "aerospike/as_arraylist.h"
+#include "aerospike/as_bytes.h"
+#include "aerospike/as_double.h"
+#include "aerospike/as_hashmap.h"
+#include "aerospike/as_integer.h"
+#include "aerospike/as_nil.h"
+#include "aerospike/as_string.h"
+#include "aerospike/as_val.h"
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_hash_math.h"
+
+#include "log.h"
+#include "msgpack_in.h"
+
+#include "base/datamodel.h"
+#include "base/exp.h"
+
+//#include "warnings.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// The spec is a msgpack list - [[op, exp, ...], ...] with an optional second
+// element [group-exp, max-groups]. Count's exp is optional - without it, count
+// is of records. Distinct takes an optional HLL n-index-bits after its exp.
+//
+// Per node, the result is a list with an element per op, or with group-by, a
+// map of group (integer or string) to such a list. Elements are partial, for
+// the client to merge across nodes - avg is [sum, count] and distinct is an
+// HLL particle.
+
+#define MAX_N_OPS 16
+#define MAX_N_GROUPS (16U * 1024U)
+
+#define DEFAULT_N_INDEX_BITS 12
+#define MIN_N_INDEX_BITS 4
+#define MAX_N_INDEX_BITS 16
+
+#define INIT_N_SLOTS 16 // must be power of 2
+
+#define STACK_FLAT_SZ 256
+
+typedef struct aggr_op_s {
+	as_query_aggr_op code;
+	uint8_t n_index_bits; // distinct only
+	as_exp* exp; // only count may have none
+} aggr_op;
+
+struct as_query_aggr_s {
+	uint32_t n_ops;
+	aggr_op ops[MAX_N_OPS];
+
+	as_exp* group_exp; // NULL if not grouping
+	uint32_t max_groups;
+};
+
+typedef struct aggr_val_s {
+	uint64_t count; // values aggregated
+	bool is_float; // sum, min, max - integer part in i, float part in f
+	int64_t i;
+	double f;
+	uint8_t* sketch; // distinct only
+} aggr_val;
+
+typedef struct aggr_key_s {
+	as_particle_type type; // integer, string, or null if not grouping
+	int64_t i;
+	char* str;
+	uint32_t str_sz;
+	uint64_t hash;
+} aggr_key;
+
+typedef struct aggr_group_s {
+	aggr_key key;
+	aggr_val vals[];
+} aggr_group;
+
+struct as_query_aggr_acc_s {
+	const as_query_aggr* aggr;
+
+	uint32_t n_groups;
+	uint32_t n_slots;
+	aggr_group** slots; // open addressing
+};
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static bool parse_op(msgpack_in* mp, aggr_op* op);
+static bool parse_group_by(msgpack_in* mp, as_query_aggr* aggr);
+static as_exp* parse_exp(msgpack_in* mp);
+
+static aggr_group* get_group(as_query_aggr_acc* acc, const aggr_key* key);
+static void grow_slots(as_query_aggr_acc* acc);
+static void destroy_group(const as_query_aggr* aggr, aggr_group* g);
+
+static void add_value(const aggr_op* op, aggr_val* v, const as_exp_ctx* ctx);
+static void add_distinct(const aggr_op* op, aggr_val* v, as_bin* b);
+static void merge_value(const aggr_op* op, aggr_val* to, const aggr_val* from);
+static void sum_number(aggr_val* v, bool is_float, int64_t i, double f);
+static void keep_extreme(aggr_val* v, bool is_max, bool is_float, int64_t i, double f);
+
+static as_val* group_result(const as_query_aggr* aggr, const aggr_group* g);
+static as_val* op_result(const aggr_op* op, const aggr_val* v);
+static as_val* sum_result(const aggr_val* v);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline bool
+bin_number(const as_bin* b, bool* is_float, int64_t* i, double* f)
+{
+	switch (as_bin_get_particle_type(b)) {
+	case AS_PARTICLE_TYPE_INTEGER:
+		*is_float = false;
+		*i = as_bin_particle_integer_value(b);
+		return true;
+	case AS_PARTICLE_TYPE_FLOAT:
+		*is_float = true;
+		*f = as_bin_particle_float_value(b);
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline bool
+key_matches(const aggr_key* k1, const aggr_key* k2)
+{
+	if (k1->hash != k2->hash || k1->type != k2->type) {
+		return false;
+	}
+
+	switch (k1->type) {
+	case AS_PARTICLE_TYPE_INTEGER:
+		return k1->i == k2->i;
+	case AS_PARTICLE_TYPE_STRING:
+		return k1->str_sz == k2->str_sz &&
+				memcmp(k1->str, k2->str, k1->str_sz) == 0;
+	default:
+		return true;
+	}
+}
+
+
+//==========================================================
+// Public API.
+//
+
+as_query_aggr*
+as_query_aggr_create(const uint8_t* buf, uint32_t buf_sz)
+{
+	msgpack_in mp = { .buf = buf, .buf_sz = buf_sz };
+
+	uint32_t n_eles;
+
+	if (! msgpack_get_list_ele_count(&mp, &n_eles) || n_eles == 0 ||
+			n_eles > 2) {
+		cf_warning(AS_QUERY, "aggregation spec not a list of 1 or 2");
+		return NULL;
+	}
+
+	uint32_t n_ops;
+
+	if (! msgpack_get_list_ele_count(&mp, &n_ops) || n_ops == 0 ||
+			n_ops > MAX_N_OPS) {
+		cf_warning(AS_QUERY, "aggregation spec needs 1 to %u ops", MAX_N_OPS);
+		return NULL;
+	}
+
+	as_query_aggr* aggr = cf_calloc(1, sizeof(as_query_aggr));
+
+	aggr->max_groups = 1;
+
+	for (uint32_t i = 0; i < n_ops; i++) {
+		if (! parse_op(&mp, &aggr->ops[i])) {
+			as_query_aggr_destroy(aggr);
+			return NULL;
+		}
+
+		aggr->n_ops++;
+	}
+
+	if (n_eles == 2 && ! parse_group_by(&mp, aggr)) {
+		as_query_aggr_destroy(aggr);
+		return NULL;
+	}
+
+	if (mp.offset != mp.buf_sz) {
+		cf_warning(AS_QUERY, "aggregation spec has trailing bytes");
+		as_query_aggr_destroy(aggr);
+		return NULL;
+	}
+
+	return aggr;
+}
+
+void
+as_query_aggr_destroy(as_query_aggr* aggr)
+{
+	for (uint32_t i = 0; i < aggr->n_ops; i++) {
+		as_exp_destroy(aggr->ops[i].exp); // may be NULL
+	}
+
+	as_exp_destroy(aggr->group_exp); // may be NULL
+	cf_free(aggr);
+}
+
+as_query_aggr_acc*
+as_query_aggr_acc_create(const as_query_aggr* aggr)
+{
+	as_query_aggr_acc* acc = cf_malloc(sizeof(as_query_aggr_acc));
+
+	*acc = (as_query_aggr_acc){
+			.aggr = aggr,
+			.n_slots = INIT_N_SLOTS,
+			.slots = cf_calloc(INIT_N_SLOTS, sizeof(aggr_group*))
+	};
+
+	// Without group-by there's always exactly one (key-less) group.
+	if (aggr->group_exp == NULL) {
+		aggr_key key = { .type = AS_PARTICLE_TYPE_NULL };
+
+		get_group(acc, &key);
+	}
+
+	return acc;
+}
+
+void
+as_query_aggr_acc_destroy(as_query_aggr_acc* acc)
+{
+	for (uint32_t s = 0; s < acc->n_slots; s++) {
+		if (acc->slots[s] != NULL) {
+			destroy_group(acc->aggr, acc->slots[s]);
+		}
+	}
+
+	cf_free(acc->slots);
+	cf_free(acc);
+}
+
+// Returns false if the record makes too many groups.
+bool
+as_query_aggr_acc_add(as_query_aggr_acc* acc, const as_exp_ctx* ctx)
+{
+	const as_query_aggr* aggr = acc->aggr;
+	aggr_key key = { .type = AS_PARTICLE_TYPE_NULL };
+	as_bin rb = { 0 };
+
+	if (aggr->group_exp != NULL) {
+		if (! as_exp_eval(aggr->group_exp, ctx, &rb, NULL, false)) {
+			return true; // records without a group are skipped
+		}
+
+		key.type = as_bin_get_particle_type(&rb);
+
+		switch (key.type) {
+		case AS_PARTICLE_TYPE_INTEGER:
+			key.i = as_bin_particle_integer_value(&rb);
+			key.hash = cf_wyhash64((const void*)&key.i, sizeof(key.i));
+			break;
+		case AS_PARTICLE_TYPE_STRING:
+			key.str_sz = as_bin_particle_string_ptr(&rb, &key.str);
+			key.hash = cf_wyhash64((const void*)key.str, key.str_sz);
+			break;
+		default:
+			as_bin_particle_destroy(&rb);
+			return true; // records without a group are skipped
+		}
+	}
+
+	aggr_group* g = get_group(acc, &key);
+
+	as_bin_particle_destroy(&rb);
+
+	if (g == NULL) {
+		return false;
+	}
+
+	for (uint32_t i = 0; i < aggr->n_ops; i++) {
+		add_value(&aggr->ops[i], &g->vals[i], ctx);
+	}
+
+	return true;
+}
+
+// Returns false if the merged accumulator has too many groups.
+bool
+as_query_aggr_acc_merge(as_query_aggr_acc* to, const as_query_aggr_acc* from)
+{
+	const as_query_aggr* aggr = to->aggr;
+
+	for (uint32_t s = 0; s < from->n_slots; s++) {
+		const aggr_group* from_g = from->slots[s];
+
+		if (from_g == NULL) {
+			continue;
+		}
+
+		aggr_group* to_g = get_group(to, &from_g->key);
+
+		if (to_g == NULL) {
+			return false;
+		}
+
+		for (uint32_t i = 0; i < aggr->n_ops; i++) {
+			merge_value(&aggr->ops[i], &to_g->vals[i], &from_g->vals[i]);
+		}
+	}
+
+	return true;
+}
+
+as_val*
+as_query_aggr_acc_result(const as_query_aggr_acc* acc)
+{
+	const as_query_aggr* aggr = acc->aggr;
+
+	if (aggr->group_exp == NULL) {
+		return group_result(aggr, acc->slots[0]); // key hash is 0
+	}
+
+	as_hashmap* map = as_hashmap_new(acc->n_groups == 0 ? 1 : acc->n_groups);
+
+	for (uint32_t s = 0; s < acc->n_slots; s++) {
+		const aggr_group* g = acc->slots[s];
+
+		if (g == NULL) {
+			continue;
+		}
+
+		as_val* key;
+
+		if (g->key.type == AS_PARTICLE_TYPE_INTEGER) {
+			key = (as_val*)as_integer_new(g->key.i);
+		}
+		else {
+			char* str = cf_malloc(g->key.str_sz + 1);
+
+			memcpy(str, g->key.str, g->key.str_sz);
+			str[g->key.str_sz] = '\0';
+
+			key = (as_val*)as_string_new_wlen(str, g->key.str_sz, true);
+		}
+
+		as_hashmap_set(map, key, group_result(aggr, g));
+	}
+
+	return (as_val*)map;
+}
+
+
+//==========================================================
+// Local helpers - parse spec.
+//
+
+static bool
+parse_op(msgpack_in* mp, aggr_op* op)
+{
+	uint32_t n_eles;
+	uint64_t code;
+
+	if (! msgpack_get_list_ele_count(mp, &n_eles) || n_eles == 0 ||
+			n_eles > 3 || ! msgpack_get_uint64(mp, &code) ||
+			code >= AS_QUERY_AGGR_OP_END) {
+		cf_warning(AS_QUERY, "bad aggregation op");
+		return false;
+	}
+
+	op->code = (as_query_aggr_op)code;
+	op->n_index_bits = DEFAULT_N_INDEX_BITS;
+
+	if (n_eles == 1) {
+		if (op->code != AS_QUERY_AGGR_OP_COUNT) {
+			cf_warning(AS_QUERY, "aggregation op %u needs an exp", op->code);
+			return false;
+		}
+
+		return true;
+	}
+
+	if ((op->exp = parse_exp(mp)) == NULL) {
+		return false;
+	}
+
+	if (n_eles == 3) {
+		uint64_t n_index_bits;
+
+		if (op->code != AS_QUERY_AGGR_OP_DISTINCT ||
+				! msgpack_get_uint64(mp, &n_index_bits) ||
+				n_index_bits < MIN_N_INDEX_BITS ||
+				n_index_bits > MAX_N_INDEX_BITS) {
+			cf_warning(AS_QUERY, "bad aggregation op %u param", op->code);
+			// The caller doesn't count a failed op - it won't destroy this.
+			as_exp_destroy(op->exp);
+			op->exp = NULL;
+			return false;
+		}
+
+		op->n_index_bits = (uint8_t)n_index_bits;
+	}
+
+	return true;
+}
+
+static bool
+parse_group_by(msgpack_in* mp, as_query_aggr* aggr)
+{
+	uint32_t n_eles;
+
+	if (! msgpack_get_list_ele_count(mp, &n_eles) || n_eles != 2) {
+		cf_warning(AS_QUERY, "aggregation group-by not a list of 2");
+		return false;
+	}
+
+	if ((aggr->group_exp = parse_exp(mp)) == NULL) {
+		return false;
+	}
+
+	uint64_t max_groups;
+
+	if (! msgpack_get_uint64(mp, &max_groups) || max_groups == 0 ||
+			max_groups > MAX_N_GROUPS) {
+		cf_warning(AS_QUERY, "aggregation max-groups must be 1 to %u",
+				MAX_N_GROUPS);
+		return false;
+	}
+
+	aggr->max_groups = (uint32_t)max_groups;
+
+	return true;
+}
+
+static as_exp*
+parse_exp(msgpack_in* mp)
+{
+	uint32_t exp_sz;
+	const uint8_t* exp_buf = msgpack_get_ele(mp, &exp_sz);
+
+	if (exp_buf == NULL) {
+		cf_warning(AS_QUERY, "aggregation exp not msgpack");
+		return NULL;
+	}
+
+	as_exp* exp = as_exp_build_buf(exp_buf, exp_sz, true);
+
+	if (exp == NULL) {
+		cf_warning(AS_QUERY, "failed to build aggregation exp");
+	}
+
+	return exp;
+}
+
+
+//==========================================================
+// Local helpers - groups.
+//
+
+// Returns NULL if the group is new and there are already max-groups.
+static aggr_group*
+get_group(as_query_aggr_acc* acc, const aggr_key* key)
+{
+	uint32_t mask = acc->n_slots - 1;
+	uint32_t s = (uint32_t)key->hash & mask;
+	aggr_group* g;
+
+	while ((g = acc->slots[s]) != NULL) {
+		if (key_matches(&g->key, key)) {
+			return g;
+		}
+
+		s = (s + 1) & mask;
+	}
+
+	const as_query_aggr* aggr = acc->aggr;
+
+	if (acc->n_groups == aggr->max_groups) {
+		return NULL;
+	}
+
+	g = cf_calloc(1, sizeof(aggr_group) + aggr->n_ops * sizeof(aggr_val));
+	g->key = *key;
+
+	if (key->type == AS_PARTICLE_TYPE_STRING) {
+		g->key.str = cf_malloc(key->str_sz);
+		memcpy(g->key.str, key->str, key->str_sz);
+	}
+
+	acc->slots[s] = g;
+	acc->n_groups++;
+
+	// Keep load factor under 3/4.
+	if (acc->n_groups * 4 > acc->n_slots * 3) {
+		grow_slots(acc);
+	}
+
+	return g;
+}
+
+static void
+grow_slots(as_query_aggr_acc* acc)
+{
+	uint32_t old_n_slots = acc->n_slots;
+	aggr_group** old_slots = acc->slots;
+
+	acc->n_slots *= 2;
+	acc->slots = cf_calloc(acc->n_slots, sizeof(aggr_group*));
+
+	uint32_t mask = acc->n_slots - 1;
+
+	for (uint32_t os = 0; os < old_n_slots; os++) {
+		aggr_group* g = old_slots[os];
+
+		if (g == NULL) {
+			continue;
+		}
+
+		uint32_t s = (uint32_t)g->key.hash & mask;
+
+		while (acc->slots[s] != NULL) {
+			s = (s + 1) & mask;
+		}
+
+		acc->slots[s] = g;
+	}
+
+	cf_free(old_slots);
+}
+
+static void
+destroy_group(const as_query_aggr* aggr, aggr_group* g)
+{
+	for (uint32_t i = 0; i < aggr->n_ops; i++) {
+		if (g->vals[i].sketch != NULL) {
+			cf_free(g->vals[i].sketch);
+		}
+	}
+
+	if (g->key.type == AS_PARTICLE_TYPE_STRING) {
+		cf_free(g->key.str);
+	}
+
+	cf_free(g);
+}
+
+
+//==========================================================
+// Local helpers - accumulate.
+//
+
+static void
+add_value(const aggr_op* op, aggr_val* v, const as_exp_ctx* ctx)
+{
+	if (op->exp == NULL) { // count of records
+		v->count++;
+		return;
+	}
+
+	as_bin rb = { 0 };
+
+	if (! as_exp_eval(op->exp, ctx, &rb, NULL, false)) {
+		return;
+	}
+
+	bool is_float;
+	int64_t i = 0;
+	double f = 0.0;
+
+	if (! as_bin_is_live(&rb)) {
+		// Nothing to aggregate.
+	}
+	else if (op->code == AS_QUERY_AGGR_OP_COUNT) {
+		v->count++;
+	}
+	else if (op->code == AS_QUERY_AGGR_OP_DISTINCT) {
+		add_distinct(op, v, &rb);
+	}
+	else if (bin_number(&rb, &is_float, &i, &f)) {
+		if (op->code == AS_QUERY_AGGR_OP_SUM ||
+				op->code == AS_QUERY_AGGR_OP_AVG) {
+			sum_number(v, is_float, i, f);
+		}
+		else {
+			keep_extreme(v, op->code == AS_QUERY_AGGR_OP_MAX, is_float, i, f);
+		}
+
+		v->count++;
+	}
+
+	as_bin_particle_destroy(&rb);
+}
+
+static void
+add_distinct(const aggr_op* op, aggr_val* v, as_bin* b)
+{
+	if (v->sketch == NULL) {
+		v->sketch = cf_malloc(as_hll_sketch_sz(op->n_index_bits));
+		as_hll_sketch_init(v->sketch, op->n_index_bits);
+	}
+
+	// Hash the flat form - it distinguishes types, and is the same on all
+	// nodes, so per-node sketches can be unioned.
+	uint32_t flat_sz = as_bin_particle_flat_size(b);
+	uint8_t stack_flat[STACK_FLAT_SZ];
+	uint8_t* flat = flat_sz <= STACK_FLAT_SZ ? stack_flat : cf_malloc(flat_sz);
+
+	as_bin_particle_to_flat(b, flat);
+	as_hll_sketch_add(v->sketch, flat, flat_sz);
+
+	if (flat != stack_flat) {
+		cf_free(flat);
+	}
+
+	v->count++;
+}
+
+static void
+merge_value(const aggr_op* op, aggr_val* to, const aggr_val* from)
+{
+	if (from->count == 0) {
+		return;
+	}
+
+	switch (op->code) {
+	case AS_QUERY_AGGR_OP_COUNT:
+		break;
+	case AS_QUERY_AGGR_OP_SUM:
+	case AS_QUERY_AGGR_OP_AVG:
+		sum_number(to, false, from->i, 0.0);
+
+		if (from->is_float) {
+			sum_number(to, true, 0, from->f);
+		}
+		break;
+	case AS_QUERY_AGGR_OP_MIN:
+	case AS_QUERY_AGGR_OP_MAX:
+		if (to->count == 0) {
+			to->is_float = from->is_float;
+			to->i = from->i;
+			to->f = from->f;
+		}
+		else {
+			keep_extreme(to, op->code == AS_QUERY_AGGR_OP_MAX,
+					from->is_float, from->i, from->f);
+		}
+		break;
+	case AS_QUERY_AGGR_OP_DISTINCT:
+		if (to->sketch == NULL) {
+			uint32_t sz = as_hll_sketch_sz(op->n_index_bits);
+
+			to->sketch = cf_malloc(sz);
+			memcpy(to->sketch, from->sketch, sz);
+		}
+		else {
+			as_hll_sketch_union(to->sketch, from->sketch);
+		}
+		break;
+	default:
+		cf_crash(AS_QUERY, "bad aggregation op %u", op->code);
+	}
+
+	to->count += from->count;
+}
+
+// Integers sum exactly until they overflow - the excess goes to the float part.
+static void
+sum_number(aggr_val* v, bool is_float, int64_t i, double f)
+{
+	if (is_float) {
+		v->f += f;
+		v->is_float = true;
+		return;
+	}
+
+	int64_t sum;
+
+	if (__builtin_add_overflow(v->i, i, &sum)) {
+		v->f += (double)i;
+		v->is_float = true;
+		return;
+	}
+
+	v->i = sum;
+}
+
+static void
+keep_extreme(aggr_val* v, bool is_max, bool is_float, int64_t i, double f)
+{
+	if (v->count != 0) {
+		bool better;
+
+		if (! is_float && ! v->is_float) {
+			better = is_max ? i > v->i : i < v->i;
+		}
+		else {
+			double x = is_float ? f : (double)i;
+			double cur = v->is_float ? v->f : (double)v->i;
+
+			better = is_max ? x > cur : x < cur;
+		}
+
+		if (! better) {
+			return;
+		}
+	}
+
+	v->is_float = is_float;
+	v->i = i;
+	v->f = f;
+}
+
+
+//==========================================================
+// Local helpers - results.
+//
+
+static as_val*
+group_result(const as_query_aggr* aggr, const aggr_group* g)
+{
+	as_arraylist* list = as_arraylist_new(aggr->n_ops, 0);
+
+	for (uint32_t i = 0; i < aggr->n_ops; i++) {
+		as_arraylist_append(list, op_result(&aggr->ops[i], &g->vals[i]));
+	}
+
+	return (as_val*)list;
+}
+
+static as_val*
+op_result(const aggr_op* op, const aggr_val* v)
+{
+	switch (op->code) {
+	case AS_QUERY_AGGR_OP_COUNT:
+		return (as_val*)as_integer_new((int64_t)v->count);
+	case AS_QUERY_AGGR_OP_SUM:
+		return v->count == 0 ? (as_val*)&as_nil : sum_result(v);
+	case AS_QUERY_AGGR_OP_MIN:
+	case AS_QUERY_AGGR_OP_MAX:
+		if (v->count == 0) {
+			return (as_val*)&as_nil;
+		}
+
+		return v->is_float ?
+				(as_val*)as_double_new(v->f) : (as_val*)as_integer_new(v->i);
+	case AS_QUERY_AGGR_OP_AVG: {
+		// Nodes can't average - the client divides the merged sum by count.
+		as_arraylist* pair = as_arraylist_new(2, 0);
+
+		as_arraylist_append(pair, sum_result(v));
+		as_arraylist_append(pair, (as_val*)as_integer_new((int64_t)v->count));
+
+		return (as_val*)pair;
+	}
+	case AS_QUERY_AGGR_OP_DISTINCT: {
+		uint32_t sz = as_hll_sketch_sz(op->n_index_bits);
+		uint8_t* sketch = cf_malloc(sz);
+
+		if (v->sketch == NULL) {
+			as_hll_sketch_init(sketch, op->n_index_bits);
+		}
+		else {
+			memcpy(sketch, v->sketch, sz);
+		}
+
+		as_bytes* bytes = as_bytes_new_wrap(sketch, sz, true);
+
+		bytes->type = AS_BYTES_HLL;
+
+		return (as_val*)bytes;
+	}
+	default:
+		cf_crash(AS_QUERY, "bad aggregation op %u", op->code);
+		return NULL;
+	}
+}
+
+static as_val*
+sum_result(const aggr_val* v)
+{
+	if (v->is_float) {
+		return (as_val*)as_double_new((double)v->i + v->f);
+	}
+
+	return (as_val*)as_integer_new(v->i);
+}
@@ -72,8 +72,8 @@ static uint32_t g_query_job_trid = 0;
 // Forward declarations.
 //
 
-static void finish(as_query_job* _job);
 static void range_free(as_query_range* range);
+static void entries_free(as_query_range* entries, uint32_t n_entries);
 static uint32_t throttle_sleep(as_query_job* _job, uint64_t count, uint64_t now);
 
 
@@ -135,17 +135,21 @@ as_query_job_init(as_query_job* _job, const as_query_vtable* vtable,
 	strcpy(_job->client, tr->from.proto_fd_h->client);
 }
 
-void*
-as_query_job_run(void* pv_job)
+// Called on a query worker. Short jobs run to the end - long jobs run until the
+// stint is up, or the scheduler wants the worker elsewhere.
+void
+as_query_job_run(as_query_job* _job, uint64_t stint_end_ns)
 {
-	as_query_job* _job = (as_query_job*)pv_job;
-
-	if (! _job->is_short && ! _job->started) {
+	if (! _job->is_short) {
+		// Workers come and go - the latest to start a stint steers throttling.
 		_job->base_sys_tid = cf_thread_sys_tid();
-		_job->started = true;
 
-		if (_job->rps == 0) {
-			as_query_manager_add_max_job_threads(_job);
+		if (! _job->started) {
+			_job->started = true;
+
+			if (_job->rps == 0) {
+				as_query_manager_add_max_job_threads(_job);
+			}
 		}
 	}
 
@@ -155,6 +159,10 @@ as_query_job_run(void* pv_job)
 	while ((pid = as_faa_uint32(&_job->pid, 1)) < AS_PARTITIONS) {
 		as_partition_reservation rsv;
 
+		if (_job->pid_order != NULL) {
+			pid = _job->pid_order[pid];
+		}
+
 		if (_job->pids == NULL) {
 			if (as_partition_reserve_write(_job->ns, pid, &rsv, NULL) != 0) {
 				continue;
@@ -180,39 +188,56 @@ as_query_job_run(void* pv_job)
 		_job->vtable.slice_fn(_job, &rsv, &bb);
 		as_partition_release(&rsv);
 
-		if (! _job->is_short && cf_thread_sys_tid() != _job->base_sys_tid &&
-				(_job->n_threads > _job->ns->n_single_query_threads ||
-						g_n_query_threads > g_config.n_query_threads_limit)) {
+		if (! _job->is_short &&
+				as_query_manager_should_yield(_job, stint_end_ns)) {
 			break;
 		}
 	}
 
+	// Flush per stint - the worker may run other jobs before this one again.
 	if (bb != NULL) {
 		_job->vtable.slice_fn(_job, NULL, &bb);
 		cf_buf_builder_free(bb);
 	}
+}
 
-	as_decr_uint32(&g_n_query_threads);
+// Called once, by the last worker to leave a job with no partitions left.
+void
+as_query_job_finish(as_query_job* _job)
+{
+	_job->vtable.finish_fn(_job);
 
-	int32_t n = (int32_t)as_aaf_uint32_rls(&_job->n_threads, -1);
+	if (_job->rps_udata != NULL) {
+		as_security_done_rps(_job->rps_udata, _job->rps, false);
+		_job->rps_udata = NULL;
+	}
 
-	cf_assert(n >= 0, AS_QUERY, "query job thread underflow %d", n);
+	if (_job->si != NULL) {
+		as_sindex_release(_job->si);
+		_job->si = NULL;
+	}
 
-	if (n == 0) {
-		// Subsequent finish/destroy may require an 'acquire' barrier.
-		as_fence_acq();
+	as_sindex_release_arr(_job->and_sis, _job->n_and_sis);
+	_job->n_and_sis = 0;
 
-		finish(_job);
+	if (_job->is_short) {
+		as_query_job_destroy(_job);
+	}
+	else {
+		as_query_manager_finish_job(_job);
+	}
+}
 
-		if (_job->is_short) {
-			as_query_job_destroy(_job);
-		}
-		else {
-			as_query_manager_finish_job(_job);
-		}
+uint32_t
+as_query_job_weight(const as_query_job* _job)
+{
+	if (_job->weight != 0) {
+		return _job->weight;
 	}
 
-	return NULL;
+	return _job->is_background ?
+			as_load_uint32(&g_config.query_background_weight) :
+			as_load_uint32(&g_config.query_foreground_weight);
 }
 
 uint32_t
@@ -286,10 +311,16 @@ as_query_job_destroy(as_query_job* _job)
 		cf_free(_job->pids);
 	}
 
+	if (_job->pid_order != NULL) {
+		cf_free(_job->pid_order);
+	}
+
 	if (_job->si != NULL) {
 		as_sindex_release(_job->si);
 	}
 
+	as_sindex_release_arr(_job->and_sis, _job->n_and_sis);
+
 	if (_job->range != NULL) {
 		range_free(_job->range);
 	}
@@ -311,6 +342,7 @@ as_query_job_info(as_query_job* _job, as_mon_jobstat* stat)
 	stat->n_pids_requested = _job->n_pids_requested;
 	stat->rps = _job->rps;
 	stat->active_threads = _job->n_threads;
+	stat->weight = _job->is_short ? 0 : as_query_job_weight(_job);
 	stat->progress_pct = progress_pct(_job);
 	stat->run_time = active_ns / 1000000;
 	stat->time_since_done = since_finish_ns / 1000000;
@@ -349,22 +381,6 @@ as_query_job_info(as_query_job* _job, as_mon_jobstat* stat)
 // Local helpers.
 //
 
-static void
-finish(as_query_job* _job)
-{
-	_job->vtable.finish_fn(_job);
-
-	if (_job->rps_udata != NULL) {
-		as_security_done_rps(_job->rps_udata, _job->rps, false);
-		_job->rps_udata = NULL;
-	}
-
-	if (_job->si != NULL) {
-		as_sindex_release(_job->si);
-		_job->si = NULL;
-	}
-}
-
 // So that calloc'ed but not fully initialized range is freed correctly.
 COMPILER_ASSERT(AS_PARTICLE_TYPE_GEOJSON != 0);
 
@@ -383,9 +399,37 @@ range_free(as_query_range* range)
 		cf_free(range->ctx_buf);
 	}
 
+	if (range->exp_buf != NULL) {
+		cf_free(range->exp_buf);
+	}
+
+	if (range->str_start != NULL) {
+		cf_free(range->str_start);
+	}
+
+	if (range->prefix != NULL) {
+		entries_free(range->prefix, range->n_prefix);
+	}
+
+	if (range->multi != NULL) {
+		entries_free(range->multi, range->n_multi);
+	}
+
 	cf_free(range);
 }
 
+static void
+entries_free(as_query_range* entries, uint32_t n_entries)
+{
+	for (uint32_t i = 0; i < n_entries; i++) {
+		if (entries[i].str_start != NULL) {
+			cf_free(entries[i].str_start);
+		}
+	}
+
+	cf_free(entries);
+}
+
 static uint32_t
 throttle_sleep(as_query_job* _job, uint64_t count, uint64_t now)
 {
@@ -50,6 +50,9 @@
 // Typedefs & constants.
 //
 
+// Long jobs hand their worker back to the scheduler this often.
+#define STINT_NS (10 * 1000 * 1000)
+
 typedef struct find_item_s {
 	uint64_t trid;
 	as_query_job* _job;
@@ -60,6 +63,10 @@ typedef struct info_item_s {
 	as_query_job** p_job;
 } info_item;
 
+typedef struct pick_item_s {
+	as_query_job* _job;
+} pick_item;
+
 
 //==========================================================
 // Globals.
@@ -74,7 +81,10 @@ static as_query_manager g_mgr;
 // Forward declarations.
 //
 
-static void add_query_job_thread(as_query_job* _job);
+static void add_workers(uint32_t n_workers);
+static void* run_worker(void* udata);
+static as_query_job* pick_job(void);
+static int pick_cb(void* buf, void* udata);
 static void evict_finished_jobs(void);
 static int abort_cb(void* buf, void* udata);
 static int info_cb(void* buf, void* udata);
@@ -85,6 +95,34 @@ static as_query_job* find_job(cf_queue* jobs, uint64_t trid, bool remove_job);
 static int find_cb(void* buf, void* udata);
 
 
+//==========================================================
+// Inlines & macros.
+//
+
+static inline uint32_t
+job_thread_max(const as_query_job* _job)
+{
+	if (_job->is_short) {
+		return 1;
+	}
+
+	// Don't need more threads than there are partitions to query.
+	uint32_t n_pids = _job->n_pids_requested == 0 ?
+			AS_PARTITIONS : (uint32_t)_job->n_pids_requested;
+	uint32_t single_max = as_load_uint32(&_job->ns->n_single_query_threads);
+
+	return n_pids < single_max ? n_pids : single_max;
+}
+
+static inline uint32_t
+job_thread_cap(const as_query_job* _job)
+{
+	uint32_t max = job_thread_max(_job);
+
+	return _job->n_threads_wanted < max ? _job->n_threads_wanted : max;
+}
+
+
 //==========================================================
 // Public API.
 //
@@ -96,6 +134,7 @@ as_query_manager_startup_init(void)
 
 	g_mgr.active_jobs = cf_queue_create(sizeof(as_query_job*), false);
 	g_mgr.finished_jobs = cf_queue_create(sizeof(as_query_job*), false);
+	g_mgr.short_jobs = cf_queue_create(sizeof(as_query_job*), false);
 }
 
 int
@@ -107,13 +146,18 @@ as_query_manager_start_job(as_query_job* _job)
 
 	cf_mutex_lock(&g_mgr.lock);
 
-	if (g_n_query_threads >= g_config.n_query_threads_limit) {
-		cf_warning(AS_QUERY, "at query threads limit - can't start new query");
-		cf_mutex_unlock(&g_mgr.lock);
-		return AS_ERR_FORBIDDEN;
-	}
+	if (_job->is_short) {
+		// Long jobs wait their turn, but a short job backlog means overload.
+		if (cf_queue_sz(g_mgr.short_jobs) >=
+				as_load_uint32(&g_config.n_query_threads_limit)) {
+			cf_warning(AS_QUERY, "at query threads limit - can't start new query");
+			cf_mutex_unlock(&g_mgr.lock);
+			return AS_ERR_FORBIDDEN;
+		}
 
-	if (! _job->is_short) {
+		cf_queue_push(g_mgr.short_jobs, &_job);
+	}
+	else {
 		_job->base_us = _job->start_ns / 1000; // for throttling
 
 		// Make sure trid is unique.
@@ -124,10 +168,15 @@ as_query_manager_start_job(as_query_job* _job)
 			return AS_ERR_PARAMETER;
 		}
 
+		// Start level with the jobs being served, not ahead of them all.
+		_job->pass = g_mgr.pass;
+
 		cf_queue_push(g_mgr.active_jobs, &_job);
 	}
 
-	add_query_job_thread(_job);
+	_job->n_threads_wanted = 1;
+
+	add_workers(1);
 
 	cf_mutex_unlock(&g_mgr.lock);
 
@@ -137,16 +186,11 @@ as_query_manager_start_job(as_query_job* _job)
 void
 as_query_manager_add_job_thread(as_query_job* _job)
 {
-	if ((_job->n_pids_requested != 0 &&
-			_job->n_threads >= (uint32_t)_job->n_pids_requested) ||
-			_job->n_threads >= _job->ns->n_single_query_threads) {
-		return;
-	}
-
 	cf_mutex_lock(&g_mgr.lock);
 
-	if (g_n_query_threads < g_config.n_query_threads_limit) {
-		add_query_job_thread(_job);
+	if (_job->n_threads_wanted < job_thread_max(_job)) {
+		_job->n_threads_wanted++;
+		add_workers(1);
 	}
 
 	cf_mutex_unlock(&g_mgr.lock);
@@ -155,48 +199,40 @@ as_query_manager_add_job_thread(as_query_job* _job)
 void
 as_query_manager_add_max_job_threads(as_query_job* _job)
 {
-	uint32_t n_pids = _job->n_pids_requested == 0 ?
-			AS_PARTITIONS : (uint32_t)_job->n_pids_requested;
+	cf_mutex_lock(&g_mgr.lock);
 
-	if (_job->n_threads >= n_pids) {
-		return;
-	}
+	_job->n_threads_wanted = UINT32_MAX;
 
-	uint32_t single_max = as_load_uint32(&_job->ns->n_single_query_threads);
+	uint32_t n_threads = job_thread_cap(_job);
 
-	if (_job->n_threads >= single_max) {
-		return;
+	// Idle workers exit, so the pool only grows to cover what jobs want.
+	if (_job->n_threads < n_threads) {
+		add_workers(n_threads - _job->n_threads);
 	}
 
-	// Don't need more threads than there are partitions to query.
-	uint32_t n_extra = n_pids - _job->n_threads;
-
-	uint32_t single_extra = single_max - _job->n_threads;
-
-	if (single_extra < n_extra) {
-		n_extra = single_extra;
-	}
+	cf_mutex_unlock(&g_mgr.lock);
+}
 
+// Unlocked reads - a stale answer only moves a yield by a partition.
+bool
+as_query_manager_should_yield(const as_query_job* _job, uint64_t stint_end_ns)
+{
 	uint32_t all_max = as_load_uint32(&g_config.n_query_threads_limit);
+	uint32_t n_workers = as_load_uint32(&g_n_query_threads);
 
-	cf_mutex_lock(&g_mgr.lock);
-
-	if (g_n_query_threads >= all_max) {
-		cf_mutex_unlock(&g_mgr.lock);
-		return;
+	if (n_workers > all_max) {
+		return true; // pool shrinking
 	}
 
-	uint32_t all_extra = all_max - g_n_query_threads;
-
-	if (all_extra < n_extra) {
-		n_extra = all_extra;
+	if (n_workers == all_max && cf_queue_sz(g_mgr.short_jobs) != 0) {
+		return true; // short jobs can't get a new worker
 	}
 
-	for (uint32_t n = 0; n < n_extra; n++) {
-		add_query_job_thread(_job);
+	if (as_load_uint32(&_job->n_threads) > job_thread_cap(_job)) {
+		return true;
 	}
 
-	cf_mutex_unlock(&g_mgr.lock);
+	return cf_queue_sz(g_mgr.active_jobs) > 1 && cf_getns() > stint_end_ns;
 }
 
 void
@@ -237,6 +273,22 @@ as_query_manager_abort_job(uint64_t trid)
 	return true;
 }
 
+bool
+as_query_manager_set_job_weight(uint64_t trid, uint32_t weight)
+{
+	cf_mutex_lock(&g_mgr.lock);
+
+	as_query_job* _job = find_active(trid);
+
+	if (_job != NULL) {
+		_job->weight = weight;
+	}
+
+	cf_mutex_unlock(&g_mgr.lock);
+
+	return _job != NULL;
+}
+
 uint32_t
 as_query_manager_abort_all_jobs(void)
 {
@@ -333,13 +385,108 @@ as_query_manager_get_active_job_count(void)
 // Local helpers.
 //
 
+// Call with lock held.
 static void
-add_query_job_thread(as_query_job* _job)
+add_workers(uint32_t n_workers)
+{
+	uint32_t all_max = as_load_uint32(&g_config.n_query_threads_limit);
+
+	for (uint32_t n = 0; n < n_workers && g_n_query_threads < all_max; n++) {
+		as_incr_uint32(&g_n_query_threads);
+		cf_thread_create_transient(run_worker, NULL);
+	}
+}
+
+static void*
+run_worker(void* udata)
 {
-	as_incr_uint32(&g_n_query_threads);
-	as_incr_uint32(&_job->n_threads);
+	(void)udata;
+
+	cf_mutex_lock(&g_mgr.lock);
+
+	while (true) {
+		if (g_n_query_threads >
+				as_load_uint32(&g_config.n_query_threads_limit)) {
+			break; // pool shrinking
+		}
+
+		as_query_job* _job = pick_job();
+
+		if (_job == NULL) {
+			break; // idle - exit, start_job will add workers as needed
+		}
+
+		_job->n_threads++;
+
+		cf_mutex_unlock(&g_mgr.lock);
+
+		uint64_t start_ns = cf_getns();
+
+		as_query_job_run(_job, start_ns + STINT_NS);
+
+		uint64_t run_ns = cf_getns() - start_ns;
+
+		cf_mutex_lock(&g_mgr.lock);
+
+		if (! _job->is_short) {
+			_job->pass += run_ns / as_query_job_weight(_job);
+		}
+
+		// Last worker out of an exhausted job finishes it.
+		if (--_job->n_threads == 0 &&
+				as_load_uint32(&_job->pid) >= AS_PARTITIONS) {
+			cf_mutex_unlock(&g_mgr.lock);
+			as_query_job_finish(_job);
+			cf_mutex_lock(&g_mgr.lock);
+		}
+	}
 
-	cf_thread_create_transient(as_query_job_run, _job);
+	as_decr_uint32(&g_n_query_threads);
+
+	cf_mutex_unlock(&g_mgr.lock);
+
+	return NULL;
+}
+
+// Call with lock held. Short jobs first, then the least served long job.
+static as_query_job*
+pick_job(void)
+{
+	as_query_job* _job;
+
+	if (cf_queue_pop(g_mgr.short_jobs, &_job, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
+		return _job;
+	}
+
+	pick_item item = { NULL };
+
+	cf_queue_reduce(g_mgr.active_jobs, pick_cb, &item);
+
+	_job = item._job;
+
+	if (_job != NULL && _job->pass > g_mgr.pass) {
+		g_mgr.pass = _job->pass;
+	}
+
+	return _job;
+}
+
+static int
+pick_cb(void* buf, void* udata)
+{
+	as_query_job* _job = *(as_query_job**)buf;
+	pick_item* item = (pick_item*)udata;
+
+	if (as_load_uint32(&_job->pid) >= AS_PARTITIONS ||
+			_job->n_threads >= job_thread_cap(_job)) {
+		return 0;
+	}
+
+	if (item->_job == NULL || _job->pass < item->_job->pass) {
+		item->_job = _job;
+	}
+
+	return 0;
 }
 
 static void
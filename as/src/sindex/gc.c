@@ -44,6 +44,8 @@
 #include "base/stats.h"
 #include "sindex/sindex.h"
 #include "sindex/sindex_tree.h"
+#include "storage/storage.h"
+#include "transaction/rw_utils.h"
 
 //#include "warnings.h"
 
@@ -58,6 +60,10 @@ typedef struct rlist_ele_s {
 
 #define THROTTLE_THRESHOLD (64 * 1024 * 1024)
 
+// Sweeping this many sindex keys costs about as much as reading one deleted
+// record's bins to remove its keys directly.
+#define TARGETED_KEYS_PER_RECORD 1000
+
 
 //==========================================================
 // Forward declarations.
@@ -65,6 +71,10 @@ typedef struct rlist_ele_s {
 
 static void gc_ns_cycle(as_namespace* ns);
 static void gc_ns(as_namespace* ns);
+static bool targeted_is_cheaper(as_namespace* ns, uint32_t n_records);
+static void gc_targeted(as_namespace* ns, cf_queue* rlist);
+static bool remove_record_keys(as_namespace* ns, as_index* r, cf_arenax_handle r_h);
+static void wait_for_bulk(as_namespace* ns);
 
 
 //==========================================================
@@ -186,7 +196,16 @@ gc_ns_cycle(as_namespace* ns)
 
 	cf_mutex_unlock(&ns->si_gc_list_mutex);
 
-	gc_ns(ns);
+	// Dropped trees can only be found by sweeping - otherwise, if there are
+	// few enough deleted records, remove their keys directly.
+	if (cf_queue_sz(tlist) == 0 &&
+			targeted_is_cheaper(ns, (uint32_t)cf_queue_sz(rlist))) {
+		gc_targeted(ns, rlist); // leaves records it couldn't clean
+	}
+
+	if (cf_queue_sz(rlist) != 0 || cf_queue_sz(tlist) != 0) {
+		gc_ns(ns);
+	}
 
 	rlist_ele ele;
 
@@ -250,3 +269,123 @@ gc_ns(as_namespace* ns)
 			ns->name, ns->n_sindex_gc_cleaned,
 			ns->n_sindex_gc_cleaned - n_cleaned, cf_getms() - start_ms);
 }
+
+static bool
+targeted_is_cheaper(as_namespace* ns, uint32_t n_records)
+{
+	uint64_t n_keys = 0;
+
+	SINDEX_GRLOCK();
+
+	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
+		as_sindex* si = ns->sindexes[i];
+
+		if (si != NULL) {
+			n_keys += as_sindex_tree_n_keys(si);
+		}
+	}
+
+	SINDEX_GRUNLOCK();
+
+	return (uint64_t)n_records * TARGETED_KEYS_PER_RECORD <= n_keys;
+}
+
+// Deleted records' storage isn't freed until they're destroyed, so their bins
+// (and hence sindex keys) can still be read.
+static void
+gc_targeted(as_namespace* ns, cf_queue* rlist)
+{
+	uint64_t start_ms = cf_getms();
+	uint32_t n_records = (uint32_t)cf_queue_sz(rlist);
+	cf_queue* done = cf_queue_create(sizeof(rlist_ele), false);
+
+	for (uint32_t i = 0; i < n_records; i++) {
+		rlist_ele ele;
+
+		cf_queue_pop(rlist, &ele, CF_QUEUE_NOWAIT);
+
+		as_index* r = (as_index*)cf_arenax_resolve(ns->arena, ele.r_h);
+
+		cf_assert(r->in_sindex == 1, AS_SINDEX, "bad in_sindex bit");
+		cf_assert(r->rc == 1, AS_SINDEX, "bad ref count %u", r->rc);
+
+		if (remove_record_keys(ns, r, ele.r_h)) {
+			cf_queue_push(done, &ele);
+		}
+		else {
+			cf_queue_push(rlist, &ele); // leave it to the sweep
+		}
+	}
+
+	// A bulk build may yet insert keys referring to the records.
+	wait_for_bulk(ns);
+
+	uint32_t n_cleaned = (uint32_t)cf_queue_sz(done);
+	rlist_ele ele;
+
+	while (cf_queue_pop(done, &ele, CF_QUEUE_NOWAIT) == CF_QUEUE_OK) {
+		as_index* r = (as_index*)cf_arenax_resolve(ns->arena, ele.r_h);
+
+		cf_assert(r->rc == 0, AS_SINDEX, "bad ref count %u", r->rc);
+
+		as_record_destroy(r, ns);
+		cf_arenax_free(ns->arena, ele.r_h, NULL);
+	}
+
+	cf_queue_destroy(done);
+
+	cf_info(AS_SINDEX, "{%s} sindex-gc-targeted: records (%u,%u) total-ms %lu",
+			ns->name, n_cleaned, n_records - n_cleaned,
+			cf_getms() - start_ms);
+}
+
+static bool
+remove_record_keys(as_namespace* ns, as_index* r, cf_arenax_handle r_h)
+{
+	as_storage_rd rd;
+
+	as_storage_record_open(ns, r, &rd);
+
+	as_bin stack_bins[RECORD_MAX_BINS];
+	bool ok = as_storage_rd_load_bins(&rd, stack_bins) == 0;
+
+	if (ok) {
+		as_index_ref r_ref = { .r = r, .r_h = r_h };
+
+		// Also clears in_sindex, releasing the sindex reference.
+		ok = remove_from_sindex_bins(ns, &r_ref, rd.bins, rd.n_bins);
+
+		// A key we didn't find may still refer to the record - restore the
+		// reference and leave the record for the sweep.
+		if (! ok) {
+			as_index_set_in_sindex(r);
+		}
+	}
+
+	as_storage_record_close(&rd);
+
+	return ok;
+}
+
+static void
+wait_for_bulk(as_namespace* ns)
+{
+	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
+		SINDEX_GRLOCK();
+
+		as_sindex* si = ns->sindexes[i];
+
+		if (si == NULL) {
+			SINDEX_GRUNLOCK();
+			continue;
+		}
+
+		as_sindex_reserve(si);
+
+		SINDEX_GRUNLOCK();
+
+		as_sindex_tree_wait_for_bulk(si);
+
+		as_sindex_release(si);
+	}
+}
@@ -0,0 +1,589 @@
+/*
+ * persist.c
+ *
+ * Copyright (C) 2022 Aerospike, Inc.
+ *
+ * Portions may be licensed to Aerospike, Inc. under one or more contributor
+ * license agreements.
+ *
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU Affero General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option) any
+ * later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE. See the GNU Affero General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see http://www.gnu.org/licenses/
+ */
+
+//==========================================================
+// Includes.
+//
+
+#include "sindex/persist.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "citrusleaf/alloc.h"
+#include "citrusleaf/cf_digest.h"
+#include "citrusleaf/cf_hash_math.h"
+
+#include "arenax.h"
+#include "log.h"
+
+#include "base/cfg.h"
+#include "base/datamodel.h"
+#include "base/index.h"
+#include "fabric/partition.h"
+#include "sindex/sindex.h"
+#include "sindex/sindex_tree.h"
+
+//#include "warnings.h"
+
+
+//==========================================================
+// Typedefs & constants.
+//
+
+// On clean shutdown, sindex keys are written out by digest - arena handles
+// don't survive a cold start. At startup, once the primary index is rebuilt, a
+// partition's keys are re-attached only if its records are exactly those seen
+// at shutdown - same digests, generations and last-update-times. Otherwise
+// (e.g. records expired or resurrected during the cold start) the partition
+// falls back to the usual sweep.
+
+#define PERSIST_MAGIC 0x5349504552534953UL // "SIPERSIS"
+#define PERSIST_VERSION 1
+
+#define MAX_PERSIST_PATH_SZ 1024
+
+#define MIN_CAPACITY 1024
+
+typedef struct persist_header_s {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t n_sindexes;
+	// Followed by n_sindexes definitions, SINDEX_SMD_KEY_MAX_SZ each.
+} persist_header;
+
+typedef struct persist_pid_header_s {
+	uint64_t n_records;
+	uint64_t checksum;
+	// Followed, per sindex, by a uint64_t key count and the keys.
+} persist_pid_header;
+
+typedef struct persist_key_s {
+	int64_t bval;
+	cf_digest keyd;
+} __attribute__ ((__packed__)) persist_key;
+
+typedef struct pid_summary_s {
+	uint64_t n_records;
+	uint64_t checksum;
+
+	// Only collected when saving.
+	bool collect_r_hs;
+	uint64_t n_r_hs;
+	uint64_t r_hs_capacity;
+	uint64_t* r_hs;
+} pid_summary;
+
+typedef struct save_cb_info_s {
+	as_namespace* ns;
+	const pid_summary* summary;
+
+	uint64_t n_keys;
+	uint64_t capacity;
+	persist_key* keys;
+} save_cb_info;
+
+
+//==========================================================
+// Forward declarations.
+//
+
+static uint32_t load_sindexes(as_namespace* ns, FILE* fh);
+static bool attach_keys(as_sindex* si, as_index_tree* tree, uint32_t pid, const persist_key* keys, uint64_t n_keys);
+
+static uint32_t collect_sindexes(as_namespace* ns, as_sindex** sis);
+static void defn_key(as_sindex* si, char* key);
+static void summarize(as_index_tree* tree, pid_summary* s);
+static void summarize_cb(as_index* r, cf_arenax_handle r_h, void* udata);
+static int r_h_cmp(const void* pa, const void* pb);
+static void save_key_cb(int64_t bval, cf_arenax_handle r_h, void* udata);
+
+
+//==========================================================
+// Inlines & macros.
+//
+
+static inline void
+persist_path(const as_namespace* ns, char* path)
+{
+	sprintf(path, "%s/%s.sindex", g_config.work_directory, ns->name);
+}
+
+static inline bool
+write_all(FILE* fh, const void* buf, size_t sz)
+{
+	return sz == 0 || fwrite(buf, sz, 1, fh) == 1;
+}
+
+static inline bool
+read_all(FILE* fh, void* buf, size_t sz)
+{
+	return sz == 0 || fread(buf, sz, 1, fh) == 1;
+}
+
+
+//==========================================================
+// Public API.
+//
+
+// Called on shutdown with all partitions' record locks held.
+void
+as_sindex_persist_save(as_namespace* ns)
+{
+	if (! ns->storage_sindex_persist) {
+		return;
+	}
+
+	as_sindex* sis[MAX_N_SINDEXES];
+	uint32_t n_sindexes = collect_sindexes(ns, sis);
+
+	if (n_sindexes == 0) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < n_sindexes; i++) {
+		if (! sis[i]->readable) {
+			cf_info(AS_SINDEX, "{%s} sindex %s still populating - not persisting sindexes",
+					ns->name, sis[i]->iname);
+			return;
+		}
+	}
+
+	char path[MAX_PERSIST_PATH_SZ];
+	char tmp_path[MAX_PERSIST_PATH_SZ + 4];
+
+	persist_path(ns, path);
+	sprintf(tmp_path, "%s.tmp", path);
+
+	FILE* fh = fopen(tmp_path, "w");
+
+	if (fh == NULL) {
+		cf_warning(AS_SINDEX, "{%s} failed to open %s: %s", ns->name, tmp_path,
+				cf_strerror(errno));
+		return;
+	}
+
+	persist_header header = {
+			.magic = PERSIST_MAGIC,
+			.version = PERSIST_VERSION,
+			.n_sindexes = n_sindexes
+	};
+
+	bool ok = write_all(fh, &header, sizeof(header));
+
+	for (uint32_t i = 0; ok && i < n_sindexes; i++) {
+		char key[SINDEX_SMD_KEY_MAX_SZ] = { 0 };
+
+		defn_key(sis[i], key);
+		ok = write_all(fh, key, sizeof(key));
+	}
+
+	pid_summary s = { .collect_r_hs = true };
+	save_cb_info ci = { .ns = ns, .summary = &s };
+
+	for (uint32_t pid = 0; ok && pid < AS_PARTITIONS; pid++) {
+		summarize(ns->partitions[pid].tree, &s);
+
+		persist_pid_header pid_header = {
+				.n_records = s.n_records,
+				.checksum = s.checksum
+		};
+
+		ok = write_all(fh, &pid_header, sizeof(pid_header));
+
+		for (uint32_t i = 0; ok && i < n_sindexes; i++) {
+			ci.n_keys = 0;
+
+			as_sindex_tree_visit(sis[i], pid, save_key_cb, &ci);
+
+			ok = write_all(fh, &ci.n_keys, sizeof(ci.n_keys)) &&
+					write_all(fh, ci.keys, ci.n_keys * sizeof(persist_key));
+		}
+	}
+
+	if (s.r_hs != NULL) {
+		cf_free(s.r_hs);
+	}
+
+	if (ci.keys != NULL) {
+		cf_free(ci.keys);
+	}
+
+	if (fclose(fh) != 0) {
+		ok = false;
+	}
+
+	if (! ok || rename(tmp_path, path) != 0) {
+		cf_warning(AS_SINDEX, "{%s} failed to write %s: %s", ns->name, path,
+				cf_strerror(errno));
+		unlink(tmp_path);
+		return;
+	}
+
+	cf_info(AS_SINDEX, "{%s} persisted %u sindex(es) to %s", ns->name,
+			n_sindexes, path);
+}
+
+// Called at startup after the primary index is rebuilt. Returns the number of
+// partitions whose sindex keys were fully re-attached - these are flagged in
+// ns->si_persisted_pids.
+uint32_t
+as_sindex_persist_load(as_namespace* ns)
+{
+	char path[MAX_PERSIST_PATH_SZ];
+
+	persist_path(ns, path);
+
+	FILE* fh = fopen(path, "r");
+
+	if (fh == NULL) {
+		return 0;
+	}
+
+	// Only good for the startup right after it's written - the next shutdown
+	// may not be clean.
+	unlink(path);
+
+	uint32_t n_persisted = 0;
+
+	if (ns->storage_sindex_persist && ! ns->storage_data_in_memory &&
+			! ns->sindexes_resumed_readable) {
+		n_persisted = load_sindexes(ns, fh);
+	}
+
+	fclose(fh);
+
+	return n_persisted;
+}
+
+
+//==========================================================
+// Local helpers - load.
+//
+
+static uint32_t
+load_sindexes(as_namespace* ns, FILE* fh)
+{
+	as_sindex* sis[MAX_N_SINDEXES];
+	uint32_t n_sindexes = collect_sindexes(ns, sis);
+
+	persist_header header;
+
+	if (! read_all(fh, &header, sizeof(header)) ||
+			header.magic != PERSIST_MAGIC ||
+			header.version != PERSIST_VERSION) {
+		cf_warning(AS_SINDEX, "{%s} bad persisted sindex file - ignoring",
+				ns->name);
+		return 0;
+	}
+
+	if (header.n_sindexes != n_sindexes || n_sindexes == 0) {
+		cf_info(AS_SINDEX, "{%s} sindexes changed since shutdown - ignoring persisted sindexes",
+				ns->name);
+		return 0;
+	}
+
+	// Map file order to current sindexes - definitions must match exactly.
+	as_sindex* file_sis[n_sindexes];
+
+	for (uint32_t i = 0; i < n_sindexes; i++) {
+		char file_key[SINDEX_SMD_KEY_MAX_SZ];
+
+		if (! read_all(fh, file_key, sizeof(file_key))) {
+			cf_warning(AS_SINDEX, "{%s} truncated persisted sindex file - ignoring",
+					ns->name);
+			return 0;
+		}
+
+		file_key[sizeof(file_key) - 1] = '\0';
+		file_sis[i] = NULL;
+
+		for (uint32_t j = 0; j < n_sindexes; j++) {
+			char key[SINDEX_SMD_KEY_MAX_SZ] = { 0 };
+
+			defn_key(sis[j], key);
+
+			if (strcmp(key, file_key) == 0) {
+				file_sis[i] = sis[j];
+				break;
+			}
+		}
+
+		if (file_sis[i] == NULL) {
+			cf_info(AS_SINDEX, "{%s} sindexes changed since shutdown - ignoring persisted sindexes",
+					ns->name);
+			return 0;
+		}
+	}
+
+	ns->si_persisted_pids = cf_calloc(AS_PARTITIONS, sizeof(bool));
+
+	pid_summary s = { .collect_r_hs = false };
+	uint64_t capacity = 0;
+	persist_key* keys = NULL;
+	uint32_t n_persisted = 0;
+	bool ok = true;
+
+	for (uint32_t pid = 0; ok && pid < AS_PARTITIONS; pid++) {
+		persist_pid_header pid_header;
+
+		if (! read_all(fh, &pid_header, sizeof(pid_header))) {
+			ok = false;
+			break;
+		}
+
+		// Don't bother with partition reservations - it's startup.
+		as_index_tree* tree = ns->partitions[pid].tree;
+
+		summarize(tree, &s);
+
+		bool match = pid_header.n_records == s.n_records &&
+				pid_header.checksum == s.checksum;
+		bool all_found = true;
+
+		for (uint32_t i = 0; i < n_sindexes; i++) {
+			uint64_t n_keys;
+
+			if (! read_all(fh, &n_keys, sizeof(n_keys))) {
+				ok = false;
+				break;
+			}
+
+			if (! match) {
+				if (fseek(fh, (long)(n_keys * sizeof(persist_key)),
+						SEEK_CUR) != 0) {
+					ok = false;
+					break;
+				}
+
+				continue;
+			}
+
+			if (n_keys > capacity) {
+				capacity = n_keys < MIN_CAPACITY ? MIN_CAPACITY : n_keys;
+				keys = cf_realloc(keys, capacity * sizeof(persist_key));
+			}
+
+			if (! read_all(fh, keys, n_keys * sizeof(persist_key))) {
+				ok = false;
+				break;
+			}
+
+			if (! attach_keys(file_sis[i], tree, pid, keys, n_keys)) {
+				all_found = false;
+			}
+		}
+
+		// A partially attached partition is harmless - the sweep's puts of
+		// keys already present are no-ops.
+		if (ok && match && all_found) {
+			ns->si_persisted_pids[pid] = true;
+			n_persisted++;
+		}
+	}
+
+	if (keys != NULL) {
+		cf_free(keys);
+	}
+
+	if (! ok) {
+		cf_warning(AS_SINDEX, "{%s} truncated persisted sindex file", ns->name);
+	}
+
+	cf_info(AS_SINDEX, "{%s} re-attached persisted sindex keys for %u of %u partitions",
+			ns->name, n_persisted, AS_PARTITIONS);
+
+	return n_persisted;
+}
+
+static bool
+attach_keys(as_sindex* si, as_index_tree* tree, uint32_t pid,
+		const persist_key* keys, uint64_t n_keys)
+{
+	if (n_keys == 0) {
+		return true;
+	}
+
+	as_namespace* ns = si->ns;
+	struct as_sindex_bulk_s* bulk = as_sindex_tree_bulk_start(si, pid);
+	bool all_found = true;
+
+	for (uint64_t k = 0; k < n_keys; k++) {
+		as_index_ref r_ref;
+
+		if (as_record_get(tree, &keys[k].keyd, &r_ref) != 0) {
+			all_found = false;
+			continue;
+		}
+
+		as_index_set_in_sindex(r_ref.r);
+		as_sindex_tree_bulk_add(bulk, keys[k].bval, r_ref.r_h);
+
+		as_record_done(&r_ref, ns);
+	}
+
+	as_sindex_tree_bulk_finish(bulk);
+
+	return all_found;
+}
+
+
+//==========================================================
+// Local helpers - generic.
+//
+
+static uint32_t
+collect_sindexes(as_namespace* ns, as_sindex** sis)
+{
+	uint32_t n_sindexes = 0;
+
+	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
+		as_sindex* si = ns->sindexes[i];
+
+		if (si != NULL && ! si->dropped) {
+			sis[n_sindexes++] = si;
+		}
+	}
+
+	return n_sindexes;
+}
+
+// The SMD key - unique per definition.
+static void
+defn_key(as_sindex* si, char* key)
+{
+	const char* set_name = si->set_name[0] == '\0' ? NULL : si->set_name;
+
+	if (as_sindex_is_exp(si)) {
+		as_sindex_build_exp_smd_key(si->ns->name, set_name, si->exp_b64,
+				si->itype, si->ktype, si->ordered, key);
+		return;
+	}
+
+	if (! as_sindex_is_composite(si)) {
+		as_sindex_build_smd_key(si->ns->name, set_name, si->bin_name,
+				si->ctx_b64, si->itype, si->ktype, si->ordered, key);
+		return;
+	}
+
+	uint32_t n_bins = si->n_cbins + 1;
+	char* bin_names[MAX_COMPOSITE_BINS];
+	char* ctxs[MAX_COMPOSITE_BINS];
+	as_particle_type ktypes[MAX_COMPOSITE_BINS];
+
+	for (uint32_t i = 0; i < si->n_cbins; i++) {
+		bin_names[i] = si->cbins[i].bin_name;
+		ctxs[i] = si->cbins[i].ctx_b64;
+		ktypes[i] = si->cbins[i].ktype;
+	}
+
+	bin_names[si->n_cbins] = si->bin_name;
+	ctxs[si->n_cbins] = si->ctx_b64;
+	ktypes[si->n_cbins] = si->ktype;
+
+	as_sindex_build_composite_smd_key(si->ns->name, set_name, n_bins,
+			bin_names, ctxs, ktypes, key);
+}
+
+static void
+summarize(as_index_tree* tree, pid_summary* s)
+{
+	s->n_records = 0;
+	s->checksum = 0;
+	s->n_r_hs = 0;
+
+	as_index_visit_quiesced(tree, summarize_cb, s);
+
+	if (s->n_r_hs > 1) {
+		qsort(s->r_hs, s->n_r_hs, sizeof(uint64_t), r_h_cmp);
+	}
+}
+
+static void
+summarize_cb(as_index* r, cf_arenax_handle r_h, void* udata)
+{
+	pid_summary* s = (pid_summary*)udata;
+
+	struct {
+		cf_digest keyd;
+		uint64_t last_update_time;
+		uint16_t generation;
+	} __attribute__ ((__packed__)) id = {
+			.keyd = r->keyd,
+			.last_update_time = r->last_update_time,
+			.generation = r->generation
+	};
+
+	// Order-independent, so cold start's insertion order doesn't matter.
+	s->checksum ^= cf_wyhash64((const void*)&id, sizeof(id));
+	s->n_records++;
+
+	if (! s->collect_r_hs) {
+		return;
+	}
+
+	if (s->n_r_hs == s->r_hs_capacity) {
+		s->r_hs_capacity = s->r_hs_capacity == 0 ?
+				MIN_CAPACITY : s->r_hs_capacity * 2;
+		s->r_hs = cf_realloc(s->r_hs, s->r_hs_capacity * sizeof(uint64_t));
+	}
+
+	s->r_hs[s->n_r_hs++] = r_h;
+}
+
+static int
+r_h_cmp(const void* pa, const void* pb)
+{
+	uint64_t a = *(const uint64_t*)pa;
+	uint64_t b = *(const uint64_t*)pb;
+
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+static void
+save_key_cb(int64_t bval, cf_arenax_handle r_h, void* udata)
+{
+	save_cb_info* ci = (save_cb_info*)udata;
+	const pid_summary* s = ci->summary;
+	uint64_t h = r_h;
+
+	// Skip keys pending garbage collection - their records aren't in the tree.
+	if (s->n_r_hs == 0 ||
+			bsearch(&h, s->r_hs, s->n_r_hs, sizeof(uint64_t), r_h_cmp) == NULL) {
+		return;
+	}
+
+	if (ci->n_keys == ci->capacity) {
+		ci->capacity = ci->capacity == 0 ? MIN_CAPACITY : ci->capacity * 2;
+		ci->keys = cf_realloc(ci->keys, ci->capacity * sizeof(persist_key));
+	}
+
+	as_index* r = cf_arenax_resolve(ci->ns->arena, r_h);
+
+	ci->keys[ci->n_keys++] = (persist_key){ .bval = bval, .keyd = r->keyd };
+}
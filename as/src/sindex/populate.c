@@ -40,9 +40,11 @@
 
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/exp.h"
 #include "base/index.h"
 #include "base/set_index.h"
 #include "fabric/partition.h"
+#include "sindex/persist.h"
 #include "sindex/sindex.h"
 #include "sindex/sindex_tree.h"
 #include "storage/storage.h"
@@ -83,6 +85,7 @@ typedef struct populate_cb_info_s {
 	as_namespace* ns;
 	as_sindex* si;
 	as_index_tree* tree;
+	struct as_sindex_bulk_s* bulk;
 	uint64_t* p_n_total_reduced;
 	bool* p_aborted;
 	uint32_t n_reduced;
@@ -134,6 +137,9 @@ as_sindex_populate_startup(void)
 	for (uint32_t ns_ix = 0; ns_ix < g_config.n_namespaces; ns_ix++) {
 		as_namespace* ns = g_config.namespaces[ns_ix];
 
+		// Also discards any persisted sindex file we won't use.
+		uint32_t n_persisted = as_sindex_persist_load(ns);
+
 		if (as_sindex_n_sindexes(ns) == 0) {
 			continue;
 		}
@@ -142,10 +148,16 @@ as_sindex_populate_startup(void)
 			continue;
 		}
 
-		if (! ns->storage_data_in_memory) {
+		if (! ns->storage_data_in_memory && n_persisted != AS_PARTITIONS) {
 			populate_startup(ns);
 		}
-		// else - data-in-memory (cold or cool restart) - already built sindex.
+		// else - data-in-memory (cold or cool restart) or all partitions
+		// persisted - already built sindex.
+
+		if (ns->si_persisted_pids != NULL) {
+			cf_free(ns->si_persisted_pids);
+			ns->si_persisted_pids = NULL;
+		}
 
 		mark_all_readable(ns);
 
@@ -262,6 +274,11 @@ run_startup(void* udata)
 			continue;
 		}
 
+		// Already re-attached from persisted sindex file.
+		if (ns->si_persisted_pids != NULL && ns->si_persisted_pids[pid]) {
+			continue;
+		}
+
 		cbi.tree = tree;
 
 		as_index_reduce_live(tree, startup_reduce_cb, &cbi);
@@ -390,11 +407,16 @@ run_populate(void* udata)
 
 		cbi.tree = tree;
 
-		if (! as_set_index_reduce(ns, tree, popi->si->set_id, NULL,
+		// Collect the partition's keys and build its tree in one go.
+		cbi.bulk = as_sindex_tree_bulk_start(popi->si, pid);
+
+		if (! as_set_index_reduce_unordered(ns, tree, popi->si->set_id,
 				populate_reduce_cb, &cbi)) {
 			as_index_reduce_live(tree, populate_reduce_cb, &cbi);
 		}
 
+		as_sindex_tree_bulk_finish(cbi.bulk);
+
 		as_partition_release(&rsv);
 	}
 
@@ -455,7 +477,20 @@ populate_reduce_cb(as_index_ref* r_ref, void* udata)
 		return true;
 	}
 
-	as_sindex_put_rd(si, &rd, r_ref);
+	as_sindex_bin sbin;
+
+	if (as_sindex_sbin_from_rd(si, &rd, &sbin)) {
+		// Mark record for sindex before insertion.
+		as_index_set_in_sindex(r);
+
+		for (uint32_t i = 0; i < sbin.n_values; i++) {
+			int64_t bval = i == 0 ? sbin.val : sbin.values[i];
+
+			as_sindex_tree_bulk_add(cbi->bulk, bval, r_ref->r_h);
+		}
+
+		as_sindex_sbin_free_all(&sbin, 1);
+	}
 
 	as_storage_record_close(&rd);
 	as_record_done(r_ref, ns);
@@ -506,6 +541,34 @@ run_destroy_sindex(void* udata)
 			cf_free(si->ctx_buf);
 		}
 
+		for (uint32_t i = 0; i < si->n_cbins; i++) {
+			as_sindex_cbin* cbin = &si->cbins[i];
+
+			if (cbin->ctx_b64 != NULL) {
+				cf_free(cbin->ctx_b64);
+			}
+
+			if (cbin->ctx_buf != NULL) {
+				cf_free(cbin->ctx_buf);
+			}
+		}
+
+		if (si->cbins != NULL) {
+			cf_free(si->cbins);
+		}
+
+		if (si->exp_b64 != NULL) {
+			cf_free(si->exp_b64);
+		}
+
+		if (si->exp_buf != NULL) {
+			cf_free(si->exp_buf);
+		}
+
+		if (si->exp != NULL) {
+			as_exp_destroy(si->exp);
+		}
+
 		cf_rc_free(si);
 	}
 
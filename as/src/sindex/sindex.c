@@ -33,8 +33,10 @@
 #include <stdint.h>
 #include <string.h>
 
+#include "aerospike/as_atomic.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_b64.h"
+#include "citrusleaf/cf_clock.h"
 #include "citrusleaf/cf_ll.h"
 
 #include "arenax.h"
@@ -48,6 +50,7 @@
 #include "base/cdt.h"
 #include "base/cfg.h"
 #include "base/datamodel.h"
+#include "base/exp.h"
 #include "base/index.h"
 #include "base/smd.h"
 #include "geospatial/geospatial.h"
@@ -72,9 +75,16 @@ typedef struct as_sindex_def_s {
 	char bin_name[AS_BIN_NAME_MAX_SZ];
 	as_particle_type ktype;
 	as_sindex_type itype;
+	bool ordered;
 	char* ctx_b64;
 	uint8_t* ctx_buf;
 	uint32_t ctx_buf_sz;
+	uint32_t n_cbins;
+	as_sindex_cbin cbins[MAX_COMPOSITE_BINS - 1];
+	char* exp_b64;
+	uint8_t* exp_buf;
+	uint32_t exp_buf_sz;
+	as_exp* exp;
 } as_sindex_def;
 
 typedef struct defn_hash_ele_s {
@@ -109,6 +119,7 @@ pthread_rwlock_t g_sindex_rwlock = PTHREAD_RWLOCK_INITIALIZER;
 
 static void as_sindex_smd_accept_cb(const cf_vector* items, as_smd_accept_type accept_type);
 static bool smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def);
+static bool smd_cbins_to_def(const char* read, uint32_t len, as_sindex_def* def);
 static void smd_create(as_sindex_def* def, bool startup);
 static void smd_drop(as_sindex_def* def);
 static void rename_sindex(as_sindex* si, const char* iname);
@@ -126,13 +137,19 @@ static bool bin_bitmap_is_set(const as_namespace* ns, uint32_t bin_id);
 static uint32_t si_arr_by_set_and_bin(const as_namespace* ns, uint16_t set_id, uint16_t bin_id, as_sindex** si_arr);
 static uint32_t sbins_arr_from_bin(as_namespace* ns, uint16_t set_id, const as_bin* b, as_sindex_bin* start_sbin, as_sindex_op op);
 static cf_ll* si_list_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id);
-static as_sindex* si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id, as_particle_type ktype, as_sindex_type itype, const uint8_t* ctx_buf, uint32_t ctx_buf_sz);
+static as_sindex* si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id, as_particle_type ktype, as_sindex_type itype, bool ordered, const uint8_t* ctx_buf, uint32_t ctx_buf_sz);
+static as_sindex* composite_si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id, const as_sindex_def* def);
+static as_sindex* exp_si_by_defn(const as_namespace* ns, uint16_t set_id, const uint8_t* exp_buf, uint32_t exp_buf_sz, as_particle_type ktype, as_sindex_type itype, bool ordered);
 static bool compare_ctx(const uint8_t* ctx1_buf, uint32_t ctx1_buf_sz, const uint8_t* ctx2_buf, uint32_t ctx2_buf_sz);
 
 static bool sbin_from_bin(as_sindex* si, const as_bin* b, as_sindex_bin* sbin);
 static bool sbin_from_simple_bin(as_sindex* si, const as_bin* b, as_sindex_bin* sbin);
 static bool sbin_from_cdt_bin(as_sindex* si, const as_bin* b, as_sindex_bin* sbin);
 
+static bool exp_sbin_from_bins(as_sindex* si, as_record* r, const as_bin* bins, uint32_t n_bins, as_sindex_bin* sbin);
+static bool composite_bval_from_bins(const as_sindex* si, const as_bin* bins, uint32_t n_bins, int64_t* bval);
+static bool cbin_bval_from_bins(const char* bin_name, uint16_t bin_id, as_particle_type ktype, const uint8_t* ctx_buf, uint32_t ctx_buf_sz, const as_bin* bins, uint32_t n_bins, int64_t* bval);
+
 static void add_value_to_sbin(as_sindex_bin* sbin, int64_t val);
 
 static bool add_listvalues_foreach(msgpack_in* element, void* udata);
@@ -143,7 +160,7 @@ static void add_long_from_msgpack(msgpack_in* element, as_sindex_bin* sbin);
 static void add_string_from_msgpack(msgpack_in* element, as_sindex_bin* sbin);
 static void add_geojson_from_msgpack(msgpack_in* element, as_sindex_bin* sbin);
 
-static char const* ktype_str(as_particle_type ktype);
+static char const* ktype_str(as_particle_type ktype, bool ordered);
 static as_particle_type ktype_from_smd_char(char c);
 static char ktype_to_smd_char(as_particle_type ktype);
 static as_sindex_type itype_from_smd_char(char c);
@@ -185,6 +202,45 @@ as_sindex_def_free(as_sindex_def* def)
 	if (def->ctx_buf != NULL) {
 		cf_free(def->ctx_buf);
 	}
+
+	for (uint32_t i = 0; i < def->n_cbins; i++) {
+		as_sindex_cbin* cbin = &def->cbins[i];
+
+		if (cbin->ctx_b64 != NULL) {
+			cf_free(cbin->ctx_b64);
+		}
+
+		if (cbin->ctx_buf != NULL) {
+			cf_free(cbin->ctx_buf);
+		}
+	}
+
+	if (def->exp_b64 != NULL) {
+		cf_free(def->exp_b64);
+	}
+
+	if (def->exp_buf != NULL) {
+		cf_free(def->exp_buf);
+	}
+
+	if (def->exp != NULL) {
+		as_exp_destroy(def->exp);
+	}
+}
+
+static inline void
+append_ctx(const char* ctx_b64, const uint8_t* ctx_buf, uint32_t ctx_buf_sz,
+		bool b64, cf_dyn_buf* db)
+{
+	if (ctx_buf == NULL) {
+		cf_dyn_buf_append_string(db, "null");
+	}
+	else if (b64) {
+		cf_dyn_buf_append_string(db, ctx_b64);
+	}
+	else {
+		cdt_ctx_to_dynbuf(ctx_buf, ctx_buf_sz, db);
+	}
 }
 
 static inline uint32_t
@@ -315,17 +371,9 @@ as_sindex_put_all_rd(as_namespace* ns, as_storage_rd* rd, as_index_ref* r_ref)
 void
 as_sindex_put_rd(as_sindex* si, as_storage_rd* rd, as_index_ref* r_ref)
 {
-	as_bin* b = as_bin_get_live(rd, si->bin_name);
-
-	if (b == NULL) {
-		return;
-	}
-
 	as_sindex_bin sbin;
 
-	init_sbin(&sbin, AS_SINDEX_OP_INSERT, si);
-
-	if (sbin_from_bin(si, b, &sbin)) {
+	if (as_sindex_sbin_from_rd(si, rd, &sbin)) {
 		// Mark record for sindex before insertion.
 		as_index_set_in_sindex(r_ref->r);
 
@@ -334,6 +382,32 @@ as_sindex_put_rd(as_sindex* si, as_storage_rd* rd, as_index_ref* r_ref)
 	}
 }
 
+// Returns false if the record has nothing to put in this sindex. Caller must
+// free a populated sbin.
+bool
+as_sindex_sbin_from_rd(as_sindex* si, as_storage_rd* rd, as_sindex_bin* sbin)
+{
+	if (as_sindex_is_derived(si)) {
+		return as_sindex_derived_sbin(si, rd->r, rd->bins, rd->n_bins, sbin,
+				AS_SINDEX_OP_INSERT);
+	}
+
+	as_bin* b = as_bin_get_live(rd, si->bin_name);
+
+	if (b == NULL) {
+		return false;
+	}
+
+	init_sbin(sbin, AS_SINDEX_OP_INSERT, si);
+
+	if (! sbin_from_bin(si, b, sbin)) {
+		sbin_free(sbin);
+		return false;
+	}
+
+	return true;
+}
+
 
 //==========================================================
 // Public API - modify sindexes from writes/deletes.
@@ -379,10 +453,13 @@ as_sindex_sbins_from_bin(as_namespace* ns, uint16_t set_id, const as_bin* b,
 	return n_populated;
 }
 
-void
+// Returns false if any delete didn't find its key.
+bool
 as_sindex_update_by_sbin(as_sindex_bin* start_sbin, uint32_t n_sbins,
 		cf_arenax_handle r_h)
 {
+	bool all_found = true;
+
 	// Deletes before inserts - a sindex key can recur with different op.
 
 	for (uint32_t i = 0; i < n_sbins; i++) {
@@ -392,7 +469,9 @@ as_sindex_update_by_sbin(as_sindex_bin* start_sbin, uint32_t n_sbins,
 			for (uint32_t j = 0; j < sbin->n_values; j++) {
 				int64_t bval = j == 0 ? sbin->val : sbin->values[j];
 
-				as_sindex_tree_delete(sbin->si, bval, r_h);
+				if (! as_sindex_tree_delete(sbin->si, bval, r_h)) {
+					all_found = false;
+				}
 			}
 		}
 	}
@@ -408,6 +487,8 @@ as_sindex_update_by_sbin(as_sindex_bin* start_sbin, uint32_t n_sbins,
 			}
 		}
 	}
+
+	return all_found;
 }
 
 void
@@ -418,6 +499,60 @@ as_sindex_sbin_free_all(as_sindex_bin* sbin, uint32_t n_sbins)
 	}
 }
 
+// Composite and expression sindexes aren't in the set+bin-id hash - a change to
+// any bin may change their keys, so callers handle them separately.
+uint32_t
+as_sindex_derived_arr_lookup_lockfree(const as_namespace* ns,
+		uint16_t set_id, as_sindex** si_arr)
+{
+	if (ns->n_derived_sindexes == 0) {
+		return 0;
+	}
+
+	uint32_t n_sindexes = 0;
+
+	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
+		as_sindex* si = ns->sindexes[i];
+
+		if (si != NULL && as_sindex_is_derived(si) &&
+				(si->set_id == INVALID_SET_ID || si->set_id == set_id)) {
+			as_sindex_reserve(si);
+			si_arr[n_sindexes++] = si;
+		}
+	}
+
+	return n_sindexes;
+}
+
+// Returns false if the record doesn't have all of a composite sindex's bins, or
+// an expression sindex's expression doesn't yield a value of its key type.
+bool
+as_sindex_derived_sbin(as_sindex* si, as_record* r, const as_bin* bins,
+		uint32_t n_bins, as_sindex_bin* sbin, as_sindex_op op)
+{
+	if (as_sindex_is_exp(si)) {
+		init_sbin(sbin, op, si);
+
+		if (! exp_sbin_from_bins(si, r, bins, n_bins, sbin)) {
+			sbin_free(sbin);
+			return false;
+		}
+
+		return true;
+	}
+
+	int64_t bval;
+
+	if (! composite_bval_from_bins(si, bins, n_bins, &bval)) {
+		return false;
+	}
+
+	init_sbin(sbin, op, si);
+	add_value_to_sbin(sbin, bval);
+
+	return true;
+}
+
 
 //==========================================================
 // Public API - query.
@@ -426,7 +561,7 @@ as_sindex_sbin_free_all(as_sindex_bin* sbin, uint32_t n_sbins)
 as_sindex*
 as_sindex_lookup_by_defn(const as_namespace* ns, uint16_t set_id,
 		uint16_t bin_id, as_particle_type ktype, as_sindex_type itype,
-		const uint8_t* ctx_buf, uint32_t ctx_buf_sz)
+		bool ordered, const uint8_t* ctx_buf, uint32_t ctx_buf_sz)
 {
 	SINDEX_GRLOCK();
 
@@ -435,12 +570,92 @@ as_sindex_lookup_by_defn(const as_namespace* ns, uint16_t set_id,
 		return NULL;
 	}
 
-	as_sindex* si = si_by_defn(ns, set_id, bin_id, ktype, itype, ctx_buf,
-			ctx_buf_sz);
+	as_sindex* si = si_by_defn(ns, set_id, bin_id, ktype, itype, ordered,
+			ctx_buf, ctx_buf_sz);
 
 	if (si == NULL && set_id != INVALID_SET_ID) {
-		si = si_by_defn(ns, INVALID_SET_ID, bin_id, ktype, itype, ctx_buf,
-				ctx_buf_sz);
+		si = si_by_defn(ns, INVALID_SET_ID, bin_id, ktype, itype, ordered,
+				ctx_buf, ctx_buf_sz);
+	}
+
+	if (si != NULL) {
+		as_sindex_reserve(si);
+	}
+
+	SINDEX_GRUNLOCK();
+
+	return si;
+}
+
+// Leading bins must match in order - last bin id, ktype and context are the
+// range bin. Leading bin contexts are as defined by the sindex.
+as_sindex*
+as_sindex_lookup_composite(const as_namespace* ns, uint16_t set_id,
+		const uint16_t* bin_ids, const as_particle_type* ktypes,
+		uint32_t n_bins, const uint8_t* ctx_buf, uint32_t ctx_buf_sz)
+{
+	SINDEX_GRLOCK();
+
+	as_sindex* set_si = NULL;
+	as_sindex* setless_si = NULL;
+
+	for (uint32_t i = 0; i < MAX_N_SINDEXES && set_si == NULL; i++) {
+		as_sindex* si = ns->sindexes[i];
+
+		if (si == NULL || si->n_cbins + 1 != n_bins ||
+				si->bin_id != bin_ids[n_bins - 1] ||
+				si->ktype != ktypes[n_bins - 1] ||
+				! compare_ctx(si->ctx_buf, si->ctx_buf_sz, ctx_buf,
+						ctx_buf_sz)) {
+			continue;
+		}
+
+		uint32_t c_ix;
+
+		for (c_ix = 0; c_ix < si->n_cbins; c_ix++) {
+			if (si->cbins[c_ix].bin_id != bin_ids[c_ix] ||
+					si->cbins[c_ix].ktype != ktypes[c_ix]) {
+				break;
+			}
+		}
+
+		if (c_ix != si->n_cbins) {
+			continue;
+		}
+
+		if (si->set_id == set_id) {
+			set_si = si;
+		}
+		else if (si->set_id == INVALID_SET_ID && setless_si == NULL) {
+			setless_si = si;
+		}
+	}
+
+	as_sindex* si = set_si != NULL ? set_si : setless_si;
+
+	if (si != NULL) {
+		as_sindex_reserve(si);
+	}
+
+	SINDEX_GRUNLOCK();
+
+	return si;
+}
+
+// Expression must match the sindex's byte for byte.
+as_sindex*
+as_sindex_lookup_exp(const as_namespace* ns, uint16_t set_id,
+		const uint8_t* exp_buf, uint32_t exp_buf_sz, as_particle_type ktype,
+		as_sindex_type itype, bool ordered)
+{
+	SINDEX_GRLOCK();
+
+	as_sindex* si = exp_si_by_defn(ns, set_id, exp_buf, exp_buf_sz, ktype,
+			itype, ordered);
+
+	if (si == NULL && set_id != INVALID_SET_ID) {
+		si = exp_si_by_defn(ns, INVALID_SET_ID, exp_buf, exp_buf_sz, ktype,
+				itype, ordered);
 	}
 
 	if (si != NULL) {
@@ -483,9 +698,14 @@ as_sindex_lookup_by_iname_lockfree(const as_namespace* ns, const char* iname)
 // Public API - info & stats.
 //
 
+// Pass NULL ordered where ordered strings aren't allowed.
 as_particle_type
-as_sindex_ktype_from_string(const char* ktype_str)
+as_sindex_ktype_from_string(const char* ktype_str, bool* ordered)
 {
+	if (ordered != NULL) {
+		*ordered = false;
+	}
+
 	if (strcasecmp(ktype_str, "numeric") == 0) {
 		return AS_PARTICLE_TYPE_INTEGER;
 	}
@@ -494,6 +714,11 @@ as_sindex_ktype_from_string(const char* ktype_str)
 		return AS_PARTICLE_TYPE_STRING;
 	}
 
+	if (ordered != NULL && strcasecmp(ktype_str, "string-ordered") == 0) {
+		*ordered = true;
+		return AS_PARTICLE_TYPE_STRING;
+	}
+
 	if (strcasecmp(ktype_str, "geo2dsphere") == 0) {
 		return AS_PARTICLE_TYPE_GEOJSON;
 	}
@@ -559,6 +784,16 @@ as_sindex_stats_str(as_namespace* ns, char* iname, cf_dyn_buf* db)
 
 	info_append_uint64(db, "stat_gc_recs", si->n_gc_cleaned);
 
+	if (as_sindex_is_exp(si)) {
+		uint64_t n_evals = as_load_uint64(&si->n_exp_evals);
+		uint64_t eval_ns = as_load_uint64(&si->exp_eval_ns);
+
+		info_append_uint64(db, "exp_evals", n_evals);
+		info_append_uint64(db, "exp_eval_fails", si->n_exp_eval_fails);
+		info_append_uint64(db, "exp_eval_avg_ns",
+				n_evals == 0 ? 0 : eval_ns / n_evals);
+	}
+
 	cf_dyn_buf_chomp(db);
 
 	SINDEX_GRUNLOCK();
@@ -586,22 +821,43 @@ as_sindex_list_str(const as_namespace* ns, bool b64, cf_dyn_buf* db)
 		cf_dyn_buf_append_string(db, si->set_name[0] != '\0' ?
 				si->set_name : "NULL");
 		cf_dyn_buf_append_string(db, ":bin=");
+
+		for (uint32_t c_ix = 0; c_ix < si->n_cbins; c_ix++) {
+			cf_dyn_buf_append_string(db, si->cbins[c_ix].bin_name);
+			cf_dyn_buf_append_char(db, ',');
+		}
+
 		cf_dyn_buf_append_string(db, si->bin_name);
 		cf_dyn_buf_append_string(db, ":type=");
-		cf_dyn_buf_append_string(db, ktype_str(si->ktype));
+
+		for (uint32_t c_ix = 0; c_ix < si->n_cbins; c_ix++) {
+			cf_dyn_buf_append_string(db,
+					ktype_str(si->cbins[c_ix].ktype, false));
+			cf_dyn_buf_append_char(db, ',');
+		}
+
+		cf_dyn_buf_append_string(db, ktype_str(si->ktype, si->ordered));
 		cf_dyn_buf_append_string(db, ":indextype=");
 		cf_dyn_buf_append_string(db, sindex_itypes[si->itype]);
 		cf_dyn_buf_append_string(db, ":context=");
 
-		if (si->ctx_buf == NULL) {
-			cf_dyn_buf_append_string(db, "null");
+		for (uint32_t c_ix = 0; c_ix < si->n_cbins; c_ix++) {
+			const as_sindex_cbin* cbin = &si->cbins[c_ix];
+
+			append_ctx(cbin->ctx_b64, cbin->ctx_buf, cbin->ctx_buf_sz, b64, db);
+			cf_dyn_buf_append_char(db, ',');
 		}
-		else {
+
+		append_ctx(si->ctx_b64, si->ctx_buf, si->ctx_buf_sz, b64, db);
+
+		if (as_sindex_is_exp(si)) {
+			cf_dyn_buf_append_string(db, ":exp=");
+
 			if (b64) {
-				cf_dyn_buf_append_string(db, si->ctx_b64);
+				cf_dyn_buf_append_string(db, si->exp_b64);
 			}
 			else {
-				cdt_ctx_to_dynbuf(si->ctx_buf, si->ctx_buf_sz, db);
+				as_exp_display(si->exp, db);
 			}
 		}
 
@@ -621,7 +877,7 @@ as_sindex_list_str(const as_namespace* ns, bool b64, cf_dyn_buf* db)
 void
 as_sindex_build_smd_key(const char* ns_name, const char* set_name,
 		const char* bin_name, const char* cdt_ctx, as_sindex_type itype,
-		as_particle_type ktype, char* smd_key)
+		as_particle_type ktype, bool ordered, char* smd_key)
 {
 	// ns-name|<set-name>|bin-name|itype|ktype
 
@@ -633,7 +889,59 @@ as_sindex_build_smd_key(const char* ns_name, const char* set_name,
 			cdt_ctx == NULL ? "" : "|c",
 			cdt_ctx == NULL ? "" : cdt_ctx,
 			itype_to_smd_char(itype),
-			ktype_to_smd_char(ktype));
+			// The 'O' ktype ensures older nodes reject ordered strings.
+			ordered ? 'O' : ktype_to_smd_char(ktype));
+}
+
+void
+as_sindex_build_composite_smd_key(const char* ns_name, const char* set_name,
+		uint32_t n_bins, char* const* bin_names, char* const* cdt_ctxs,
+		const as_particle_type* ktypes, char* smd_key)
+{
+	// ns-name|<set-name>|bin-name|m<bin-name>:ktype[:<cdt-context>][,...]|itype|ktype
+	// ns-name|<set-name>|bin-name|c<cdt-context>|m<bin-name>:ktype[:<cdt-context>][,...]|itype|ktype
+
+	// The last bin (the range bin) goes in the usual place - the leading bins
+	// follow in key order. The 'm' prefix ensures older nodes reject these.
+
+	uint32_t last = n_bins - 1;
+	char* write = smd_key;
+
+	write += sprintf(write, "%s|%s|%s%s%s|m",
+			ns_name,
+			set_name == NULL ? "" : set_name,
+			bin_names[last],
+			cdt_ctxs[last] == NULL ? "" : "|c",
+			cdt_ctxs[last] == NULL ? "" : cdt_ctxs[last]);
+
+	for (uint32_t i = 0; i < last; i++) {
+		write += sprintf(write, "%s%s:%c%s%s",
+				i == 0 ? "" : ",",
+				bin_names[i],
+				ktype_to_smd_char(ktypes[i]),
+				cdt_ctxs[i] == NULL ? "" : ":",
+				cdt_ctxs[i] == NULL ? "" : cdt_ctxs[i]);
+	}
+
+	sprintf(write, "|%c|%c", itype_to_smd_char(AS_SINDEX_ITYPE_DEFAULT),
+			ktype_to_smd_char(ktypes[last]));
+}
+
+void
+as_sindex_build_exp_smd_key(const char* ns_name, const char* set_name,
+		const char* exp_b64, as_sindex_type itype, as_particle_type ktype,
+		bool ordered, char* smd_key)
+{
+	// ns-name|<set-name>||x<exp>|itype|ktype
+
+	// There's no bin - the empty bin name ensures older nodes reject these.
+
+	sprintf(smd_key, "%s|%s||x%s|%c|%c",
+			ns_name,
+			set_name == NULL ? "" : set_name,
+			exp_b64,
+			itype_to_smd_char(itype),
+			ordered ? 'O' : ktype_to_smd_char(ktype));
 }
 
 int32_t
@@ -685,6 +993,41 @@ as_sindex_cdt_ctx_b64_decode(const char* ctx_b64, uint32_t ctx_b64_len,
 	return (int32_t)buf_sz_out;
 }
 
+// Returns NULL if the expression is invalid, or reads anything but bins - a
+// write's old bins are evaluated with the record's new metadata, so a key from
+// such an expression couldn't be found to delete. Caller owns both the
+// expression and the decoded buffer.
+as_exp*
+as_sindex_exp_b64_decode(const char* exp_b64, uint32_t exp_b64_len,
+		uint8_t** buf_r, uint32_t* buf_sz_r)
+{
+	uint8_t* buf = cf_malloc(cf_b64_decoded_buf_size(exp_b64_len));
+	uint32_t buf_sz;
+
+	if (! cf_b64_validate_and_decode(exp_b64, exp_b64_len, buf, &buf_sz)) {
+		cf_free(buf);
+		return NULL;
+	}
+
+	as_exp* exp = as_exp_build_buf(buf, buf_sz, true);
+
+	if (exp == NULL) {
+		cf_free(buf);
+		return NULL;
+	}
+
+	if (! as_exp_reads_only_bins(exp)) {
+		as_exp_destroy(exp);
+		cf_free(buf);
+		return NULL;
+	}
+
+	*buf_r = buf;
+	*buf_sz_r = buf_sz;
+
+	return exp;
+}
+
 
 //==========================================================
 // Local helpers - create, delete, rename sindexes.
@@ -698,6 +1041,7 @@ as_sindex_smd_accept_cb(const cf_vector* items, as_smd_accept_type accept_type)
 		as_sindex_def def = { 0 };
 
 		if (! smd_item_to_def(item->key, item->value, &def)) {
+			as_sindex_def_free(&def);
 			continue;
 		}
 
@@ -717,6 +1061,7 @@ smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def)
 {
 	// ns-name|<set-name>|bin-name|itype|ktype
 	// ns-name|<set-name>|bin-name|c<cdt-context>|itype|ktype
+	// ns-name|<set-name>||x<exp>|itype|ktype
 
 	const char* read = smd_key;
 	const char* tok = strchr(read, TOK_CHAR_DELIMITER);
@@ -773,7 +1118,9 @@ smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def)
 
 	uint32_t bin_name_len = (uint32_t)(tok - read);
 
-	if (bin_name_len == 0 || bin_name_len >= AS_BIN_NAME_MAX_SZ) {
+	// Expression sindexes have no bin name.
+	if ((bin_name_len == 0 && *(tok + 1) != 'x') ||
+			bin_name_len >= AS_BIN_NAME_MAX_SZ) {
 		cf_warning(AS_SINDEX, "smd - bad bin name");
 		return false;
 	}
@@ -784,6 +1131,28 @@ smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def)
 	read = tok + 1;
 	tok = strchr(read, TOK_CHAR_DELIMITER);
 
+	const char* exp_start = NULL;
+	uint32_t exp_len = 0;
+
+	if (bin_name_len == 0) {
+		if (tok == NULL) {
+			cf_warning(AS_SINDEX, "smd - expression missing delimiter");
+			return false;
+		}
+
+		exp_start = read + 1;
+		exp_len = (uint32_t)(tok - exp_start);
+
+		if (exp_len == 0 || exp_len >= EXP_B64_MAX_SZ) {
+			cf_warning(AS_SINDEX, "smd - bad expression length");
+			return false;
+		}
+
+		// Also parsed at the end.
+		read = tok + 1;
+		tok = strchr(read, TOK_CHAR_DELIMITER);
+	}
+
 	const char* ctx_start = NULL;
 	uint32_t ctx_len = 0;
 
@@ -806,6 +1175,23 @@ smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def)
 		tok = strchr(read, TOK_CHAR_DELIMITER);
 	}
 
+	const char* cbins_start = NULL;
+	uint32_t cbins_len = 0;
+
+	if (*read == 'm') {
+		if (tok == NULL) {
+			cf_warning(AS_SINDEX, "smd - composite bins missing delimiter");
+			return false;
+		}
+
+		cbins_start = read + 1;
+		cbins_len = (uint32_t)(tok - cbins_start);
+
+		// Also parsed at the end.
+		read = tok + 1;
+		tok = strchr(read, TOK_CHAR_DELIMITER);
+	}
+
 	if (tok == NULL) {
 		cf_warning(AS_SINDEX, "smd - itype missing delimiter");
 		return false;
@@ -830,7 +1216,9 @@ smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def)
 		return false;
 	}
 
-	def->ktype = ktype_from_smd_char(*read);
+	def->ordered = *read == 'O';
+	def->ktype = def->ordered ?
+			AS_PARTICLE_TYPE_STRING : ktype_from_smd_char(*read);
 
 	if (def->ktype == AS_PARTICLE_TYPE_BAD) {
 		cf_warning(AS_SINDEX, "smd - bad ktype");
@@ -869,6 +1257,135 @@ smd_item_to_def(const char* smd_key, const char* smd_value, as_sindex_def* def)
 		def->ctx_buf_sz = (uint32_t)buf_sz;
 	}
 
+	if (exp_start != NULL) {
+		if (ctx_start != NULL || cbins_start != NULL) {
+			cf_warning(AS_SINDEX, "smd - expression with context or composite bins");
+			return false;
+		}
+
+		char* exp_b64 = cf_malloc(exp_len + 1);
+
+		memcpy(exp_b64, exp_start, exp_len);
+		exp_b64[exp_len] = '\0';
+
+		def->exp = as_sindex_exp_b64_decode(exp_b64, exp_len, &def->exp_buf,
+				&def->exp_buf_sz);
+
+		if (def->exp == NULL) {
+			cf_warning(AS_SINDEX, "smd - invalid expression");
+			cf_free(exp_b64);
+			return false;
+		}
+
+		def->exp_b64 = exp_b64;
+	}
+
+	if (cbins_start != NULL) {
+		if (def->itype != AS_SINDEX_ITYPE_DEFAULT ||
+				def->ktype == AS_PARTICLE_TYPE_GEOJSON || def->ordered) {
+			cf_warning(AS_SINDEX, "smd - composite must be default itype and not geo");
+			return false;
+		}
+
+		return smd_cbins_to_def(cbins_start, cbins_len, def);
+	}
+
+	return true;
+}
+
+static bool
+smd_cbins_to_def(const char* read, uint32_t len, as_sindex_def* def)
+{
+	// <bin-name>:ktype[:<cdt-context>][,<bin-name>:ktype[:<cdt-context>]...]
+
+	const char* end = read + len;
+
+	while (read < end) {
+		if (def->n_cbins == MAX_COMPOSITE_BINS - 1) {
+			cf_warning(AS_SINDEX, "smd - too many composite bins");
+			return false;
+		}
+
+		const char* comp_end = memchr(read, ',', (size_t)(end - read));
+
+		if (comp_end == NULL) {
+			comp_end = end;
+		}
+
+		const char* tok = memchr(read, ':', (size_t)(comp_end - read));
+
+		if (tok == NULL) {
+			cf_warning(AS_SINDEX, "smd - composite bin missing ktype");
+			return false;
+		}
+
+		as_sindex_cbin* cbin = &def->cbins[def->n_cbins++];
+		uint32_t bin_name_len = (uint32_t)(tok - read);
+
+		if (bin_name_len == 0 || bin_name_len >= AS_BIN_NAME_MAX_SZ) {
+			cf_warning(AS_SINDEX, "smd - bad composite bin name");
+			return false;
+		}
+
+		memcpy(cbin->bin_name, read, bin_name_len);
+		cbin->bin_name[bin_name_len] = '\0';
+
+		read = tok + 1;
+
+		if (read == comp_end ||
+				(read + 1 != comp_end && *(read + 1) != ':')) {
+			cf_warning(AS_SINDEX, "smd - composite ktype not single char");
+			return false;
+		}
+
+		cbin->ktype = ktype_from_smd_char(*read);
+
+		if (cbin->ktype != AS_PARTICLE_TYPE_INTEGER &&
+				cbin->ktype != AS_PARTICLE_TYPE_STRING) {
+			cf_warning(AS_SINDEX, "smd - bad composite ktype");
+			return false;
+		}
+
+		read++;
+
+		if (read != comp_end) {
+			const char* ctx_start = read + 1; // skip ':'
+			uint32_t ctx_len = (uint32_t)(comp_end - ctx_start);
+
+			if (ctx_len == 0 || ctx_len >= CTX_B64_MAX_SZ) {
+				cf_warning(AS_SINDEX, "smd - bad composite context length");
+				return false;
+			}
+
+			char* ctx_b64 = cf_malloc(ctx_len + 1);
+			uint8_t* buf = NULL;
+
+			memcpy(ctx_b64, ctx_start, ctx_len);
+			ctx_b64[ctx_len] = '\0';
+
+			int32_t buf_sz = as_sindex_cdt_ctx_b64_decode(ctx_b64, ctx_len,
+					&buf);
+
+			if (buf_sz < 0) {
+				cf_warning(AS_SINDEX, "smd - invalid composite cdt context decode result %d",
+						buf_sz);
+				cf_free(ctx_b64);
+				return false;
+			}
+
+			cbin->ctx_b64 = ctx_b64;
+			cbin->ctx_buf = buf;
+			cbin->ctx_buf_sz = (uint32_t)buf_sz;
+		}
+
+		read = comp_end == end ? end : comp_end + 1;
+	}
+
+	if (def->n_cbins == 0) {
+		cf_warning(AS_SINDEX, "smd - no composite bins");
+		return false;
+	}
+
 	return true;
 }
 
@@ -889,9 +1406,9 @@ smd_create(as_sindex_def* def, bool startup)
 		return;
 	}
 
-	uint16_t bin_id;
+	uint16_t bin_id = 0; // expression sindexes have no bin
 
-	if (! as_bin_get_or_assign_id_w_len(ns, def->bin_name,
+	if (def->exp == NULL && ! as_bin_get_or_assign_id_w_len(ns, def->bin_name,
 			strlen(def->bin_name), &bin_id)) {
 		cf_warning(AS_SINDEX, "SINDEX CREATE: can't assign bin-id - ignoring %s",
 				def->iname);
@@ -910,8 +1427,30 @@ smd_create(as_sindex_def* def, bool startup)
 		return;
 	}
 
-	if ((cur_si = si_by_defn(ns, set_id, bin_id, def->ktype, def->itype,
-			def->ctx_buf, def->ctx_buf_sz)) != NULL) {
+	for (uint32_t i = 0; i < def->n_cbins; i++) {
+		as_sindex_cbin* cbin = &def->cbins[i];
+
+		if (! as_bin_get_or_assign_id_w_len(ns, cbin->bin_name,
+				strlen(cbin->bin_name), &cbin->bin_id)) {
+			cf_warning(AS_SINDEX, "SINDEX CREATE: can't assign bin-id - ignoring %s",
+					def->iname);
+			SINDEX_GWUNLOCK();
+			return;
+		}
+	}
+
+	if (def->exp != NULL) {
+		cur_si = exp_si_by_defn(ns, set_id, def->exp_buf, def->exp_buf_sz,
+				def->ktype, def->itype, def->ordered);
+	}
+	else {
+		cur_si = def->n_cbins == 0 ?
+				si_by_defn(ns, set_id, bin_id, def->ktype, def->itype,
+						def->ordered, def->ctx_buf, def->ctx_buf_sz) :
+				composite_si_by_defn(ns, set_id, bin_id, def);
+	}
+
+	if (cur_si != NULL) {
 		cf_info(AS_SINDEX, "SINDEX CREATE: renaming %s to %s", cur_si->iname,
 				def->iname);
 
@@ -936,9 +1475,14 @@ smd_create(as_sindex_def* def, bool startup)
 			.bin_id = bin_id,
 			.ktype = def->ktype,
 			.itype = def->itype,
+			.ordered = def->ordered,
 			.ctx_b64 = def->ctx_b64,
 			.ctx_buf = def->ctx_buf,
 			.ctx_buf_sz = def->ctx_buf_sz,
+			.exp_b64 = def->exp_b64,
+			.exp_buf = def->exp_buf,
+			.exp_buf_sz = def->exp_buf_sz,
+			.exp = def->exp,
 			.n_btrees = AS_PARTITIONS
 	};
 
@@ -949,6 +1493,19 @@ smd_create(as_sindex_def* def, bool startup)
 	// These are now owned by si - don't free outside.
 	def->ctx_b64 = NULL;
 	def->ctx_buf = NULL;
+	def->exp_b64 = NULL;
+	def->exp_buf = NULL;
+	def->exp = NULL;
+
+	if (def->n_cbins != 0) {
+		size_t cbins_sz = def->n_cbins * sizeof(as_sindex_cbin);
+
+		si->n_cbins = def->n_cbins;
+		si->cbins = cf_malloc(cbins_sz);
+		memcpy(si->cbins, def->cbins, cbins_sz);
+
+		def->n_cbins = 0; // contexts now owned by si
+	}
 
 	if (ns->flat_sindexes == NULL) {
 		add_to_sindexes(si);
@@ -997,9 +1554,9 @@ smd_drop(as_sindex_def* def)
 	SINDEX_GWLOCK();
 
 	as_namespace* ns = def->ns;
-	uint16_t bin_id;
+	uint16_t bin_id = 0;
 
-	if (! as_bin_get_id(ns, def->bin_name, &bin_id)) {
+	if (def->exp == NULL && ! as_bin_get_id(ns, def->bin_name, &bin_id)) {
 		cf_warning(AS_SINDEX, "SINDEX DROP: bin '%s' not found", def->bin_name);
 		SINDEX_GWUNLOCK();
 		return;
@@ -1014,8 +1571,31 @@ smd_drop(as_sindex_def* def)
 		return;
 	}
 
-	as_sindex* si = si_by_defn(ns, set_id, bin_id, def->ktype, def->itype,
-			def->ctx_buf, def->ctx_buf_sz);
+	if (def->n_cbins != 0) {
+		for (uint32_t i = 0; i < def->n_cbins; i++) {
+			as_sindex_cbin* cbin = &def->cbins[i];
+
+			if (! as_bin_get_id(ns, cbin->bin_name, &cbin->bin_id)) {
+				cf_warning(AS_SINDEX, "SINDEX DROP: bin '%s' not found",
+						cbin->bin_name);
+				SINDEX_GWUNLOCK();
+				return;
+			}
+		}
+	}
+
+	as_sindex* si;
+
+	if (def->exp != NULL) {
+		si = exp_si_by_defn(ns, set_id, def->exp_buf, def->exp_buf_sz,
+				def->ktype, def->itype, def->ordered);
+	}
+	else {
+		si = def->n_cbins == 0 ?
+				si_by_defn(ns, set_id, bin_id, def->ktype, def->itype,
+						def->ordered, def->ctx_buf, def->ctx_buf_sz) :
+				composite_si_by_defn(ns, set_id, bin_id, def);
+	}
 
 	if (si == NULL) {
 		cf_warning(AS_SINDEX, "SINDEX DROP: defn not found");
@@ -1061,8 +1641,14 @@ add_sindex(as_sindex* si, uint16_t bin_id)
 {
 	as_namespace* ns = si->ns;
 
-	defn_hash_put(si, bin_id);
 	cf_shash_put(ns->sindex_iname_hash, si->iname, &si);
+
+	if (as_sindex_is_derived(si)) {
+		ns->n_derived_sindexes++;
+		return;
+	}
+
+	defn_hash_put(si, bin_id);
 	bin_bitmap_set(ns, bin_id);
 }
 
@@ -1071,8 +1657,14 @@ delete_sindex(as_sindex* si)
 {
 	as_namespace* ns = si->ns;
 
-	defn_hash_delete(si);
 	cf_shash_delete(ns->sindex_iname_hash, si->iname);
+
+	if (as_sindex_is_derived(si)) {
+		ns->n_derived_sindexes--;
+		return;
+	}
+
+	defn_hash_delete(si);
 	bin_bitmap_clear(ns, si->bin_id);
 }
 
@@ -1161,7 +1753,8 @@ bin_bitmap_clear(as_namespace* ns, uint32_t bin_id)
 	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
 		as_sindex* si = ns->sindexes[i];
 
-		if (si != NULL && (uint32_t)si->bin_id == bin_id) {
+		if (si != NULL && ! as_sindex_is_derived(si) &&
+				(uint32_t)si->bin_id == bin_id) {
 			return;
 		}
 	}
@@ -1261,8 +1854,8 @@ si_list_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id)
 
 static as_sindex*
 si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id,
-		as_particle_type ktype, as_sindex_type itype, const uint8_t* ctx_buf,
-		uint32_t ctx_buf_sz)
+		as_particle_type ktype, as_sindex_type itype, bool ordered,
+		const uint8_t* ctx_buf, uint32_t ctx_buf_sz)
 {
 	cf_ll* si_ll = si_list_by_defn(ns, set_id, bin_id);
 
@@ -1276,7 +1869,7 @@ si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id,
 		defn_hash_ele* prop_ele = (defn_hash_ele*)ele;
 		as_sindex* si = prop_ele->si;
 
-		if (si->ktype == ktype && si->itype == itype &&
+		if (si->ktype == ktype && si->itype == itype && si->ordered == ordered &&
 				compare_ctx(si->ctx_buf, si->ctx_buf_sz, ctx_buf, ctx_buf_sz)) {
 			return si;
 		}
@@ -1287,6 +1880,61 @@ si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id,
 	return NULL;
 }
 
+static as_sindex*
+composite_si_by_defn(const as_namespace* ns, uint16_t set_id, uint16_t bin_id,
+		const as_sindex_def* def)
+{
+	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
+		as_sindex* si = ns->sindexes[i];
+
+		if (si == NULL || si->set_id != set_id || si->bin_id != bin_id ||
+				si->ktype != def->ktype || si->n_cbins != def->n_cbins ||
+				! compare_ctx(si->ctx_buf, si->ctx_buf_sz, def->ctx_buf,
+						def->ctx_buf_sz)) {
+			continue;
+		}
+
+		uint32_t c_ix;
+
+		for (c_ix = 0; c_ix < si->n_cbins; c_ix++) {
+			const as_sindex_cbin* si_cbin = &si->cbins[c_ix];
+			const as_sindex_cbin* def_cbin = &def->cbins[c_ix];
+
+			if (si_cbin->bin_id != def_cbin->bin_id ||
+					si_cbin->ktype != def_cbin->ktype ||
+					! compare_ctx(si_cbin->ctx_buf, si_cbin->ctx_buf_sz,
+							def_cbin->ctx_buf, def_cbin->ctx_buf_sz)) {
+				break;
+			}
+		}
+
+		if (c_ix == si->n_cbins) {
+			return si;
+		}
+	}
+
+	return NULL;
+}
+
+static as_sindex*
+exp_si_by_defn(const as_namespace* ns, uint16_t set_id,
+		const uint8_t* exp_buf, uint32_t exp_buf_sz, as_particle_type ktype,
+		as_sindex_type itype, bool ordered)
+{
+	for (uint32_t i = 0; i < MAX_N_SINDEXES; i++) {
+		as_sindex* si = ns->sindexes[i];
+
+		if (si != NULL && as_sindex_is_exp(si) && si->set_id == set_id &&
+				si->ktype == ktype && si->itype == itype &&
+				si->ordered == ordered && si->exp_buf_sz == exp_buf_sz &&
+				memcmp(si->exp_buf, exp_buf, exp_buf_sz) == 0) {
+			return si;
+		}
+	}
+
+	return NULL;
+}
+
 static bool
 compare_ctx(const uint8_t* ctx1_buf, uint32_t ctx1_buf_sz,
 		const uint8_t* ctx2_buf, uint32_t ctx2_buf_sz)
@@ -1380,7 +2028,7 @@ sbin_from_simple_bin(as_sindex* si, const as_bin* b, as_sindex_bin* sbin)
 			return false;
 		}
 
-		add_value_to_sbin(sbin, as_sindex_string_to_bval(str, len));
+		add_value_to_sbin(sbin, as_sindex_string_bval(si, str, len));
 
 		return true;
 	}
@@ -1432,6 +2080,137 @@ sbin_from_cdt_bin(as_sindex* si, const as_bin* b, as_sindex_bin* sbin)
 // Local helpers - value to sbin.
 //
 
+// The bins may not be a storage record's (e.g. a write's old bins), so the
+// expression only gets them via a minimal rd - expressions that read the key or
+// metadata are rejected when the index is defined.
+static bool
+exp_sbin_from_bins(as_sindex* si, as_record* r, const as_bin* bins,
+		uint32_t n_bins, as_sindex_bin* sbin)
+{
+	as_namespace* ns = si->ns;
+
+	as_storage_rd rd = {
+			.r = r,
+			.ns = ns,
+			.bins = (as_bin*)bins,
+			.n_bins = (uint16_t)n_bins
+	};
+
+	as_exp_ctx ctx = { .ns = ns, .r = r, .rd = &rd };
+	as_bin rb = { 0 };
+
+	uint64_t start_ns = cf_getns();
+	bool evaluated = as_exp_eval(si->exp, &ctx, &rb, NULL, false);
+
+	as_add_uint64(&si->exp_eval_ns, (int64_t)(cf_getns() - start_ns));
+	as_incr_uint64(&si->n_exp_evals);
+
+	if (! evaluated) {
+		as_incr_uint64(&si->n_exp_eval_fails);
+		return false;
+	}
+
+	bool rv = as_bin_is_live(&rb) && sbin_from_bin(si, &rb, sbin);
+
+	as_bin_particle_destroy(&rb);
+
+	return rv;
+}
+
+static bool
+composite_bval_from_bins(const as_sindex* si, const as_bin* bins,
+		uint32_t n_bins, int64_t* bval)
+{
+	int64_t prefix_bvals[MAX_COMPOSITE_BINS - 1];
+
+	for (uint32_t i = 0; i < si->n_cbins; i++) {
+		const as_sindex_cbin* cbin = &si->cbins[i];
+
+		if (! cbin_bval_from_bins(cbin->bin_name, cbin->bin_id, cbin->ktype,
+				cbin->ctx_buf, cbin->ctx_buf_sz, bins, n_bins,
+				&prefix_bvals[i])) {
+			return false;
+		}
+	}
+
+	int64_t last_bval;
+
+	if (! cbin_bval_from_bins(si->bin_name, si->bin_id, si->ktype, si->ctx_buf,
+			si->ctx_buf_sz, bins, n_bins, &last_bval)) {
+		return false;
+	}
+
+	*bval = as_sindex_composite_bval(
+			as_sindex_composite_prefix(prefix_bvals, si->n_cbins), si->ktype,
+			last_bval);
+
+	return true;
+}
+
+static bool
+cbin_bval_from_bins(const char* bin_name, uint16_t bin_id,
+		as_particle_type ktype, const uint8_t* ctx_buf, uint32_t ctx_buf_sz,
+		const as_bin* bins, uint32_t n_bins, int64_t* bval)
+{
+	const as_bin* b = NULL;
+
+	for (uint32_t i = 0; i < n_bins; i++) {
+		if (bins[i].id == bin_id) {
+			b = &bins[i];
+			break;
+		}
+	}
+
+	if (b == NULL || as_bin_is_tombstone(b)) {
+		return false;
+	}
+
+	as_particle_type type = as_bin_get_particle_type(b);
+	as_bin ctx_bin = { 0 };
+
+	if (ctx_buf != NULL) {
+		if (type != AS_PARTICLE_TYPE_LIST && type != AS_PARTICLE_TYPE_MAP) {
+			return false;
+		}
+
+		if (! as_bin_cdt_get_by_context(b, ctx_buf, ctx_buf_sz, &ctx_bin,
+				false)) {
+			return false;
+		}
+
+		type = as_bin_get_particle_type(&ctx_bin);
+		b = &ctx_bin;
+	}
+
+	bool rv = false;
+
+	if (type == ktype) {
+		if (type == AS_PARTICLE_TYPE_INTEGER) {
+			*bval = as_bin_particle_integer_value(b);
+			rv = true;
+		}
+		else {
+			char* str;
+			uint32_t len = as_bin_particle_string_ptr(b, &str);
+
+			if (len > MAX_STRING_KSIZE) {
+				cf_ticker_warning(AS_SINDEX, "failed sindex on bin %s - string longer than %u",
+						bin_name, MAX_STRING_KSIZE);
+			}
+			else {
+				*bval = as_sindex_string_to_bval(str, len);
+				rv = true;
+			}
+		}
+	}
+
+	if (ctx_buf != NULL) {
+		as_bin_particle_destroy(&ctx_bin);
+	}
+
+	return rv;
+}
+
 static void
 add_value_to_sbin(as_sindex_bin* sbin, int64_t val)
 {
@@ -1528,7 +2307,8 @@ add_string_from_msgpack(msgpack_in* element, as_sindex_bin* sbin)
 	str++;
 	str_sz--;
 
-	add_value_to_sbin(sbin, as_sindex_string_to_bval((const char*)str, str_sz));
+	add_value_to_sbin(sbin, as_sindex_string_bval(sbin->si, (const char*)str,
+			str_sz));
 }
 
 static void
@@ -1581,11 +2361,11 @@ add_geojson_from_msgpack(msgpack_in* element, as_sindex_bin* sbin)
 //
 
 static char const*
-ktype_str(as_particle_type ktype)
+ktype_str(as_particle_type ktype, bool ordered)
 {
 	switch (ktype) {
 	case AS_PARTICLE_TYPE_INTEGER: return "numeric";
-	case AS_PARTICLE_TYPE_STRING: return "string";
+	case AS_PARTICLE_TYPE_STRING: return ordered ? "string-ordered" : "string";
 	case AS_PARTICLE_TYPE_GEOJSON: return "geo2dsphere";
 	default:
 		cf_crash(AS_SINDEX, "invalid ktype %d", ktype);
@@ -32,6 +32,7 @@
 #include "log.h"
 
 #include "base/datamodel.h"
+#include "sindex/persist.h"
 
 
 //==========================================================
@@ -46,6 +47,7 @@ as_sindex_resume(void)
 void
 as_sindex_shutdown(as_namespace* ns)
 {
+	as_sindex_persist_save(ns);
 }
 
 
@@ -31,14 +31,20 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#if defined __x86_64__
+#include <immintrin.h>
+#endif
+
 #include "aerospike/as_arch.h"
 #include "aerospike/as_atomic.h"
 #include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_hash_math.h"
+#include "citrusleaf/cf_random.h"
 
 #include "arenax.h"
 #include "bits.h"
@@ -59,6 +65,14 @@
 
 #define BINARY_SEARCH 1
 
+// AVX2 narrowing of in-node searches - dispatched at runtime, since we build
+// for a baseline x86-64 target.
+#if defined __x86_64__
+#define SIMD_SEARCH 1
+#else
+#define SIMD_SEARCH 0
+#endif
+
 
 //==========================================================
 // Typedefs & constants.
@@ -71,8 +85,17 @@
 
 #define MAX_CARDINALITY_BURST 1000
 
+#define HIST_N_SAMPLES 1024 // reservoir of bvals the histogram is cut from
+
+#define RH_SET_MIN_CAPACITY 1024
+
 #define CACHE_LINE_SZ 64
 
+#define SIMD_WINDOW 16 // keys - small enough to compare all at once
+
+#define BULK_MIN_CAPACITY (16 * 1024)
+#define SIDE_MIN_CAPACITY 64
+
 #define HLL_N_INDEX_BITS 16
 #define HLL_N_REGISTERS (1 << HLL_N_INDEX_BITS) // 64K
 
@@ -106,6 +129,13 @@ typedef struct gc_collect_cb_info_s {
 	search_key last;
 } gc_collect_cb_info;
 
+// Intersection - sorted record handles a query's keys must be among.
+
+typedef struct rh_filter_s {
+	const uint64_t* r_hs;
+	uint32_t n_r_hs;
+} rh_filter;
+
 typedef struct query_collect_cb_info_s {
 	cf_arenax* arena;
 	as_index_tree* tree;
@@ -115,10 +145,85 @@ typedef struct query_collect_cb_info_s {
 	si_btree_key* keys;
 
 	bool de_dup;
+	const rh_filter* filter;
 
 	search_key last;
 } query_collect_cb_info;
 
+// While a tree is bulk building, writes queue here and are replayed, in order,
+// once the new tree is in place.
+
+typedef struct side_op_s {
+	si_btree_key key;
+	bool is_put;
+} side_op;
+
+typedef struct si_btree_side_s {
+	uint32_t n_ops;
+	uint32_t capacity;
+	side_op* ops;
+} si_btree_side;
+
+typedef struct bulk_ele_s {
+	uint64_t ubval; // bval with the sort order of an unsigned integer
+	uint64_t r_h;
+	cf_digest keyd;
+	uint8_t keyd_stub;
+} bulk_ele;
+
+typedef struct as_sindex_bulk_s {
+	as_sindex* si;
+	si_btree* bt;
+	uint64_t n_eles;
+	uint64_t capacity;
+	bulk_ele* eles;
+} as_sindex_bulk;
+
+typedef struct bulk_collect_cb_info_s {
+	uint64_t n_keys;
+	si_btree_key* keys;
+} bulk_collect_cb_info;
+
+// Multi-range queries on list/map sindexes may find a record under several
+// entries - handles already passed to the callback are remembered here.
+
+typedef struct rh_set_s {
+	uint32_t n_used;
+	uint32_t capacity; // power of 2
+	uint64_t* slots; // r_h + 1, so 0 means empty
+} rh_set;
+
+typedef struct filter_cb_info_s {
+	as_namespace* ns;
+	const rh_filter* filter;
+	as_sindex_reduce_fn cb;
+	void* udata;
+} filter_cb_info;
+
+typedef struct intersect_collect_cb_info_s {
+	cf_arenax* arena;
+
+	uint32_t n_keys_reduced;
+	uint32_t n_r_hs;
+	uint32_t capacity;
+	uint64_t* r_hs;
+
+	search_key last;
+} intersect_collect_cb_info;
+
+typedef struct multi_cb_info_s {
+	as_namespace* ns;
+	as_sindex_reduce_fn cb;
+	void* udata;
+	rh_set* seen;
+	bool stopped;
+} multi_cb_info;
+
+typedef struct visit_cb_info_s {
+	as_sindex_visit_fn cb;
+	void* udata;
+} visit_cb_info;
+
 typedef struct hyperloglog_s {
 	uint8_t registers[HLL_REGISTERS_SZ];
 } hyperloglog;
@@ -129,6 +234,7 @@ typedef struct cardinality_collect_cb_info_s {
 	uint64_t* n_keys;
 	hyperloglog* bval_hll;
 	hyperloglog* rec_hll;
+	int64_t* samples;
 
 	uint32_t n_keys_reduced;
 
@@ -142,19 +248,45 @@ typedef struct cardinality_collect_cb_info_s {
 
 static void gc_reduce_and_delete(as_sindex* si, si_btree* bt);
 static bool gc_collect_cb(const si_btree_key* key, void* udata);
-static void query_reduce(si_btree* bt, as_partition_reservation* rsv, int64_t start_bval, int64_t end_bval, int64_t resume_bval, cf_digest* keyd, bool de_dup, as_sindex_reduce_fn cb, void* udata);
+static void query_reduce(si_btree* bt, as_partition_reservation* rsv, int64_t start_bval, int64_t end_bval, int64_t resume_bval, cf_digest* keyd, bool de_dup, const rh_filter* filter, as_sindex_reduce_fn cb, void* udata);
+static void query_reduce_desc(si_btree* bt, as_partition_reservation* rsv, int64_t start_bval, int64_t end_bval, as_sindex_reduce_fn cb, void* udata);
+static bool query_burst(si_btree* bt, as_partition_reservation* rsv, const query_collect_cb_info* ci, as_sindex_reduce_fn cb, void* udata);
 static bool query_collect_cb(const si_btree_key* key, void* udata);
-static void cardinality_reduce(as_sindex* si, si_btree* bt, uint64_t* n_keys, hyperloglog* bval_hll, hyperloglog* rec_hll);
+static bool filter_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata);
+static bool filter_has(const rh_filter* filter, uint64_t r_h);
+static bool intersect_collect_cb(const si_btree_key* key, void* udata);
+static int r_h_cmp(const void* pa, const void* pb);
+static void multi_query_reduce(si_btree* bt, const as_query_range* range, as_partition_reservation* rsv, int64_t resume_bval, cf_digest* keyd, as_sindex_reduce_fn cb, void* udata);
+static bool multi_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata);
+static bool rh_set_add(rh_set* set, cf_arenax_handle r_h);
+static void cardinality_reduce(as_sindex* si, si_btree* bt, uint64_t* n_keys, hyperloglog* bval_hll, hyperloglog* rec_hll, int64_t* samples);
 static bool cardinality_collect_cb(const si_btree_key* key, void* udata);
+static void hist_build(as_sindex* si, int64_t* samples, uint64_t n_keys);
+static int sample_cmp(const void* pa, const void* pb);
+static bool gc_bulk_in_progress(si_btree* bt);
+static void wait_for_bulk(as_sindex* si, si_btree* bt);
+static bool visit_cb(const si_btree_key* key, void* udata);
+
+static void bulk_sort(as_sindex_bulk* bulk);
+static bool bulk_radix_pass(const bulk_ele* src, bulk_ele* dst, uint64_t n_eles, uint32_t pass);
+static int bulk_keyd_cmp(const void* pa, const void* pb);
+static si_btree_key* bulk_merge(as_sindex_bulk* bulk, uint64_t* n_keys);
+static bool bulk_collect_cb(const si_btree_key* key, void* udata);
+static si_arena_handle bulk_build(si_btree* bt, si_btree_key* keys, uint64_t n_keys);
+static void side_append(si_btree_side* side, const si_btree_key* key, bool is_put);
 
 static si_btree* si_btree_create(cf_arenax* arena, as_sindex_arena* si_arena, bool unsigned_bvals, uint32_t si_id, uint16_t tree_ix);
 static void si_btree_destroy(si_btree* bt);
 static bool si_btree_put(si_btree* bt, const si_btree_key* key);
+static bool si_btree_put_lockfree(si_btree* bt, const si_btree_key* key);
+static bool si_btree_delete_lockfree(si_btree* bt, const si_btree_key* key);
+static void si_btree_reduce_rev(si_btree* bt, const search_key* start_skey, const search_key* end_skey, si_btree_reduce_fn cb, void* udata);
 
 static void btree_destroy(si_btree* bt, si_arena_handle node_h);
 static bool btree_put(si_btree* bt, si_btree_node* node, const si_btree_key* key);
 static bool btree_delete(si_btree* bt, si_btree_node* node, key_mode mode, const si_btree_key* key_in, si_btree_key* key_out);
 static bool btree_reduce(si_btree* bt, si_btree_node* node, const search_key* start_skey, const search_key* end_skey, si_btree_reduce_fn cb, void* udata);
+static bool btree_reduce_rev(si_btree* bt, si_btree_node* node, const search_key* start_skey, const search_key* end_skey, si_btree_reduce_fn cb, void* udata);
 static bool delete_case_1(si_btree* bt, si_btree_node* node, key_mode mode, const si_btree_key* key_in, si_btree_key* key_out);
 static bool delete_case_2(si_btree* bt, si_btree_node* node, key_mode mode, const si_btree_key* key_in, si_btree_key* key_out, key_bound bound);
 static bool delete_case_2a(si_btree* bt, si_btree_node* node, uint32_t i, si_btree_node* child);
@@ -169,7 +301,13 @@ static si_arena_handle create_node(const si_btree* bt, bool leaf);
 static void move_keys(const si_btree* bt, si_btree_node* dst, uint32_t dst_i, si_btree_node* src, uint32_t src_i, uint32_t n_keys);
 static void move_children(const si_btree* bt, si_btree_node* dst, uint32_t dst_i, si_btree_node* src, uint32_t src_i, uint32_t n_children);
 static key_bound greatest_lower_bound(const si_btree* bt, const si_btree_node* node, const si_btree_key* key);
+static key_bound greatest_lower_bound_from(const si_btree* bt, const si_btree_node* node, const si_btree_key* key, uint32_t start);
 static key_bound left_bound(const si_btree* bt, const si_btree_node* node, const search_key* skey);
+static key_bound left_bound_from(const si_btree* bt, const si_btree_node* node, const search_key* skey, uint32_t start);
+static uint32_t rev_bound(const si_btree* bt, const si_btree_node* node, const search_key* skey, bool* equal);
+#if SIMD_SEARCH == 1
+static uint32_t first_bval_ge_avx2(const si_btree* bt, const si_btree_node* node, int64_t bval);
+#endif
 static void split_child(si_btree* bt, si_btree_node* node, uint32_t i, si_btree_node* child);
 static void merge_children(si_btree* bt, si_btree_node* node, uint32_t i, si_btree_node* left, si_arena_handle right_h);
 
@@ -212,6 +350,13 @@ bval_cmp_unsigned(int64_t bval_1, int64_t bval_2)
 			1 : ((uint64_t)bval_1 < (uint64_t)bval_2 ? -1 : 0);
 }
 
+static inline bool
+bval_lt(const si_btree* bt, int64_t bval_1, int64_t bval_2)
+{
+	return bt->unsigned_bvals ?
+			(uint64_t)bval_1 < (uint64_t)bval_2 : bval_1 < bval_2;
+}
+
 static inline int32_t
 key_cmp(const si_btree* bt, const si_btree_key* key_1,
 		const si_btree_key* key_2)
@@ -268,6 +413,19 @@ skey_cmp(const si_btree* bt, const search_key* skey, const si_btree_key* key)
 	return cf_digest_compare(&skey->keyd, &r->keyd);
 }
 
+// For walking keys high to low - without a digest, a search key follows all
+// keys with its bval.
+static inline int32_t
+rev_skey_cmp(const si_btree* bt, const search_key* skey,
+		const si_btree_key* key)
+{
+	if (! skey->has_digest && skey->bval == key->bval) {
+		return 1;
+	}
+
+	return skey_cmp(bt, skey, key);
+}
+
 static inline int32_t
 end_skey_cmp(const si_btree* bt, const search_key* skey,
 		const si_btree_key* key)
@@ -340,6 +498,35 @@ set_child(const si_btree* bt, si_btree_node* node, uint32_t i,
 
 #define ROUND_FRACTION(n, d) ((uint64_t)(((double)n / d) + 0.5))
 
+static inline uint64_t
+bval_to_ubval(const si_btree* bt, int64_t bval)
+{
+	return bt->unsigned_bvals ?
+			(uint64_t)bval : (uint64_t)bval ^ 0x8000000000000000UL;
+}
+
+static inline int64_t
+ubval_to_bval(const si_btree* bt, uint64_t ubval)
+{
+	return bt->unsigned_bvals ?
+			(int64_t)ubval : (int64_t)(ubval ^ 0x8000000000000000UL);
+}
+
+// Pass 0 is the stub, passes 1 to 8 the bval bytes, least significant first.
+static inline uint8_t
+radix_byte(const bulk_ele* ele, uint32_t pass)
+{
+	return pass == 0 ?
+			ele->keyd_stub : (uint8_t)(ele->ubval >> ((pass - 1) * 8));
+}
+
+// Spreads n_total as evenly as possible over n_parts.
+static inline uint64_t
+share(uint64_t n_total, uint64_t n_parts, uint64_t i)
+{
+	return (n_total / n_parts) + (i < n_total % n_parts ? 1 : 0);
+}
+
 
 //==========================================================
 // Public API.
@@ -352,12 +539,18 @@ as_sindex_tree_create(as_sindex* si)
 
 	si->btrees = cf_malloc(si->n_btrees * sizeof(si_btree*));
 
-	bool unsigned_bvals = si->ktype == AS_PARTICLE_TYPE_GEOJSON;
+	// Composite keys are ordered by their (unsigned) prefix hash first.
+	bool unsigned_bvals = si->ktype == AS_PARTICLE_TYPE_GEOJSON ||
+			as_sindex_is_composite(si);
 
 	for (uint32_t ix = 0; ix < si->n_btrees; ix++) {
 		si->btrees[ix] = si_btree_create(ns->arena, ns->si_arena,
 				unsigned_bvals, si->id, (uint16_t)ix);
 	}
+
+	cf_mutex_init(&si->bulk_lock);
+	cf_condition_init(&si->bulk_done);
+	si->n_bulk_building = 0;
 }
 
 void
@@ -367,6 +560,9 @@ as_sindex_tree_destroy(as_sindex* si)
 		si_btree_destroy(si->btrees[ix]);
 	}
 
+	cf_mutex_destroy(&si->bulk_lock);
+	cf_condition_destroy(&si->bulk_done);
+
 	cf_free(si->btrees);
 	si->btrees = NULL;
 }
@@ -403,6 +599,19 @@ as_sindex_tree_gc(as_sindex* si)
 	}
 }
 
+// Returns once no tree is bulk building, or the sindex is dropped.
+void
+as_sindex_tree_wait_for_bulk(as_sindex* si)
+{
+	cf_mutex_lock(&si->bulk_lock);
+
+	while (! si->dropped && si->n_bulk_building != 0) {
+		cf_condition_wait(&si->bulk_done, &si->bulk_lock);
+	}
+
+	cf_mutex_unlock(&si->bulk_lock);
+}
+
 bool
 as_sindex_tree_put(as_sindex* si, int64_t bval, cf_arenax_handle r_h)
 {
@@ -449,14 +658,246 @@ as_sindex_tree_query(as_sindex* si, const as_query_range* range,
 			}
 
 			query_reduce(bt, rsv, r->start, r->end, bval, keyd, range->de_dup,
-					cb, udata);
+					NULL, cb, udata);
+		}
+
+		return;
+	}
+
+	if (as_sindex_is_composite(si)) {
+		// Seek straight to the slice for the leading values.
+		int64_t prefix_bvals[MAX_COMPOSITE_BINS - 1];
+
+		for (uint32_t i = 0; i < si->n_cbins; i++) {
+			prefix_bvals[i] = range->prefix[i].u.r.start;
+		}
+
+		uint64_t prefix = as_sindex_composite_prefix(prefix_bvals,
+				si->n_cbins);
+
+		int64_t start_bval = as_sindex_composite_bval(prefix, si->ktype,
+				range->u.r.start);
+		int64_t end_bval = as_sindex_composite_bval(prefix, si->ktype,
+				range->u.r.end);
+
+		if (range->desc) {
+			query_reduce_desc(bt, rsv, start_bval, end_bval, cb, udata);
+			return;
 		}
 
+		query_reduce(bt, rsv, start_bval, end_bval, bval, keyd, false, NULL, cb,
+				udata);
+		return;
+	}
+
+	if (range->n_multi != 0) {
+		multi_query_reduce(bt, range, rsv, bval, keyd, cb, udata);
 		return;
 	}
 
+	if (range->desc) {
+		query_reduce_desc(bt, rsv, range->u.r.start, range->u.r.end, cb,
+				udata);
+		return;
+	}
+
+	query_reduce(bt, rsv, range->u.r.start, range->u.r.end, bval, keyd,
+			range->de_dup, NULL, cb, udata);
+}
+
+// Intersection - narrows sorted record handles to those with keys in this
+// sindex's range, in one partition. Pass NULL r_hs to start from all of them.
+// Handles of since-deleted records may linger - callers must re-check.
+uint64_t*
+as_sindex_tree_intersect(as_sindex* si, const as_query_range* range,
+		uint32_t pid, uint64_t* r_hs, uint32_t* n_r_hs)
+{
+	si_btree* bt = si->btrees[pid];
+
+	intersect_collect_cb_info ci = {
+			.arena = bt->arena,
+			.last = { .bval = range->u.r.start }
+	};
+
+	search_key end_skey = { .bval = range->u.r.end };
+
+	while (true) {
+		si_btree_reduce(bt, &ci.last, &end_skey, intersect_collect_cb, &ci);
+
+		if (ci.n_keys_reduced != MAX_QUERY_BURST) {
+			break;
+		}
+
+		ci.n_keys_reduced = 0;
+	}
+
+	uint32_t n_found = 0;
+
+	if (ci.n_r_hs != 0) {
+		qsort(ci.r_hs, ci.n_r_hs, sizeof(uint64_t), r_h_cmp);
+
+		// De-dup - non-default itypes may have several keys per record.
+		n_found = 1;
+
+		for (uint32_t i = 1; i < ci.n_r_hs; i++) {
+			if (ci.r_hs[i] != ci.r_hs[n_found - 1]) {
+				ci.r_hs[n_found++] = ci.r_hs[i];
+			}
+		}
+	}
+
+	if (r_hs == NULL) {
+		*n_r_hs = n_found;
+		return ci.r_hs;
+	}
+
+	uint32_t n_kept = 0;
+	uint32_t j = 0;
+
+	for (uint32_t i = 0; i < *n_r_hs && j < n_found; i++) {
+		while (j < n_found && ci.r_hs[j] < r_hs[i]) {
+			j++;
+		}
+
+		if (j < n_found && ci.r_hs[j] == r_hs[i]) {
+			r_hs[n_kept++] = r_hs[i];
+		}
+	}
+
+	if (ci.r_hs != NULL) {
+		cf_free(ci.r_hs);
+	}
+
+	*n_r_hs = n_kept;
+
+	return r_hs;
+}
+
+// Like as_sindex_tree_query(), for a plain range, but skips keys whose records
+// aren't among the (sorted) r_hs - before the records are locked or read.
+void
+as_sindex_tree_query_filtered(as_sindex* si, const as_query_range* range,
+		as_partition_reservation* rsv, int64_t bval, cf_digest* keyd,
+		const uint64_t* r_hs, uint32_t n_r_hs, as_sindex_reduce_fn cb,
+		void* udata)
+{
+	si_btree* bt = si->btrees[rsv->p->id];
+	rh_filter filter = { .r_hs = r_hs, .n_r_hs = n_r_hs };
+
 	query_reduce(bt, rsv, range->u.r.start, range->u.r.end, bval, keyd,
-			range->de_dup, cb, udata);
+			range->de_dup, &filter, cb, udata);
+}
+
+// Bulk build - the populate job collects a partition's keys, then sorts them
+// and builds the tree bottom-up rather than descending once per key. Writes to
+// the tree meanwhile are deferred to a side buffer.
+as_sindex_bulk*
+as_sindex_tree_bulk_start(as_sindex* si, uint32_t pid)
+{
+	si_btree* bt = si->btrees[pid];
+	as_sindex_bulk* bulk = cf_calloc(1, sizeof(as_sindex_bulk));
+
+	bulk->si = si;
+	bulk->bt = bt;
+
+	pthread_rwlock_wrlock(&bt->lock);
+
+	cf_assert(bt->side == NULL, AS_SINDEX, "tree %u already bulk building",
+			pid);
+
+	bt->side = cf_calloc(1, sizeof(si_btree_side));
+
+	pthread_rwlock_unlock(&bt->lock);
+
+	cf_mutex_lock(&si->bulk_lock);
+	si->n_bulk_building++;
+	cf_mutex_unlock(&si->bulk_lock);
+
+	return bulk;
+}
+
+// Called with the record locked.
+void
+as_sindex_tree_bulk_add(as_sindex_bulk* bulk, int64_t bval,
+		cf_arenax_handle r_h)
+{
+	if (bulk->n_eles == bulk->capacity) {
+		bulk->capacity = bulk->capacity == 0 ?
+				BULK_MIN_CAPACITY : bulk->capacity * 2;
+		bulk->eles = cf_realloc(bulk->eles, bulk->capacity * sizeof(bulk_ele));
+	}
+
+	as_index* r = cf_arenax_resolve(bulk->bt->arena, r_h);
+
+	bulk->eles[bulk->n_eles++] = (bulk_ele){
+			.ubval = bval_to_ubval(bulk->bt, bval),
+			.r_h = r_h,
+			.keyd = r->keyd,
+			.keyd_stub = get_keyd_stub(&r->keyd)
+	};
+}
+
+void
+as_sindex_tree_bulk_finish(as_sindex_bulk* bulk)
+{
+	si_btree* bt = bulk->bt;
+
+	bulk_sort(bulk);
+
+	pthread_rwlock_wrlock(&bt->lock);
+
+	si_btree_side* side = bt->side;
+
+	// A dropped sindex isn't garbage collected, so existing keys may refer to
+	// freed records - don't compare them, just let the tree go.
+	if (! bulk->si->dropped) {
+		if (bulk->n_eles != 0) {
+			uint64_t n_keys;
+			si_btree_key* keys = bulk_merge(bulk, &n_keys);
+
+			btree_destroy(bt, bt->root_h);
+
+			bt->n_nodes = 0;
+			bt->root_h = bulk_build(bt, keys, n_keys);
+			bt->n_keys = n_keys;
+
+			cf_free(keys);
+		}
+
+		for (uint32_t i = 0; i < side->n_ops; i++) {
+			side_op* op = &side->ops[i];
+
+			if (op->is_put) {
+				si_btree_put_lockfree(bt, &op->key);
+			}
+			else {
+				si_btree_delete_lockfree(bt, &op->key);
+			}
+		}
+	}
+
+	bt->side = NULL;
+
+	pthread_rwlock_unlock(&bt->lock);
+
+	as_sindex* si = bulk->si;
+
+	cf_mutex_lock(&si->bulk_lock);
+	si->n_bulk_building--;
+	cf_condition_signal(&si->bulk_done); // only waiter is the ns GC thread
+	cf_mutex_unlock(&si->bulk_lock);
+
+	if (side->ops != NULL) {
+		cf_free(side->ops);
+	}
+
+	cf_free(side);
+
+	if (bulk->eles != NULL) {
+		cf_free(bulk->eles);
+	}
+
+	cf_free(bulk);
 }
 
 void
@@ -467,11 +908,17 @@ as_sindex_tree_collect_cardinality(as_sindex* si)
 	hyperloglog* rec_hll = si->itype == AS_SINDEX_ITYPE_DEFAULT ?
 			NULL : cf_calloc(1, sizeof(hyperloglog));
 
+	// Only integer and ordered string bvals are ordered like the values they
+	// represent.
+	int64_t* samples = (si->ktype == AS_PARTICLE_TYPE_INTEGER &&
+			! as_sindex_is_composite(si)) || si->ordered ?
+					cf_malloc(HIST_N_SAMPLES * sizeof(int64_t)) : NULL;
+
 	for (uint32_t ix = 0; ix < si->n_btrees; ix++) {
 		si_btree* bt = si->btrees[ix];
 
 		if (bt->n_keys != 0) {
-			cardinality_reduce(si, bt, &n_keys, &bval_hll, rec_hll);
+			cardinality_reduce(si, bt, &n_keys, &bval_hll, rec_hll, samples);
 
 			usleep(100);
 		}
@@ -491,6 +938,71 @@ as_sindex_tree_collect_cardinality(as_sindex* si)
 	else {
 		si->keys_per_rec = n_keys == 0 ? 0 : 1;
 	}
+
+	as_namespace* ns = si->ns;
+	as_set* p_set = as_namespace_get_set_by_id(ns, si->set_id);
+
+	si->hist_n_scan_objects = p_set != NULL && p_set->index_enabled ?
+			p_set->n_objects : ns->n_objects;
+	si->hist_n_keys = n_keys;
+
+	if (samples != NULL) {
+		hist_build(si, samples, n_keys);
+		cf_free(samples);
+	}
+}
+
+// Estimates how many keys have bvals in [start, end]. Equality uses the
+// average keys per bval, ranges interpolate linearly within histogram buckets.
+// Returns UINT64_MAX if there's nothing to go on.
+uint64_t
+as_sindex_tree_estimate_keys(const as_sindex* si, int64_t start, int64_t end)
+{
+	if (start == end) {
+		return si->keys_per_bval == 0 ? UINT64_MAX : si->keys_per_bval;
+	}
+
+	uint32_t n_bounds = si->n_hist_bounds;
+
+	if (n_bounds == 0) {
+		return UINT64_MAX;
+	}
+
+	const int64_t* bounds = si->hist_bounds;
+	uint32_t n_buckets = n_bounds - 1;
+	double n_covered = 0;
+
+	for (uint32_t i = 0; i < n_buckets; i++) {
+		int64_t lo = bounds[i];
+		int64_t hi = bounds[i + 1];
+
+		if (end < lo || start > hi) {
+			continue;
+		}
+
+		if (lo == hi || (start <= lo && end >= hi)) {
+			n_covered += 1.0;
+			continue;
+		}
+
+		// Doubles - the span may not fit in an int64_t.
+		double from = start > lo ? (double)start : (double)lo;
+		double to = end < hi ? (double)end : (double)hi;
+
+		n_covered += (to - from + 1) / ((double)hi - (double)lo + 1);
+	}
+
+	return (uint64_t)(n_covered * (double)si->hist_n_keys / n_buckets);
+}
+
+// Visits every key of one physical tree in order, under the tree's read lock.
+void
+as_sindex_tree_visit(as_sindex* si, uint32_t pid, as_sindex_visit_fn cb,
+		void* udata)
+{
+	visit_cb_info ci = { .cb = cb, .udata = udata };
+
+	si_btree_reduce(si->btrees[pid], NULL, NULL, visit_cb, &ci);
 }
 
 
@@ -516,6 +1028,14 @@ gc_reduce_and_delete(as_sindex* si, si_btree* bt)
 	};
 
 	while (! si->dropped) {
+		// A bulk build may hold (or have deferred deletes of) keys referring
+		// to records about to be freed - let it finish first.
+		wait_for_bulk(si, bt);
+
+		if (si->dropped) {
+			return;
+		}
+
 		search_key* last = first ? NULL : &ci.last;
 
 		si_btree_reduce(bt, last, NULL, gc_collect_cb, &ci);
@@ -526,6 +1046,8 @@ gc_reduce_and_delete(as_sindex* si, si_btree* bt)
 			si_btree_delete(bt, &keys[i]);
 		}
 
+		wait_for_bulk(si, bt);
+
 		si->n_gc_cleaned += ci.n_keys;
 		ns->n_sindex_gc_cleaned += ci.n_keys;
 
@@ -568,11 +1090,24 @@ gc_collect_cb(const si_btree_key* key, void* udata)
 static void
 query_reduce(si_btree* bt, as_partition_reservation* rsv, int64_t start_bval,
 		int64_t end_bval, int64_t resume_bval, cf_digest* keyd, bool de_dup,
-		as_sindex_reduce_fn cb, void* udata)
+		const rh_filter* filter, as_sindex_reduce_fn cb, void* udata)
 {
 	as_namespace* ns = rsv->ns;
 
 	if (ns->xmem_type == CF_XMEM_TYPE_FLASH) {
+		if (filter != NULL) {
+			filter_cb_info fi = {
+					.ns = ns,
+					.filter = filter,
+					.cb = cb,
+					.udata = udata
+			};
+
+			query_reduce_no_rc(bt, rsv, start_bval, end_bval, resume_bval,
+					keyd, de_dup, filter_reduce_cb, &fi);
+			return;
+		}
+
 		query_reduce_no_rc(bt, rsv, start_bval, end_bval, resume_bval, keyd,
 				de_dup, cb, udata);
 		return;
@@ -585,169 +1120,719 @@ query_reduce(si_btree* bt, as_partition_reservation* rsv, int64_t start_bval,
 			.tree = rsv->tree,
 			.keys = keys,
 			.de_dup = de_dup,
+			.filter = filter,
 			.last = { .bval = start_bval }
 	};
 
-	if (keyd != NULL && (bt->unsigned_bvals ?
-			(uint64_t)resume_bval >= (uint64_t)start_bval :
-			resume_bval >= start_bval)) {
-		ci.last = (search_key){
-				.bval = resume_bval,
-				.has_digest = true,
-				.keyd_stub = get_keyd_stub(keyd),
-				.keyd = *keyd
-		};
+	if (keyd != NULL && (bt->unsigned_bvals ?
+			(uint64_t)resume_bval >= (uint64_t)start_bval :
+			resume_bval >= start_bval)) {
+		ci.last = (search_key){
+				.bval = resume_bval,
+				.has_digest = true,
+				.keyd_stub = get_keyd_stub(keyd),
+				.keyd = *keyd
+		};
+	}
+
+	if (bt->unsigned_bvals ?
+			(uint64_t)ci.last.bval > (uint64_t)end_bval :
+			ci.last.bval > end_bval) {
+		return;
+	}
+
+	search_key end_skey = { .bval = end_bval };
+
+	while (true) {
+		si_btree_reduce(bt, &ci.last, &end_skey, query_collect_cb, &ci);
+
+		if (! query_burst(bt, rsv, &ci, cb, udata)) {
+			return; // user callback stopped query
+		}
+
+		if (ci.n_keys_reduced != MAX_QUERY_BURST) {
+			return; // done with this physical tree
+		}
+
+		ci.n_keys_reduced = 0;
+		ci.n_keys = 0;
+	}
+}
+
+// Like query_reduce() for a plain range, but from end_bval down to start_bval.
+// Only ordered (top-K) queries walk down - they don't resume, and are never on
+// non-default itypes, so there's no resume key or de-dup.
+static void
+query_reduce_desc(si_btree* bt, as_partition_reservation* rsv,
+		int64_t start_bval, int64_t end_bval, as_sindex_reduce_fn cb,
+		void* udata)
+{
+	if (bval_lt(bt, end_bval, start_bval)) {
+		return;
+	}
+
+	si_btree_key keys[MAX_QUERY_BURST];
+
+	query_collect_cb_info ci = {
+			.arena = bt->arena,
+			.tree = rsv->tree,
+			.keys = keys,
+			.last = { .bval = end_bval } // no digest - includes end_bval
+	};
+
+	search_key end_skey = { .bval = start_bval };
+
+	while (true) {
+		si_btree_reduce_rev(bt, &ci.last, &end_skey, query_collect_cb, &ci);
+
+		if (! query_burst(bt, rsv, &ci, cb, udata)) {
+			return; // user callback stopped query
+		}
+
+		if (ci.n_keys_reduced != MAX_QUERY_BURST) {
+			return; // done with this physical tree
+		}
+
+		ci.n_keys_reduced = 0;
+		ci.n_keys = 0;
+	}
+}
+
+// Returns false if the callback stopped the query.
+static bool
+query_burst(si_btree* bt, as_partition_reservation* rsv,
+		const query_collect_cb_info* ci, as_sindex_reduce_fn cb, void* udata)
+{
+	as_namespace* ns = rsv->ns;
+	bool do_more = true;
+
+	for (uint32_t i = 0; i < ci->n_keys; i++) {
+		const si_btree_key* key = &ci->keys[i];
+
+		as_record* r = cf_arenax_resolve(bt->arena, key->r_h);
+		as_index_ref r_ref = {
+				.r = r,
+				.r_h = key->r_h,
+				.olock = as_index_olock_from_keyd(rsv->tree, &r->keyd)
+		};
+
+		cf_mutex_lock(r_ref.olock);
+
+		as_index_release(r);
+
+		if (! as_index_is_valid_record(r)) {
+			as_record_done(&r_ref, ns);
+			continue;
+		}
+
+		if (do_more) {
+			// Callback MUST call as_record_done() to unlock record.
+			do_more = cb(&r_ref, key->bval, udata);
+		}
+		else {
+			cf_mutex_unlock(r_ref.olock);
+		}
+	}
+
+	return do_more;
+}
+
+static bool
+query_collect_cb(const si_btree_key* key, void* udata)
+{
+	query_collect_cb_info* ci = (query_collect_cb_info*)udata;
+	as_index_tree* tree = ci->tree;
+
+	as_index* r = cf_arenax_resolve(ci->arena, key->r_h);
+
+	if ((ci->filter == NULL || filter_has(ci->filter, key->r_h)) &&
+			r->tree_id == tree->id && r->generation != 0 && (r->rc == 1 ||
+			! (ci->de_dup && find_r_h(key->r_h, ci->keys, ci->n_keys)))) {
+		cf_mutex* rlock = as_index_rlock_from_keyd(tree, &r->keyd);
+
+		cf_mutex_lock(rlock);
+
+		if (r->generation != 0) {
+			as_index_reserve(r);
+			ci->keys[ci->n_keys++] = *key;
+		}
+
+		cf_mutex_unlock(rlock);
+	}
+
+	if (++ci->n_keys_reduced == MAX_QUERY_BURST) {
+		ci->last = (search_key){
+				.bval = key->bval,
+				.has_digest = true,
+				.keyd_stub = get_keyd_stub(&r->keyd),
+				.keyd = r->keyd
+		};
+
+		return false; // stops si_btree_reduce()
+	}
+
+	return true;
+}
+
+static bool
+filter_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
+{
+	filter_cb_info* fi = (filter_cb_info*)udata;
+
+	if (! filter_has(fi->filter, r_ref->r_h)) {
+		as_record_done(r_ref, fi->ns);
+		return true;
+	}
+
+	return fi->cb(r_ref, bval, fi->udata);
+}
+
+static bool
+filter_has(const rh_filter* filter, uint64_t r_h)
+{
+	return bsearch(&r_h, filter->r_hs, filter->n_r_hs, sizeof(uint64_t),
+			r_h_cmp) != NULL;
+}
+
+static bool
+intersect_collect_cb(const si_btree_key* key, void* udata)
+{
+	intersect_collect_cb_info* ci = (intersect_collect_cb_info*)udata;
+
+	if (ci->n_r_hs == ci->capacity) {
+		ci->capacity = ci->capacity == 0 ? MAX_QUERY_BURST : ci->capacity * 2;
+		ci->r_hs = cf_realloc(ci->r_hs, ci->capacity * sizeof(uint64_t));
+	}
+
+	ci->r_hs[ci->n_r_hs++] = key->r_h;
+
+	if (++ci->n_keys_reduced == MAX_QUERY_BURST) {
+		as_index* r = cf_arenax_resolve(ci->arena, key->r_h);
+
+		ci->last = (search_key){
+				.bval = key->bval,
+				.has_digest = true,
+				.keyd_stub = get_keyd_stub(&r->keyd),
+				.keyd = r->keyd
+		};
+
+		return false; // stops si_btree_reduce()
+	}
+
+	return true;
+}
+
+static int
+r_h_cmp(const void* pa, const void* pb)
+{
+	uint64_t a = *(const uint64_t*)pa;
+	uint64_t b = *(const uint64_t*)pb;
+
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+// Entries are sorted and (integers) disjoint, so together they traverse the
+// tree once, in order - a resumed query skips the entries it's past.
+static void
+multi_query_reduce(si_btree* bt, const as_query_range* range,
+		as_partition_reservation* rsv, int64_t resume_bval, cf_digest* keyd,
+		as_sindex_reduce_fn cb, void* udata)
+{
+	rh_set seen = { 0 };
+
+	multi_cb_info mi = {
+			.ns = rsv->ns,
+			.cb = cb,
+			.udata = udata,
+			.seen = range->de_dup ? &seen : NULL
+	};
+
+	for (uint32_t i = 0; i < range->n_multi && ! mi.stopped; i++) {
+		const as_query_range_start_end* r = &range->multi[i].u.r;
+
+		// Strings with colliding hashes share a bval - traverse it once.
+		if (i != 0 && r->start == range->multi[i - 1].u.r.start) {
+			continue;
+		}
+
+		if (keyd != NULL && resume_bval > r->end) {
+			continue;
+		}
+
+		query_reduce(bt, rsv, r->start, r->end, resume_bval, keyd,
+				range->de_dup, NULL, multi_reduce_cb, &mi);
+	}
+
+	if (seen.slots != NULL) {
+		cf_free(seen.slots);
+	}
+}
+
+static bool
+multi_reduce_cb(as_index_ref* r_ref, int64_t bval, void* udata)
+{
+	multi_cb_info* mi = (multi_cb_info*)udata;
+
+	if (mi->seen != NULL && ! rh_set_add(mi->seen, r_ref->r_h)) {
+		as_record_done(r_ref, mi->ns);
+		return true;
+	}
+
+	if (! mi->cb(r_ref, bval, mi->udata)) {
+		mi->stopped = true;
+		return false;
+	}
+
+	return true;
+}
+
+// Returns false if already in the set.
+static bool
+rh_set_add(rh_set* set, cf_arenax_handle r_h)
+{
+	if ((set->n_used + 1) * 2 > set->capacity) {
+		uint32_t old_capacity = set->capacity;
+		uint64_t* old_slots = set->slots;
+
+		set->capacity = old_capacity == 0 ?
+				RH_SET_MIN_CAPACITY : old_capacity * 2;
+		set->slots = cf_calloc(set->capacity, sizeof(uint64_t));
+		set->n_used = 0;
+
+		for (uint32_t i = 0; i < old_capacity; i++) {
+			if (old_slots[i] != 0) {
+				rh_set_add(set, old_slots[i] - 1);
+			}
+		}
+
+		if (old_slots != NULL) {
+			cf_free(old_slots);
+		}
+	}
+
+	uint64_t v = r_h + 1;
+	uint32_t mask = set->capacity - 1;
+	uint32_t i = (uint32_t)((v * 0x9E3779B97F4A7C15UL) >> 32) & mask;
+
+	while (set->slots[i] != 0) {
+		if (set->slots[i] == v) {
+			return false;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	set->slots[i] = v;
+	set->n_used++;
+
+	return true;
+}
+
+static void
+cardinality_reduce(as_sindex* si, si_btree* bt, uint64_t* n_keys,
+		hyperloglog* bval_hll, hyperloglog* rec_hll, int64_t* samples)
+{
+	as_namespace* ns = si->ns;
+
+	bool first = true;
+
+	cardinality_collect_cb_info ci = {
+			.ns = ns,
+			.n_keys = n_keys,
+			.bval_hll = bval_hll,
+			.rec_hll = rec_hll,
+			.samples = samples
+	};
+
+	while (! si->dropped) {
+		search_key* last = first ? NULL : &ci.last;
+
+		si_btree_reduce(bt, last, NULL, cardinality_collect_cb, &ci);
+
+		first = false;
+
+		if (ci.n_keys_reduced != MAX_CARDINALITY_BURST) {
+			return; // done with this physical tree
+		}
+
+		ci.n_keys_reduced = 0;
+	}
+}
+
+static bool
+cardinality_collect_cb(const si_btree_key* key, void* udata)
+{
+	cardinality_collect_cb_info* ci = (cardinality_collect_cb_info*)udata;
+	as_namespace* ns = ci->ns;
+
+	uint64_t n_keys = ++(*ci->n_keys);
+
+	hll_add(ci->bval_hll, (const uint8_t*)&key->bval, sizeof(key->bval));
+
+	if (ci->samples != NULL) {
+		// Reservoir sampling - every key equally likely to be kept.
+		uint64_t ix = n_keys <= HIST_N_SAMPLES ?
+				n_keys - 1 : cf_get_rand64() % n_keys;
+
+		if (ix < HIST_N_SAMPLES) {
+			ci->samples[ix] = key->bval;
+		}
+	}
+
+	if (ci->rec_hll != NULL) {
+		uint64_t h = key->r_h;
+
+		// TODO - worth it to "swap" to LE and use 5 bytes?
+		hll_add(ci->rec_hll, (const uint8_t*)&h, sizeof(h));
+	}
+
+	if (++ci->n_keys_reduced == MAX_CARDINALITY_BURST) {
+		as_index* r = cf_arenax_resolve(ns->arena, key->r_h);
+
+		ci->last.bval = key->bval;
+		ci->last.has_digest = true;
+		ci->last.keyd_stub = get_keyd_stub(&r->keyd);
+		ci->last.keyd = r->keyd;
+
+		return false; // stops si_btree_reduce()
+	}
+
+	return true;
+}
+
+static void
+hist_build(as_sindex* si, int64_t* samples, uint64_t n_keys)
+{
+	uint32_t n_samples = n_keys < HIST_N_SAMPLES ?
+			(uint32_t)n_keys : HIST_N_SAMPLES;
+
+	if (n_samples == 0) {
+		si->n_hist_bounds = 0;
+		return;
+	}
+
+	qsort(samples, n_samples, sizeof(int64_t), sample_cmp);
+
+	// Queries may read the bounds meanwhile - at worst a skewed estimate.
+	for (uint32_t i = 0; i < SI_HIST_N_BOUNDS; i++) {
+		si->hist_bounds[i] = samples[(uint64_t)i * (n_samples - 1) /
+				SI_HIST_N_BUCKETS];
+	}
+
+	si->n_hist_bounds = SI_HIST_N_BOUNDS;
+}
+
+static int
+sample_cmp(const void* pa, const void* pb)
+{
+	int64_t a = *(const int64_t*)pa;
+	int64_t b = *(const int64_t*)pb;
+
+	return a > b ? 1 : (a < b ? -1 : 0);
+}
+
+static bool
+visit_cb(const si_btree_key* key, void* udata)
+{
+	visit_cb_info* ci = (visit_cb_info*)udata;
+
+	ci->cb(key->bval, key->r_h, ci->udata);
+
+	return true;
+}
+
+static bool
+gc_bulk_in_progress(si_btree* bt)
+{
+	pthread_rwlock_rdlock(&bt->lock);
+
+	bool in_progress = bt->side != NULL;
+
+	pthread_rwlock_unlock(&bt->lock);
+
+	return in_progress;
+}
+
+static void
+wait_for_bulk(as_sindex* si, si_btree* bt)
+{
+	cf_mutex_lock(&si->bulk_lock);
+
+	while (! si->dropped && gc_bulk_in_progress(bt)) {
+		cf_condition_wait(&si->bulk_done, &si->bulk_lock);
+	}
+
+	cf_mutex_unlock(&si->bulk_lock);
+}
+
+
+//==========================================================
+// Local helpers - bulk build.
+//
+
+// LSD radix sort on (bval, stub), then digest order within equal runs. Passes
+// in which every element falls in the same bucket are skipped - the common
+// case for the high bytes of small integers.
+static void
+bulk_sort(as_sindex_bulk* bulk)
+{
+	uint64_t n_eles = bulk->n_eles;
+
+	if (n_eles < 2) {
+		return;
+	}
+
+	bulk_ele* src = bulk->eles;
+	bulk_ele* dst = cf_malloc(n_eles * sizeof(bulk_ele));
+
+	// Least significant first - the stub, then bval from its lowest byte up.
+	for (uint32_t pass = 0; pass < 1 + sizeof(uint64_t); pass++) {
+		if (bulk_radix_pass(src, dst, n_eles, pass)) {
+			bulk_ele* temp = src;
+
+			src = dst;
+			dst = temp;
+		}
+	}
+
+	if (src != bulk->eles) {
+		memcpy(bulk->eles, src, n_eles * sizeof(bulk_ele));
+		cf_free(src);
+	}
+	else {
+		cf_free(dst);
+	}
+
+	bulk_ele* eles = bulk->eles;
+	uint64_t run_start = 0;
+
+	for (uint64_t i = 1; i <= n_eles; i++) {
+		if (i == n_eles || eles[i].ubval != eles[run_start].ubval ||
+				eles[i].keyd_stub != eles[run_start].keyd_stub) {
+			if (i - run_start > 1) {
+				qsort(&eles[run_start], i - run_start, sizeof(bulk_ele),
+						bulk_keyd_cmp);
+			}
+
+			run_start = i;
+		}
+	}
+
+	// Drop duplicates - e.g. a list holding the same value twice.
+
+	uint64_t n_unique = 1;
+
+	for (uint64_t i = 1; i < n_eles; i++) {
+		if (eles[i].ubval != eles[n_unique - 1].ubval ||
+				eles[i].keyd_stub != eles[n_unique - 1].keyd_stub ||
+				cf_digest_compare(&eles[i].keyd, &eles[n_unique - 1].keyd) != 0) {
+			eles[n_unique++] = eles[i];
+		}
+	}
+
+	bulk->n_eles = n_unique;
+}
+
+// Returns false if the pass was skipped, leaving src as is.
+static bool
+bulk_radix_pass(const bulk_ele* src, bulk_ele* dst, uint64_t n_eles,
+		uint32_t pass)
+{
+	uint64_t counts[256] = { 0 };
+
+	for (uint64_t i = 0; i < n_eles; i++) {
+		counts[radix_byte(&src[i], pass)]++;
+	}
+
+	uint64_t offset = 0;
+
+	for (uint32_t b = 0; b < 256; b++) {
+		if (counts[b] == n_eles) {
+			return false;
+		}
+
+		uint64_t count = counts[b];
+
+		counts[b] = offset;
+		offset += count;
 	}
 
-	if (bt->unsigned_bvals ?
-			(uint64_t)ci.last.bval > (uint64_t)end_bval :
-			ci.last.bval > end_bval) {
-		return;
+	for (uint64_t i = 0; i < n_eles; i++) {
+		dst[counts[radix_byte(&src[i], pass)]++] = src[i];
 	}
 
-	search_key end_skey = { .bval = end_bval };
+	return true;
+}
 
-	while (true) {
-		si_btree_reduce(bt, &ci.last, &end_skey, query_collect_cb, &ci);
+static int
+bulk_keyd_cmp(const void* pa, const void* pb)
+{
+	const bulk_ele* a = (const bulk_ele*)pa;
+	const bulk_ele* b = (const bulk_ele*)pb;
 
-		bool do_more = true;
+	return cf_digest_compare(&a->keyd, &b->keyd);
+}
 
-		for (uint32_t i = 0; i < ci.n_keys; i++) {
-			si_btree_key* key = &keys[i];
+// Called under the tree's write lock. Merges keys already in the tree (put
+// before the build started) with the sorted bulk keys - where both have a key,
+// the bulk one wins, as it would for a put.
+static si_btree_key*
+bulk_merge(as_sindex_bulk* bulk, uint64_t* n_keys)
+{
+	si_btree* bt = bulk->bt;
 
-			as_record* r = cf_arenax_resolve(bt->arena, key->r_h);
-			as_index_ref r_ref = {
-					.r = r,
-					.r_h = key->r_h,
-					.olock = as_index_olock_from_keyd(rsv->tree, &r->keyd)
-			};
+	bulk_collect_cb_info ci = {
+			.keys = cf_malloc((bt->n_keys + 1) * sizeof(si_btree_key))
+	};
 
-			cf_mutex_lock(r_ref.olock);
+	btree_reduce(bt, SI_RESOLVE(bt->root_h), NULL, NULL, bulk_collect_cb, &ci);
 
-			as_index_release(r);
+	si_btree_key* keys = cf_malloc((ci.n_keys + bulk->n_eles + 1) *
+			sizeof(si_btree_key));
 
-			if (! as_index_is_valid_record(r)) {
-				as_record_done(&r_ref, ns);
-				continue;
-			}
+	uint64_t i_old = 0;
+	uint64_t i_bulk = 0;
+	uint64_t n = 0;
 
-			if (do_more) {
-				// Callback MUST call as_record_done() to unlock record.
-				do_more = cb(&r_ref, key->bval, udata);
-			}
-			else {
-				cf_mutex_unlock(r_ref.olock);
-			}
+	while (i_old < ci.n_keys || i_bulk < bulk->n_eles) {
+		if (i_bulk == bulk->n_eles) {
+			keys[n++] = ci.keys[i_old++];
+			continue;
 		}
 
-		if (! do_more) {
-			return; // user callback stopped query
+		bulk_ele* ele = &bulk->eles[i_bulk];
+		si_btree_key key = {
+				.bval = ubval_to_bval(bt, ele->ubval),
+				.keyd_stub = ele->keyd_stub,
+				.r_h = ele->r_h
+		};
+
+		int32_t cmp = i_old == ci.n_keys ?
+				1 : key_cmp(bt, &ci.keys[i_old], &key);
+
+		if (cmp < 0) {
+			keys[n++] = ci.keys[i_old++];
+			continue;
 		}
 
-		if (ci.n_keys_reduced != MAX_QUERY_BURST) {
-			return; // done with this physical tree
+		if (cmp == 0) {
+			i_old++;
 		}
 
-		ci.n_keys_reduced = 0;
-		ci.n_keys = 0;
+		keys[n++] = key;
+		i_bulk++;
 	}
+
+	cf_free(ci.keys);
+
+	*n_keys = n;
+
+	return keys;
 }
 
 static bool
-query_collect_cb(const si_btree_key* key, void* udata)
+bulk_collect_cb(const si_btree_key* key, void* udata)
 {
-	query_collect_cb_info* ci = (query_collect_cb_info*)udata;
-	as_index_tree* tree = ci->tree;
+	bulk_collect_cb_info* ci = (bulk_collect_cb_info*)udata;
 
-	as_index* r = cf_arenax_resolve(ci->arena, key->r_h);
+	ci->keys[ci->n_keys++] = *key;
 
-	if (r->tree_id == tree->id && r->generation != 0 && (r->rc == 1 ||
-			! (ci->de_dup && find_r_h(key->r_h, ci->keys, ci->n_keys)))) {
-		cf_mutex* rlock = as_index_rlock_from_keyd(tree, &r->keyd);
+	return true;
+}
 
-		cf_mutex_lock(rlock);
+// Fills leaves evenly, one separator key between neighbours, then builds each
+// inner level the same way from the level below. Node counts are the minimum
+// that fit, which keeps every non-root node at or above min degree.
+static si_arena_handle
+bulk_build(si_btree* bt, si_btree_key* keys, uint64_t n_keys)
+{
+	uint64_t max_leaf_keys = bt->leaf_order - 1;
 
-		if (r->generation != 0) {
-			as_index_reserve(r);
-			ci->keys[ci->n_keys++] = *key;
-		}
+	if (n_keys <= max_leaf_keys) {
+		si_arena_handle root_h = create_node(bt, true);
+		si_btree_node* root = SI_RESOLVE(root_h);
 
-		cf_mutex_unlock(rlock);
-	}
+		memcpy(mut_key(bt, root, 0), keys, n_keys * sizeof(si_btree_key));
+		root->n_keys = (uint16_t)n_keys;
 
-	if (++ci->n_keys_reduced == MAX_QUERY_BURST) {
-		ci->last = (search_key){
-				.bval = key->bval,
-				.has_digest = true,
-				.keyd_stub = get_keyd_stub(&r->keyd),
-				.keyd = r->keyd
-		};
+		bt->n_nodes++;
 
-		return false; // stops si_btree_reduce()
+		return root_h;
 	}
 
-	return true;
-}
+	uint64_t n_nodes = (n_keys + 1 + max_leaf_keys) / (max_leaf_keys + 1);
+	si_arena_handle* handles = cf_malloc(n_nodes * sizeof(si_arena_handle));
 
-static void
-cardinality_reduce(as_sindex* si, si_btree* bt, uint64_t* n_keys,
-		hyperloglog* bval_hll, hyperloglog* rec_hll)
-{
-	as_namespace* ns = si->ns;
+	// Separators are compacted to the front of keys as they're consumed.
+	uint64_t n_in_leaves = n_keys - (n_nodes - 1);
+	uint64_t k = 0;
 
-	bool first = true;
+	for (uint64_t i = 0; i < n_nodes; i++) {
+		uint64_t n = share(n_in_leaves, n_nodes, i);
+		si_arena_handle leaf_h = create_node(bt, true);
+		si_btree_node* leaf = SI_RESOLVE(leaf_h);
 
-	cardinality_collect_cb_info ci = {
-			.ns = ns,
-			.n_keys = n_keys,
-			.bval_hll = bval_hll,
-			.rec_hll = rec_hll
-	};
+		memcpy(mut_key(bt, leaf, 0), &keys[k], n * sizeof(si_btree_key));
+		leaf->n_keys = (uint16_t)n;
+		k += n;
 
-	while (! si->dropped) {
-		search_key* last = first ? NULL : &ci.last;
+		if (i < n_nodes - 1) {
+			keys[i] = keys[k++];
+		}
 
-		si_btree_reduce(bt, last, NULL, cardinality_collect_cb, &ci);
+		handles[i] = leaf_h;
+	}
 
-		first = false;
+	bt->n_nodes += n_nodes;
 
-		if (ci.n_keys_reduced != MAX_CARDINALITY_BURST) {
-			return; // done with this physical tree
-		}
+	while (n_nodes > 1) {
+		uint64_t n_parents = (n_nodes + bt->inner_order - 1) / bt->inner_order;
+		uint64_t c = 0;
 
-		ci.n_keys_reduced = 0;
-	}
-}
+		for (uint64_t p = 0; p < n_parents; p++) {
+			uint64_t n_children = share(n_nodes, n_parents, p);
+			si_arena_handle node_h = create_node(bt, false);
+			si_btree_node* node = SI_RESOLVE(node_h);
 
-static bool
-cardinality_collect_cb(const si_btree_key* key, void* udata)
-{
-	cardinality_collect_cb_info* ci = (cardinality_collect_cb_info*)udata;
-	as_namespace* ns = ci->ns;
+			for (uint32_t j = 0; j < n_children; j++) {
+				set_child(bt, node, j, handles[c + j]);
+
+				if (j < n_children - 1) {
+					set_key(bt, node, j, &keys[c + j]);
+				}
+			}
 
-	(*ci->n_keys)++;
+			node->n_keys = (uint16_t)(n_children - 1);
+			c += n_children;
 
-	hll_add(ci->bval_hll, (const uint8_t*)&key->bval, sizeof(key->bval));
+			if (p < n_parents - 1) {
+				keys[p] = keys[c - 1];
+			}
 
-	if (ci->rec_hll != NULL) {
-		uint64_t h = key->r_h;
+			handles[p] = node_h;
+		}
 
-		// TODO - worth it to "swap" to LE and use 5 bytes?
-		hll_add(ci->rec_hll, (const uint8_t*)&h, sizeof(h));
+		bt->n_nodes += n_parents;
+		n_nodes = n_parents;
 	}
 
-	if (++ci->n_keys_reduced == MAX_CARDINALITY_BURST) {
-		as_index* r = cf_arenax_resolve(ns->arena, key->r_h);
+	si_arena_handle root_h = handles[0];
 
-		ci->last.bval = key->bval;
-		ci->last.has_digest = true;
-		ci->last.keyd_stub = get_keyd_stub(&r->keyd);
-		ci->last.keyd = r->keyd;
+	cf_free(handles);
 
-		return false; // stops si_btree_reduce()
+	return root_h;
+}
+
+static void
+side_append(si_btree_side* side, const si_btree_key* key, bool is_put)
+{
+	if (side->n_ops == side->capacity) {
+		side->capacity = side->capacity == 0 ?
+				SIDE_MIN_CAPACITY : side->capacity * 2;
+		side->ops = cf_realloc(side->ops, side->capacity * sizeof(side_op));
 	}
 
-	return true;
+	side->ops[side->n_ops++] = (side_op){ .key = *key, .is_put = is_put };
 }
 
 
@@ -810,6 +1895,41 @@ si_btree_put(si_btree* bt, const si_btree_key* key)
 {
 	pthread_rwlock_wrlock(&bt->lock);
 
+	if (bt->side != NULL) {
+		side_append(bt->side, key, true);
+		pthread_rwlock_unlock(&bt->lock);
+		return true;
+	}
+
+	bool added = si_btree_put_lockfree(bt, key);
+
+	pthread_rwlock_unlock(&bt->lock);
+	return added;
+}
+
+// Accessed from enterprise split.
+bool
+si_btree_delete(si_btree* bt, const si_btree_key* key)
+{
+	pthread_rwlock_wrlock(&bt->lock);
+
+	// Deferred - not known to have found the key.
+	if (bt->side != NULL) {
+		side_append(bt->side, key, false);
+		pthread_rwlock_unlock(&bt->lock);
+		return false;
+	}
+
+	bool found = si_btree_delete_lockfree(bt, key);
+
+	pthread_rwlock_unlock(&bt->lock);
+	return found;
+}
+
+// Called under the tree's write lock.
+static bool
+si_btree_put_lockfree(si_btree* bt, const si_btree_key* key)
+{
 	si_btree_node* root = SI_RESOLVE(bt->root_h);
 
 	if (root->n_keys == root->max_degree - 1) {
@@ -826,22 +1946,18 @@ si_btree_put(si_btree* bt, const si_btree_key* key)
 	}
 
 	if (! btree_put(bt, root, key)) {
-		pthread_rwlock_unlock(&bt->lock);
 		return false;
 	}
 
 	bt->n_keys++;
 
-	pthread_rwlock_unlock(&bt->lock);
 	return true;
 }
 
-// Accessed from enterprise split.
-bool
-si_btree_delete(si_btree* bt, const si_btree_key* key)
+// Called under the tree's write lock.
+static bool
+si_btree_delete_lockfree(si_btree* bt, const si_btree_key* key)
 {
-	pthread_rwlock_wrlock(&bt->lock);
-
 	si_btree_node* root = SI_RESOLVE(bt->root_h);
 	bool found = btree_delete(bt, root, KEY_MODE_MATCH, key, NULL);
 
@@ -859,7 +1975,6 @@ si_btree_delete(si_btree* bt, const si_btree_key* key)
 		bt->n_nodes--;
 	}
 
-	pthread_rwlock_unlock(&bt->lock);
 	return found;
 }
 
@@ -875,6 +1990,18 @@ si_btree_reduce(si_btree* bt, const search_key* start_skey,
 	pthread_rwlock_unlock(&bt->lock);
 }
 
+static void
+si_btree_reduce_rev(si_btree* bt, const search_key* start_skey,
+		const search_key* end_skey, si_btree_reduce_fn cb, void* udata)
+{
+	pthread_rwlock_rdlock(&bt->lock);
+
+	btree_reduce_rev(bt, SI_RESOLVE(bt->root_h), start_skey, end_skey, cb,
+			udata);
+
+	pthread_rwlock_unlock(&bt->lock);
+}
+
 
 //==========================================================
 // Local helpers - lowest btree layer.
@@ -1056,6 +2183,56 @@ btree_reduce(si_btree* bt, si_btree_node* node, const search_key* start_skey,
 	return true;
 }
 
+// Mirror of btree_reduce(), from high keys to low - the start key is the upper
+// bound, and the end key's bval the lower.
+static bool
+btree_reduce_rev(si_btree* bt, si_btree_node* node,
+		const search_key* start_skey, const search_key* end_skey,
+		si_btree_reduce_fn cb, void* udata)
+{
+	uint32_t i = node->n_keys; // keys below i are candidates
+
+	if (start_skey != NULL) {
+		bool equal;
+
+		i = rev_bound(bt, node, start_skey, &equal);
+
+		if (equal) {
+			// Child i is all below the key equal to the (exclusive) start key.
+			start_skey = NULL;
+		}
+	}
+
+	const si_arena_handle* children = node->leaf == 0 ?
+			const_children(bt, node) : NULL;
+
+	if (children != NULL &&
+			! btree_reduce_rev(bt, SI_RESOLVE(children[i]), start_skey,
+					end_skey, cb, udata)) {
+		return false;
+	}
+
+	while (i-- != 0) {
+		const si_btree_key* key_cb = const_key(bt, node, i);
+
+		if (end_skey != NULL && end_skey_cmp(bt, end_skey, key_cb) > 0) {
+			return false;
+		}
+
+		if (! cb(key_cb, udata)) {
+			return false;
+		}
+
+		if (children != NULL &&
+				! btree_reduce_rev(bt, SI_RESOLVE(children[i]), NULL,
+						end_skey, cb, udata)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static bool
 delete_case_1(si_btree* bt, si_btree_node* node, key_mode mode,
 		const si_btree_key* key_in, si_btree_key* key_out)
@@ -1342,19 +2519,62 @@ move_children(const si_btree* bt, si_btree_node* dst, uint32_t dst_i,
 			n_children * sizeof(si_arena_handle));
 }
 
-#if BINARY_SEARCH == 0
+// With AVX2, narrow down by bval alone to the first key not below the search
+// bval, then only compare full keys within that bval's run (if any).
 static key_bound
 greatest_lower_bound(const si_btree* bt, const si_btree_node* node,
 		const si_btree_key* key)
 {
-	int32_t index = -1;
+#if SIMD_SEARCH == 1
+	if (__builtin_cpu_supports("avx2")) {
+		uint32_t start = first_bval_ge_avx2(bt, node, key->bval);
+
+		if (start == node->n_keys ||
+				const_key(bt, node, start)->bval != key->bval) {
+			return (key_bound){ .index = (int32_t)start - 1, .equal = false };
+		}
+
+		return greatest_lower_bound_from(bt, node, key, start);
+	}
+#endif
+
+	return greatest_lower_bound_from(bt, node, key, 0);
+}
+
+static key_bound
+left_bound(const si_btree* bt, const si_btree_node* node,
+		const search_key* skey)
+{
+#if SIMD_SEARCH == 1
+	if (__builtin_cpu_supports("avx2")) {
+		uint32_t start = first_bval_ge_avx2(bt, node, skey->bval);
+
+		// Without a digest, a search key precedes all keys with its bval.
+		if (start == node->n_keys || ! skey->has_digest ||
+				const_key(bt, node, start)->bval != skey->bval) {
+			return (key_bound){ .index = (int32_t)start - 1, .equal = false };
+		}
+
+		return left_bound_from(bt, node, skey, start);
+	}
+#endif
+
+	return left_bound_from(bt, node, skey, 0);
+}
+
+#if BINARY_SEARCH == 0
+static key_bound
+greatest_lower_bound_from(const si_btree* bt, const si_btree_node* node,
+		const si_btree_key* key, uint32_t start)
+{
+	int32_t index = (int32_t)start - 1;
 	bool equal = false;
-	const si_btree_key* key_i = const_key(bt, node, 0);
+	const si_btree_key* key_i = const_key(bt, node, start);
 	const uint8_t* pref = (const uint8_t*)key_i;
 
 	as_arch_prefetch_nt(pref);
 
-	for (uint32_t i = 0; i < node->n_keys; i++) {
+	for (uint32_t i = start; i < node->n_keys; i++) {
 		if ((const uint8_t*)key_i >= pref) {
 			pref += CACHE_LINE_SZ;
 			as_arch_prefetch_nt(pref);
@@ -1380,12 +2600,12 @@ greatest_lower_bound(const si_btree* bt, const si_btree_node* node,
 }
 #else
 static key_bound
-greatest_lower_bound(const si_btree* bt, const si_btree_node* node,
-		const si_btree_key* key)
+greatest_lower_bound_from(const si_btree* bt, const si_btree_node* node,
+		const si_btree_key* key, uint32_t start)
 {
-	int32_t lower = 0;
+	int32_t lower = (int32_t)start;
 	int32_t upper = node->n_keys - 1;
-	key_bound bound = { .index = -1, .equal = false };
+	key_bound bound = { .index = lower - 1, .equal = false };
 
 	while (lower <= upper) {
 		int32_t i = (lower + upper) / 2;
@@ -1416,17 +2636,17 @@ greatest_lower_bound(const si_btree* bt, const si_btree_node* node,
 
 #if BINARY_SEARCH == 0
 static key_bound
-left_bound(const si_btree* bt, const si_btree_node* node,
-		const search_key* skey)
+left_bound_from(const si_btree* bt, const si_btree_node* node,
+		const search_key* skey, uint32_t start)
 {
-	int32_t index = -1;
+	int32_t index = (int32_t)start - 1;
 	bool equal = false;
-	const si_btree_key* key_i = const_key(bt, node, 0);
+	const si_btree_key* key_i = const_key(bt, node, start);
 	const uint8_t* pref = (const uint8_t*)key_i;
 
 	as_arch_prefetch_nt(pref);
 
-	for (uint32_t i = 0; i < node->n_keys; i++) {
+	for (uint32_t i = start; i < node->n_keys; i++) {
 		if ((const uint8_t*)key_i >= pref) {
 			pref += CACHE_LINE_SZ;
 			as_arch_prefetch_nt(pref);
@@ -1452,12 +2672,12 @@ left_bound(const si_btree* bt, const si_btree_node* node,
 }
 #else
 static key_bound
-left_bound(const si_btree* bt, const si_btree_node* node,
-		const search_key* skey)
+left_bound_from(const si_btree* bt, const si_btree_node* node,
+		const search_key* skey, uint32_t start)
 {
-	int32_t lower = 0;
+	int32_t lower = (int32_t)start;
 	int32_t upper = node->n_keys - 1;
-	key_bound bound = { .index = -1, .equal = false };
+	key_bound bound = { .index = lower - 1, .equal = false };
 
 	while (lower <= upper) {
 		int32_t i = (lower + upper) / 2;
@@ -1486,6 +2706,89 @@ left_bound(const si_btree* bt, const si_btree_node* node,
 }
 #endif
 
+// Number of keys below the search key - keys are unique, so at most the one
+// at the returned index can equal it.
+static uint32_t
+rev_bound(const si_btree* bt, const si_btree_node* node,
+		const search_key* skey, bool* equal)
+{
+	uint32_t lower = 0;
+	uint32_t upper = node->n_keys;
+
+	*equal = false;
+
+	while (lower < upper) {
+		uint32_t i = (lower + upper) / 2;
+		int32_t rel = rev_skey_cmp(bt, skey, const_key(bt, node, i));
+
+		if (rel > 0) {
+			lower = i + 1;
+		}
+		else {
+			upper = i;
+			*equal = rel == 0;
+		}
+	}
+
+	return lower;
+}
+
+#if SIMD_SEARCH == 1
+// Returns the index of the first key whose bval isn't below the given bval, or
+// n_keys if there's none. Bisects on bval alone down to a window, then counts
+// the window's smaller bvals four at a time - keys are packed, so gather.
+__attribute__((target("avx2")))
+static uint32_t
+first_bval_ge_avx2(const si_btree* bt, const si_btree_node* node, int64_t bval)
+{
+	uint32_t lower = 0;
+	uint32_t upper = node->n_keys;
+
+	while (upper - lower > SIMD_WINDOW) {
+		uint32_t i = (lower + upper) / 2;
+
+		if (bval_lt(bt, const_key(bt, node, i)->bval, bval)) {
+			lower = i + 1;
+		}
+		else {
+			upper = i;
+		}
+	}
+
+	const uint8_t* base = (const uint8_t*)const_key(bt, node, lower);
+	uint32_t n_window = upper - lower;
+	uint32_t n_below = 0;
+	uint32_t i = 0;
+
+	// Flipping the sign bit makes signed compares order unsigned bvals.
+	__m256i flip = _mm256_set1_epi64x(bt->unsigned_bvals ? INT64_MIN : 0);
+	__m256i target = _mm256_xor_si256(_mm256_set1_epi64x(bval), flip);
+	__m256i offsets = _mm256_setr_epi64x(0, sizeof(si_btree_key),
+			2 * sizeof(si_btree_key), 3 * sizeof(si_btree_key));
+
+	for (; i + 4 <= n_window; i += 4) {
+		__m256i bvals = _mm256_i64gather_epi64(
+				(const long long*)(base + (i * sizeof(si_btree_key))),
+				offsets, 1);
+
+		bvals = _mm256_xor_si256(bvals, flip);
+
+		__m256i below = _mm256_cmpgt_epi64(target, bvals);
+
+		n_below += cf_bit_count64((uint64_t)
+				_mm256_movemask_pd(_mm256_castsi256_pd(below)));
+	}
+
+	for (; i < n_window; i++) {
+		if (bval_lt(bt, const_key(bt, node, lower + i)->bval, bval)) {
+			n_below++;
+		}
+	}
+
+	return lower + n_below;
+}
+#endif
+
 static void
 split_child(si_btree* bt, si_btree_node* node, uint32_t i, si_btree_node* child)
 {
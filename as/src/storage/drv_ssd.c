@@ -82,6 +82,9 @@
 
 #define WRITE_IN_PLACE 1
 
+#define READ_AHEAD_MAX_SZ (1024 * 1024)
+#define READ_AHEAD_MAX_GAP (64 * 1024) // don't read more dead space than this
+
 
 //==========================================================
 // Miscellaneous utility functions.
@@ -499,6 +502,7 @@ swb_get(drv_ssd *ssd, bool use_reserve)
 
 	swb_reserve(swb);
 	p_wblock_state->swb = swb;
+	p_wblock_state->n_swbs++;
 
 	cf_mutex_unlock(&p_wblock_state->LOCK);
 
@@ -1090,6 +1094,7 @@ ssd_wblock_init(drv_ssd *ssd)
 		p_wblock_state->swb = NULL;
 		p_wblock_state->state = WBLOCK_STATE_NONE;
 		p_wblock_state->n_vac_dests = 0;
+		p_wblock_state->n_swbs = 0;
 	}
 }
 
@@ -1098,6 +1103,42 @@ ssd_wblock_init(drv_ssd *ssd)
 // Record reading utilities.
 //
 
+// The buffer was read before the record was locked, but only from wblocks that
+// weren't written during the read - use it only if it still holds the version
+// the index points at.
+static bool
+ssd_read_ahead_copy(drv_ssd *ssd, const as_storage_read_ahead *ra,
+		const as_record *r, uint64_t record_offset, uint32_t record_size,
+		uint8_t **p_read_buf)
+{
+	if (ra->buf == NULL || ra->file_id != ssd->file_id ||
+			record_offset < ra->start_offset ||
+			record_offset + record_size > ra->end_offset) {
+		return false;
+	}
+
+	uint8_t *read_buf = cf_malloc(record_size);
+	as_flat_record *flat = (as_flat_record*)read_buf;
+
+	memcpy(read_buf, ra->buf + (record_offset - ra->start_offset),
+			record_size);
+
+	ssd_decrypt_whole(ssd, record_offset, r->n_rblocks, flat);
+
+	if (flat->magic != AS_FLAT_MAGIC || flat->n_rblocks != r->n_rblocks ||
+			cf_digest_compare(&flat->keyd, &r->keyd) != 0 ||
+			flat->generation != r->generation ||
+			flat->last_update_time != r->last_update_time) {
+		cf_free(read_buf);
+		return false;
+	}
+
+	*p_read_buf = read_buf;
+
+	return true;
+}
+
+
 int
 ssd_read_record(as_storage_rd *rd, bool pickle_only)
 {
@@ -1155,6 +1196,11 @@ ssd_read_record(as_storage_rd *rd, bool pickle_only)
 
 		ssd_decrypt_whole(ssd, record_offset, r->n_rblocks, flat);
 	}
+	else if (rd->read_ahead != NULL && ssd_read_ahead_copy(ssd,
+			rd->read_ahead, r, record_offset, record_size, &read_buf)) {
+		// Data is in a storage-ordered scan's read-ahead buffer.
+		flat = (as_flat_record*)read_buf;
+	}
 	else {
 		// Normal case - data is read from device.
 		as_incr_uint32(&ns->n_reads_from_device);
@@ -1338,6 +1384,136 @@ as_storage_record_load_pickle_ssd(as_storage_rd *rd)
 }
 
 
+bool
+as_storage_read_ahead_add_ssd(as_namespace *ns, as_storage_read_ahead *ra,
+		const as_record *r)
+{
+	if (STORAGE_RBLOCK_IS_INVALID(r->rblock_id)) {
+		return ra->n_records++ == 0; // read will fail anyway
+	}
+
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	drv_ssd *ssd = &ssds->ssds[r->file_id];
+
+	uint64_t record_offset = RBLOCK_ID_TO_OFFSET(r->rblock_id);
+	uint64_t start_offset = BYTES_DOWN_TO_IO_MIN(ssd, record_offset);
+	uint64_t end_offset = BYTES_UP_TO_IO_MIN(ssd,
+			record_offset + N_RBLOCKS_TO_SIZE(r->n_rblocks));
+
+	if (ra->n_records == 0) {
+		ra->file_id = r->file_id;
+		ra->start_offset = start_offset;
+		ra->end_offset = end_offset;
+		ra->n_records = 1;
+
+		return true;
+	}
+
+	if (r->file_id != ra->file_id || start_offset < ra->start_offset ||
+			start_offset > ra->end_offset + READ_AHEAD_MAX_GAP ||
+			end_offset - ra->start_offset > READ_AHEAD_MAX_SZ) {
+		return false;
+	}
+
+	if (end_offset > ra->end_offset) {
+		ra->end_offset = end_offset;
+	}
+
+	ra->n_records++;
+
+	return true;
+}
+
+
+// Fails if any wblock in the range has an swb attached, i.e. may be flushed
+// under an unlocked read. Otherwise sums the wblocks' swb counts, so a caller
+// can tell whether any were attached (and written) since.
+static bool
+read_ahead_wblocks_stable(drv_ssd *ssd, const as_storage_read_ahead *ra,
+		uint64_t *p_n_swbs)
+{
+	uint32_t first_id = OFFSET_TO_WBLOCK_ID(ssd, ra->start_offset);
+	uint32_t last_id = OFFSET_TO_WBLOCK_ID(ssd, ra->end_offset - 1);
+	uint64_t n_swbs = 0;
+
+	for (uint32_t wblock_id = first_id; wblock_id <= last_id; wblock_id++) {
+		ssd_wblock_state *wblock_state = &ssd->wblock_state[wblock_id];
+
+		cf_mutex_lock(&wblock_state->LOCK);
+
+		bool has_swb = wblock_state->swb != NULL;
+
+		n_swbs += wblock_state->n_swbs;
+
+		cf_mutex_unlock(&wblock_state->LOCK);
+
+		if (has_swb) {
+			return false;
+		}
+	}
+
+	*p_n_swbs = n_swbs;
+
+	return true;
+}
+
+void
+as_storage_read_ahead_load_ssd(as_namespace *ns, as_storage_read_ahead *ra)
+{
+	// A lone record is read as usual.
+	if (ra->n_records < 2 || ra->end_offset <= ra->start_offset) {
+		return;
+	}
+
+	drv_ssds *ssds = (drv_ssds*)ns->storage_private;
+	drv_ssd *ssd = &ssds->ssds[ra->file_id];
+	size_t read_size = ra->end_offset - ra->start_offset;
+
+	uint64_t n_swbs_before;
+
+	// Wblocks being written are read one record at a time - records still in
+	// an swb are then served from it.
+	if (! read_ahead_wblocks_stable(ssd, ra, &n_swbs_before)) {
+		return;
+	}
+
+	uint8_t *buf = cf_valloc(read_size);
+
+	int fd = ssd_fd_get(ssd);
+
+	uint64_t start_ns = ns->storage_benchmarks_enabled ? cf_getns() : 0;
+
+	if (! pread_all(fd, buf, read_size, (off_t)ra->start_offset)) {
+		cf_warning(AS_DRV_SSD, "{%s} read-ahead %s: IO failed errno %d (%s) size %lu",
+				ns->name, ssd->name, errno, cf_strerror(errno), read_size);
+		cf_free(buf);
+		close(fd);
+		as_decr_uint32(&ssd->n_fds);
+		return; // records will be read one by one
+	}
+
+	if (start_ns != 0) {
+		histogram_insert_data_point(ssd->hist_read, start_ns);
+		histogram_insert_raw(ns->device_read_size_hist, read_size);
+	}
+
+	ssd_fd_put(ssd, fd);
+
+	as_incr_uint32(&ns->n_reads_from_device);
+
+	uint64_t n_swbs_after;
+
+	// A wblock written during the read may have been torn - don't use it.
+	if (! read_ahead_wblocks_stable(ssd, ra, &n_swbs_after) ||
+			n_swbs_after != n_swbs_before) {
+		cf_free(buf);
+		return; // records will be read one by one
+	}
+
+	ra->buf = buf;
+}
+
+
 //==========================================================
 // Record writing utilities.
 //
@@ -2509,11 +2685,19 @@ ssd_cold_start_add_record(drv_ssds* ssds, drv_ssd* ssd,
 
 	ssd_cold_start_init_repl_state(ns, r);
 
+	uint32_t old_void_time = r->void_time;
+
+	if (! is_create) {
+		as_nsup_online_hist_remove(ns, old_void_time);
+	}
+
 	// Set/reset the record's last-update-time generation, and void-time.
 	r->last_update_time = flat->last_update_time;
 	r->generation = flat->generation;
 	r->void_time = opt_meta.void_time;
 
+	as_nsup_online_hist_add(ns, r->void_time);
+
 	// Set/reset the records's XDR-write status.
 	ssd_cold_start_init_xdr_state(flat, r);
 
@@ -2595,7 +2779,7 @@ ssd_cold_start_add_record(drv_ssds* ssds, drv_ssd* ssd,
 	}
 
 	ssd_cold_start_transition_record(ns, flat, &opt_meta, p_partition->tree,
-			&r_ref, is_create);
+			&r_ref, is_create, old_void_time);
 
 	uint32_t wblock_id = RBLOCK_ID_TO_WBLOCK_ID(ssd, rblock_id);
 
@@ -2933,6 +3117,11 @@ si_startup_do_record(drv_ssds* ssds, drv_ssd* ssd, as_flat_record* flat,
 
 	as_namespace* ns = ssds->ns;
 
+	// Ignore partitions already re-attached from persisted sindex file.
+	if (ns->si_persisted_pids != NULL && ns->si_persisted_pids[pid]) {
+		return;
+	}
+
 	// Includes round rblock padding, so may not literally exclude the mark.
 	const uint8_t* end = (const uint8_t*)flat + record_size - END_MARK_SZ;
 
@@ -3230,6 +3419,8 @@ ssd_init_synchronous(drv_ssds *ssds)
 			p->tree = as_index_tree_create(&ns->tree_shared, p->tree_id,
 					as_partition_tree_done, (void*)p);
 
+			as_partition_numa_home_tree(p);
+
 			as_set_index_create_all(ns, p->tree);
 		}
 	}
@@ -96,10 +96,11 @@ ssd_cold_start_adjust_cenotaph(as_namespace* ns, const as_flat_record* flat,
 void
 ssd_cold_start_transition_record(as_namespace* ns, const as_flat_record* flat,
 		const as_flat_opt_meta* opt_meta, as_index_tree* tree,
-		as_index_ref* r_ref, bool is_create)
+		as_index_ref* r_ref, bool is_create, uint32_t old_void_time)
 {
 	index_metadata old_metadata = {
 			// Note - other members irrelevant.
+			.void_time = old_void_time,
 			.generation = is_create ? 0 : 1, // fake to transition set-index
 	};
 
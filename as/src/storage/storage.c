@@ -32,6 +32,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include "citrusleaf/alloc.h"
 #include "citrusleaf/cf_digest.h"
 #include "citrusleaf/cf_queue.h"
 
@@ -379,6 +380,7 @@ as_storage_record_open(as_namespace *ns, as_record *r, as_storage_rd *rd)
 	rd->pickle_sz = 0;
 	rd->orig_pickle_sz = 0;
 	rd->pickle = NULL;
+	rd->read_ahead = NULL;
 
 	if (as_storage_record_open_table[ns->storage_type]) {
 		as_storage_record_open_table[ns->storage_type](rd);
@@ -799,6 +801,47 @@ as_storage_record_device_size(const as_namespace *ns, const as_record *r)
 	return 0;
 }
 
+//--------------------------------------
+// as_storage_read_ahead_add
+//
+
+typedef bool (*as_storage_read_ahead_add_fn)(as_namespace *ns, as_storage_read_ahead *ra, const as_record *r);
+static const as_storage_read_ahead_add_fn as_storage_read_ahead_add_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory doesn't read records
+	NULL, // pmem reads are memory copies - nothing to gain
+	as_storage_read_ahead_add_ssd
+};
+
+bool
+as_storage_read_ahead_add(as_namespace *ns, as_storage_read_ahead *ra,
+		const as_record *r)
+{
+	if (as_storage_read_ahead_add_table[ns->storage_type]) {
+		return as_storage_read_ahead_add_table[ns->storage_type](ns, ra, r);
+	}
+
+	return ra->n_records++ == 0; // one record at a time
+}
+
+//--------------------------------------
+// as_storage_read_ahead_load
+//
+
+typedef void (*as_storage_read_ahead_load_fn)(as_namespace *ns, as_storage_read_ahead *ra);
+static const as_storage_read_ahead_load_fn as_storage_read_ahead_load_table[AS_NUM_STORAGE_ENGINES] = {
+	NULL, // memory doesn't read records
+	NULL, // pmem reads are memory copies - nothing to gain
+	as_storage_read_ahead_load_ssd
+};
+
+void
+as_storage_read_ahead_load(as_namespace *ns, as_storage_read_ahead *ra)
+{
+	if (as_storage_read_ahead_load_table[ns->storage_type]) {
+		as_storage_read_ahead_load_table[ns->storage_type](ns, ra);
+	}
+}
+
 
 //==========================================================
 // Generic functions that don't use "v-tables".
@@ -943,3 +986,13 @@ as_storage_rd_load_pickle(as_storage_rd *rd)
 
 	return as_storage_record_load_pickle(rd);
 }
+
+void
+as_storage_read_ahead_reset(as_storage_read_ahead *ra)
+{
+	if (ra->buf != NULL) {
+		cf_free(ra->buf);
+	}
+
+	*ra = (as_storage_read_ahead){ 0 };
+}
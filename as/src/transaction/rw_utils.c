@@ -418,6 +418,11 @@ update_sindex(as_namespace* ns, as_index_ref* r_ref, as_bin* old_bins,
 				new_bins[i].id, &si_arr[si_arr_index]);
 	}
 
+	uint32_t derived_ix = si_arr_index;
+
+	si_arr_index += as_sindex_derived_arr_lookup_lockfree(ns, set_id,
+			&si_arr[si_arr_index]);
+
 	if (si_arr_index == 0) {
 		SINDEX_GRUNLOCK();
 		as_index_clear_in_sindex(r); // no sindex corresponding to old/new bins
@@ -518,6 +523,33 @@ update_sindex(as_namespace* ns, as_index_ref* r_ref, as_bin* old_bins,
 		n_populated += n;
 	}
 
+	// Composite and expression sindexes - compare keys built from all the old
+	// and new bins.
+	for (uint32_t i = derived_ix; i < si_arr_index; i++) {
+		as_sindex* si = si_arr[i];
+		as_sindex_bin* old_sbin = &sbins[n_populated];
+
+		bool has_old = as_sindex_derived_sbin(si, r, old_bins, n_old_bins,
+				old_sbin, AS_SINDEX_OP_DELETE);
+
+		as_sindex_bin* new_sbin = &sbins[n_populated + (has_old ? 1 : 0)];
+
+		bool has_new = as_sindex_derived_sbin(si, r, new_bins, n_new_bins,
+				new_sbin, AS_SINDEX_OP_INSERT);
+
+		if (has_new) {
+			record_in_sindex = true;
+		}
+
+		if (has_old && has_new &&
+				as_sindex_sbin_values_match(old_sbin, new_sbin)) {
+			as_sindex_sbin_free_all(old_sbin, 2);
+			continue; // keys unchanged
+		}
+
+		n_populated += (has_old ? 1 : 0) + (has_new ? 1 : 0);
+	}
+
 	SINDEX_GRUNLOCK();
 
 	if (record_in_sindex) {
@@ -572,7 +604,8 @@ remove_from_sindex(as_namespace* ns, as_index_ref* r_ref)
 }
 
 
-void
+// Returns false if any key wasn't found (or its delete was deferred).
+bool
 remove_from_sindex_bins(as_namespace* ns, as_index_ref* r_ref, as_bin* bins,
 		uint32_t n_bins)
 {
@@ -591,6 +624,11 @@ remove_from_sindex_bins(as_namespace* ns, as_index_ref* r_ref, as_bin* bins,
 				bins[i].id, &si_arr[si_arr_index]);
 	}
 
+	uint32_t derived_ix = si_arr_index;
+
+	si_arr_index += as_sindex_derived_arr_lookup_lockfree(ns, set_id,
+			&si_arr[si_arr_index]);
+
 	as_sindex_bin sbins[n_sindexes];
 	uint32_t n_populated = 0;
 
@@ -599,10 +637,19 @@ remove_from_sindex_bins(as_namespace* ns, as_index_ref* r_ref, as_bin* bins,
 				&sbins[n_populated], AS_SINDEX_OP_DELETE);
 	}
 
+	for (uint32_t i = derived_ix; i < si_arr_index; i++) {
+		if (as_sindex_derived_sbin(si_arr[i], r, bins, n_bins,
+				&sbins[n_populated], AS_SINDEX_OP_DELETE)) {
+			n_populated++;
+		}
+	}
+
 	SINDEX_GRUNLOCK();
 
+	bool all_found = true;
+
 	if (n_populated != 0) {
-		as_sindex_update_by_sbin(sbins, n_populated, r_ref->r_h);
+		all_found = as_sindex_update_by_sbin(sbins, n_populated, r_ref->r_h);
 		as_sindex_sbin_free_all(sbins, n_populated);
 	}
 
@@ -610,6 +657,8 @@ remove_from_sindex_bins(as_namespace* ns, as_index_ref* r_ref, as_bin* bins,
 	as_index_clear_in_sindex(r);
 
 	as_sindex_release_arr(si_arr, si_arr_index);
+
+	return all_found;
 }
 
 
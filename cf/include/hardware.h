@@ -49,13 +49,16 @@ typedef uint32_t cf_topo_napi_id;
 void cf_topo_config(cf_topo_auto_pin auto_pin, cf_topo_numa_node_index a_numa_node,
 		const cf_addr_list *addrs);
 void cf_topo_force_map_memory(const uint8_t *from, size_t size);
+void cf_topo_bind_memory(const void *from, size_t size, cf_topo_numa_node_index i_numa_node);
 void cf_topo_migrate_memory(void);
 void cf_topo_info(void);
 
 uint16_t cf_topo_count_cores(void);
 uint16_t cf_topo_count_cpus(void);
+uint16_t cf_topo_count_numa_nodes(void);
 
 cf_topo_cpu_index cf_topo_current_cpu(void);
+cf_topo_numa_node_index cf_topo_cpu_numa_node(cf_topo_cpu_index i_cpu);
 cf_topo_cpu_index cf_topo_socket_cpu(const cf_socket *sock);
 cf_topo_napi_id cf_topo_socket_napi_id(const cf_socket *sock);
 
@@ -66,6 +66,7 @@ void linear_hist_clear(linear_hist *h, uint32_t start, uint32_t max_offset);
 uint64_t linear_hist_get_total(linear_hist *h);
 void linear_hist_merge(linear_hist *h1, linear_hist *h2);
 void linear_hist_insert_data_point(linear_hist *h, uint32_t point);
+void linear_hist_insert_data_points(linear_hist *h, uint32_t point, uint64_t count);
 uint64_t linear_hist_get_threshold_for_fraction(linear_hist *h, uint32_t tenths_pct, linear_hist_threshold *p_threshold);
 uint64_t linear_hist_get_threshold_for_subtotal(linear_hist *h, uint64_t subtotal, linear_hist_threshold *p_threshold);
 
@@ -146,6 +146,7 @@ static os_numa_node_index g_numa_node_index_to_os_numa_node_index[CPU_SETSIZE];
 static cf_topo_os_cpu_index g_core_index_to_os_cpu_index[CPU_SETSIZE];
 static cf_topo_os_cpu_index g_cpu_index_to_os_cpu_index[CPU_SETSIZE];
 static cf_topo_cpu_index g_os_cpu_index_to_cpu_index[CPU_SETSIZE];
+static cf_topo_numa_node_index g_cpu_index_to_numa_node_index[CPU_SETSIZE];
 
 static cf_topo_numa_node_index g_i_numa_node;
 
@@ -359,6 +360,16 @@ set_mempolicy_safe(uint32_t mode, uint64_t *node_mask, size_t max_node)
 	}
 }
 
+static void
+mbind_safe(void *addr, size_t len, uint32_t mode, uint64_t *node_mask, size_t max_node,
+		uint32_t flags)
+{
+	if (syscall(__NR_mbind, addr, len, mode, node_mask, max_node, flags) < 0) {
+		cf_warning(CF_HARDWARE, "mbind() system call failed: %d (%s)",
+				errno, cf_strerror(errno));
+	}
+}
+
 static void
 migrate_pages_safe(pid_t pid, size_t max_node, uint64_t *from_mask, uint64_t *to_mask)
 {
@@ -560,6 +571,7 @@ detect(cf_topo_numa_node_index a_numa_node)
 		g_core_index_to_os_cpu_index[i] = INVALID_INDEX;
 		g_cpu_index_to_os_cpu_index[i] = INVALID_INDEX;
 		g_os_cpu_index_to_cpu_index[i] = INVALID_INDEX;
+		g_cpu_index_to_numa_node_index[i] = INVALID_INDEX;
 
 		os_numa_node_index_to_numa_node_index[i] = INVALID_INDEX;
 		g_numa_node_index_to_os_numa_node_index[i] = INVALID_INDEX;
@@ -744,6 +756,7 @@ detect(cf_topo_numa_node_index a_numa_node)
 
 		g_os_cpu_index_to_cpu_index[g_n_os_cpus] = g_n_cpus;
 		g_cpu_index_to_os_cpu_index[g_n_cpus] = g_n_os_cpus;
+		g_cpu_index_to_numa_node_index[g_n_cpus] = i_numa_node;
 
 		cf_detail(CF_HARDWARE, "OS CPU index %hu <-> CPU index %hu", g_n_os_cpus, g_n_cpus);
 		++g_n_cpus;
@@ -828,6 +841,22 @@ cf_topo_count_cpus(void)
 	return g_n_cpus;
 }
 
+uint16_t
+cf_topo_count_numa_nodes(void)
+{
+	return g_n_numa_nodes;
+}
+
+cf_topo_numa_node_index
+cf_topo_cpu_numa_node(cf_topo_cpu_index i_cpu)
+{
+	if (i_cpu >= g_n_cpus) {
+		cf_crash(CF_HARDWARE, "invalid CPU index %hu", i_cpu);
+	}
+
+	return g_cpu_index_to_numa_node_index[i_cpu];
+}
+
 static cf_topo_cpu_index
 os_cpu_index_to_cpu_index(cf_topo_os_cpu_index i_os_cpu)
 {
@@ -1909,6 +1938,36 @@ cf_topo_force_map_memory(const uint8_t *from, size_t size)
 	}
 }
 
+void
+cf_topo_bind_memory(const void *from, size_t size, cf_topo_numa_node_index i_numa_node)
+{
+	if (g_n_numa_nodes < 2 || i_numa_node >= g_n_numa_nodes) {
+		return;
+	}
+
+	// Only whole pages can be bound - the partial pages at either end may be
+	// shared with unrelated allocations, so leave them alone.
+
+	uint8_t *start = (uint8_t *)
+			(((int64_t)from + (MEM_PAGE_SIZE - 1)) & -MEM_PAGE_SIZE);
+	uint8_t *end = (uint8_t *)(((int64_t)from + (int64_t)size) & -MEM_PAGE_SIZE);
+
+	if (end <= start) {
+		return;
+	}
+
+	os_numa_node_index i_os_numa_node = g_numa_node_index_to_os_numa_node_index[i_numa_node];
+	uint64_t to_mask = 1UL << i_os_numa_node;
+	cf_detail(CF_HARDWARE, "binding %zu bytes to NUMA node mask %016" PRIx64,
+			(size_t)(end - start), to_mask);
+
+	// Preferred rather than bound, so we fall back instead of failing when the
+	// node runs out of memory. Unlike select(), we have to pass "number of
+	// valid bits + 1".
+	mbind_safe(start, (size_t)(end - start), MPOL_PREFERRED, &to_mask, 65,
+			MPOL_MF_MOVE);
+}
+
 void
 cf_topo_migrate_memory(void)
 {
@@ -199,6 +199,16 @@ linear_hist_merge(linear_hist *h1, linear_hist *h2)
 //
 void
 linear_hist_insert_data_point(linear_hist *h, uint32_t point)
+{
+	linear_hist_insert_data_points(h, point, 1);
+}
+
+//------------------------------------------------
+// Insert count data points at the same value -
+// e.g. when loading from a coarser histogram.
+//
+void
+linear_hist_insert_data_points(linear_hist *h, uint32_t point, uint64_t count)
 {
 	int32_t offset = (int32_t)(point - h->start);
 	int32_t bucket = 0;
@@ -211,7 +221,7 @@ linear_hist_insert_data_point(linear_hist *h, uint32_t point)
 		}
 	}
 
-	h->counts[bucket]++;
+	h->counts[bucket] += count;
 }
 
 //------------------------------------------------